@@ -0,0 +1,96 @@
+# -----------------------------------------------------------------------------
+# This source file has been developed within the scope of the
+# Technical Director course at Filmakademie Baden-Wuerttemberg.
+# http://technicaldirector.de
+#
+# Written by Tim Lehr
+# Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+# -----------------------------------------------------------------------------
+
+"""Bake worker for headless mayapy sessions.
+
+Launched by "hdCache -bake", but it can also run on farm nodes directly.
+The resulting shard files are merged with "hdcachetool merge":
+
+    HD_BAKE_WORKER=1 mayapy -c "import maya.standalone; maya.standalone.initialize(); \\
+        import hyperdrive.hdbake; hyperdrive.hdbake.main()" \\
+        --scene shot.ma --frames 1001-1100 --out /shared/bake/chunk01
+"""
+
+import os
+import re
+import sys
+import argparse
+import pymel.core as pm
+
+from .utils import logger
+log = logger.get_logger(__name__)
+
+
+def _read_frames(frames):
+    """Frames are either a "start-end" range or a file with one frame per line."""
+    frame_range = re.match(r"^(-?\d+)-(-?\d+)$", frames)
+    if frame_range and not os.path.isfile(frames):
+        start, end = int(frame_range.group(1)), int(frame_range.group(2))
+        return [float(x) for x in range(start, end + 1)]
+
+    with open(frames) as frames_file:
+        return [float(line) for line in frames_file if line.strip()]
+
+
+def bake_frames(scene, frames, out_dir, cache_ids=None):
+    """Evaluate the cache nodes of a scene on the given frames and write the poses
+    into one shard file per cache: <out_dir>/<cache_id>.hdc"""
+    if not os.environ.get("HD_BAKE_WORKER"):
+        raise RuntimeError("HD_BAKE_WORKER is not set. Caches only store poses during playback.")
+
+    pm.loadPlugin("hyperdrive", quiet=True)
+    pm.openFile(scene, force=True)
+    pm.currentTime(frames[0], update=True)
+
+    if not os.path.isdir(out_dir):
+        os.makedirs(out_dir)
+
+    # reading the cache ID evaluates the pose node, which creates the cache
+    cache_nodes = []
+    shard_ids = set()
+    for node in pm.ls(type="hyperdriveCache"):
+        cache_id = node.inCacheId.get()
+        if not cache_id or (cache_ids and cache_id not in cache_ids):
+            continue
+        cache_nodes.append(node)
+        if cache_id not in shard_ids:
+            pm.other.hdCache(cache_id, "-detachDiskTier", "-diskTier", os.path.join(out_dir, cache_id + ".hdc"))
+            shard_ids.add(cache_id)
+
+    log.info("Bake {} frames for {} caches into '{}'".format(len(frames), len(shard_ids), out_dir))
+    for i, frame in enumerate(frames):
+        pm.currentTime(frame, update=True)
+        for node in cache_nodes:
+            pm.dgeval(node.outMeshes)
+        if i % 50 == 0:
+            log.info("Baked frame {} ({} / {})".format(frame, i + 1, len(frames)))
+
+    # detaching flushes the shard index
+    for cache_id in shard_ids:
+        pm.other.hdCache(cache_id, "-detachDiskTier")
+
+
+def main(argv=None):
+    parser = argparse.ArgumentParser(prog="hyperdrive.hdbake", description="Bake Hyperdrive pose caches.")
+    parser.add_argument("--scene", required=True, help="Maya scene to bake")
+    parser.add_argument("--frames", required=True, help="frame range 'start-end' or a file with one frame per line")
+    parser.add_argument("--out", required=True, help="output directory for the cache shards")
+    parser.add_argument("--caches", default="", help="comma separated cache IDs, all caches if empty")
+    args = parser.parse_args(sys.argv[1:] if argv is None else argv)
+
+    try:
+        frames = _read_frames(args.frames)
+        cache_ids = set(x for x in args.caches.split(",") if x)
+        if frames:
+            bake_frames(args.scene, frames, args.out, cache_ids)
+    except Exception:
+        log.exception("Bake failed.")
+        sys.exit(1)
+
+    sys.exit(0)
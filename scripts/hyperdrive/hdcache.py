@@ -9,6 +9,7 @@
 # -----------------------------------------------------------------------------
 
 import json
+import multiprocessing
 import pymel.core as pm
 from .utils import logger
 log = logger.get_logger(__name__)
@@ -21,6 +22,142 @@ def get_cache_list():
     return json.loads(encoded)
 
 
+def get_pose_memo_stats():
+    """Frame to pose ID memo of every pose node, with hit rates."""
+    encoded = pm.other.hdStats("-poseMemo")
+    return json.loads(encoded)
+
+
+def get_rig_fingerprint_stats():
+    """Rig fingerprint of every pose node. It is part of the pose keys, so caches of a changed rig are not reused."""
+    encoded = pm.other.hdStats("-rigFingerprint")
+    return json.loads(encoded)
+
+
+def get_evaluator_stats():
+    """Frames served from cache per rig. Rigs with a missed pose are evaluated alone, cached rigs stay frozen."""
+    encoded = pm.other.hdStats("-evaluator")
+    return json.loads(encoded)
+
+
+def get_registry_stats():
+    """Hyperdrive nodes tracked for the evaluator and how often their links were refreshed."""
+    encoded = pm.other.hdStats("-registry")
+    return json.loads(encoded)
+
+
+def get_prefetch_stats():
+    encoded = pm.other.hdPrefetch("-stats")
+    return json.loads(encoded)
+
+
+def set_prefetch_enabled(enabled):
+    pm.other.hdPrefetch("-enable", int(bool(enabled)))
+
+
+def set_prefetch_max_lookahead(frames):
+    pm.other.hdPrefetch("-maxLookahead", int(frames))
+
+
+def get_autofill_stats():
+    encoded = pm.other.hdAutoFill("-stats")
+    return json.loads(encoded)
+
+
+def set_autofill_enabled(enabled):
+    """Fill uncached frames of the playback range while Maya is idle."""
+    pm.other.hdAutoFill("-enable", int(bool(enabled)))
+
+
+def set_autofill_budget(milliseconds):
+    pm.other.hdAutoFill("-budget", float(milliseconds))
+
+
+def export_geometry(cache_id, path, start=None, end=None, step=1.0):
+    """Export the cached poses of a frame range as a pose indexed geometry stream (.hdgeo).
+    Held and repeated poses are stored once. Every frame of the range has to be cached."""
+    args = [str(cache_id), "-file", str(path), "-step", float(step)]
+    if start is not None:
+        args += ["-start", float(start)]
+    if end is not None:
+        args += ["-end", float(end)]
+    encoded = pm.other.hdExport(*args)
+    return json.loads(encoded)
+
+
+def get_replay_stats():
+    encoded = pm.other.hdReplay("-stats")
+    return json.loads(encoded)
+
+
+def set_replay_enabled(enabled, write_back=None, subframes=None):
+    """Serve the sidecar caches read-only for batch renders, the rigs are only evaluated on misses.
+    With write_back, missed poses are stored in a shard next to the sidecar, see 'hdcachetool merge'.
+    The subframes are offsets like (-0.25, 0.25) whose poses are prefetched for motion blur."""
+    if write_back is not None:
+        pm.other.hdReplay("-writeBack", int(bool(write_back)))
+    if subframes is not None:
+        pm.other.hdReplay("-subframes", ",".join(str(float(s)) for s in subframes))
+    pm.other.hdReplay("-enable", int(bool(enabled)))
+
+
+def get_realtime_stats():
+    encoded = pm.other.hdRealtime("-stats")
+    return json.loads(encoded)
+
+
+def get_realtime_frames():
+    """Per-frame record of the last playback: evaluated rigs and substituted poses."""
+    encoded = pm.other.hdRealtime("-frames")
+    return json.loads(encoded)
+
+
+def set_realtime_enabled(enabled, fps=None):
+    """Hold the playback frame rate. Missed poses over the frame budget show the nearest cached
+    pose of the rig, the skipped frames are evaluated once Maya is idle. fps=0 uses the scene rate."""
+    if fps is not None:
+        pm.other.hdRealtime("-fps", float(fps))
+    pm.other.hdRealtime("-enable", int(bool(enabled)))
+
+
+def get_interactive_stats():
+    encoded = pm.other.hdInteractive("-stats")
+    return json.loads(encoded)
+
+
+def set_interactive_enabled(enabled):
+    """Serve the caches while scrubbing and stepping frames, not just during playback.
+    Rigs whose controls are manipulated are evaluated until the next time change."""
+    pm.other.hdInteractive("-enable", int(bool(enabled)))
+
+
+def get_coverage(start=None, end=None, step=1.0, pose_node=None):
+    """Cache coverage of a frame range, sampled from the anim curves without evaluating the rigs.
+    Defaults to the playback range. The 'coverage' string holds one character per frame:
+    'c' cached, 'u' uncached, 'd' duplicate of an earlier uncached frame."""
+    args = ["-step", float(step)]
+    if start is not None:
+        args += ["-start", float(start)]
+    if end is not None:
+        args += ["-end", float(end)]
+    if pose_node:
+        args += ["-node", str(pose_node)]
+    encoded = pm.other.hdCoverage(*args)
+    return json.loads(encoded)
+
+
+def bake(start, end, workers=None, cache_id=None):
+    """Bake a frame range into the caches with parallel mayapy workers.
+    The scene has to be saved. Bakes all caches if no cache ID is given."""
+    workers = workers or max(1, multiprocessing.cpu_count() // 2)
+    args = ["-bake", float(start), float(end), "-workers", int(workers)]
+    if cache_id:
+        args.insert(0, cache_id)
+    result = pm.other.hdCache(*args)
+    log.info(result)
+    return result
+
+
 def get_cache_dict(cache_id):
     cache_list = get_cache_list()
     for cache_dict in cache_list:
@@ -84,10 +221,65 @@ class HdCache(object):
     def max_pose_count(self):
         return self._convert_size(self.cache_dict["max_size"])
 
+    @property
+    def disk_path(self):
+        return self.cache_dict.get("disk_path") or None
+
+    @disk_path.setter
+    def disk_path(self, path):
+        if path:
+            self._execute_cmd("cache", "-diskTier", path)
+            log.info("Attached disk tier to cache: '{}'. Path: {}".format(self.cache_id, path))
+        else:
+            self._execute_cmd("cache", "-detachDiskTier")
+            log.info("Detached disk tier from cache: '{}'".format(self.cache_id))
+
+    @property
+    def disk_pose_count(self):
+        return self.cache_dict.get("disk_size", 0)
+
+    @property
+    def shared_segment(self):
+        return self.cache_dict.get("shared_segment") or None
+
+    def enable_shared_tier(self, size_mb):
+        """Share poses with other Maya sessions on this host using the same rig and meshes.
+        The segment is attached once the next pose of this cache has been evaluated."""
+        self._execute_cmd("cache", "-sharedTier", float(size_mb))
+        log.info("Enabled shared memory tier for cache: '{}'. Segment size: {}mb".format(self.cache_id, size_mb))
+
+    def disable_shared_tier(self):
+        self._execute_cmd("cache", "-detachSharedTier")
+        log.info("Disabled shared memory tier for cache: '{}'".format(self.cache_id))
+
+    @property
+    def daemon_socket(self):
+        return self.cache_dict.get("daemon_socket") or None
+
+    @property
+    def daemon_connected(self):
+        return self.cache_dict.get("daemon_connected", False)
+
+    def enable_daemon_tier(self, socket_path=None):
+        """Share poses through a running hyperdrive-cached daemon.
+        Uses the daemon's default socket if no path is given."""
+        if socket_path:
+            self._execute_cmd("cache", "-daemonTier", socket_path)
+        else:
+            self._execute_cmd("cache", "-daemonTier")
+        log.info("Enabled cache daemon tier for cache: '{}'".format(self.cache_id))
+
+    def disable_daemon_tier(self):
+        self._execute_cmd("cache", "-detachDaemonTier")
+        log.info("Disabled cache daemon tier for cache: '{}'".format(self.cache_id))
+
     @classmethod
     def get_all(cls):
         return [cls(x["id"]) for x in get_cache_list()]
 
+    def bake(self, start, end, workers=None):
+        return bake(start, end, workers=workers, cache_id=self.cache_id)
+
     def clear(self):
         self._execute_cmd("cache", "-clear")
         log.info("Cleared cache: '{}'".format(self.cache_id))
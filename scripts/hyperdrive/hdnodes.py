@@ -8,10 +8,12 @@
 # Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
 # -----------------------------------------------------------------------------
 
+import json
+
 import pymel.core as pm
 
 from . import utils
-from .hdcache import HdCache
+from .hdcache import HdCache, get_coverage
 from .utils import logger
 log = logger.get_logger(__name__)
 
@@ -46,6 +48,14 @@ class HdPoseNode(object):
     def rig_tag(self, value):
         self.native_node.inRigTag.set(value)
 
+    @property
+    def share_caches(self):
+        return self.native_node.inShareCaches.get()
+
+    @share_caches.setter
+    def share_caches(self, value):
+        self.native_node.inShareCaches.set(value)
+
     @property
     def pose_id(self):
         return self.native_node.outPoseId.get()
@@ -81,6 +91,9 @@ class HdPoseNode(object):
         except pm.MayaObjectError:
             return False
 
+    def get_coverage(self, start=None, end=None, step=1.0):
+        return get_coverage(start, end, step, pose_node=self.name)
+
     # MESHES
 
     def add_meshes(self, *mesh_nodes):
@@ -91,22 +104,40 @@ class HdPoseNode(object):
     # CONTROLLER ATTRIBUTES
 
     def get_controller_attrs(self):
-        return self.native_node.inCtrlVals.inputs(plugs=True)
+        return self.native_node.inCtrlVals.inputs(plugs=True) + self.native_node.inCtrlMatrices.inputs(plugs=True)
 
     def remove_controller_attrs(self, *attrs):
         for attr in attrs:
             if attr in self.native_node.inCtrlVals.inputs(plugs=True):
                 self.native_node.inCtrlVals.disconnect(attr)
-
-    def add_controller_attrs(self, *attrs):
+            if attr in self.native_node.inCtrlMatrices.inputs(plugs=True):
+                self.native_node.inCtrlMatrices.disconnect(attr)
+
+    def add_controller_attrs(self, *attrs, **kwargs):
+        """Connect control attributes to the pose node.
+        By default every attribute is connected to 'inCtrlVals'. With bulk=True the translate,
+        scale and shear channels of a control are captured by a single connection of its local
+        matrix to 'inCtrlMatrices'. The rotate channels stay scalar, a matrix does not tell
+        rotations a full turn apart.
+        Int, enum and bool attributes are connected without a conversion.
+        """
+        flags = ["-bulk", int(kwargs.get("bulk", False))]
         for attr in attrs:
-            try:
-                attr.connect(self.native_node.inCtrlVals, nextAvailable=True)
-            except RuntimeError:
-                log.warning("Error connecting '{}'.".format(attr))
-
-    def add_keyable_controller_attrs(self, ctrl_node):
-        self.add_controller_attrs(*[x for x in ctrl_node.listAttrs() if x.isKeyable()])
+            flags += ["-control", unicode(attr)]
+        return self._setup(*flags)
+
+    def add_keyable_controller_attrs(self, ctrl_node, **kwargs):
+        return self._setup("-control", unicode(ctrl_node), "-bulk", int(kwargs.get("bulk", False)))
+
+    def _setup(self, *flags):
+        """Make all connections in a single undoable 'hdSetup' call."""
+        if not flags:
+            return
+        result = json.loads(pm.other.hdSetup(self.name, *flags))
+        if result["unresolved"]:
+            log.warning("{} names could not be resolved, see the script editor.".format(result["unresolved"]))
+        log.debug("Connected {} plugs to '{}'.".format(result["connections"], self.name))
+        return result
 
     # WHITELIST
 
@@ -119,25 +150,37 @@ class HdPoseNode(object):
                 self.native_node.inWhitelist.disconnect(node)
 
     def add_whitelisted_nodes(self, *nodes):
+        flags = []
         for node in nodes:
-            try:
-                whitelist_attr = utils.mayautil.get_next_available_array_element(self.native_node.inWhitelist)
-                node.message.connect(whitelist_attr)
-                log.debug("Whitelisted node: '{}'".format(node))
-            except RuntimeError:
-                log.warning("Error whitelisting '{}'.".format(node.name()))
+            flags += ["-whitelist", unicode(node)]
+        return self._setup(*flags)
 
     # BLACKLIST
 
     def get_blacklisted_nodes(self):
-        return self.native_node.outFreezeRig.outputs()
+        return self.native_node.inBlacklist.inputs() + self.native_node.outFreezeRig.outputs()
 
-    def remove_blacklisted_node(self, *nodes):
+    def remove_blacklisted_nodes(self, *nodes):
         for node in nodes:
+            for plug in node.message.outputs(plugs=True):
+                if plug.node() == self.native_node:
+                    node.message.disconnect(plug)
             if node in self.native_node.outFreezeRig.outputs():
-                self.native_node.outFreezeRig.disconnect(node)
+                self.native_node.outFreezeRig.disconnect(node.frozen)
+
+    remove_blacklisted_node = remove_blacklisted_nodes
+
+    def add_blacklisted_nodes(self, *nodes, **kwargs):
+        """Blacklisted nodes are skipped on cached frames.
+        By default the Hyperdrive evaluator skips them without touching the nodes. With native=False
+        the nodes are frozen through their 'frozen' attribute instead, which also works without the evaluator.
+        """
+        if kwargs.get("native", True):
+            flags = []
+            for node in nodes:
+                flags += ["-blacklist", unicode(node)]
+            return self._setup(*flags)
 
-    def add_blacklisted_nodes(self, *nodes):
         for node in nodes:
             if node.frozen.isConnected():
                 log.warning("Node '{}' already has a attribute connected to frozen. We will rewire it.".format(node))
@@ -148,20 +191,30 @@ class HdPoseNode(object):
             except RuntimeError:
                 log.warning("Error blacklisting '{}'.".format(node.name()))
 
+    def convert_blacklist_to_native(self):
+        """Move nodes frozen through 'outFreezeRig' to the evaluator blacklist."""
+        nodes = self.native_node.outFreezeRig.outputs()
+        for node in nodes:
+            self.native_node.outFreezeRig.disconnect(node.frozen)
+            node.frozen.set(False)
+        self.add_blacklisted_nodes(*nodes)
+
     def update_blacklist_from_input_meshes(self):
         for cache_node in self.cache_nodes:
             self.add_blacklisted_nodes(*cache_node.get_in_mesh_nodes())
 
     def update_blacklist_from_nodetypes(self,  *nodetypes, **kwargs):
-        for node in pm.Namespace(kwargs.get("namespace", ":")).listNodes(recursive=True):
-            if node.nodeType() in nodetypes:
-                self.add_blacklisted_nodes(node)
+        flags = ["-namespace", kwargs.get("namespace", ":")]
+        for nodetype in nodetypes:
+            flags += ["-nodeType", nodetype]
+        return self._setup(*flags)
 
     @classmethod
     def create(cls, rig_tag, **kwargs):
         native_node = pm.createNode(cls._native_node_type, ss=True)
         pose_node = cls(native_node)
         pose_node.rig_tag = rig_tag
+        pose_node.share_caches = kwargs.get("share_caches", True)
         return pose_node
 
     @classmethod
@@ -167,7 +167,10 @@ class CacheWidget(QtWidgets.QWidget):
         self._btn_box.addWidget(self._remove_cache_node_btn)
         self._btn_box.addWidget(self._clear_cache_btn)
 
+        self._coverage_bar = CoverageBar(self._pose_node)
+
         self._layout.addWidget(self._node_table_view)
+        self._layout.addWidget(self._coverage_bar)
         self._layout.addLayout(self._btn_box)
 
         self.installEventFilter(self)
@@ -210,6 +213,7 @@ class CacheWidget(QtWidgets.QWidget):
 
     def update_ui(self):
         self._node_table_model.refresh()
+        self._coverage_bar.refresh()
 
     def eventFilter(self, object, event):
         catch = [QtCore.QEvent.WindowActivate,
@@ -219,6 +223,53 @@ class CacheWidget(QtWidgets.QWidget):
         return super(CacheWidget, self).eventFilter(object, event)
 
 
+class CoverageBar(QtWidgets.QWidget):
+    """Timeline strip of the playback range. Shows which frames are cached for the rig.
+    Clicking a frame moves the playhead there.
+    """
+    _colors = {
+        "c": QtGui.QColor(90, 170, 90),
+        "u": QtGui.QColor(190, 80, 70),
+        "d": QtGui.QColor(200, 160, 70),
+    }
+
+    def __init__(self, pose_node):
+        super(CoverageBar, self).__init__()
+        self._pose_node = pose_node
+        self._coverage = None
+        self.setMinimumHeight(16)
+        self.setMaximumHeight(16)
+
+    def refresh(self):
+        try:
+            self._coverage = self._pose_node.get_coverage()
+        except RuntimeError:
+            self._coverage = None
+        if self._coverage:
+            self.setToolTip("{cached} cached, {uncached} uncached, {duplicate} duplicate frames".format(**self._coverage))
+        self.update()
+
+    def paintEvent(self, event):
+        painter = QtGui.QPainter(self)
+        painter.fillRect(self.rect(), self.palette().window())
+        if not self._coverage or not self._coverage["coverage"]:
+            return
+
+        coverage = self._coverage["coverage"]
+        frame_width = self.width() / len(coverage)
+        for index, state in enumerate(coverage):
+            left = int(index * frame_width)
+            right = int((index + 1) * frame_width)
+            painter.fillRect(left, 0, max(1, right - left), self.height(), self._colors.get(state, QtCore.Qt.gray))
+
+    def mousePressEvent(self, event):
+        if not self._coverage or not self._coverage["coverage"]:
+            return
+        frames = self._coverage["frames"]
+        index = min(frames - 1, int(event.pos().x() / self.width() * frames))
+        pm.currentTime(self._coverage["start"] + index * self._coverage["step"])
+
+
 class NodelistWidget(QtWidgets.QWidget):
 
     _add_btn_text = "Add"
@@ -0,0 +1,404 @@
+//
+// -----------------------------------------------------------------------------
+// This source file has been developed within the scope of the
+// Technical Director course at Filmakademie Baden-Wuerttemberg.
+// http://technicaldirector.de
+//
+// Written by Tim Lehr
+// Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+// -----------------------------------------------------------------------------
+//
+
+#include "HdAsyncReader.h"
+
+#include <errno.h>
+#include <unistd.h>
+#include <algorithm>
+
+#include "HdLogger.h"
+
+// io_uring is talked to through raw syscalls, so there is no liburing dependency.
+// Older build hosts (e.g. CentOS 7) lack the kernel header and only get the thread pool.
+#if defined(__linux__) && defined(__has_include)
+    #if __has_include(<linux/io_uring.h>)
+        #define HD_HAS_IO_URING 1
+    #endif
+#endif
+
+#ifdef HD_HAS_IO_URING
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup 425
+#endif
+#ifndef __NR_io_uring_enter
+#define __NR_io_uring_enter 426
+#endif
+#endif
+
+namespace
+{
+    const uint64_t WAKEUP_REQUEST_ID = 0;
+}
+
+struct HdAsyncReader::Ring
+{
+    int                 fd = -1;
+#ifdef HD_HAS_IO_URING
+    void*               sqPtr = MAP_FAILED;
+    size_t              sqSize = 0;
+    void*               cqPtr = MAP_FAILED;
+    size_t              cqSize = 0;
+    io_uring_sqe*       sqes = (io_uring_sqe*) MAP_FAILED;
+    size_t              sqesSize = 0;
+
+    unsigned*           sqHead;
+    unsigned*           sqTail;
+    unsigned*           sqMask;
+    unsigned*           sqEntries;
+    unsigned*           sqArray;
+    unsigned*           cqHead;
+    unsigned*           cqTail;
+    unsigned*           cqMask;
+    io_uring_cqe*       cqes;
+
+    ~Ring()
+    {
+        if (sqes != MAP_FAILED) ::munmap(sqes, sqesSize);
+        if (cqPtr != MAP_FAILED && cqPtr != sqPtr) ::munmap(cqPtr, cqSize);
+        if (sqPtr != MAP_FAILED) ::munmap(sqPtr, sqSize);
+        if (fd >= 0) ::close(fd);
+    }
+#endif
+};
+
+HdAsyncReader::HdAsyncReader(unsigned int threadCount, unsigned int queueDepth) : pending_(0)
+{
+    log = HdUtils::getLoggerInstance("HdAsyncReader");
+
+    if (initRing(queueDepth))
+    {
+        threads_.push_back(std::thread(&HdAsyncReader::ringCompletionLoop, this));
+        log->info("Async reads use io_uring. Queue depth: {}", queueDepth);
+        return;
+    }
+
+    ring_.reset();
+    if (threadCount < 1) threadCount = 1;
+    for (unsigned int i=0; i<threadCount; i++)
+    {
+        threads_.push_back(std::thread(&HdAsyncReader::poolWorkerLoop, this));
+    }
+    log->info("Async reads use thread pool fallback. Threads: {}", threadCount);
+}
+
+HdAsyncReader::~HdAsyncReader()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+
+        // requests that never reached the kernel can be dropped right away
+        while (!queue_.empty())
+        {
+            delete queue_.front();
+            queue_.pop_front();
+            pending_--;
+        }
+
+        if (ring_)
+        {
+            // wake up the completion thread, it exits once the kernel is done with all buffers
+            submitToRing(WAKEUP_REQUEST_ID, nullptr);
+        }
+    }
+    condition_.notify_all();
+
+    for (size_t i=0; i<threads_.size(); i++)
+    {
+        threads_[i].join();
+    }
+}
+
+std::string HdAsyncReader::backendName()
+{
+    return ring_ ? "io_uring" : "threadpool";
+}
+
+bool HdAsyncReader::submit(int fd, uint64_t offset, size_t size, Callback callback)
+{
+    if (fd < 0) return false;
+
+    Request* request = new Request();
+    request->fd = fd;
+    request->offset = offset;
+    request->size = size;
+    request->callback = callback;
+    request->blob = HdBlob::allocate(size, &request->buffer);
+    request->done = 0;
+    request->submitTime = std::chrono::high_resolution_clock::now();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (stopping_)
+    {
+        delete request;
+        return false;
+    }
+    pending_++;
+
+    if (ring_)
+    {
+        uint64_t requestId = nextRequestId_++;
+        inFlight_[requestId] = request;
+        if (!submitToRing(requestId, request))
+        {
+            // submission queue full, resubmitted as soon as completions come in
+            inFlight_.erase(requestId);
+            queue_.push_back(request);
+        }
+        return true;
+    }
+
+    queue_.push_back(request);
+    lock.unlock();
+    condition_.notify_one();
+    return true;
+}
+
+void HdAsyncReader::complete(Request* request, bool success)
+{
+    std::chrono::duration<double, std::milli> latency = std::chrono::high_resolution_clock::now() - request->submitTime;
+    if (request->callback)
+    {
+        request->callback(success, request->blob, latency.count());
+    }
+    delete request;
+    pending_--;
+}
+
+void HdAsyncReader::poolWorkerLoop()
+{
+    while (true)
+    {
+        Request* request = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            condition_.wait(lock, [this]{ return stopping_ || !queue_.empty(); });
+            if (stopping_ && queue_.empty()) return;
+            request = queue_.front();
+            queue_.pop_front();
+        }
+
+        bool success = true;
+        while (request->done < request->size)
+        {
+            ssize_t result = ::pread(request->fd, request->buffer + request->done,
+                                     request->size - request->done, (off_t) (request->offset + request->done));
+            if (result < 0 && errno == EINTR) continue;
+            if (result <= 0)
+            {
+                success = false;
+                break;
+            }
+            request->done += result;
+        }
+        complete(request, success);
+    }
+}
+
+#ifdef HD_HAS_IO_URING
+
+bool HdAsyncReader::initRing(unsigned int queueDepth)
+{
+    std::unique_ptr<Ring> ring(new Ring());
+
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+
+    ring->fd = (int) ::syscall(__NR_io_uring_setup, queueDepth, &params);
+    if (ring->fd < 0)
+    {
+        log->debug("io_uring not available: {}", std::strerror(errno));
+        return false;
+    }
+
+    ring->sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+    bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMap)
+    {
+        ring->sqSize = std::max(ring->sqSize, ring->cqSize);
+    }
+
+    ring->sqPtr = ::mmap(nullptr, ring->sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sqPtr == MAP_FAILED) return false;
+
+    if (singleMap)
+    {
+        ring->cqPtr = ring->sqPtr;
+    } else
+    {
+        ring->cqPtr = ::mmap(nullptr, ring->cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                             ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cqPtr == MAP_FAILED) return false;
+    }
+
+    ring->sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    ring->sqes = (io_uring_sqe*) ::mmap(nullptr, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                        ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) return false;
+
+    char* sq = (char*) ring->sqPtr;
+    ring->sqHead = (unsigned*) (sq + params.sq_off.head);
+    ring->sqTail = (unsigned*) (sq + params.sq_off.tail);
+    ring->sqMask = (unsigned*) (sq + params.sq_off.ring_mask);
+    ring->sqEntries = (unsigned*) (sq + params.sq_off.ring_entries);
+    ring->sqArray = (unsigned*) (sq + params.sq_off.array);
+
+    char* cq = (char*) ring->cqPtr;
+    ring->cqHead = (unsigned*) (cq + params.cq_off.head);
+    ring->cqTail = (unsigned*) (cq + params.cq_off.tail);
+    ring->cqMask = (unsigned*) (cq + params.cq_off.ring_mask);
+    ring->cqes = (io_uring_cqe*) (cq + params.cq_off.cqes);
+
+    ring_ = std::move(ring);
+    return true;
+}
+
+// expects mutex_ to be held
+bool HdAsyncReader::submitToRing(uint64_t requestId, Request* request)
+{
+    Ring* ring = ring_.get();
+
+    unsigned tail = *ring->sqTail;
+    unsigned head = __atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE);
+    if (tail - head >= *ring->sqEntries) return false;
+
+    unsigned index = tail & *ring->sqMask;
+    io_uring_sqe* sqe = &ring->sqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = requestId;
+
+    if (request == nullptr)
+    {
+        sqe->opcode = IORING_OP_NOP;
+    } else
+    {
+        // READV is the oldest read opcode, so this works on every io_uring kernel
+        iovec* iov = &request->iov;
+        iov->iov_base = request->buffer + request->done;
+        iov->iov_len = request->size - request->done;
+
+        sqe->opcode = IORING_OP_READV;
+        sqe->fd = request->fd;
+        sqe->addr = (uint64_t) (uintptr_t) iov;
+        sqe->len = 1;
+        sqe->off = request->offset + request->done;
+    }
+
+    ring->sqArray[index] = index;
+    __atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+
+    int result;
+    do
+    {
+        result = (int) ::syscall(__NR_io_uring_enter, ring->fd, 1, 0, 0, nullptr, 0);
+    } while (result < 0 && errno == EINTR);
+    if (result > 0) return true;
+
+    // without SQPOLL the kernel only consumes the ring in io_uring_enter, which runs under mutex_.
+    // A consumed entry is in flight, one that was not is withdrawn so a retry cannot submit it twice.
+    if (__atomic_load_n(ring->sqHead, __ATOMIC_ACQUIRE) == tail + 1) return true;
+    __atomic_store_n(ring->sqTail, tail, __ATOMIC_RELEASE);
+    return false;
+}
+
+void HdAsyncReader::ringCompletionLoop()
+{
+    Ring* ring = ring_.get();
+
+    while (true)
+    {
+        int result = (int) ::syscall(__NR_io_uring_enter, ring->fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+        if (result < 0 && errno != EINTR)
+        {
+            log->error("io_uring wait failed: {}", std::strerror(errno));
+            return;
+        }
+
+        std::vector<std::pair<Request*, bool>> finished;
+        bool exitLoop = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+
+            unsigned head = *ring->cqHead;
+            while (head != __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE))
+            {
+                io_uring_cqe* cqe = &ring->cqes[head & *ring->cqMask];
+                uint64_t requestId = cqe->user_data;
+                int res = cqe->res;
+                head++;
+
+                auto it = inFlight_.find(requestId);
+                if (it == inFlight_.end()) continue;
+
+                Request* request = it->second;
+                if (res > 0) request->done += res;
+
+                if (res > 0 && request->done < request->size && !stopping_)
+                {
+                    // short read, queue the remainder
+                    if (submitToRing(requestId, request)) continue;
+                }
+
+                inFlight_.erase(it);
+                finished.push_back(std::make_pair(request, res > 0 && request->done == request->size));
+            }
+            __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+
+            // move backlog into the ring now that there is room again
+            while (!queue_.empty() && !stopping_)
+            {
+                uint64_t requestId = nextRequestId_++;
+                inFlight_[requestId] = queue_.front();
+                if (!submitToRing(requestId, queue_.front()))
+                {
+                    inFlight_.erase(requestId);
+                    break;
+                }
+                queue_.pop_front();
+            }
+
+            exitLoop = stopping_ && inFlight_.empty();
+        }
+
+        for (size_t i=0; i<finished.size(); i++)
+        {
+            complete(finished[i].first, finished[i].second);
+        }
+
+        if (exitLoop) return;
+    }
+}
+
+#else
+
+bool HdAsyncReader::initRing(unsigned int queueDepth)
+{
+    return false;
+}
+
+bool HdAsyncReader::submitToRing(uint64_t requestId, Request* request)
+{
+    return false;
+}
+
+void HdAsyncReader::ringCompletionLoop()
+{
+}
+
+#endif
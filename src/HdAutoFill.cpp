@@ -0,0 +1,325 @@
+//
+// -----------------------------------------------------------------------------
+// This source file has been developed within the scope of the
+// Technical Director course at Filmakademie Baden-Wuerttemberg.
+// http://technicaldirector.de
+//
+// Written by Tim Lehr
+// Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+// -----------------------------------------------------------------------------
+//
+
+#include "HdAutoFill.h"
+
+#include <cmath>
+#include <algorithm>
+#include <maya/MAnimControl.h>
+#include <maya/MDGContext.h>
+#include <maya/MEventMessage.h>
+#include <maya/MFileIO.h>
+#include <maya/MFnDependencyNode.h>
+#include <maya/MItDependencyNodes.h>
+#include <maya/MPlug.h>
+#include <maya/MPlugArray.h>
+#include <maya/MTime.h>
+
+#include "HdMeshCache.h"
+#include "HdCacheNode.h"
+#include "HdPoseNode.h"
+
+namespace
+{
+    // events that pause the fill and restart it at the playhead
+    const char* INTERACTION_EVENTS[] = {
+        "timeChanged",
+        "playbackRangeChanged",
+        "SelectionChanged",
+        "ToolChanged",
+        "DragRelease",
+        "Undo",
+        "Redo",
+    };
+}
+
+HdAutoFill::HdAutoFill()
+{
+    log = HdUtils::getLoggerInstance("HdAutoFill");
+    lastInteraction_ = HdUtils::getCurrentTimePoint();
+}
+
+HdAutoFill::~HdAutoFill()
+{
+    shutdown();
+}
+
+HdAutoFill& HdAutoFill::instance()
+{
+    static HdAutoFill autoFill;
+    return autoFill;
+}
+
+void HdAutoFill::setEnabled(bool enabled)
+{
+    if (enabled == enabled_) return;
+    enabled_ = enabled;
+
+    if (enabled)
+    {
+        MStatus status;
+        for (size_t i=0; i<sizeof(INTERACTION_EVENTS) / sizeof(INTERACTION_EVENTS[0]); i++)
+        {
+            MCallbackId id = MEventMessage::addEventCallback(INTERACTION_EVENTS[i], HdAutoFill::onInteraction, this, &status);
+            CHECK_MSTATUS(status);
+            if (status == MS::kSuccess) interactionCallbacks_.append(id);
+        }
+        restart();
+    } else
+    {
+        if (interactionCallbacks_.length() > 0) MMessage::removeCallbacks(interactionCallbacks_);
+        interactionCallbacks_.clear();
+        done_ = true;
+        if (!hasWork()) deregisterIdle();
+    }
+    log->info("Auto-fill {}.", enabled ? "enabled" : "disabled");
+}
+
+void HdAutoFill::setBudget(double milliseconds)
+{
+    budgetMs_ = std::max(1.0, milliseconds);
+}
+
+void HdAutoFill::backFill(const std::vector<double>& frames)
+{
+    if (frames.empty()) return;
+    backFill_.insert(backFill_.end(), frames.begin(), frames.end());
+    lastInteraction_ = HdUtils::getCurrentTimePoint();
+    registerIdle();
+}
+
+void HdAutoFill::shutdown()
+{
+    enabled_ = false;
+    deregisterIdle();
+    backFill_.clear();
+    if (interactionCallbacks_.length() > 0)
+    {
+        MMessage::removeCallbacks(interactionCallbacks_);
+        interactionCallbacks_.clear();
+    }
+    done_ = true;
+}
+
+void HdAutoFill::registerIdle()
+{
+    // an idle callback keeps Maya busy, so it only exists while there is work
+    if (idleRegistered_) return;
+
+    MStatus status;
+    idleCallback_ = MEventMessage::addEventCallback("idle", HdAutoFill::onIdle, this, &status);
+    CHECK_MSTATUS(status);
+    idleRegistered_ = (status == MS::kSuccess);
+}
+
+void HdAutoFill::deregisterIdle()
+{
+    if (!idleRegistered_) return;
+    MMessage::removeCallback(idleCallback_);
+    idleRegistered_ = false;
+}
+
+void HdAutoFill::restart()
+{
+    lastInteraction_ = HdUtils::getCurrentTimePoint();
+    origin_ = std::floor(HdUtils::getCurrentFrame());
+    rangeStart_ = MAnimControl::minTime().value();
+    rangeEnd_ = MAnimControl::maxTime().value();
+    origin_ = std::min(std::max(origin_, std::ceil(rangeStart_)), rangeEnd_);
+    step_ = 0;
+    done_ = false;
+    registerIdle();
+}
+
+bool HdAutoFill::hasWork()
+{
+    return !backFill_.empty() || (enabled_ && !done_);
+}
+
+bool HdAutoFill::nextFrame(double& frame)
+{
+    // 0, +1, -1, +2, -2, ... around the playhead
+    double maxOffset = std::max(rangeEnd_ - origin_, origin_ - rangeStart_);
+    while (!done_)
+    {
+        unsigned int step = step_++;
+        double offset = (double) ((step + 1) / 2);
+        if (offset > maxOffset)
+        {
+            done_ = true;
+            break;
+        }
+
+        frame = (step % 2 == 1) ? origin_ + offset : origin_ - offset;
+        if (frame >= rangeStart_ && frame <= rangeEnd_) return true;
+    }
+    return false;
+}
+
+std::vector<HdAutoFill::FillTarget> HdAutoFill::collectTargets()
+{
+    std::vector<FillTarget> targets;
+    MStatus status;
+
+    MItDependencyNodes nodeIt(MFn::kPluginDependNode, &status);
+    CHECK_MSTATUS(status);
+    for (; status == MS::kSuccess && !nodeIt.isDone(); nodeIt.next())
+    {
+        MFnDependencyNode depNodeFn(nodeIt.thisNode());
+        if (depNodeFn.typeId() != HdPoseNode::id) continue;
+
+        FillTarget target;
+        target.poseNode = nodeIt.thisNode();
+
+        // the cache nodes are the destinations of the pose node's cache ID outputs
+        MPlug cacheIdsPlug(target.poseNode, HdPoseNode::aOutCacheIds);
+        for (unsigned int i=0; i<cacheIdsPlug.numElements(); i++)
+        {
+            MPlug elementPlug = cacheIdsPlug.elementByPhysicalIndex(i);
+            MString cacheId;
+            if (elementPlug.getValue(cacheId) != MS::kSuccess || cacheId.length() < 1) continue;
+
+            MPlugArray destinations;
+            elementPlug.destinations(destinations);
+            for (unsigned int j=0; j<destinations.length(); j++)
+            {
+                MObject cacheNode = destinations[j].node();
+                MFnDependencyNode cacheNodeFn(cacheNode);
+                if (cacheNodeFn.typeId() != HdCacheNode::id) continue;
+
+                target.cacheNodes.push_back(cacheNode);
+                target.cacheIds.push_back(cacheId.asChar());
+            }
+        }
+        if (!target.cacheNodes.empty()) targets.push_back(target);
+    }
+    return targets;
+}
+
+bool HdAutoFill::fillFrame(const std::vector<FillTarget>& targets, double frame)
+{
+    MStatus status;
+    MTime time(frame, MTime::uiUnit());
+    bool evaluated = false;
+
+    for (size_t i=0; i<targets.size(); i++)
+    {
+        // the pose ID is cheap to compute, the rig and meshes are not evaluated
+        HdPose pose = HdPoseNode::createPoseAtTime(targets[i].poseNode, time, status);
+        if (status != MS::kSuccess) continue;
+        std::string poseId = pose.hash();
+
+        for (size_t j=0; j<targets[i].cacheNodes.size(); j++)
+        {
+            std::shared_ptr<HdMeshCache> meshCache = HdCacheMap::get(targets[i].cacheIds[j], status);
+            if (meshCache == nullptr || meshCache->exists(poseId)) continue;
+
+            MPlug outMeshesPlug(targets[i].cacheNodes[j], HdCacheNode::aOutMeshes);
+            if (outMeshesPlug.numElements() < 1) continue;
+
+            // pulling one output in the frame's context runs the regular capture in compute
+            MDGContext context(time);
+            MObject meshData;
+            HdUtils::setAutoFillActive(true);
+            status = outMeshesPlug.elementByPhysicalIndex(0).getValue(meshData, context);
+            HdUtils::setAutoFillActive(false);
+            CHECK_MSTATUS(status);
+
+            evaluated = true;
+            if (meshCache->exists(poseId)) posesStored_++;
+        }
+    }
+    return evaluated;
+}
+
+void HdAutoFill::runSlice()
+{
+    std::vector<FillTarget> targets = collectTargets();
+    if (targets.empty())
+    {
+        done_ = true;
+        backFill_.clear();
+        return;
+    }
+
+    slices_++;
+    HdUtils::time_point startTime = HdUtils::getCurrentTimePoint();
+
+    // frames skipped by real-time playback before the rest of the range
+    while (!backFill_.empty())
+    {
+        double frame = backFill_.front();
+        backFill_.pop_front();
+        framesChecked_++;
+        if (fillFrame(targets, frame)) framesBackFilled_++;
+
+        HdUtils::time_duration elapsed = HdUtils::getCurrentTimePoint() - startTime;
+        if (elapsed.count() >= budgetMs_) return;
+    }
+
+    double frame;
+    while (enabled_ && nextFrame(frame))
+    {
+        framesChecked_++;
+        if (fillFrame(targets, frame)) framesFilled_++;
+
+        HdUtils::time_duration elapsed = HdUtils::getCurrentTimePoint() - startTime;
+        if (elapsed.count() >= budgetMs_) break;
+    }
+
+    if (enabled_ && done_) log->info("Auto-fill finished playback range {} - {}.", rangeStart_, rangeEnd_);
+}
+
+void HdAutoFill::onIdle(void* clientData)
+{
+    HdAutoFill* autoFill = static_cast<HdAutoFill*>(clientData);
+    if (!autoFill->hasWork())
+    {
+        autoFill->deregisterIdle();
+        return;
+    }
+
+    if (MAnimControl::isPlaying() || MAnimControl::isScrubbing() || MFileIO::isReadingFile()) return;
+
+    // give the user a moment before the next slice, in case they keep working
+    HdUtils::time_duration idle = HdUtils::getCurrentTimePoint() - autoFill->lastInteraction_;
+    if (idle.count() < autoFill->idleDelayMs_) return;
+
+    autoFill->runSlice();
+    if (!autoFill->hasWork()) autoFill->deregisterIdle();
+}
+
+void HdAutoFill::onInteraction(void* clientData)
+{
+    HdAutoFill* autoFill = static_cast<HdAutoFill*>(clientData);
+    if (!autoFill->enabled_) return;
+
+    if (!autoFill->done_ && autoFill->step_ > 0) autoFill->interruptions_++;
+    autoFill->restart();
+}
+
+std::string HdAutoFill::getStatsJson()
+{
+    std::string result = "{";
+    result += "\"enabled\": " + std::string(enabled_ ? "true" : "false") + ", ";
+    result += "\"active\": " + std::string(idleRegistered_ && hasWork() ? "true" : "false") + ", ";
+    result += "\"budget_ms\": " + std::to_string(budgetMs_) + ", ";
+    result += "\"range_start\": " + std::to_string(rangeStart_) + ", ";
+    result += "\"range_end\": " + std::to_string(rangeEnd_) + ", ";
+    result += "\"slices\": " + std::to_string(slices_) + ", ";
+    result += "\"frames_checked\": " + std::to_string(framesChecked_) + ", ";
+    result += "\"frames_filled\": " + std::to_string(framesFilled_) + ", ";
+    result += "\"poses_stored\": " + std::to_string(posesStored_) + ", ";
+    result += "\"back_fill_pending\": " + std::to_string(backFill_.size()) + ", ";
+    result += "\"frames_back_filled\": " + std::to_string(framesBackFilled_) + ", ";
+    result += "\"interruptions\": " + std::to_string(interruptions_) + "}";
+    return result;
+}
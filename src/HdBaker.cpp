@@ -0,0 +1,307 @@
+//
+// -----------------------------------------------------------------------------
+// This source file has been developed within the scope of the
+// Technical Director course at Filmakademie Baden-Wuerttemberg.
+// http://technicaldirector.de
+//
+// Written by Tim Lehr
+// Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+// -----------------------------------------------------------------------------
+//
+
+#include "HdBaker.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <thread>
+#include <chrono>
+
+#include <maya/MGlobal.h>
+#include <maya/MComputation.h>
+#include <maya/MObjectArray.h>
+
+#include "HdUtils.h"
+#include "HdMeshCache.h"
+#include "HdPoseNode.h"
+#include "HdPoseSampler.h"
+#include "HdCoverage.h"
+
+extern char** environ;
+
+namespace
+{
+    const std::string CACHEFILE_EXTENSION = ".hdc";
+    const std::string WORKER_SCRIPT = "import maya.standalone; maya.standalone.initialize(); "
+                                      "import hyperdrive.hdbake; hyperdrive.hdbake.main()";
+
+    std::string workerDirectory(const std::string& bakeDir, unsigned int worker)
+    {
+        return bakeDir + "/worker" + std::to_string(worker);
+    }
+
+    std::string framesFile(const std::string& bakeDir, unsigned int worker)
+    {
+        return bakeDir + "/worker" + std::to_string(worker) + ".frames";
+    }
+}
+
+std::shared_ptr<spdlog::logger> HdBaker::log = HdUtils::getLoggerInstance("HdBaker");
+
+MStatus HdBaker::bake(double start, double end, unsigned int workerCount, const std::set<std::string>& cacheIds, std::string& report)
+{
+    MStatus status;
+    if (workerCount < 1 || end < start) return MS::kInvalidParameter;
+
+    // the workers open the scene from disk
+    MString scenePath;
+    int modified = 0;
+    MGlobal::executeCommand("file -q -sceneName", scenePath);
+    MGlobal::executeCommand("file -q -modified", modified);
+    if (scenePath.length() == 0 || modified)
+    {
+        report = "Save the scene before baking. Bake workers load it from disk.";
+        return MS::kFailure;
+    }
+
+    HdUtils::time_point startTime = HdUtils::getCurrentTimePoint();
+
+    std::vector<double> frames;
+    std::set<std::string> bakeCacheIds;
+    status = planFrames(start, end, cacheIds, frames, bakeCacheIds);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    if (frames.empty())
+    {
+        report = "All poses in frame range are cached already. Nothing to bake.";
+        return MS::kSuccess;
+    }
+
+    const char* tmpDir = std::getenv("TMPDIR");
+    std::string bakeDirTemplate = std::string(tmpDir != nullptr && tmpDir[0] != '\0' ? tmpDir : "/tmp") + "/hyperdrive-bake-XXXXXX";
+    std::vector<char> bakeDirBuffer(bakeDirTemplate.begin(), bakeDirTemplate.end());
+    bakeDirBuffer.push_back('\0');
+    if (::mkdtemp(bakeDirBuffer.data()) == nullptr)
+    {
+        report = std::string("Could not create bake directory: ") + std::strerror(errno);
+        return MS::kFailure;
+    }
+    std::string bakeDir = bakeDirBuffer.data();
+
+    // contiguous chunks keep consecutive, similar frames on the same worker
+    unsigned int workers = (unsigned int) std::min((size_t) workerCount, frames.size());
+    size_t chunkSize = (frames.size() + workers - 1) / workers;
+
+    std::vector<pid_t> pids;
+    for (unsigned int w=0; w<workers; w++)
+    {
+        std::string shardDir = workerDirectory(bakeDir, w);
+        std::string framesPath = framesFile(bakeDir, w);
+        ::mkdir(shardDir.c_str(), 0755);
+
+        std::ofstream framesOut(framesPath.c_str());
+        for (size_t i=w*chunkSize; i<std::min(frames.size(), (w+1)*chunkSize); i++)
+        {
+            framesOut << frames[i] << "\n";
+        }
+        framesOut.close();
+
+        pid_t pid = spawnWorker(scenePath.asChar(), framesPath, shardDir, bakeCacheIds);
+        if (pid > 0) pids.push_back(pid);
+    }
+
+    log->info("Baking {} frames of '{}' with {} workers. Bake directory: '{}'", frames.size(), scenePath.asChar(), pids.size(), bakeDir);
+    MStatus workerStatus = pids.empty() ? MS::kFailure : waitForWorkers(pids);
+
+    // merge what has been baked, even if some workers failed
+    size_t merged = 0;
+    size_t skipped = 0;
+    for (unsigned int w=0; w<workers; w++)
+    {
+        std::string shardDir = workerDirectory(bakeDir, w);
+        for (std::set<std::string>::const_iterator it = bakeCacheIds.begin(); it != bakeCacheIds.end(); ++it)
+        {
+            std::string shardPath = shardDir + "/" + *it + CACHEFILE_EXTENSION;
+            if (::access(shardPath.c_str(), R_OK) == 0)
+            {
+                std::shared_ptr<HdMeshCache> meshCache = HdCacheMap::get(*it, status);
+                if (meshCache != nullptr) meshCache->mergeShard(shardPath, merged, skipped);
+            }
+            ::unlink(shardPath.c_str());
+        }
+        ::rmdir(shardDir.c_str());
+        ::unlink(framesFile(bakeDir, w).c_str());
+    }
+    ::rmdir(bakeDir.c_str());
+
+    std::string duration = HdUtils::getTimeDiffString(startTime, HdUtils::getCurrentTimePoint());
+    report = "Baked " + std::to_string(frames.size()) + " frames with " + std::to_string(pids.size()) + " workers in " + duration + ". " +
+             std::to_string(merged) + " poses merged, " + std::to_string(skipped) + " duplicates skipped.";
+    if (workerStatus != MS::kSuccess) report += " Some workers failed, see the script editor output.";
+    log->info(report);
+    return workerStatus;
+}
+
+MStatus HdBaker::planFrames(double start, double end, const std::set<std::string>& cacheIds,
+                            std::vector<double>& frames, std::set<std::string>& bakeCacheIds)
+{
+    MStatus status;
+
+    MObjectArray poseNodes = HdCoverage::poseNodes(status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    std::vector<double> rangeFrames;
+    for (double frame=std::floor(start); frame<=end; frame+=1.0) rangeFrames.push_back(frame);
+    std::vector<bool> needed(rangeFrames.size(), false);
+
+    // poses that are planned already, a pose reached on several frames is only baked once
+    std::set<std::string> plannedPoses;
+
+    for (unsigned int i=0; i<poseNodes.length(); i++)
+    {
+        std::vector<std::string> nodeCacheIds = HdPoseNode::getCacheIds(poseNodes[i], status);
+        if (status != MS::kSuccess || nodeCacheIds.empty()) continue;
+
+        // the pose IDs are sampled from the anim curves, the rig and meshes are not evaluated
+        HdPoseSampler sampler(poseNodes[i], status);
+        if (status != MS::kSuccess) continue;
+        std::vector<std::string> poseIds = sampler.sample(rangeFrames, status);
+        if (status != MS::kSuccess) continue;
+
+        for (size_t f=0; f<rangeFrames.size(); f++)
+        {
+            for (size_t j=0; j<nodeCacheIds.size(); j++)
+            {
+                const std::string& cacheId = nodeCacheIds[j];
+                if (!cacheIds.empty() && cacheIds.find(cacheId) == cacheIds.end()) continue;
+                if (!plannedPoses.insert(cacheId + "/" + poseIds[f]).second) continue;
+
+                std::shared_ptr<HdMeshCache> meshCache = HdCacheMap::get(cacheId, status);
+                if (meshCache == nullptr || meshCache->exists(poseIds[f])) continue;
+
+                bakeCacheIds.insert(cacheId);
+                needed[f] = true;
+            }
+        }
+    }
+
+    for (size_t f=0; f<rangeFrames.size(); f++)
+    {
+        if (needed[f]) frames.push_back(rangeFrames[f]);
+    }
+
+    log->info("Planned bake of {} frames in range {} - {} for {} caches.", frames.size(), start, end, bakeCacheIds.size());
+    return MS::kSuccess;
+}
+
+std::string HdBaker::workerCommand()
+{
+    const char* mayaLocation = std::getenv("MAYA_LOCATION");
+    if (mayaLocation != nullptr && mayaLocation[0] != '\0')
+    {
+        std::string mayapy = std::string(mayaLocation) + "/bin/mayapy";
+        if (::access(mayapy.c_str(), X_OK) == 0) return mayapy;
+    }
+    return "mayapy";
+}
+
+pid_t HdBaker::spawnWorker(const std::string& scenePath, const std::string& framesFile,
+                           const std::string& shardDir, const std::set<std::string>& cacheIds)
+{
+    std::string caches;
+    for (std::set<std::string>::const_iterator it = cacheIds.begin(); it != cacheIds.end(); ++it)
+    {
+        if (!caches.empty()) caches += ",";
+        caches += *it;
+    }
+
+    std::vector<std::string> args;
+    args.push_back(workerCommand());
+    args.push_back("-c");
+    args.push_back(WORKER_SCRIPT);
+    args.push_back("--scene");
+    args.push_back(scenePath);
+    args.push_back("--frames");
+    args.push_back(framesFile);
+    args.push_back("--out");
+    args.push_back(shardDir);
+    args.push_back("--caches");
+    args.push_back(caches);
+
+    std::vector<char*> argv;
+    for (size_t i=0; i<args.size(); i++) argv.push_back(const_cast<char*>(args[i].c_str()));
+    argv.push_back(nullptr);
+
+    // the environment of this session (module path, licenses) plus the bake flag
+    std::string bakeFlag = "HD_BAKE_WORKER=1";
+    std::vector<char*> envp;
+    for (char** env = environ; *env != nullptr; env++) envp.push_back(*env);
+    envp.push_back(const_cast<char*>(bakeFlag.c_str()));
+    envp.push_back(nullptr);
+
+    pid_t pid = -1;
+    int result = ::posix_spawnp(&pid, argv[0], nullptr, nullptr, argv.data(), envp.data());
+    if (result != 0)
+    {
+        log->error("Could not launch bake worker '{}': {}", argv[0], std::strerror(result));
+        return -1;
+    }
+
+    log->info("Launched bake worker {} for frames in '{}'.", pid, framesFile);
+    return pid;
+}
+
+MStatus HdBaker::waitForWorkers(std::vector<pid_t>& workers)
+{
+    MStatus status = MS::kSuccess;
+    MComputation computation;
+    computation.beginComputation();
+
+    bool interrupted = false;
+    size_t running = workers.size();
+    while (running > 0)
+    {
+        if (!interrupted && computation.isInterruptRequested())
+        {
+            interrupted = true;
+            log->warn("Bake interrupted. Stop {} running workers.", running);
+            for (size_t i=0; i<workers.size(); i++)
+            {
+                if (workers[i] > 0) ::kill(workers[i], SIGTERM);
+            }
+            status = MS::kFailure;
+        }
+
+        for (size_t i=0; i<workers.size(); i++)
+        {
+            if (workers[i] <= 0) continue;
+
+            int exitStatus = 0;
+            pid_t result = ::waitpid(workers[i], &exitStatus, WNOHANG);
+            if (result == 0) continue;
+
+            if (result < 0 || !WIFEXITED(exitStatus) || WEXITSTATUS(exitStatus) != 0)
+            {
+                log->error("Bake worker {} failed.", workers[i]);
+                status = MS::kFailure;
+            } else
+            {
+                log->info("Bake worker {} finished.", workers[i]);
+            }
+            workers[i] = -1;
+            running--;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    }
+
+    computation.endComputation();
+    return status;
+}
@@ -0,0 +1,679 @@
+//
+// -----------------------------------------------------------------------------
+// This source file has been developed within the scope of the
+// Technical Director course at Filmakademie Baden-Wuerttemberg.
+// http://technicaldirector.de
+//
+// Written by Tim Lehr
+// Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+// -----------------------------------------------------------------------------
+//
+
+#include "HdCacheFile.h"
+
+#include <vector>
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+
+#include "HdLogger.h"
+
+namespace
+{
+    const uint32_t MAX_KEY_SIZE = 4096;
+
+    // longest run of the shufflerle codec, encoded as control byte run + 125
+    const uint64_t MAX_RUN = 130;
+
+    bool preadAll(int fd, char* buffer, size_t size, uint64_t offset)
+    {
+        while (size > 0)
+        {
+            ssize_t result = ::pread(fd, buffer, size, (off_t) offset);
+            if (result < 0 && errno == EINTR) continue;
+            if (result <= 0) return false;
+            buffer += result;
+            offset += result;
+            size -= result;
+        }
+        return true;
+    }
+
+    bool pwriteAll(int fd, const char* buffer, size_t size, uint64_t offset)
+    {
+        while (size > 0)
+        {
+            ssize_t result = ::pwrite(fd, buffer, size, (off_t) offset);
+            if (result < 0 && errno == EINTR) continue;
+            if (result <= 0) return false;
+            buffer += result;
+            offset += result;
+            size -= result;
+        }
+        return true;
+    }
+
+    template <typename T>
+    void appendPod(std::vector<char>& buffer, const T& value)
+    {
+        const char* src = reinterpret_cast<const char*>(&value);
+        buffer.insert(buffer.end(), src, src + sizeof(T));
+    }
+
+    template <typename T>
+    bool readPod(const std::vector<char>& buffer, size_t& pos, T& value)
+    {
+        if (pos + sizeof(T) > buffer.size()) return false;
+        std::memcpy(&value, buffer.data() + pos, sizeof(T));
+        pos += sizeof(T);
+        return true;
+    }
+
+    uint64_t recordSize(const HdCacheFileEntry& entry)
+    {
+        return entry.payloadOffset - entry.recordOffset + entry.payloadSize;
+    }
+
+    // byte i of every 4 byte lane goes to plane i, a trailing partial lane is kept as is
+    void shuffle(const char* src, char* dst, size_t size)
+    {
+        size_t lanes = size / 4;
+        for (size_t i=0; i<lanes; i++)
+        {
+            for (size_t b=0; b<4; b++) dst[b * lanes + i] = src[i * 4 + b];
+        }
+        std::memcpy(dst + lanes * 4, src + lanes * 4, size - lanes * 4);
+    }
+
+    void unshuffle(const char* src, char* dst, size_t size)
+    {
+        size_t lanes = size / 4;
+        for (size_t i=0; i<lanes; i++)
+        {
+            for (size_t b=0; b<4; b++) dst[i * 4 + b] = src[b * lanes + i];
+        }
+        std::memcpy(dst + lanes * 4, src + lanes * 4, size - lanes * 4);
+    }
+}
+
+HdCacheFile::HdCacheFile()
+{
+    log = HdUtils::getLoggerInstance("HdCacheFile");
+}
+
+HdCacheFile::~HdCacheFile()
+{
+    close();
+}
+
+bool HdCacheFile::open(const std::string& path, bool writable)
+{
+    close();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    path_ = path;
+    writable_ = writable;
+    lockedByOther_ = false;
+
+    int flags = writable ? (O_RDWR | O_CREAT) : O_RDONLY;
+    fd_ = ::open(path.c_str(), flags, 0644);
+    if (fd_ < 0)
+    {
+        log->error("Could not open cache file '{}': {}", path, std::strerror(errno));
+        return false;
+    }
+
+    // one writer per file, the appends and index rewrites of two processes would interleave
+    if (writable && ::flock(fd_, LOCK_EX | LOCK_NB) != 0)
+    {
+        if (errno == EWOULDBLOCK)
+        {
+            log->warn("Cache file '{}' is opened for writing by another process.", path);
+            lockedByOther_ = true;
+            ::close(fd_);
+            fd_ = -1;
+            return false;
+        }
+        log->warn("Could not lock cache file '{}': {}. Open it unlocked.", path, std::strerror(errno));
+    }
+
+    struct stat fileStat;
+    if (::fstat(fd_, &fileStat) != 0)
+    {
+        log->error("Could not stat cache file '{}': {}", path, std::strerror(errno));
+        ::close(fd_);
+        fd_ = -1;
+        return false;
+    }
+
+    if (fileStat.st_size == 0)
+    {
+        if (!writable)
+        {
+            log->error("Cache file '{}' is empty.", path);
+            ::close(fd_);
+            fd_ = -1;
+            return false;
+        }
+
+        // fresh file, write an empty header
+        endOffset_ = sizeof(HdCacheFileHeader);
+        if (!writeHeader(0, 0))
+        {
+            ::close(fd_);
+            fd_ = -1;
+            return false;
+        }
+        log->info("Created cache file: '{}'", path);
+        return true;
+    }
+
+    HdCacheFileHeader header;
+    if (!readHeader(header))
+    {
+        log->error("Invalid cache file header: '{}'", path);
+        ::close(fd_);
+        fd_ = -1;
+        return false;
+    }
+
+    codec_ = header.codec;
+    deadBytes_ = header.reserved[0];
+
+    if (!loadIndex(header))
+    {
+        log->warn("Missing or damaged index in cache file '{}'. Recover by scanning records.", path);
+        deadBytes_ = 0;
+        scanRecords();
+
+        if (writable_)
+        {
+            // drop everything behind the last valid record
+            if (::ftruncate(fd_, (off_t) endOffset_) != 0)
+            {
+                log->warn("Could not truncate damaged tail of cache file '{}'.", path);
+            }
+            indexDirty_ = true;
+        }
+    }
+
+    log->info("Opened cache file '{}'. Poses: {}, Size: {} bytes", path, index_.size(), endOffset_);
+    return true;
+}
+
+bool HdCacheFile::flush()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (fd_ < 0 || !writable_) return false;
+    if (!indexDirty_) return true;
+
+    std::vector<char> buffer;
+    buffer.reserve(index_.size() * 64);
+    appendPod(buffer, HD_CACHEINDEX_MAGIC);
+    appendPod(buffer, (uint32_t) 0);
+    appendPod(buffer, (uint64_t) index_.size());
+
+    for (auto it = index_.begin(); it != index_.end(); ++it)
+    {
+        const HdCacheFileEntry& entry = it->second;
+        appendPod(buffer, (uint32_t) it->first.size());
+        appendPod(buffer, entry.codec);
+        appendPod(buffer, entry.recordOffset);
+        appendPod(buffer, entry.payloadSize);
+        appendPod(buffer, entry.rawSize);
+        appendPod(buffer, entry.checksum);
+        buffer.insert(buffer.end(), it->first.begin(), it->first.end());
+    }
+
+    // the index lives behind the last record and is overwritten by the next append
+    if (!pwriteAll(fd_, buffer.data(), buffer.size(), endOffset_))
+    {
+        log->error("Could not write index of cache file '{}': {}", path_, std::strerror(errno));
+        return false;
+    }
+
+    if (::ftruncate(fd_, (off_t) (endOffset_ + buffer.size())) != 0)
+    {
+        log->warn("Could not truncate cache file '{}'.", path_);
+    }
+
+    if (!writeHeader(endOffset_, buffer.size())) return false;
+    ::fdatasync(fd_);
+
+    indexDirty_ = false;
+    log->debug("Flushed cache file '{}'. Poses: {}", path_, index_.size());
+    return true;
+}
+
+void HdCacheFile::close()
+{
+    if (fd_ < 0) return;
+    if (writable_) flush();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    ::close(fd_);
+    fd_ = -1;
+    index_.clear();
+    endOffset_ = 0;
+    recordCount_ = 0;
+    deadBytes_ = 0;
+    indexDirty_ = false;
+}
+
+bool HdCacheFile::readHeader(HdCacheFileHeader& header)
+{
+    if (!preadAll(fd_, reinterpret_cast<char*>(&header), sizeof(header), 0)) return false;
+    if (std::memcmp(header.magic, HD_CACHEFILE_MAGIC, sizeof(header.magic)) != 0) return false;
+    if (header.version != HD_CACHEFILE_VERSION)
+    {
+        log->error("Unsupported cache file version: {}", header.version);
+        return false;
+    }
+    return true;
+}
+
+bool HdCacheFile::writeHeader(uint64_t indexOffset, uint64_t indexSize)
+{
+    HdCacheFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, HD_CACHEFILE_MAGIC, sizeof(header.magic));
+    header.version = HD_CACHEFILE_VERSION;
+    header.codec = codec_;
+    header.indexOffset = indexOffset;
+    header.indexSize = indexSize;
+    header.recordCount = recordCount_;
+    header.reserved[0] = deadBytes_;
+
+    if (!pwriteAll(fd_, reinterpret_cast<const char*>(&header), sizeof(header), 0))
+    {
+        log->error("Could not write header of cache file '{}': {}", path_, std::strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool HdCacheFile::loadIndex(const HdCacheFileHeader& header)
+{
+    if (header.indexOffset < sizeof(HdCacheFileHeader) || header.indexSize < 16) return false;
+
+    std::vector<char> buffer(header.indexSize);
+    if (!preadAll(fd_, buffer.data(), buffer.size(), header.indexOffset)) return false;
+
+    size_t pos = 0;
+    uint32_t magic, reserved;
+    uint64_t count;
+    if (!readPod(buffer, pos, magic) || magic != HD_CACHEINDEX_MAGIC) return false;
+    if (!readPod(buffer, pos, reserved) || !readPod(buffer, pos, count)) return false;
+
+    index_.clear();
+    index_.reserve(count);
+
+    for (uint64_t i=0; i<count; i++)
+    {
+        uint32_t keySize;
+        HdCacheFileEntry entry;
+        if (!readPod(buffer, pos, keySize) || keySize > MAX_KEY_SIZE) return false;
+        if (!readPod(buffer, pos, entry.codec)) return false;
+        if (!readPod(buffer, pos, entry.recordOffset)) return false;
+        if (!readPod(buffer, pos, entry.payloadSize)) return false;
+        if (!readPod(buffer, pos, entry.rawSize)) return false;
+        if (!readPod(buffer, pos, entry.checksum)) return false;
+        if (pos + keySize > buffer.size()) return false;
+
+        std::string poseId(buffer.data() + pos, keySize);
+        pos += keySize;
+
+        entry.payloadOffset = entry.recordOffset + sizeof(HdCacheRecordHeader) + keySize;
+        if (entry.payloadOffset > header.indexOffset || entry.payloadSize > header.indexOffset - entry.payloadOffset) return false;
+        index_[poseId] = entry;
+    }
+
+    endOffset_ = header.indexOffset;
+    recordCount_ = header.recordCount;
+    return true;
+}
+
+bool HdCacheFile::scanRecords()
+{
+    struct stat fileStat;
+    if (::fstat(fd_, &fileStat) != 0) return false;
+    uint64_t fileSize = (uint64_t) fileStat.st_size;
+
+    index_.clear();
+    recordCount_ = 0;
+    uint64_t offset = sizeof(HdCacheFileHeader);
+
+    while (offset + sizeof(HdCacheRecordHeader) <= fileSize)
+    {
+        HdCacheRecordHeader record;
+        if (!preadAll(fd_, reinterpret_cast<char*>(&record), sizeof(record), offset)) break;
+        if (record.magic != HD_CACHERECORD_MAGIC || record.keySize > MAX_KEY_SIZE) break;
+
+        uint64_t payloadOffset = offset + sizeof(record) + record.keySize;
+        if (payloadOffset > fileSize || record.payloadSize > fileSize - payloadOffset) break; // truncated record
+
+        std::string poseId(record.keySize, '\0');
+        if (!preadAll(fd_, &poseId[0], record.keySize, offset + sizeof(record))) break;
+
+        HdCacheFileEntry entry;
+        entry.recordOffset = offset;
+        entry.payloadOffset = payloadOffset;
+        entry.payloadSize = record.payloadSize;
+        entry.rawSize = record.rawSize;
+        entry.checksum = record.checksum;
+        entry.codec = record.codec;
+
+        if (record.flags & kRecordTombstone)
+        {
+            auto it = index_.find(poseId);
+            if (it != index_.end())
+            {
+                deadBytes_ += recordSize(it->second);
+                index_.erase(it);
+            }
+            deadBytes_ += recordSize(entry);
+        } else
+        {
+            insertEntry(poseId, entry);
+        }
+
+        recordCount_++;
+        offset = payloadOffset + record.payloadSize;
+    }
+
+    endOffset_ = offset;
+    log->info("Recovered {} poses from {} records in cache file '{}'.", index_.size(), recordCount_, path_);
+    return true;
+}
+
+void HdCacheFile::insertEntry(const std::string& poseId, const HdCacheFileEntry& entry)
+{
+    auto it = index_.find(poseId);
+    if (it != index_.end())
+    {
+        // superseded record stays in the file until compaction
+        deadBytes_ += recordSize(it->second);
+        it->second = entry;
+    } else
+    {
+        index_[poseId] = entry;
+    }
+}
+
+bool HdCacheFile::appendRecord(const std::string& poseId, const char* payload, const HdCacheFileEntry& entry, uint32_t flags)
+{
+    if (fd_ < 0 || !writable_) return false;
+
+    if (poseId.size() > MAX_KEY_SIZE)
+    {
+        log->error("Pose ID exceeds maximum key size: '{}'", poseId);
+        return false;
+    }
+
+    if (!indexDirty_)
+    {
+        // invalidate the on-disk index before the first append overwrites it
+        if (!writeHeader(0, 0)) return false;
+        indexDirty_ = true;
+    }
+
+    HdCacheRecordHeader record;
+    record.magic = HD_CACHERECORD_MAGIC;
+    record.flags = flags;
+    record.keySize = (uint32_t) poseId.size();
+    record.codec = entry.codec;
+    record.payloadSize = entry.payloadSize;
+    record.rawSize = entry.rawSize;
+    record.checksum = entry.checksum;
+
+    std::vector<char> buffer(sizeof(record) + poseId.size());
+    std::memcpy(buffer.data(), &record, sizeof(record));
+    std::memcpy(buffer.data() + sizeof(record), poseId.data(), poseId.size());
+
+    uint64_t offset = endOffset_;
+    if (!pwriteAll(fd_, buffer.data(), buffer.size(), offset) ||
+        !pwriteAll(fd_, payload, entry.payloadSize, offset + buffer.size()))
+    {
+        log->error("Could not append record to cache file '{}': {}", path_, std::strerror(errno));
+        return false;
+    }
+
+    HdCacheFileEntry stored = entry;
+    stored.recordOffset = offset;
+    stored.payloadOffset = offset + buffer.size();
+    endOffset_ = stored.payloadOffset + entry.payloadSize;
+    recordCount_++;
+
+    if (flags & kRecordTombstone)
+    {
+        auto it = index_.find(poseId);
+        if (it != index_.end())
+        {
+            deadBytes_ += recordSize(it->second);
+            index_.erase(it);
+        }
+        deadBytes_ += recordSize(stored);
+    } else
+    {
+        insertEntry(poseId, stored);
+    }
+    return true;
+}
+
+bool HdCacheFile::exists(const std::string& poseId)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return index_.find(poseId) != index_.end();
+}
+
+size_t HdCacheFile::size()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return index_.size();
+}
+
+bool HdCacheFile::locate(const std::string& poseId, HdCacheFileEntry& entry)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(poseId);
+    if (it == index_.end()) return false;
+    entry = it->second;
+    return true;
+}
+
+bool HdCacheFile::read(const std::string& poseId, HdBlob& blob)
+{
+    HdCacheFileEntry entry;
+    if (!locate(poseId, entry)) return false;
+    return readEntry(entry, blob, true);
+}
+
+bool HdCacheFile::readEntry(const HdCacheFileEntry& entry, HdBlob& blob, bool verify)
+{
+    HdBlob payload;
+    if (!readPayload(entry, payload, verify)) return false;
+    return decodePayload(entry, payload, blob);
+}
+
+bool HdCacheFile::readPayload(const HdCacheFileEntry& entry, HdBlob& payload, bool verify)
+{
+    char* buffer;
+    payload = HdBlob::allocate(entry.payloadSize, &buffer);
+
+    // pread does not move the file offset, no lock needed
+    if (!preadAll(fd_, buffer, entry.payloadSize, entry.payloadOffset))
+    {
+        log->error("Could not read pose payload at offset {} from '{}'.", entry.payloadOffset, path_);
+        return false;
+    }
+
+    if (verify && hdChecksum64(payload.begin(), payload.size) != entry.checksum)
+    {
+        log->error("Checksum mismatch for pose payload at offset {} in '{}'.", entry.payloadOffset, path_);
+        return false;
+    }
+    return true;
+}
+
+bool HdCacheFile::decodePayload(const HdCacheFileEntry& entry, const HdBlob& payload, HdBlob& blob)
+{
+    if (entry.codec == kCodecRaw && payload.size == entry.rawSize)
+    {
+        blob = payload;
+        return true;
+    }
+
+    if (entry.codec == kCodecShuffleRle)
+    {
+        // a run of 2 bytes expands to at most MAX_RUN bytes, a larger raw size is a corrupt entry
+        if (entry.rawSize > payload.size * (MAX_RUN / 2)) return false;
+
+        // run length decode into planes, then interleave the planes again
+        std::vector<char> planes(entry.rawSize);
+        const unsigned char* src = reinterpret_cast<const unsigned char*>(payload.begin());
+        size_t pos = 0;
+        size_t out = 0;
+        while (pos < payload.size)
+        {
+            unsigned char control = src[pos++];
+            if (control < 128)
+            {
+                size_t count = (size_t) control + 1;
+                if (pos + count > payload.size || out + count > planes.size()) return false;
+                std::memcpy(planes.data() + out, src + pos, count);
+                pos += count;
+                out += count;
+            } else
+            {
+                size_t count = (size_t) control - 125;
+                if (pos >= payload.size || out + count > planes.size()) return false;
+                std::memset(planes.data() + out, src[pos++], count);
+                out += count;
+            }
+        }
+        if (out != planes.size()) return false;
+
+        char* buffer;
+        blob = HdBlob::allocate(entry.rawSize, &buffer);
+        unshuffle(planes.data(), buffer, entry.rawSize);
+        return true;
+    }
+    return false;
+}
+
+bool HdCacheFile::encodePayload(uint32_t codec, const HdBlob& blob, HdBlob& payload, HdCacheFileEntry& entry)
+{
+    entry.codec = codec;
+    entry.rawSize = blob.size;
+
+    if (codec == kCodecRaw)
+    {
+        payload = blob;
+    } else if (codec == kCodecShuffleRle)
+    {
+        // point and index data varies mostly in the low bytes, so the high byte planes compress well
+        std::vector<char> planes(blob.size);
+        shuffle(blob.begin(), planes.data(), blob.size);
+
+        std::vector<char> encoded;
+        encoded.reserve(blob.size / 2 + 16);
+        const unsigned char* src = reinterpret_cast<const unsigned char*>(planes.data());
+        size_t pos = 0;
+        while (pos < planes.size())
+        {
+            size_t run = 1;
+            while (pos + run < planes.size() && run < MAX_RUN && src[pos + run] == src[pos]) run++;
+
+            if (run >= 3)
+            {
+                encoded.push_back((char) (run + 125));
+                encoded.push_back((char) src[pos]);
+                pos += run;
+                continue;
+            }
+
+            // literal block up to the next run of at least 3
+            size_t start = pos;
+            while (pos < planes.size() && pos - start < 128)
+            {
+                if (pos + 2 < planes.size() && src[pos] == src[pos + 1] && src[pos] == src[pos + 2]) break;
+                pos++;
+            }
+            encoded.push_back((char) (pos - start - 1));
+            encoded.insert(encoded.end(), planes.data() + start, planes.data() + pos);
+        }
+        payload = HdBlob::copy(encoded.data(), encoded.size());
+    } else
+    {
+        return false;
+    }
+
+    entry.payloadSize = payload.size;
+    entry.checksum = hdChecksum64(payload.begin(), payload.size);
+    return true;
+}
+
+std::string HdCacheFile::codecName(uint32_t codec)
+{
+    switch (codec)
+    {
+        case kCodecRaw:         return "raw";
+        case kCodecShuffleRle:  return "shufflerle";
+        default:                return "unknown";
+    }
+}
+
+void HdCacheFile::setCodec(uint32_t codec)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    codec_ = codec;
+    if (fd_ >= 0 && writable_) indexDirty_ = true; // header is rewritten on flush
+}
+
+bool HdCacheFile::write(const std::string& poseId, const HdBlob& blob)
+{
+    HdBlob payload;
+    HdCacheFileEntry entry;
+    if (!encodePayload(codec_, blob, payload, entry)) return false;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    return appendRecord(poseId, payload.begin(), entry, 0);
+}
+
+bool HdCacheFile::writeEncoded(const std::string& poseId, const HdBlob& payload, const HdCacheFileEntry& entry)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return appendRecord(poseId, payload.begin(), entry, 0);
+}
+
+bool HdCacheFile::remove(const std::string& poseId)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (index_.find(poseId) == index_.end()) return false;
+
+    HdCacheFileEntry entry;
+    return appendRecord(poseId, "", entry, kRecordTombstone);
+}
+
+void HdCacheFile::forEachEntry(std::function<void(const std::string&, const HdCacheFileEntry&)> callback)
+{
+    std::vector<std::pair<std::string, HdCacheFileEntry>> entries;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries.assign(index_.begin(), index_.end());
+    }
+
+    // visit in file order, so streaming over large files reads sequentially
+    std::sort(entries.begin(), entries.end(),
+        [](const std::pair<std::string, HdCacheFileEntry>& a, const std::pair<std::string, HdCacheFileEntry>& b) {
+            return a.second.recordOffset < b.second.recordOffset;
+        });
+
+    for (size_t i=0; i<entries.size(); i++)
+    {
+        callback(entries[i].first, entries[i].second);
+    }
+}
@@ -34,12 +34,14 @@
 #include <maya/MUuid.h>
 
 #include "HdUtils.h"
+#include "HdPoseNode.h"
 
 MTypeId HdCacheNode::id(0x00151216);
 MObject HdCacheNode::aInMeshes;
 MObject HdCacheNode::aOutMeshes;
 MObject HdCacheNode::aInCacheId;
 MObject HdCacheNode::aInPoseId;
+MObject HdCacheNode::aCacheFile;
 
 HdCacheNode::HdCacheNode(): currentPoseValid(false), lastPoseId(""){}
 HdCacheNode::~HdCacheNode(){}
@@ -95,6 +97,24 @@ std::string HdCacheNode::getCacheId(MDataBlock& data, MStatus& status)
     }
 }
 
+std::string HdCacheNode::getRigTag(MStatus& status)
+{
+    // the rig tag lives on the pose node driving this cache node
+    MPlug poseIdPlug(thisMObject(), aInPoseId);
+    MPlugArray sourcePlugs;
+    poseIdPlug.connectedTo(sourcePlugs, true, false, &status);
+    if (status != MS::kSuccess || sourcePlugs.length() < 1)
+    {
+        status = MS::kNotFound;
+        return "";
+    }
+
+    MPlug rigTagPlug(sourcePlugs[0].node(), HdPoseNode::aInRigTag);
+    MString rigTag;
+    status = rigTagPlug.getValue(rigTag);
+    return rigTag.asChar();
+}
+
 MStatus HdCacheNode::skipCompute(const MPlug& plug, MDataBlock& data) 
 {
     MStatus status = MS::kSuccess;
@@ -108,30 +128,31 @@ MStatus HdCacheNode::preEvaluation(const  MDGContext& context, const MEvaluation
 {
     // Only check pose validity in normal content
     // Reference: https://knowledge.autodesk.com/search-result/caas/CloudHelp/cloudhelp/2017/ENU/Maya-SDK/py-ref/class-open-maya-1-1-m-d-g-context-html.html
+    // The instance state belongs to the normal context, other contexts (motion trails,
+    // ghosting, background evaluation) may run concurrently and keep no state.
+    if (!context.isNormal()) return MS::kSuccess;
+
     currentPoseValid = false;
     hdDisabled = false;
     
-    if( context.isNormal() ) 
-    {
-        MStatus status;
-        if(evaluationNode.dirtyPlugExists(aInPoseId, &status) && status)
-        {   
-            MPlug plug = evaluationNode.dirtyPlug(aInPoseId, &status);
-            CHECK_MSTATUS_AND_RETURN_IT(status);
-
-            std::string newPoseId = plug.asString().asChar();
-            log->debug("Pre-Eval - Dirty plug: {} // New Pose ID: '{}'", plug.info().asChar(), newPoseId);
-            
-            // Set current pose validation state
-            currentPoseValid = ((lastPoseId == newPoseId) && (newPoseId != ""));
-            hdDisabled = (newPoseId == "");
-            log->debug("Pre-Eval - Current Pose Valid: {}", currentPoseValid);
-        } else {
-            currentPoseValid = true;
-        }
+    MStatus status;
+    if(evaluationNode.dirtyPlugExists(aInPoseId, &status) && status)
+    {   
+        MPlug plug = evaluationNode.dirtyPlug(aInPoseId, &status);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+
+        std::string newPoseId = plug.asString().asChar();
+        log->debug("Pre-Eval - Dirty plug: {} // New Pose ID: '{}'", plug.info().asChar(), newPoseId);
+        
+        // Set current pose validation state
+        currentPoseValid = ((lastPoseId == newPoseId) && (newPoseId != ""));
+        hdDisabled = (newPoseId == "");
+        log->debug("Pre-Eval - Current Pose Valid: {}", currentPoseValid);
+    } else {
+        currentPoseValid = true;
     }
 
-    needsEvaluation = !HdUtils::playbackActive();
+    needsEvaluation = !HdUtils::cachingActive();
     log->debug("Needs evaluation: {}", needsEvaluation);
 
     return MS::kSuccess;
@@ -163,8 +184,9 @@ MStatus HdCacheNode::compute(const MPlug& plug, MDataBlock& data)
 {
     // init vars
     MStatus status;
+    bool normalContext = data.context().isNormal();
     
-    if (!instanceLog) 
+    if (!instanceLog && normalContext) 
     {
         std::string nodeName = HdUtils::getNodeName(thisMObject());
         if (nodeName != "") 
@@ -179,9 +201,10 @@ MStatus HdCacheNode::compute(const MPlug& plug, MDataBlock& data)
     // CHECK IF COMPUTE NEEDS TO RUN
     // ***********************************
 
-    if (currentPoseValid && !needsEvaluation){
+    if (normalContext && currentPoseValid && !needsEvaluation && !HdUtils::autoFillActive()){
         // skip compute since pose did not change since last eval
         log->debug("Current Pose ID identical to last. Skip compute for plug: {}", plug.info().asChar());
+        data.setClean(plug);
         return MS::kSuccess;
     }
 
@@ -214,13 +237,23 @@ MStatus HdCacheNode::compute(const MPlug& plug, MDataBlock& data)
     // CHECK IF CACHING OR BYPASSING
     // **********************************************
 
+    // other contexts are served from the cache, they only fill it while caching is active
+    bool contextBypass = false;
+    if (!normalContext && meshCache != nullptr)
+    {
+        std::string contextPoseId = data.inputValue(aInPoseId).asString().asChar();
+        contextBypass = contextPoseId.empty() || (!HdUtils::cachingActive() && !meshCache->exists(contextPoseId));
+    }
+
     if (stateData.asShort() == 1 || 
         meshCache == nullptr || 
-        needsEvaluation || 
-        hdDisabled ||
+        (normalContext && needsEvaluation && !HdUtils::cachingActive()) || 
+        (normalContext && hdDisabled) ||
+        contextBypass ||
         status != MS::kSuccess) 
     {       
        log->warn("Bypass cache node. Forced evaluation or invalid cache. Cache ID: '{}'", cacheId);
+       if (normalContext) lastPoseId.clear();
        status = skipCompute(plug, data);
        CHECK_MSTATUS(status);
        logExecutionTime(startTime);
@@ -233,6 +266,7 @@ MStatus HdCacheNode::compute(const MPlug& plug, MDataBlock& data)
     if (!cacheIdPlug.isConnected() || !poseIdPlug.isConnected())
     {
         log->warn("Bypass cache node. 'inCacheId' and / or 'inPoseId' not connected.");
+        if (normalContext) lastPoseId.clear();
         status = skipCompute(plug, data);
         CHECK_MSTATUS(status);
         logExecutionTime(startTime);
@@ -260,9 +294,22 @@ MStatus HdCacheNode::compute(const MPlug& plug, MDataBlock& data)
 
         status = setOutMeshes(data, meshCache, poseId, true);
         CHECK_MSTATUS(status);
+
+        // the outputs are the evaluated rig, a held pose can keep them
+        if (normalContext) lastPoseId = (status == MS::kSuccess) ? poseId : std::string();
         
         if(meshSetPtr) // ... if there is a valid mesh, store it
         {
+            // other contexts may run on evaluation threads, they only put into the tiers already attached
+            if (normalContext && (meshCache->sharedTierPending() || meshCache->daemonTierPending()))
+            {
+                // the topology is only known after the first evaluation
+                std::string rigTag = getRigTag(status);
+                CHECK_MSTATUS(status);
+                if (meshCache->sharedTierPending()) meshCache->attachSharedTier(rigTag, meshSetPtr->topologyHash());
+                if (meshCache->daemonTierPending()) meshCache->attachDaemonTier(rigTag, meshSetPtr->topologyHash());
+            }
+
             meshCache->put(poseId, meshSetPtr);
             log->info("Stored new pose cache. Pose ID: {} (Cache Size: '{}')", poseId, meshCache->size());
         }
@@ -272,6 +319,7 @@ MStatus HdCacheNode::compute(const MPlug& plug, MDataBlock& data)
         log->debug("Retrieve Pose Cache: {}", poseId);
         status = setOutMeshes(data, meshCache, poseId, false);
         CHECK_MSTATUS(status);
+        if (normalContext) lastPoseId = (status == MS::kSuccess) ? poseId : std::string();
     }
 
     // remove dirty so it won't be recalculated
@@ -572,10 +620,17 @@ MStatus HdCacheNode::initialize()
     // OUTPUT - MESHES
     aOutMeshes = tAttr.create("outMeshes", "outMeshes", MFnData::kMesh);
     tAttr.setWritable(false); // disable input
-    tAttr.setStorable(true);
+    tAttr.setStorable(false); // poses live in the sidecar cache file, see HdSceneCallbacks
     tAttr.setHidden(false);
     tAttr.setArray(true);
     addAttribute(aOutMeshes);
 
+    // SIDECAR CACHE FILE (relative to the scene directory)
+    aCacheFile = tAttr.create("cacheFile", "cacheFile", MFnData::kString);
+    tAttr.setStorable(true);  // store in file
+    tAttr.setConnectable(false);
+    tAttr.setHidden(false);
+    addAttribute(aCacheFile);
+
     return MS::kSuccess;
 }
\ No newline at end of file
@@ -0,0 +1,343 @@
+//
+// -----------------------------------------------------------------------------
+// This source file has been developed within the scope of the
+// Technical Director course at Filmakademie Baden-Wuerttemberg.
+// http://technicaldirector.de
+//
+// Written by Tim Lehr
+// Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+// -----------------------------------------------------------------------------
+//
+
+#include "HdCacheProtocol.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdlib>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+
+// memfd_create and file seals are called directly, older glibc versions do not wrap them
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+#ifndef MFD_ALLOW_SEALING
+#define MFD_ALLOW_SEALING 0x0002U
+#endif
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS 1033
+#define F_SEAL_SEAL 0x0001
+#define F_SEAL_SHRINK 0x0002
+#define F_SEAL_GROW 0x0004
+#define F_SEAL_WRITE 0x0008
+#endif
+#ifndef F_GET_SEALS
+#define F_GET_SEALS 1034
+#endif
+#if !defined(__NR_memfd_create) && defined(__x86_64__)
+#define __NR_memfd_create 319
+#endif
+
+namespace
+{
+    bool writeAll(int fd, const char* data, size_t size)
+    {
+        while (size > 0)
+        {
+            ssize_t result = ::send(fd, data, size, MSG_NOSIGNAL);
+            if (result < 0 && errno == EINTR) continue;
+            if (result <= 0) return false;
+            data += result;
+            size -= result;
+        }
+        return true;
+    }
+
+    bool readAll(int fd, char* data, size_t size)
+    {
+        while (size > 0)
+        {
+            ssize_t result = ::recv(fd, data, size, 0);
+            if (result < 0 && errno == EINTR) continue;
+            if (result <= 0) return false;
+            data += result;
+            size -= result;
+        }
+        return true;
+    }
+
+    bool fillAddress(const std::string& path, sockaddr_un& address)
+    {
+        std::memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(address.sun_path)) return false;
+        std::memcpy(address.sun_path, path.c_str(), path.size());
+        return true;
+    }
+}
+
+/***********************************************
+ * HDCACHEMESSAGE
+ * ********************************************/
+
+HdCacheMessage::HdCacheMessage()
+{
+    reset(0, 0, 0);
+}
+
+HdCacheMessage::~HdCacheMessage()
+{
+    closeFds();
+}
+
+void HdCacheMessage::reset(uint16_t op, uint32_t count, uint64_t requestId)
+{
+    closeFds();
+    body.clear();
+    header.magic = HD_CACHEPROTO_MAGIC;
+    header.version = HD_CACHEPROTO_VERSION;
+    header.op = op;
+    header.count = count;
+    header.bodySize = 0;
+    header.requestId = requestId;
+}
+
+void HdCacheMessage::closeFds()
+{
+    for (size_t i=0; i<fds.size(); i++)
+    {
+        if (fds[i] >= 0) ::close(fds[i]);
+    }
+    fds.clear();
+}
+
+void HdCacheMessage::appendKey(const std::string& key)
+{
+    append((uint16_t) key.size());
+    body.append(key);
+}
+
+bool HdCacheBodyReader::readKey(std::string& key)
+{
+    uint16_t keySize;
+    if (!read(keySize)) return false;
+    return readBytes(keySize, key);
+}
+
+bool HdCacheBodyReader::readBytes(size_t size, std::string& bytes)
+{
+    if (!valid_ || pos_ + size > body_.size()) return valid_ = false;
+    bytes.assign(body_.data() + pos_, size);
+    pos_ += size;
+    return true;
+}
+
+/***********************************************
+ * HDCACHEPROTOCOL
+ * ********************************************/
+
+bool HdCacheProtocol::sendMessage(int sock, const HdCacheMessage& message)
+{
+    if (message.fds.size() > HD_CACHEPROTO_MAX_BATCH || message.body.size() > HD_CACHEPROTO_MAX_BODY) return false;
+
+    HdCacheMsgHeader header = message.header;
+    header.bodySize = (uint32_t) message.body.size();
+
+    iovec iov[2];
+    iov[0].iov_base = &header;
+    iov[0].iov_len = sizeof(header);
+    iov[1].iov_base = const_cast<char*>(message.body.data());
+    iov[1].iov_len = message.body.size();
+
+    msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = message.body.empty() ? 1 : 2;
+
+    // fds travel with the first byte of the header
+    std::vector<char> control;
+    if (!message.fds.empty())
+    {
+        size_t fdBytes = message.fds.size() * sizeof(int);
+        control.resize(CMSG_SPACE(fdBytes), 0);
+        msg.msg_control = control.data();
+        msg.msg_controllen = control.size();
+
+        cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(fdBytes);
+        std::memcpy(CMSG_DATA(cmsg), message.fds.data(), fdBytes);
+    }
+
+    ssize_t sent;
+    do
+    {
+        sent = ::sendmsg(sock, &msg, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+    if (sent < 0) return false;
+
+    // finish partial writes without ancillary data
+    size_t total = sizeof(header) + message.body.size();
+    if ((size_t) sent >= total) return true;
+    if ((size_t) sent < sizeof(header))
+    {
+        if (!writeAll(sock, reinterpret_cast<const char*>(&header) + sent, sizeof(header) - sent)) return false;
+        return writeAll(sock, message.body.data(), message.body.size());
+    }
+    size_t bodySent = sent - sizeof(header);
+    return writeAll(sock, message.body.data() + bodySent, message.body.size() - bodySent);
+}
+
+bool HdCacheProtocol::recvMessage(int sock, HdCacheMessage& message)
+{
+    message.reset(0, 0, 0);
+
+    iovec iov;
+    iov.iov_base = &message.header;
+    iov.iov_len = sizeof(message.header);
+
+    std::vector<char> control(CMSG_SPACE(HD_CACHEPROTO_MAX_BATCH * sizeof(int)), 0);
+    msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.data();
+    msg.msg_controllen = control.size();
+
+    ssize_t received;
+    do
+    {
+        received = ::recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    } while (received < 0 && errno == EINTR);
+    if (received <= 0) return false;
+
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) continue;
+        size_t fdCount = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        const int* fds = reinterpret_cast<const int*>(CMSG_DATA(cmsg));
+        message.fds.insert(message.fds.end(), fds, fds + fdCount);
+    }
+
+    if ((size_t) received < sizeof(message.header) &&
+        !readAll(sock, reinterpret_cast<char*>(&message.header) + received, sizeof(message.header) - received))
+    {
+        return false;
+    }
+
+    if (message.header.magic != HD_CACHEPROTO_MAGIC || message.header.version != HD_CACHEPROTO_VERSION ||
+        message.header.bodySize > HD_CACHEPROTO_MAX_BODY || (msg.msg_flags & MSG_CTRUNC))
+    {
+        return false;
+    }
+
+    message.body.resize(message.header.bodySize);
+    return readAll(sock, &message.body[0], message.body.size());
+}
+
+std::string HdCacheProtocol::defaultSocketPath()
+{
+    const char* path = std::getenv("HD_CACHED_SOCKET");
+    if (path != nullptr && path[0] != '\0') return path;
+
+    const char* runtimeDir = std::getenv("XDG_RUNTIME_DIR");
+    if (runtimeDir != nullptr && runtimeDir[0] != '\0') return std::string(runtimeDir) + "/hyperdrive-cached.sock";
+    return "/tmp/hyperdrive-cached-" + std::to_string(::getuid()) + ".sock";
+}
+
+int HdCacheProtocol::connectSocket(const std::string& path)
+{
+    sockaddr_un address;
+    if (!fillAddress(path, address)) return -1;
+
+    int sock = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0) return -1;
+
+    if (::connect(sock, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+    {
+        ::close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+int HdCacheProtocol::listenSocket(const std::string& path)
+{
+    sockaddr_un address;
+    if (!fillAddress(path, address)) return -1;
+
+    int sock = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sock < 0) return -1;
+
+    // remove a socket file left behind by a previous daemon
+    ::unlink(path.c_str());
+    if (::bind(sock, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(sock, 64) != 0)
+    {
+        ::close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+int HdCacheProtocol::createPayloadFd(const HdBlob& blob)
+{
+#ifdef __NR_memfd_create
+    int fd = (int) ::syscall(__NR_memfd_create, "hyperdrive-pose", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) return -1;
+
+    size_t written = 0;
+    while (written < blob.size)
+    {
+        ssize_t result = ::write(fd, blob.begin() + written, blob.size - written);
+        if (result < 0 && errno == EINTR) continue;
+        if (result <= 0)
+        {
+            ::close(fd);
+            return -1;
+        }
+        written += result;
+    }
+
+    // the receiver can rely on the content never changing
+    if (::fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0)
+    {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+#else
+    return -1;
+#endif
+}
+
+bool HdCacheProtocol::validatePayloadFd(int fd, size_t size)
+{
+    // an unsealed or short fd could change under a mapping (SIGBUS), refuse it
+    struct stat fdStat;
+    int seals = ::fcntl(fd, F_GET_SEALS);
+    if (seals < 0 || (seals & (F_SEAL_SHRINK | F_SEAL_WRITE)) != (F_SEAL_SHRINK | F_SEAL_WRITE)) return false;
+    return ::fstat(fd, &fdStat) == 0 && (size_t) fdStat.st_size >= size;
+}
+
+bool HdCacheProtocol::mapPayloadFd(int fd, size_t size, HdBlob& blob)
+{
+    if (size == 0)
+    {
+        blob = HdBlob::copy("", 0);
+        return true;
+    }
+
+    if (!validatePayloadFd(fd, size)) return false;
+
+    void* ptr = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (ptr == MAP_FAILED) return false;
+
+    std::shared_ptr<const char> data((const char*) ptr, [size](const char* p) { ::munmap((void*) p, size); });
+    blob = HdBlob(data, size);
+    return true;
+}
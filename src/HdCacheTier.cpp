@@ -0,0 +1,59 @@
+//
+// -----------------------------------------------------------------------------
+// This source file has been developed within the scope of the
+// Technical Director course at Filmakademie Baden-Wuerttemberg.
+// http://technicaldirector.de
+//
+// Written by Tim Lehr
+// Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+// -----------------------------------------------------------------------------
+//
+
+#include "HdCacheTier.h"
+
+namespace
+{
+    const uint64_t CHECKSUM_PRIME_1 = 0x9E3779B185EBCA87ULL;
+    const uint64_t CHECKSUM_PRIME_2 = 0xC2B2AE3D27D4EB4FULL;
+
+    inline uint64_t rotl64(uint64_t x, int r)
+    {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    inline uint64_t mixWord(uint64_t hash, uint64_t word)
+    {
+        word *= CHECKSUM_PRIME_2;
+        word = rotl64(word, 31);
+        word *= CHECKSUM_PRIME_1;
+        hash ^= word;
+        return rotl64(hash, 27) * CHECKSUM_PRIME_1 + 0x165667B19E3779F9ULL;
+    }
+}
+
+uint64_t hdChecksum64(const char* data, size_t size)
+{
+    // word-wise mixing, so verifying large cache files stays I/O bound
+    uint64_t hash = CHECKSUM_PRIME_1 ^ (uint64_t) size;
+    size_t wordCount = size / sizeof(uint64_t);
+
+    for (size_t i=0; i<wordCount; i++)
+    {
+        uint64_t word;
+        std::memcpy(&word, data + i * sizeof(uint64_t), sizeof(uint64_t));
+        hash = mixWord(hash, word);
+    }
+
+    uint64_t tail = 0;
+    size_t tailSize = size - wordCount * sizeof(uint64_t);
+    if (tailSize > 0)
+    {
+        std::memcpy(&tail, data + wordCount * sizeof(uint64_t), tailSize);
+        hash = mixWord(hash, tail);
+    }
+
+    hash ^= hash >> 33;
+    hash *= CHECKSUM_PRIME_2;
+    hash ^= hash >> 29;
+    return hash;
+}
@@ -11,9 +11,67 @@
 
 #include "HdCommands.h"
 #include "HdMeshCache.h"
+#include "HdPrefetcher.h"
+#include "HdAutoFill.h"
+#include "HdCoverage.h"
+#include "HdPoseMemo.h"
+#include "HdRigFingerprint.h"
+#include "HdControlWatch.h"
+#include "HdReplay.h"
+#include "HdRealtime.h"
+#include "HdGeoExporter.h"
+#include "HdBaker.h"
+#include "HdPoseNode.h"
+#include "HdEvaluator.h"
+#include "HdSceneRegistry.h"
 
 #include <maya/MGlobal.h>
 #include <maya/MObject.h>
+#include <maya/MObjectArray.h>
+#include <maya/MAnimControl.h>
+#include <maya/MSelectionList.h>
+#include <maya/MFnDependencyNode.h>
+#include <maya/MFnAttribute.h>
+#include <maya/MNamespace.h>
+
+#include <algorithm>
+
+namespace
+{
+    // transform channels captured by a control matrix, the rotate channels stay scalar
+    // since a matrix does not tell rotations a full turn apart
+    const std::set<std::string> MATRIX_CHANNELS = {
+        "translate", "translateX", "translateY", "translateZ",
+        "scale", "scaleX", "scaleY", "scaleZ",
+        "shear", "shearXY", "shearXZ", "shearYZ",
+    };
+
+    // array input of the pose node, connected in the next free elements
+    struct ArrayInput
+    {
+        MPlug                           plug;
+        unsigned int                    nextIndex = 0;
+        std::set<std::string>           sources;
+
+        ArrayInput(const MPlug& arrayPlug): plug(arrayPlug)
+        {
+            for (unsigned int i=0; i<plug.numElements(); i++)
+            {
+                MPlug elementPlug = plug.elementByPhysicalIndex(i);
+                nextIndex = std::max(nextIndex, elementPlug.logicalIndex() + 1);
+                MPlug source = elementPlug.source();
+                if (!source.isNull()) sources.insert(source.name().asChar());
+            }
+        }
+
+        // false if the source is connected already or the connection is invalid
+        bool connect(MDGModifier& dgModifier, const MPlug& source)
+        {
+            if (!sources.insert(source.name().asChar()).second) return false;
+            return dgModifier.connect(source, plug.elementByLogicalIndex(nextIndex++)) == MS::kSuccess;
+        }
+    };
+}
 
 HdCmdCache::HdCmdCache(){}
 HdCmdCache::~HdCmdCache(){}
@@ -21,6 +79,22 @@ HdCmdStats::HdCmdStats(){}
 HdCmdStats::~HdCmdStats(){}
 HdCmdLog::HdCmdLog(){}
 HdCmdLog::~HdCmdLog(){}
+HdCmdPrefetch::HdCmdPrefetch(){}
+HdCmdPrefetch::~HdCmdPrefetch(){}
+HdCmdAutoFill::HdCmdAutoFill(){}
+HdCmdAutoFill::~HdCmdAutoFill(){}
+HdCmdCoverage::HdCmdCoverage(){}
+HdCmdCoverage::~HdCmdCoverage(){}
+HdCmdExport::HdCmdExport(){}
+HdCmdExport::~HdCmdExport(){}
+HdCmdReplay::HdCmdReplay(){}
+HdCmdReplay::~HdCmdReplay(){}
+HdCmdRealtime::HdCmdRealtime(){}
+HdCmdRealtime::~HdCmdRealtime(){}
+HdCmdSetup::HdCmdSetup(){}
+HdCmdSetup::~HdCmdSetup(){}
+HdCmdInteractive::HdCmdInteractive(){}
+HdCmdInteractive::~HdCmdInteractive(){}
 
 void* HdCmdCache::creator()
 {
@@ -34,7 +108,14 @@ MStatus HdCmdCache::doIt( const MArgList& args )
     MString help("Usage: \"hdCache [cache_id] -myFlag\"\n\n " \
     "Available flags:\n" \
     "hdCache some-cache-id -clear\n" \
-    "hdCache some-cache-id -setMaxMemSize 1024000");
+    "hdCache some-cache-id -setMaxMemSize 1024000\n" \
+    "hdCache some-cache-id -diskTier /path/to/cache.hdc\n" \
+    "hdCache some-cache-id -detachDiskTier\n" \
+    "hdCache some-cache-id -sharedTier 2048 (segment size in MB)\n" \
+    "hdCache some-cache-id -detachSharedTier\n" \
+    "hdCache some-cache-id -daemonTier [/path/to/socket]\n" \
+    "hdCache some-cache-id -detachDaemonTier\n" \
+    "hdCache [some-cache-id] -bake 1001 2000 -workers 8 (all caches if no cache ID is given)");
     std::shared_ptr<HdMeshCache> meshCache;
     // Parse the arguments.
 
@@ -45,6 +126,11 @@ MStatus HdCmdCache::doIt( const MArgList& args )
     }
 
     std::string cacheId = args.asString( 0, &status ).asChar();
+
+    if (cacheId == "-bake")
+    {
+        return doBake(args, 0, std::set<std::string>(), help);
+    }
     
 
     if (status != MS::kSuccess || !HdCacheMap::exists(cacheId)) 
@@ -69,6 +155,61 @@ MStatus HdCmdCache::doIt( const MArgList& args )
             if ( MS::kSuccess == status )
                 meshCache->setMaxMemSize(size);
         }
+        else if ( MString( "-diskTier" ) == args.asString( i, &status ) && MS::kSuccess == status )
+        {
+            MString path = args.asString( ++i, &status );
+            CHECK_MSTATUS_AND_RETURN_IT(status);
+
+            status = meshCache->attachDiskTier(path.asChar());
+            if (status != MS::kSuccess)
+            {
+                displayError(MString("Failed to open disk tier: ") + path);
+                return status;
+            }
+        }
+        else if ( MString( "-detachDiskTier" ) == args.asString( i, &status ) && MS::kSuccess == status )
+        {
+            meshCache->detachDiskTier();
+        }
+        else if ( MString( "-sharedTier" ) == args.asString( i, &status ) && MS::kSuccess == status )
+        {
+            double sizeMb = args.asDouble( ++i, &status );
+            if ( MS::kSuccess != status || sizeMb <= 0.0 )
+            {
+                displayError(MString("Invalid shared memory segment size.\n\n") + help);
+                return MS::kFailure;
+            }
+            meshCache->enableSharedTier((size_t) (sizeMb * 1024.0 * 1024.0));
+        }
+        else if ( MString( "-detachSharedTier" ) == args.asString( i, &status ) && MS::kSuccess == status )
+        {
+            meshCache->enableSharedTier(0);
+            meshCache->detachSharedTier();
+        }
+        else if ( MString( "-daemonTier" ) == args.asString( i, &status ) && MS::kSuccess == status )
+        {
+            // the socket path is optional
+            std::string socketPath = HdCacheProtocol::defaultSocketPath();
+            if (i + 1 < args.length())
+            {
+                MString path = args.asString( i + 1, &status );
+                if (MS::kSuccess == status && path.length() > 0 && path.asChar()[0] != '-')
+                {
+                    socketPath = path.asChar();
+                    i++;
+                }
+            }
+            meshCache->enableDaemonTier(socketPath);
+        }
+        else if ( MString( "-detachDaemonTier" ) == args.asString( i, &status ) && MS::kSuccess == status )
+        {
+            meshCache->enableDaemonTier("");
+            meshCache->detachDaemonTier();
+        }
+        else if ( MString( "-bake" ) == args.asString( i, &status ) && MS::kSuccess == status )
+        {
+            return doBake(args, i, std::set<std::string>(&cacheId, &cacheId + 1), help);
+        }
         else
         {
             displayError(MString("Invalid arguments.\n\n") + help);
@@ -78,6 +219,41 @@ MStatus HdCmdCache::doIt( const MArgList& args )
     return MS::kSuccess;
 }
 
+MStatus HdCmdCache::doBake(const MArgList& args, unsigned int flagIndex, const std::set<std::string>& cacheIds, const MString& help)
+{
+    MStatus status;
+    double start = args.asDouble( flagIndex + 1, &status );
+    double end = MS::kSuccess == status ? args.asDouble( flagIndex + 2, &status ) : 0.0;
+    if (MS::kSuccess != status || end < start)
+    {
+        displayError(MString("Invalid bake frame range.\n\n") + help);
+        return MS::kFailure;
+    }
+
+    int workers = 1;
+    if (flagIndex + 3 < args.length())
+    {
+        if (MString( "-workers" ) != args.asString( flagIndex + 3, &status ))
+        {
+            displayError(MString("Invalid arguments.\n\n") + help);
+            return MS::kFailure;
+        }
+        workers = args.asInt( flagIndex + 4, &status );
+        if (MS::kSuccess != status || workers < 1)
+        {
+            displayError(MString("Invalid worker count.\n\n") + help);
+            return MS::kFailure;
+        }
+    }
+
+    std::string report;
+    status = HdBaker::bake(start, end, (unsigned int) workers, cacheIds, report);
+    if (status == MS::kSuccess) displayInfo(MString(report.c_str()));
+    else displayError(MString(report.c_str()));
+    setResult(MString(report.c_str()));
+    return status;
+}
+
 void* HdCmdStats::creator()
 {
     // Maya internal function used to allocate memory etc.
@@ -89,7 +265,11 @@ MStatus HdCmdStats::doIt( const MArgList& args )
     MStatus status;
     MString help("Usage: \"hdStats -json\"\n\n " \
     "Available flags:\n" \
-    "hdStats -json");
+    "hdStats -json\n" \
+    "hdStats -poseMemo\n" \
+    "hdStats -rigFingerprint\n" \
+    "hdStats -evaluator\n" \
+    "hdStats -registry");
 
      // Parse the arguments.
     for ( int i = 0; i < args.length(); i++ )
@@ -98,6 +278,26 @@ MStatus HdCmdStats::doIt( const MArgList& args )
         {
             MString result(HdCacheMap::getStatsJson().c_str());
             setResult(result);
+        }
+        else if ( MString( "-poseMemo" ) == args.asString( i, &status ) && MS::kSuccess == status )
+        {
+            MString result(HdPoseMemo::getAllStatsJson().c_str());
+            setResult(result);
+        }
+        else if ( MString( "-rigFingerprint" ) == args.asString( i, &status ) && MS::kSuccess == status )
+        {
+            MString result(HdRigFingerprint::getAllStatsJson().c_str());
+            setResult(result);
+        }
+        else if ( MString( "-evaluator" ) == args.asString( i, &status ) && MS::kSuccess == status )
+        {
+            MString result(HdEvaluator::getStatsJson().c_str());
+            setResult(result);
+        }
+        else if ( MString( "-registry" ) == args.asString( i, &status ) && MS::kSuccess == status )
+        {
+            MString result(HdSceneRegistry::instance().getStatsJson().c_str());
+            setResult(result);
         } else
         {
             displayError( MString("Invalid arguments.\n\n") + help );
@@ -141,4 +341,621 @@ MStatus HdCmdLog::doIt( const MArgList& args )
     status = MS::kInvalidParameter;
     displayError(MString("Invalid arguments.\n\n") + help);
     return MS::kSuccess;
-}
\ No newline at end of file
+}
+
+void* HdCmdPrefetch::creator()
+{
+    // Maya internal function used to allocate memory etc.
+    return new HdCmdPrefetch;
+}
+
+MStatus HdCmdPrefetch::doIt( const MArgList& args )
+{
+    MStatus status;
+    MString help("Usage: \"hdPrefetch -myFlag\"\n\n " \
+    "Available flags:\n" \
+    "hdPrefetch -enable [0 / 1] (off by default, looks ahead during playback)\n" \
+    "hdPrefetch -maxLookahead 48\n" \
+    "hdPrefetch -stats");
+
+    HdPrefetcher& prefetcher = HdPrefetcher::instance();
+
+    if (args.length() == 0)
+    {
+        displayError(MString("Invalid arguments.\n\n") + help);
+        return MS::kFailure;
+    }
+
+     // Parse the arguments.
+    for ( int i = 0; i < args.length(); i++ )
+    {
+        if ( MString( "-enable" ) == args.asString( i, &status ) && MS::kSuccess == status )
+        {
+            bool enable = args.asBool( ++i, &status );
+            CHECK_MSTATUS_AND_RETURN_IT(status);
+            prefetcher.setEnabled(enable);
+        }
+        else if ( MString( "-maxLookahead" ) == args.asString( i, &status ) && MS::kSuccess == status )
+        {
+            int frames = args.asInt( ++i, &status );
+            if ( MS::kSuccess != status || frames < 0 )
+            {
+                displayError(MString("Invalid lookahead.\n\n") + help);
+                return MS::kFailure;
+            }
+            prefetcher.setMaxLookahead((unsigned int) frames);
+        }
+        else if ( MString( "-stats" ) == args.asString( i, &status ) && MS::kSuccess == status )
+        {
+            MString result(prefetcher.getStatsJson().c_str());
+            setResult(result);
+        }
+        else
+        {
+            displayError(MString("Invalid arguments.\n\n") + help);
+            return MS::kFailure;
+        }
+    }
+    return MS::kSuccess;
+}
+
+void* HdCmdAutoFill::creator()
+{
+    // Maya internal function used to allocate memory etc.
+    return new HdCmdAutoFill;
+}
+
+MStatus HdCmdAutoFill::doIt( const MArgList& args )
+{
+    MStatus status;
+    MString help("Usage: \"hdAutoFill -myFlag\"\n\n " \
+    "Available flags:\n" \
+    "hdAutoFill -enable [0 / 1]\n" \
+    "hdAutoFill -budget 20 (milliseconds per idle slice)\n" \
+    "hdAutoFill -stats");
+
+    HdAutoFill& autoFill = HdAutoFill::instance();
+
+    if (args.length() == 0)
+    {
+        displayError(MString("Invalid arguments.\n\n") + help);
+        return MS::kFailure;
+    }
+
+     // Parse the arguments.
+    for ( int i = 0; i < args.length(); i++ )
+    {
+        if ( MString( "-enable" ) == args.asString( i, &status ) && MS::kSuccess == status )
+        {
+            bool enable = args.asBool( ++i, &status );
+            CHECK_MSTATUS_AND_RETURN_IT(status);
+            autoFill.setEnabled(enable);
+        }
+        else if ( MString( "-budget" ) == args.asString( i, &status ) && MS::kSuccess == status )
+        {
+            double budget = args.asDouble( ++i, &status );
+            if ( MS::kSuccess != status || budget <= 0.0 )
+            {
+                displayError(MString("Invalid budget.\n\n") + help);
+                return MS::kFailure;
+            }
+            autoFill.setBudget(budget);
+        }
+        else if ( MString( "-stats" ) == args.asString( i, &status ) && MS::kSuccess == status )
+        {
+            MString result(autoFill.getStatsJson().c_str());
+            setResult(result);
+        }
+        else
+        {
+            displayError(MString("Invalid arguments.\n\n") + help);
+            return MS::kFailure;
+        }
+    }
+    return MS::kSuccess;
+}
+
+void* HdCmdCoverage::creator()
+{
+    // Maya internal function used to allocate memory etc.
+    return new HdCmdCoverage;
+}
+
+MStatus HdCmdCoverage::doIt( const MArgList& args )
+{
+    MStatus status;
+    MString help("Usage: \"hdCoverage -myFlag\"\n\n " \
+    "Returns the cache coverage of a frame range as JSON. Defaults to the playback range.\n" \
+    "Available flags:\n" \
+    "hdCoverage -start 1001 -end 1100\n" \
+    "hdCoverage -step 0.5\n" \
+    "hdCoverage -node hyperdrivePose1");
+
+    double start = MAnimControl::minTime().value();
+    double end = MAnimControl::maxTime().value();
+    double step = 1.0;
+    MObjectArray poseNodes;
+
+     // Parse the arguments.
+    for ( int i = 0; i < args.length(); i++ )
+    {
+        MString flag = args.asString( i, &status );
+        if ( MS::kSuccess != status || i + 1 >= (int) args.length() )
+        {
+            displayError(MString("Invalid arguments.\n\n") + help);
+            return MS::kFailure;
+        }
+
+        if ( MString( "-start" ) == flag ) start = args.asDouble( ++i, &status );
+        else if ( MString( "-end" ) == flag ) end = args.asDouble( ++i, &status );
+        else if ( MString( "-step" ) == flag ) step = args.asDouble( ++i, &status );
+        else if ( MString( "-node" ) == flag )
+        {
+            MSelectionList selection;
+            MObject oPoseNode;
+            status = selection.add( args.asString( ++i ) );
+            if ( MS::kSuccess == status ) status = selection.getDependNode( 0, oPoseNode );
+            if ( MS::kSuccess != status || MFnDependencyNode( oPoseNode ).typeId() != HdPoseNode::id )
+            {
+                displayError(MString("Not a hyperdrivePose node: ") + args.asString( i ));
+                return MS::kFailure;
+            }
+            poseNodes.append(oPoseNode);
+        }
+        else status = MS::kFailure;
+
+        if ( MS::kSuccess != status )
+        {
+            displayError(MString("Invalid arguments.\n\n") + help);
+            return MS::kFailure;
+        }
+    }
+
+    if ( step <= 0.0 || end < start )
+    {
+        displayError(MString("Invalid frame range.\n\n") + help);
+        return MS::kFailure;
+    }
+
+    if ( poseNodes.length() == 0 )
+    {
+        poseNodes = HdCoverage::poseNodes(status);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+    }
+
+    std::string json;
+    status = HdCoverage::build(start, end, step, poseNodes, json);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    setResult(MString(json.c_str()));
+    return MS::kSuccess;
+}
+
+void* HdCmdExport::creator()
+{
+    // Maya internal function used to allocate memory etc.
+    return new HdCmdExport;
+}
+
+MStatus HdCmdExport::doIt( const MArgList& args )
+{
+    MStatus status;
+    MString help("Usage: \"hdExport cache_id -file /path/to/geo.hdgeo\"\n\n " \
+    "Exports the cached poses of a frame range as a geometry stream. Defaults to the playback range.\n" \
+    "Available flags:\n" \
+    "hdExport some-cache-id -file /path/to/geo.hdgeo -start 1001 -end 1100\n" \
+    "hdExport some-cache-id -file /path/to/geo.hdgeo -step 0.5");
+
+    if (args.length() < 3)
+    {
+        displayError(MString("Invalid arguments.\n\n") + help);
+        return MS::kFailure;
+    }
+
+    MString cacheId = args.asString( 0, &status );
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    double start = MAnimControl::minTime().value();
+    double end = MAnimControl::maxTime().value();
+    double step = 1.0;
+    MString path;
+
+     // Parse the arguments.
+    for ( int i = 1; i < args.length(); i++ )
+    {
+        MString flag = args.asString( i, &status );
+        if ( MS::kSuccess != status || i + 1 >= (int) args.length() )
+        {
+            displayError(MString("Invalid arguments.\n\n") + help);
+            return MS::kFailure;
+        }
+
+        if ( MString( "-file" ) == flag ) path = args.asString( ++i, &status );
+        else if ( MString( "-start" ) == flag ) start = args.asDouble( ++i, &status );
+        else if ( MString( "-end" ) == flag ) end = args.asDouble( ++i, &status );
+        else if ( MString( "-step" ) == flag ) step = args.asDouble( ++i, &status );
+        else status = MS::kFailure;
+
+        if ( MS::kSuccess != status )
+        {
+            displayError(MString("Invalid arguments.\n\n") + help);
+            return MS::kFailure;
+        }
+    }
+
+    if ( path.length() == 0 || step <= 0.0 || end < start )
+    {
+        displayError(MString("Invalid file or frame range.\n\n") + help);
+        return MS::kFailure;
+    }
+
+    std::string json;
+    status = HdGeoExporter::exportCache(cacheId.asChar(), path.asChar(), start, end, step, json);
+    if ( MS::kSuccess != status )
+    {
+        displayError(MString("Export of cache '") + cacheId + "' failed, see the log for details.");
+        return status;
+    }
+    setResult(MString(json.c_str()));
+    return MS::kSuccess;
+}
+
+void* HdCmdReplay::creator()
+{
+    // Maya internal function used to allocate memory etc.
+    return new HdCmdReplay;
+}
+
+MStatus HdCmdReplay::doIt( const MArgList& args )
+{
+    MStatus status;
+    MString help("Usage: \"hdReplay -myFlag\"\n\n " \
+    "Serves the sidecar caches read-only for batch and farm renders.\n" \
+    "Available flags:\n" \
+    "hdReplay -enable [0 / 1]\n" \
+    "hdReplay -writeBack [0 / 1] (store missed poses in a shard per process)\n" \
+    "hdReplay -subframes \"-0.25,0.25\" (motion blur offsets to key)\n" \
+    "hdReplay -stats");
+
+    HdReplay& replay = HdReplay::instance();
+
+    if (args.length() == 0)
+    {
+        displayError(MString("Invalid arguments.\n\n") + help);
+        return MS::kFailure;
+    }
+
+     // Parse the arguments.
+    for ( int i = 0; i < args.length(); i++ )
+    {
+        if ( MString( "-enable" ) == args.asString( i, &status ) && MS::kSuccess == status )
+        {
+            bool enable = args.asBool( ++i, &status );
+            CHECK_MSTATUS_AND_RETURN_IT(status);
+            replay.setEnabled(enable);
+        }
+        else if ( MString( "-writeBack" ) == args.asString( i, &status ) && MS::kSuccess == status )
+        {
+            bool writeBack = args.asBool( ++i, &status );
+            CHECK_MSTATUS_AND_RETURN_IT(status);
+            replay.setWriteBack(writeBack);
+        }
+        else if ( MString( "-subframes" ) == args.asString( i, &status ) && MS::kSuccess == status )
+        {
+            MString offsets = args.asString( ++i, &status );
+            if ( MS::kSuccess == status ) status = replay.setSubframes(offsets.asChar());
+            if ( MS::kSuccess != status )
+            {
+                displayError(MString("Invalid subframes.\n\n") + help);
+                return MS::kFailure;
+            }
+        }
+        else if ( MString( "-stats" ) == args.asString( i, &status ) && MS::kSuccess == status )
+        {
+            MString result(replay.getStatsJson().c_str());
+            setResult(result);
+        }
+        else
+        {
+            displayError(MString("Invalid arguments.\n\n") + help);
+            return MS::kFailure;
+        }
+    }
+    return MS::kSuccess;
+}
+
+void* HdCmdRealtime::creator()
+{
+    // Maya internal function used to allocate memory etc.
+    return new HdCmdRealtime;
+}
+
+MStatus HdCmdRealtime::doIt( const MArgList& args )
+{
+    MStatus status;
+    MString help("Usage: \"hdRealtime -myFlag\"\n\n " \
+    "Holds the playback frame rate, missed poses over the frame budget show the nearest cached pose.\n" \
+    "Available flags:\n" \
+    "hdRealtime -enable [0 / 1]\n" \
+    "hdRealtime -fps [frames per second] (0 uses the scene frame rate)\n" \
+    "hdRealtime -stats\n" \
+    "hdRealtime -frames (per-frame record of the last playback)");
+
+    HdRealtime& realtime = HdRealtime::instance();
+
+    if (args.length() == 0)
+    {
+        displayError(MString("Invalid arguments.\n\n") + help);
+        return MS::kFailure;
+    }
+
+     // Parse the arguments.
+    for ( int i = 0; i < args.length(); i++ )
+    {
+        if ( MString( "-enable" ) == args.asString( i, &status ) && MS::kSuccess == status )
+        {
+            bool enable = args.asBool( ++i, &status );
+            CHECK_MSTATUS_AND_RETURN_IT(status);
+            realtime.setEnabled(enable);
+        }
+        else if ( MString( "-fps" ) == args.asString( i, &status ) && MS::kSuccess == status )
+        {
+            double fps = args.asDouble( ++i, &status );
+            CHECK_MSTATUS_AND_RETURN_IT(status);
+            realtime.setTargetFps(fps);
+        }
+        else if ( MString( "-stats" ) == args.asString( i, &status ) && MS::kSuccess == status )
+        {
+            MString result(realtime.getStatsJson().c_str());
+            setResult(result);
+        }
+        else if ( MString( "-frames" ) == args.asString( i, &status ) && MS::kSuccess == status )
+        {
+            MString result(realtime.getFramesJson().c_str());
+            setResult(result);
+        }
+        else
+        {
+            displayError(MString("Invalid arguments.\n\n") + help);
+            return MS::kFailure;
+        }
+    }
+    return MS::kSuccess;
+}
+
+void* HdCmdSetup::creator()
+{
+    // Maya internal function used to allocate memory etc.
+    return new HdCmdSetup;
+}
+
+bool HdCmdSetup::isUndoable() const
+{
+    return changed;
+}
+
+MStatus HdCmdSetup::redoIt()
+{
+    return dgModifier.doIt();
+}
+
+MStatus HdCmdSetup::undoIt()
+{
+    return dgModifier.undoIt();
+}
+
+MStatus HdCmdSetup::doIt( const MArgList& args )
+{
+    MStatus status;
+    MString help("Usage: \"hdSetup [pose_node] -myFlag\"\n\n " \
+    "Connects controls, black- and whitelisted nodes to a pose node in one undoable step.\n" \
+    "Available flags (each can be repeated):\n" \
+    "hdSetup hyperdrivePose1 -control ctrl1 (all keyable attributes) -control ctrl2.translateX\n" \
+    "hdSetup hyperdrivePose1 -bulk [0 / 1] (translate, scale and shear as one matrix connection, default 0)\n" \
+    "hdSetup hyperdrivePose1 -blacklist node1 -whitelist node2\n" \
+    "hdSetup hyperdrivePose1 -nodeType skinCluster -namespace char1 (blacklist by type, all namespaces by default)");
+
+    if (args.length() < 2)
+    {
+        displayError(MString("Invalid arguments.\n\n") + help);
+        return MS::kFailure;
+    }
+
+    MSelectionList poseSelection;
+    MObject oPoseNode;
+    status = poseSelection.add( args.asString( 0 ) );
+    if ( MS::kSuccess == status ) status = poseSelection.getDependNode( 0, oPoseNode );
+    if ( MS::kSuccess != status || MFnDependencyNode( oPoseNode ).typeId() != HdPoseNode::id )
+    {
+        displayError(MString("Not a hyperdrivePose node: ") + args.asString( 0 ));
+        return MS::kFailure;
+    }
+
+    std::vector<MString> controls;
+    std::vector<MString> blacklist;
+    std::vector<MString> whitelist;
+    std::set<std::string> nodeTypes;
+    std::vector<MString> namespaces;
+    bool bulk = false;
+
+     // Parse the arguments.
+    for ( int i = 1; i < args.length(); i++ )
+    {
+        MString flag = args.asString( i, &status );
+        if ( MS::kSuccess != status || i + 1 >= (int) args.length() )
+        {
+            displayError(MString("Invalid arguments.\n\n") + help);
+            return MS::kFailure;
+        }
+
+        if ( MString( "-control" ) == flag ) controls.push_back( args.asString( ++i, &status ) );
+        else if ( MString( "-blacklist" ) == flag ) blacklist.push_back( args.asString( ++i, &status ) );
+        else if ( MString( "-whitelist" ) == flag ) whitelist.push_back( args.asString( ++i, &status ) );
+        else if ( MString( "-nodeType" ) == flag ) nodeTypes.insert( args.asString( ++i, &status ).asChar() );
+        else if ( MString( "-namespace" ) == flag ) namespaces.push_back( args.asString( ++i, &status ) );
+        else if ( MString( "-bulk" ) == flag ) bulk = args.asBool( ++i, &status );
+        else status = MS::kFailure;
+
+        if ( MS::kSuccess != status )
+        {
+            displayError(MString("Invalid arguments.\n\n") + help);
+            return MS::kFailure;
+        }
+    }
+
+    ArrayInput ctrlVals(MPlug(oPoseNode, HdPoseNode::aInCtrlVals));
+    ArrayInput ctrlMatrices(MPlug(oPoseNode, HdPoseNode::aInCtrlMatrices));
+    ArrayInput blacklistInput(MPlug(oPoseNode, HdPoseNode::aInBlacklist));
+    ArrayInput whitelistInput(MPlug(oPoseNode, HdPoseNode::aInWhitelist));
+    unsigned int connections = 0;
+    unsigned int unresolved = 0;
+
+    auto connectControl = [&](const MPlug& plug) {
+        MObject oNode = plug.node();
+        std::string attrName = MFnAttribute(plug.attribute()).name().asChar();
+        if (bulk && oNode.hasFn(MFn::kTransform) && MATRIX_CHANNELS.count(attrName) > 0)
+        {
+            if (ctrlMatrices.connect(dgModifier, MFnDependencyNode(oNode).findPlug("matrix", true))) connections++;
+            return;
+        }
+        if (ctrlVals.connect(dgModifier, plug)) connections++;
+    };
+
+    // the message plug of a node, for the black- and whitelist
+    auto resolveNode = [&](const MString& name, MPlug& messagePlug) -> bool {
+        MSelectionList selection;
+        MObject oNode;
+        if (selection.add(name) != MS::kSuccess || selection.getDependNode(0, oNode) != MS::kSuccess)
+        {
+            displayWarning(MString("Could not find node: ") + name);
+            unresolved++;
+            return false;
+        }
+        messagePlug = MFnDependencyNode(oNode).findPlug("message", true);
+        return true;
+    };
+
+    // CONTROLS
+    for (size_t c=0; c<controls.size(); c++)
+    {
+        MSelectionList selection;
+        MPlug plug;
+        MObject oNode;
+        if (selection.add(controls[c]) != MS::kSuccess)
+        {
+            displayWarning(MString("Could not find control: ") + controls[c]);
+            unresolved++;
+            continue;
+        }
+
+        if (selection.getPlug(0, plug) == MS::kSuccess && !plug.isNull())
+        {
+            connectControl(plug);
+            continue;
+        }
+
+        // a control node stands for its keyable attributes
+        if (selection.getDependNode(0, oNode) != MS::kSuccess) continue;
+        MFnDependencyNode nodeFn(oNode);
+        for (unsigned int a=0; a<nodeFn.attributeCount(); a++)
+        {
+            MPlug attrPlug = nodeFn.findPlug(nodeFn.attribute(a), true, &status);
+            if (status != MS::kSuccess || attrPlug.isArray() || attrPlug.isCompound() || !attrPlug.isKeyable()) continue;
+            connectControl(attrPlug);
+        }
+    }
+
+    // BLACKLIST AND WHITELIST
+    for (size_t b=0; b<blacklist.size(); b++)
+    {
+        MPlug messagePlug;
+        if (resolveNode(blacklist[b], messagePlug) && blacklistInput.connect(dgModifier, messagePlug)) connections++;
+    }
+    for (size_t w=0; w<whitelist.size(); w++)
+    {
+        MPlug messagePlug;
+        if (resolveNode(whitelist[w], messagePlug) && whitelistInput.connect(dgModifier, messagePlug)) connections++;
+    }
+
+    // one pass over the namespaces for the node type filters
+    if (!nodeTypes.empty())
+    {
+        if (namespaces.empty()) namespaces.push_back(":");
+        for (size_t n=0; n<namespaces.size(); n++)
+        {
+            MObjectArray nodes = MNamespace::getNamespaceObjects(namespaces[n], true, &status);
+            if (status != MS::kSuccess)
+            {
+                displayWarning(MString("Could not list namespace: ") + namespaces[n]);
+                unresolved++;
+                continue;
+            }
+
+            for (unsigned int i=0; i<nodes.length(); i++)
+            {
+                MFnDependencyNode nodeFn(nodes[i], &status);
+                if (status != MS::kSuccess || nodeTypes.count(nodeFn.typeName().asChar()) == 0) continue;
+                if (blacklistInput.connect(dgModifier, nodeFn.findPlug("message", true))) connections++;
+            }
+        }
+    }
+
+    // all connections in one batch, undone as one step
+    status = dgModifier.doIt();
+    if (status != MS::kSuccess)
+    {
+        dgModifier.undoIt();
+        displayError("Failed to connect the setup, see the script editor for details.");
+        return status;
+    }
+    changed = connections > 0;
+
+    std::string json = "{\"connections\": " + std::to_string(connections) + ", ";
+    json += "\"unresolved\": " + std::to_string(unresolved) + "}";
+    setResult(MString(json.c_str()));
+    return MS::kSuccess;
+}
+
+void* HdCmdInteractive::creator()
+{
+    // Maya internal function used to allocate memory etc.
+    return new HdCmdInteractive;
+}
+
+MStatus HdCmdInteractive::doIt( const MArgList& args )
+{
+    MStatus status;
+    MString help("Usage: \"hdInteractive -myFlag\"\n\n " \
+    "Serves the caches while scrubbing and stepping, rigs with manipulated controls are evaluated.\n" \
+    "Available flags:\n" \
+    "hdInteractive -enable [0 / 1]\n" \
+    "hdInteractive -stats");
+
+    if (args.length() == 0)
+    {
+        displayError(MString("Invalid arguments.\n\n") + help);
+        return MS::kFailure;
+    }
+
+     // Parse the arguments.
+    for ( int i = 0; i < args.length(); i++ )
+    {
+        if ( MString( "-enable" ) == args.asString( i, &status ) && MS::kSuccess == status )
+        {
+            bool enable = args.asBool( ++i, &status );
+            CHECK_MSTATUS_AND_RETURN_IT(status);
+            HdUtils::setInteractiveActive(enable);
+        }
+        else if ( MString( "-stats" ) == args.asString( i, &status ) && MS::kSuccess == status )
+        {
+            std::string json = "{\"enabled\": " + std::string(HdUtils::interactiveActive() ? "true" : "false") + ", ";
+            json += "\"rigs\": " + HdControlWatch::getAllStatsJson() + "}";
+            setResult(MString(json.c_str()));
+        }
+        else
+        {
+            displayError(MString("Invalid arguments.\n\n") + help);
+            return MS::kFailure;
+        }
+    }
+    return MS::kSuccess;
+}
@@ -0,0 +1,192 @@
+//
+// -----------------------------------------------------------------------------
+// This source file has been developed within the scope of the
+// Technical Director course at Filmakademie Baden-Wuerttemberg.
+// http://technicaldirector.de
+//
+// Written by Tim Lehr
+// Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+// -----------------------------------------------------------------------------
+//
+
+#include "HdControlWatch.h"
+
+#include <vector>
+#include <maya/MDGMessage.h>
+#include <maya/MPlug.h>
+
+#include "HdUtils.h"
+#include "HdPoseSampler.h"
+#include "HdPoseNode.h"
+
+namespace
+{
+    const int LINK_MESSAGES = MNodeMessage::kConnectionMade | MNodeMessage::kConnectionBroken |
+                              MNodeMessage::kAttributeArrayAdded | MNodeMessage::kAttributeArrayRemoved;
+}
+
+std::shared_ptr<spdlog::logger> HdControlWatch::log = HdUtils::getLoggerInstance("HdControlWatch");
+std::mutex HdControlWatch::registryMutex_;
+std::set<HdControlWatch*> HdControlWatch::registry_;
+MCallbackIdArray HdControlWatch::globalCallbacks_;
+
+HdControlWatch::HdControlWatch(const MObject& oPoseNode): poseNode_(oPoseNode)
+{
+    std::lock_guard<std::mutex> lock(registryMutex_);
+    registry_.insert(this);
+}
+
+HdControlWatch::~HdControlWatch()
+{
+    {
+        std::lock_guard<std::mutex> lock(registryMutex_);
+        registry_.erase(this);
+    }
+    removeCallbacks();
+}
+
+void HdControlWatch::registerCallbacks()
+{
+    MStatus status;
+    globalCallbacks_.append(MDGMessage::addTimeChangeCallback(HdControlWatch::onTimeChange, nullptr, &status));
+    CHECK_MSTATUS(status);
+}
+
+void HdControlWatch::deregisterCallbacks()
+{
+    MMessage::removeCallbacks(globalCallbacks_);
+    globalCallbacks_.clear();
+}
+
+void HdControlWatch::removeCallbacks()
+{
+    if (callbacks_.length() > 0) MMessage::removeCallbacks(callbacks_);
+    callbacks_.clear();
+}
+
+void HdControlWatch::watchNode(MObject node)
+{
+    MStatus status;
+    MCallbackId id = MNodeMessage::addAttributeChangedCallback(node, HdControlWatch::onAttributeChanged, this, &status);
+    CHECK_MSTATUS(status);
+    if (status == MS::kSuccess) callbacks_.append(id);
+}
+
+bool HdControlWatch::needsTrace()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return !traced_;
+}
+
+void HdControlWatch::trace()
+{
+    if (!poseNode_.isAlive()) return;
+    removeCallbacks();
+
+    MStatus status;
+    MObject oPoseNode = poseNode_.object();
+    HdPoseSampler sampler(oPoseNode, status, true);
+    CHECK_MSTATUS(status);
+
+    std::vector<MObject> nodes;
+    std::vector<MPlug> plugs;
+    sampler.getUpstream(nodes, plugs);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    controlPlugs_.clear();
+
+    // the pose node itself for rewired controls
+    watchNode(oPoseNode);
+
+    std::set<unsigned int> controlNodes;
+    for (size_t i=0; i<plugs.size(); i++)
+    {
+        MObject node = plugs[i].node();
+        unsigned int nodeHash = MObjectHandle::objectHashCode(node);
+        controlPlugs_.insert(std::make_pair(nodeHash, std::string(plugs[i].partialName().asChar())));
+        if (plugs[i].isChild()) controlPlugs_.insert(std::make_pair(nodeHash, std::string(plugs[i].parent().partialName().asChar())));
+        if (controlNodes.insert(nodeHash).second) watchNode(node);
+    }
+
+    traced_ = true;
+    log->debug("Traced controls of '{}': {} control nodes, {} control plugs.",
+               HdUtils::getNodeName(oPoseNode), controlNodes.size(), controlPlugs_.size());
+}
+
+bool HdControlWatch::manipulated()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (manipulated_) bypasses_++;
+    return manipulated_;
+}
+
+void HdControlWatch::release()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!manipulated_) return;
+        manipulated_ = false;
+    }
+
+    // unanimated controls do not dirty the empty pose ID on a time change
+    if (poseNode_.isAlive()) HdPoseNode::dirtyOutputs(poseNode_.object());
+}
+
+void HdControlWatch::onAttributeChanged(MNodeMessage::AttributeMessage msg, MPlug& plug, MPlug& otherPlug, void* clientData)
+{
+    HdControlWatch* watch = static_cast<HdControlWatch*>(clientData);
+    unsigned int nodeHash = MObjectHandle::objectHashCode(plug.node());
+
+    {
+        std::lock_guard<std::mutex> lock(watch->mutex_);
+        if (watch->poseNode_.isAlive() && nodeHash == MObjectHandle::objectHashCode(watch->poseNode_.object()))
+        {
+            if (msg & LINK_MESSAGES) watch->traced_ = false;
+            return;
+        }
+
+        if ((msg & MNodeMessage::kAttributeSet) == 0) return;
+        if (watch->controlPlugs_.count(std::make_pair(nodeHash, std::string(plug.partialName().asChar()))) == 0) return;
+
+        if (watch->manipulated_) return;
+        watch->manipulations_++;
+        watch->manipulated_ = true;
+    }
+
+    // the rig is only evaluated if the pose node recomputes its outputs
+    if (watch->poseNode_.isAlive()) HdPoseNode::dirtyOutputs(watch->poseNode_.object());
+}
+
+void HdControlWatch::onTimeChange(MTime& time, void* clientData)
+{
+    // a new frame shows the animated pose again
+    std::lock_guard<std::mutex> registryLock(registryMutex_);
+    for (std::set<HdControlWatch*>::iterator it = registry_.begin(); it != registry_.end(); ++it)
+    {
+        (*it)->release();
+    }
+}
+
+std::string HdControlWatch::getStatsJson()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::string result = "{";
+    result += "\"node\": \"" + (poseNode_.isAlive() ? HdUtils::getNodeName(poseNode_.object()) : std::string()) + "\", ";
+    result += "\"manipulated\": " + std::string(manipulated_ ? "true" : "false") + ", ";
+    result += "\"control_plugs\": " + std::to_string(controlPlugs_.size()) + ", ";
+    result += "\"manipulations\": " + std::to_string(manipulations_) + ", ";
+    result += "\"bypasses\": " + std::to_string(bypasses_) + "}";
+    return result;
+}
+
+std::string HdControlWatch::getAllStatsJson()
+{
+    std::lock_guard<std::mutex> registryLock(registryMutex_);
+    std::string result = "[";
+    for (std::set<HdControlWatch*>::iterator it = registry_.begin(); it != registry_.end(); ++it)
+    {
+        if (it != registry_.begin()) result += ", ";
+        result += (*it)->getStatsJson();
+    }
+    return result + "]";
+}
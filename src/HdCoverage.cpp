@@ -0,0 +1,176 @@
+//
+// -----------------------------------------------------------------------------
+// This source file has been developed within the scope of the
+// Technical Director course at Filmakademie Baden-Wuerttemberg.
+// http://technicaldirector.de
+//
+// Written by Tim Lehr
+// Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+// -----------------------------------------------------------------------------
+//
+
+#include "HdCoverage.h"
+
+#include <cstdio>
+#include <map>
+#include <set>
+
+#include <maya/MFnDependencyNode.h>
+#include <maya/MItDependencyNodes.h>
+
+#include "HdUtils.h"
+#include "HdMeshCache.h"
+#include "HdPoseNode.h"
+#include "HdPoseSampler.h"
+
+namespace
+{
+    std::string frameString(double frame)
+    {
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%g", frame);
+        return buffer;
+    }
+}
+
+std::shared_ptr<spdlog::logger> HdCoverage::log = HdUtils::getLoggerInstance("HdCoverage");
+
+MObjectArray HdCoverage::poseNodes(MStatus& status)
+{
+    MObjectArray poseNodes;
+    MItDependencyNodes nodeIt(MFn::kPluginDependNode, &status);
+    CHECK_MSTATUS_AND_RETURN(status, poseNodes);
+
+    for (; !nodeIt.isDone(); nodeIt.next())
+    {
+        MFnDependencyNode depNodeFn(nodeIt.thisNode(), &status);
+        if (status == MS::kSuccess && depNodeFn.typeId() == HdPoseNode::id) poseNodes.append(nodeIt.thisNode());
+    }
+    status = MS::kSuccess;
+    return poseNodes;
+}
+
+MStatus HdCoverage::build(double start, double end, double step, const MObjectArray& poseNodes, std::string& json)
+{
+    if (step <= 0.0 || end < start) return MS::kInvalidParameter;
+
+    HdUtils::time_point startTime = HdUtils::getCurrentTimePoint();
+
+    std::vector<double> frames;
+    for (double frame=start; frame<=end; frame+=step) frames.push_back(frame);
+
+    // a frame is only cached if it is cached for every rig
+    std::string coverage(frames.size(), 'c');
+    std::string nodesJson;
+
+    for (unsigned int i=0; i<poseNodes.length(); i++)
+    {
+        std::string nodeCoverageMap;
+        std::string nodeJson;
+        MStatus status = nodeCoverage(poseNodes[i], frames, nodeCoverageMap, nodeJson);
+        if (status != MS::kSuccess) continue;
+
+        for (size_t f=0; f<frames.size(); f++)
+        {
+            if (nodeCoverageMap[f] == 'u' || (nodeCoverageMap[f] == 'd' && coverage[f] == 'c')) coverage[f] = nodeCoverageMap[f];
+        }
+        if (!nodesJson.empty()) nodesJson += ", ";
+        nodesJson += nodeJson;
+    }
+
+    size_t counts[3] = {0, 0, 0};
+    std::string uncachedFrames;
+    for (size_t f=0; f<frames.size(); f++)
+    {
+        if (coverage[f] == 'c') counts[0]++;
+        else if (coverage[f] == 'd') counts[2]++;
+        else
+        {
+            counts[1]++;
+            if (!uncachedFrames.empty()) uncachedFrames += ", ";
+            uncachedFrames += frameString(frames[f]);
+        }
+    }
+
+    HdUtils::time_duration duration = HdUtils::getCurrentTimePoint() - startTime;
+
+    json = "{";
+    json += "\"start\": " + frameString(start) + ", ";
+    json += "\"end\": " + frameString(end) + ", ";
+    json += "\"step\": " + frameString(step) + ", ";
+    json += "\"frames\": " + std::to_string(frames.size()) + ", ";
+    json += "\"cached\": " + std::to_string(counts[0]) + ", ";
+    json += "\"uncached\": " + std::to_string(counts[1]) + ", ";
+    json += "\"duplicate\": " + std::to_string(counts[2]) + ", ";
+    json += "\"time_ms\": " + std::to_string(duration.count()) + ", ";
+    json += "\"coverage\": \"" + coverage + "\", ";
+    json += "\"uncached_frames\": [" + uncachedFrames + "], ";
+    json += "\"nodes\": [" + nodesJson + "]}";
+
+    log->info("Coverage of {} frames: {} cached, {} uncached, {} duplicate. ({}ms)",
+              frames.size(), counts[0], counts[1], counts[2], duration.count());
+    return MS::kSuccess;
+}
+
+MStatus HdCoverage::nodeCoverage(const MObject& oPoseNode, const std::vector<double>& frames,
+                                 std::string& coverage, std::string& json)
+{
+    MStatus status;
+
+    std::vector<std::string> cacheIds = HdPoseNode::getCacheIds(oPoseNode, status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    std::vector<std::shared_ptr<HdMeshCache>> meshCaches;
+    for (size_t i=0; i<cacheIds.size(); i++)
+    {
+        std::shared_ptr<HdMeshCache> meshCache = HdCacheMap::get(cacheIds[i], status);
+        if (meshCache != nullptr) meshCaches.push_back(meshCache);
+    }
+
+    HdPoseSampler sampler(oPoseNode, status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    std::vector<std::string> poseIds = sampler.sample(frames, status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    // cache lookups may hit a disk index or the daemon, so every pose is only checked once
+    std::map<std::string, bool> poseCached;
+    std::set<std::string> seenPoses;
+    std::string holds;
+    size_t runStart = 0;
+    coverage.assign(frames.size(), 'c');
+
+    for (size_t f=0; f<frames.size(); f++)
+    {
+        const std::string& poseId = poseIds[f];
+
+        std::map<std::string, bool>::iterator cachedIt = poseCached.find(poseId);
+        if (cachedIt == poseCached.end())
+        {
+            bool cached = !meshCaches.empty();
+            for (size_t i=0; i<meshCaches.size() && cached; i++) cached = meshCaches[i]->exists(poseId);
+            cachedIt = poseCached.insert(std::make_pair(poseId, cached)).first;
+        }
+
+        if (!cachedIt->second) coverage[f] = seenPoses.count(poseId) > 0 ? 'd' : 'u';
+        seenPoses.insert(poseId);
+
+        // close a hold at the last frame of a run of identical poses
+        if (f > 0 && poseIds[f - 1] != poseId) runStart = f;
+        bool runEnds = (f + 1 == frames.size()) || (poseIds[f + 1] != poseId);
+        if (runEnds && runStart < f)
+        {
+            if (!holds.empty()) holds += ", ";
+            holds += "[" + frameString(frames[runStart]) + ", " + frameString(frames[f]) + "]";
+        }
+    }
+
+    json = "{";
+    json += "\"node\": \"" + HdUtils::getNodeName(oPoseNode) + "\", ";
+    json += "\"channels\": " + std::to_string(sampler.channelCount()) + ", ";
+    json += "\"curve_channels\": " + std::to_string(sampler.curveChannelCount()) + ", ";
+    json += "\"evaluated_channels\": " + std::to_string(sampler.plugChannelCount()) + ", ";
+    json += "\"unique_poses\": " + std::to_string(seenPoses.size()) + ", ";
+    json += "\"coverage\": \"" + coverage + "\", ";
+    json += "\"holds\": [" + holds + "]}";
+    return MS::kSuccess;
+}
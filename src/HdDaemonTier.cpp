@@ -0,0 +1,252 @@
+//
+// -----------------------------------------------------------------------------
+// This source file has been developed within the scope of the
+// Technical Director course at Filmakademie Baden-Wuerttemberg.
+// http://technicaldirector.de
+//
+// Written by Tim Lehr
+// Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+// -----------------------------------------------------------------------------
+//
+
+#include "HdDaemonTier.h"
+
+#include <unistd.h>
+#include <algorithm>
+
+#include "HdLogger.h"
+
+namespace
+{
+    const std::chrono::milliseconds RECONNECT_INTERVAL(1000);
+}
+
+HdDaemonTier::HdDaemonTier(const std::string& socketPath, const std::string& keyNamespace) :
+    socketPath_(socketPath), namespace_(keyNamespace)
+{
+    log = HdUtils::getLoggerInstance("HdDaemonTier");
+    lastConnectAttempt_ = std::chrono::steady_clock::now() - RECONNECT_INTERVAL;
+}
+
+HdDaemonTier::~HdDaemonTier()
+{
+    disconnect();
+}
+
+bool HdDaemonTier::connect()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    lastConnectAttempt_ = std::chrono::steady_clock::now() - RECONNECT_INTERVAL;
+    return ensureConnected();
+}
+
+bool HdDaemonTier::connected()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return sock_ >= 0;
+}
+
+// expects mutex_ to be held
+bool HdDaemonTier::ensureConnected()
+{
+    if (sock_ >= 0) return true;
+
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (now - lastConnectAttempt_ < RECONNECT_INTERVAL) return false;
+    lastConnectAttempt_ = now;
+
+    sock_ = HdCacheProtocol::connectSocket(socketPath_);
+    if (sock_ < 0)
+    {
+        log->debug("Cache daemon not reachable at '{}'.", socketPath_);
+        return false;
+    }
+    log->info("Connected to cache daemon at '{}'.", socketPath_);
+    return true;
+}
+
+// expects mutex_ to be held
+void HdDaemonTier::disconnect()
+{
+    if (sock_ < 0) return;
+    ::close(sock_);
+    sock_ = -1;
+}
+
+// expects mutex_ to be held
+bool HdDaemonTier::roundTrip(HdCacheMessage& request, HdCacheMessage& reply)
+{
+    if (!ensureConnected()) return false;
+
+    request.header.requestId = nextRequestId_++;
+    if (!HdCacheProtocol::sendMessage(sock_, request) || !HdCacheProtocol::recvMessage(sock_, reply))
+    {
+        log->warn("Lost connection to cache daemon at '{}'.", socketPath_);
+        disconnect();
+        return false;
+    }
+
+    // the daemon could not serve the request, the connection stays usable
+    if (reply.header.op == kOpError && reply.header.requestId == request.header.requestId)
+    {
+        log->warn("Cache daemon error: {}", reply.body);
+        return false;
+    }
+
+    if (reply.header.requestId != request.header.requestId || reply.header.op != request.header.op ||
+        reply.header.count != request.header.count)
+    {
+        log->warn("Lost connection to cache daemon at '{}'.", socketPath_);
+        disconnect();
+        return false;
+    }
+    return true;
+}
+
+bool HdDaemonTier::getMany(const std::vector<std::string>& poseIds, std::vector<HdBlob>& blobs)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    blobs.assign(poseIds.size(), HdBlob());
+
+    for (size_t start=0; start<poseIds.size(); start+=HD_CACHEPROTO_MAX_BATCH)
+    {
+        size_t end = std::min(poseIds.size(), start + HD_CACHEPROTO_MAX_BATCH);
+
+        HdCacheMessage request;
+        request.reset(kOpGet, (uint32_t) (end - start), 0);
+        for (size_t i=start; i<end; i++) request.appendKey(key(poseIds[i]));
+
+        HdCacheMessage reply;
+        if (!roundTrip(request, reply)) return false;
+
+        HdCacheBodyReader reader(reply.body);
+        size_t fdIndex = 0;
+        for (size_t i=start; i<end; i++)
+        {
+            HdCacheGetResult result;
+            if (!reader.read(result)) return false;
+            if (!result.found) continue;
+            if (fdIndex >= reply.fds.size()) return false;
+
+            HdBlob blob;
+            int fd = reply.fds[fdIndex++];
+            if (HdCacheProtocol::mapPayloadFd(fd, result.payloadSize, blob) &&
+                hdChecksum64(blob.begin(), blob.size) == result.checksum)
+            {
+                blobs[i] = blob;
+            } else
+            {
+                log->warn("Invalid payload for pose ID '{}' from cache daemon.", poseIds[i]);
+            }
+        }
+    }
+    return true;
+}
+
+bool HdDaemonTier::putMany(const std::vector<std::string>& poseIds, const std::vector<HdBlob>& blobs)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (poseIds.size() != blobs.size()) return false;
+
+    bool success = true;
+    for (size_t start=0; start<poseIds.size(); start+=HD_CACHEPROTO_MAX_BATCH)
+    {
+        size_t end = std::min(poseIds.size(), start + HD_CACHEPROTO_MAX_BATCH);
+
+        HdCacheMessage request;
+        request.reset(kOpPut, (uint32_t) (end - start), 0);
+        for (size_t i=start; i<end; i++)
+        {
+            int fd = HdCacheProtocol::createPayloadFd(blobs[i]);
+            if (fd < 0)
+            {
+                log->error("Could not create payload fd for pose ID '{}'.", poseIds[i]);
+                return false;
+            }
+            request.fds.push_back(fd);
+
+            std::string entryKey = key(poseIds[i]);
+            HdCachePutEntry entry;
+            entry.keySize = (uint16_t) entryKey.size();
+            entry.payloadSize = blobs[i].size;
+            entry.checksum = hdChecksum64(blobs[i].begin(), blobs[i].size);
+            request.append(entry);
+            request.body.append(entryKey);
+        }
+
+        HdCacheMessage reply;
+        if (!roundTrip(request, reply)) return false;
+
+        HdCacheBodyReader reader(reply.body);
+        for (size_t i=start; i<end; i++)
+        {
+            uint8_t stored = 0;
+            if (!reader.read(stored)) return false;
+            success = success && stored;
+        }
+    }
+    return success;
+}
+
+bool HdDaemonTier::existsMany(const std::vector<std::string>& poseIds, std::vector<bool>& results)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    results.assign(poseIds.size(), false);
+
+    for (size_t start=0; start<poseIds.size(); start+=HD_CACHEPROTO_MAX_BATCH)
+    {
+        size_t end = std::min(poseIds.size(), start + HD_CACHEPROTO_MAX_BATCH);
+
+        HdCacheMessage request;
+        request.reset(kOpExists, (uint32_t) (end - start), 0);
+        for (size_t i=start; i<end; i++) request.appendKey(key(poseIds[i]));
+
+        HdCacheMessage reply;
+        if (!roundTrip(request, reply)) return false;
+
+        HdCacheBodyReader reader(reply.body);
+        for (size_t i=start; i<end; i++)
+        {
+            uint8_t found = 0;
+            if (!reader.read(found)) return false;
+            results[i] = found != 0;
+        }
+    }
+    return true;
+}
+
+std::string HdDaemonTier::statsJson()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    HdCacheMessage request;
+    request.reset(kOpStats, 0, 0);
+    HdCacheMessage reply;
+    if (!roundTrip(request, reply)) return "{}";
+    return reply.body;
+}
+
+bool HdDaemonTier::exists(const std::string& poseId)
+{
+    std::vector<bool> results;
+    return existsMany(std::vector<std::string>(1, poseId), results) && results[0];
+}
+
+bool HdDaemonTier::read(const std::string& poseId, HdBlob& blob)
+{
+    std::vector<HdBlob> blobs;
+    if (!getMany(std::vector<std::string>(1, poseId), blobs) || blobs[0].empty()) return false;
+    blob = blobs[0];
+    return true;
+}
+
+bool HdDaemonTier::write(const std::string& poseId, const HdBlob& blob)
+{
+    return putMany(std::vector<std::string>(1, poseId), std::vector<HdBlob>(1, blob));
+}
+
+size_t HdDaemonTier::size()
+{
+    // the daemon is shared, there is no meaningful per cache pose count
+    return 0;
+}
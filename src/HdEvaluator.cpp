@@ -16,21 +16,31 @@
 #include <maya/MFnDependencyNode.h>
 #include <maya/MFnDagNode.h>
 #include <maya/MProfiler.h>
-#include <maya/MItDependencyNodes.h>
 #include <maya/MPlug.h>
 #include <maya/MPlugArray.h>
 #include <maya/MObjectHandle.h>
 #include <maya/MGraphNodeIterator.h>
 
+#include <deque>
+
 #include "HdUtils.h"
 #include "HdPoseNode.h"
 #include "HdCacheNode.h"
+#include "HdPrefetcher.h"
+#include "HdSceneRegistry.h"
 
 namespace 
 {
     int _profilerCategory = MProfiler::addCategory("Hyperdrive Evaluator");
+
+    // smaller cached schedules are not worth waking the task pool
+    const size_t MIN_PARALLEL_NODES = 8;
 }
 
+std::mutex HdEvaluator::statsMutex_;
+std::map<std::string, HdEvaluator::RigStats> HdEvaluator::rigStats_;
+HdEvaluator::FrameStats HdEvaluator::frameStats_;
+
 HdEvaluator::HdEvaluator() {
     log = HdUtils::getLoggerInstance("HdEvaluator");
 }
@@ -69,7 +79,11 @@ void HdEvaluator::evaluatorReset()
     poseNodes.clear();
     outputMeshes.clear();
     whitelistNodes.clear();
-    cachedPoses.clear();
+    rigCached.clear();
+    rigUnchanged.clear();
+    lastPoseIds.clear();
+    cachedRigCount = 0;
+    evalNodeMap.clear();
 }
 
 void HdEvaluator::evaluatorInit()
@@ -81,7 +95,10 @@ void HdEvaluator::evaluatorInit()
     double startTimeDouble = HdUtils::timePointToDouble(startTime);
 
     log->info("*** Begin Hyperdrive evaluator initialization ***");
-    collectHdPoseNodes();
+
+    // the registry follows scene edits, only the nodes edited since the last build are queried
+    HdSceneRegistry& registry = HdSceneRegistry::instance();
+    registry.getPoseNodes(poseNodes);
 
     if (poseNodes.length() == 0) 
     {
@@ -95,9 +112,11 @@ void HdEvaluator::evaluatorInit()
     hdAvailable = true;
     log->info("{} pose nodes detected. HdEvaluator active.", poseNodes.length());
 
-    // collect output meshes
-    collectOutputMeshes();
-    collectWhitelistNodes();
+    registry.getOutputMeshes(outputMeshes);
+    registry.getWhitelistNodes(whitelistNodes);
+    log->debug("Output mesh nodes: {}, whitelisted nodes: {}", outputMeshes.size(), whitelistNodes.size());
+
+    collectRigCones();
 
     // CALC EXEC TIME
     HdUtils::time_point endTime = HdUtils::getCurrentTimePoint();
@@ -163,8 +182,6 @@ bool HdEvaluator::markIfSupported(const MEvaluationNode* node)
     MStatus status; 
 
     if (!evaluatorInitialized) evaluatorInit();
-    return true; // TEST:  SUPPORT ALL NODES
-
     if (!hdAvailable) return false;
 
     MObject oNode = node->dependencyNode(&status);
@@ -197,15 +214,20 @@ bool HdEvaluator::markIfSupported(const MEvaluationNode* node)
 void HdEvaluator::preEvaluate(const MEvaluationGraph* graph)
 {
     // *** RESET EVALUATION CHECK VARIABLES
-    cachedPoses.clear();
+    rigCached.assign(poseNodes.length(), false);
+    rigUnchanged.assign(poseNodes.length(), false);
+    lastPoseIds.resize(poseNodes.length());
+    cachedRigCount = 0;
     fullyCached = false;
     // ***
 
     if (!hdAvailable) return;
     double frame = HdUtils::getCurrentFrame();
 
-    if (!HdUtils::playbackActive()) 
+    if (!HdUtils::cachingActive()) 
     {
+        // the rigs are evaluated, their outputs no longer belong to the last pose
+        lastPoseIds.assign(poseNodes.length(), std::string());
         log->info("Frame '{}': Playback not active. Evaluate frame.", frame);
         return;
     }
@@ -244,20 +266,30 @@ void HdEvaluator::preEvaluate(const MEvaluationGraph* graph)
         if (status != MS::kSuccess) continue;
 
         unsigned int poseNodeHash = MObjectHandle::objectHashCode(oNode);
+        HdPrefetcher::instance().observe(poseId.asChar());
+
+        // a held pose leaves the outputs of the last frame valid
+        rigUnchanged[i] = freezeRig && poseId.length() > 0 && lastPoseIds[i] == poseId.asChar();
+        lastPoseIds[i] = poseId.asChar();
 
         if (freezeRig) 
         {
-            cachedPoses.insert(poseNodeHash);
+            rigCached[i] = true;
+            cachedRigCount++;
             log->info("Frame '{}': Pose caches available. Node '{}' / pose ID: '{}'.", frame, poseNodeHash, poseId.asChar());
         } else {
             log->info("Frame '{}': Uncached pose. Node '{}' / pose ID: '{}'. Evaluate.", frame, poseNodeHash, poseId.asChar());
         }
     }
 
-    if (cachedPoses.size() == poseNodes.length())  
+    if (cachedRigCount == poseNodes.length())  
     {
         fullyCached = true;
     }
+    recordFrameStats(frame);
+
+    // request disk-resident poses of the upcoming frames
+    HdPrefetcher::instance().update(poseNodes, frame);
 
     // CALC EXEC TIME
     HdUtils::time_point endTime = HdUtils::getCurrentTimePoint();
@@ -271,57 +303,200 @@ void HdEvaluator::postEvaluate(const MEvaluationGraph* graph)
 // called during scheduling
 bool HdEvaluator::clusterInitialize (const MCustomEvaluatorClusterNode* cluster)
 {
+    if (!evaluatorInitialized) evaluatorInit();
+    compileSchedule(cluster);
     return true;
 }
 
-void HdEvaluator::clusterEvaluate(const MCustomEvaluatorClusterNode* cluster)
+void HdEvaluator::compileSchedule(const MCustomEvaluatorClusterNode* cluster)
 {
-    MProfilingScope profilingScope(_profilerCategory, MProfiler::kColorD_L1, "Evaluate Hyperdrive cluster.");
+    // Resolve the node filters once per cluster, a cached frame only runs the
+    // flat list of whitelisted nodes, Hyperdrive nodes and cache output meshes.
+    MStatus status;
+    ClusterSchedule schedule;
+    std::vector<MObject> cachedObjects;
+    std::vector<size_t> cachedPositions;    // index in schedule.nodes
+
+    MGraphNodeIterator iterator(cluster, &status);
+    CHECK_MSTATUS(status);
+    if (status != MS::kSuccess) return;
 
-    if (hdAvailable && fullyCached) 
+    for (; !iterator.isDone(); iterator.next())
     {
-        MStatus status = MS::kSuccess;
-        MGraphNodeIterator iterator(cluster, &status);
-        if (status == MS::kSuccess)
+        MEvaluationNode evalNode = iterator.currentEvaluationNode(&status);
+        if (status != MS::kSuccess) continue;
+        schedule.nodeCount++;
+
+        MObject oNode = evalNode.dependencyNode(&status);
+        if (status != MS::kSuccess) continue;
+
+        unsigned int nodeHash = MObjectHandle::objectHashCode(oNode);
+        bool evaluateCached = whitelistNodes.count(nodeHash) > 0 || isHyperdriveNode(oNode, status) ||
+                              (oNode.hasFn(MFn::kMesh) && outputMeshes.count(nodeHash) > 0);
+
+        if (evaluateCached)
+        {
+            schedule.cachedNodes.push_back(evalNode);
+            cachedObjects.push_back(oNode);
+            cachedPositions.push_back(schedule.nodes.size());
+        }
+
+        // owning rig, skipped on frames where that rig is cached
+        unsigned int rig = SHARED_NODE;
+        if (!evaluateCached)
+        {
+            HashMap::const_iterator it = evalNodeMap.find(nodeHash);
+            if (it != evalNodeMap.end()) rig = it->second;
+        }
+        schedule.nodes.push_back(evalNode);
+        schedule.nodeRigs.push_back(rig);
+    }
+
+    compileCachedGraph(schedule, cachedObjects);
+
+    schedule.nodeHoldRigs.assign(schedule.nodes.size(), SHARED_NODE);
+    for (size_t i=0; i<cachedPositions.size(); i++) schedule.nodeHoldRigs[cachedPositions[i]] = schedule.cachedRigs[i];
+
+    log->debug("Compiled cluster schedule: {} of {} nodes evaluated on cached frames ({}).", 
+    schedule.cachedNodes.size(), schedule.nodeCount, schedule.cachedParallel ? "parallel" : "serial");
+    clusterSchedules.erase(cluster);
+    clusterSchedules.emplace(cluster, std::move(schedule));
+}
+
+void HdEvaluator::compileCachedGraph(ClusterSchedule& schedule, const std::vector<MObject>& cachedObjects)
+{
+    // Dependencies between the nodes of the cached schedule. Cache nodes of different
+    // characters and their output meshes are independent branches of this graph.
+    HdTaskGraph& graph = schedule.cachedGraph;
+    size_t count = cachedObjects.size();
+    graph.dependencyCounts.assign(count, 0);
+    graph.successors.assign(count, std::vector<uint32_t>());
+    graph.roots.clear();
+    schedule.cachedSerial.assign(count, false);
+    schedule.cachedParallel = count >= MIN_PARALLEL_NODES && std::thread::hardware_concurrency() > 1;
+
+    std::unordered_map<unsigned int, uint32_t> indices;
+    for (size_t i=0; i<count; i++) indices[MObjectHandle::objectHashCode(cachedObjects[i])] = (uint32_t) i;
+
+    for (size_t i=0; i<count; i++)
+    {
+        MFnDependencyNode depNodeFn(cachedObjects[i]);
+
+        // plugin nodes report their scheduling type, built-in nodes other than meshes are serialized.
+        // Plugin nodes that do not override it behave serial in Maya's own scheduler as well.
+        MPxNode* userNode = depNodeFn.userNode();
+        MPxNode::SchedulingType schedulingType = userNode != nullptr ? userNode->schedulingType() :
+            (cachedObjects[i].hasFn(MFn::kMesh) ? MPxNode::kParallel : MPxNode::kSerial);
+        if (schedulingType == MPxNode::kUntrusted) schedule.cachedParallel = false;
+        schedule.cachedSerial[i] = schedulingType != MPxNode::kParallel;
+
+        std::set<uint32_t> sources;
+        MPlugArray plugs;
+        depNodeFn.getConnections(plugs);
+        for (unsigned int p=0; p<plugs.length(); p++)
+        {
+            if (!plugs[p].isDestination()) continue;
+            std::unordered_map<unsigned int, uint32_t>::const_iterator it = indices.find(MObjectHandle::objectHashCode(plugs[p].source().node()));
+            if (it != indices.end() && it->second != i) sources.insert(it->second);
+        }
+
+        for (std::set<uint32_t>::const_iterator it = sources.begin(); it != sources.end(); ++it)
         {
-            while (!iterator.isDone())
+            graph.successors[*it].push_back((uint32_t) i);
+        }
+        graph.dependencyCounts[i] = (uint32_t) sources.size();
+        if (sources.empty()) graph.roots.push_back((uint32_t) i);
+    }
+    graph.buildLevels();
+
+    // Rig of each cached node: the pose node, its cache nodes and their output meshes.
+    // Whitelisted nodes and nodes fed by several rigs belong to no rig and always run.
+    std::unordered_map<unsigned int, unsigned int> poseIndices;
+    for (unsigned int i=0; i<poseNodes.length(); i++) poseIndices[MObjectHandle::objectHashCode(poseNodes[i])] = i;
+
+    schedule.cachedRigs.assign(count, SHARED_NODE);
+    std::vector<bool> assigned(count, false);
+    for (size_t i=0; i<count; i++)
+    {
+        unsigned int nodeHash = MObjectHandle::objectHashCode(cachedObjects[i]);
+        std::unordered_map<unsigned int, unsigned int>::const_iterator it = poseIndices.find(nodeHash);
+        if (it != poseIndices.end()) schedule.cachedRigs[i] = it->second;
+        if (it != poseIndices.end() || whitelistNodes.count(nodeHash) > 0) assigned[i] = true;
+    }
+
+    std::vector<uint32_t> dependencyCounts = graph.dependencyCounts;
+    std::deque<uint32_t> ready(graph.roots.begin(), graph.roots.end());
+    while (!ready.empty())
+    {
+        uint32_t task = ready.front();
+        ready.pop_front();
+
+        for (size_t s=0; s<graph.successors[task].size(); s++)
+        {
+            uint32_t successor = graph.successors[task][s];
+            if (!assigned[successor])
+            {
+                schedule.cachedRigs[successor] = schedule.cachedRigs[task];
+                assigned[successor] = true;
+            }
+            else if (schedule.cachedRigs[successor] != schedule.cachedRigs[task] && whitelistNodes.count(MObjectHandle::objectHashCode(cachedObjects[successor])) == 0)
             {
-                iterator.next(&status);
+                schedule.cachedRigs[successor] = SHARED_NODE;
+            }
+            if (--dependencyCounts[successor] == 0) ready.push_back(successor);
+        }
+    }
+}
+
+void HdEvaluator::clusterEvaluate(const MCustomEvaluatorClusterNode* cluster)
+{
+    MProfilingScope profilingScope(_profilerCategory, MProfiler::kColorD_L1, "Evaluate Hyperdrive cluster.");
 
-                MEvaluationNode currEvalNode = iterator.currentEvaluationNode(&status);
-                MObject oNode = currEvalNode.dependencyNode(&status);
+    if (hdAvailable && cachedRigCount > 0) 
+    {
+        std::unordered_map<const MCustomEvaluatorClusterNode*, ClusterSchedule>::const_iterator it = clusterSchedules.find(cluster);
+        if (it != clusterSchedules.end())
+        {
+            MStatus status;
+            const ClusterSchedule& schedule = it->second;
 
-                MFnDependencyNode depNodeFn(oNode, &status);
-                if (status != MS::kSuccess) continue;
-                std::string nodeName = depNodeFn.name().asChar();
+            if (fullyCached && schedule.cachedParallel)
+            {
+                // independent branches run on Maya's thread pool, serial nodes on this thread
+                HdTaskPool::instance().run(schedule.cachedGraph, schedule.cachedSerial, [&](size_t i) {
+                    unsigned int rig = schedule.cachedRigs[i];
+                    if (rig != SHARED_NODE && rigUnchanged[rig]) return;
+
+                    MStatus nodeStatus;
+                    cluster->evaluateNode(schedule.cachedNodes[i], &nodeStatus);
+                    CHECK_MSTATUS(nodeStatus);
+                });
+                return;
+            }
 
-                unsigned int nodeHash = MObjectHandle::objectHashCode(oNode);
-                bool isWhitelisted = whitelistNodes.find(nodeHash) != whitelistNodes.end();
-                        
-                if (isWhitelisted)
-                {
-                    log->debug("Evaluate whitelisted node: {}", nodeName);
-                    cluster->evaluateNode(currEvalNode, &status);
-                    CHECK_MSTATUS(status);
-                }
-                else if (!isHyperdriveNode(oNode, status))
-                {
-                    if (oNode.hasFn(MFn::kMesh)) 
-                    {
-                        bool isOutputMesh = outputMeshes.find(nodeHash) != outputMeshes.end();
-                        if (!isOutputMesh) continue;
-
-                        log->debug("Evaluate mesh node: {}", nodeName);
-                        cluster->evaluateNode(currEvalNode, &status);
-                        CHECK_MSTATUS(status);
-                    } 
-                } else 
+            if (fullyCached)
+            {
+                for (size_t i=0; i<schedule.cachedNodes.size(); i++)
                 {
-                    log->debug("Evaluate Hyperdrive node: {}", nodeName);
-                    cluster->evaluateNode(currEvalNode, &status);
+                    unsigned int rig = schedule.cachedRigs[i];
+                    if (rig != SHARED_NODE && rigUnchanged[rig]) continue;
+
+                    cluster->evaluateNode(schedule.cachedNodes[i], &status);
                     CHECK_MSTATUS(status);
                 }
-                continue;
+                return;
+            }
+
+            // some rigs missed the cache, only their cones are evaluated
+            for (size_t i=0; i<schedule.nodes.size(); i++)
+            {
+                unsigned int rig = schedule.nodeRigs[i];
+                if (rig != SHARED_NODE && rigCached[rig]) continue;
+                unsigned int holdRig = schedule.nodeHoldRigs[i];
+                if (holdRig != SHARED_NODE && rigUnchanged[holdRig]) continue;
+
+                cluster->evaluateNode(schedule.nodes[i], &status);
+                CHECK_MSTATUS(status);
             }
             return;
         }
@@ -333,115 +508,243 @@ void HdEvaluator::clusterEvaluate(const MCustomEvaluatorClusterNode* cluster)
 
 void HdEvaluator::clusterTerminate(const MCustomEvaluatorClusterNode* cluster)
 {
+    clusterSchedules.erase(cluster);
+
     if (evaluatorInitialized) 
     {
         evaluatorReset();
     }
 }
 
-void HdEvaluator::collectOutputMeshes()
+void HdEvaluator::recordFrameStats(double frame)
+{
+    std::lock_guard<std::mutex> lock(statsMutex_);
+    frameStats_.frame = frame;
+    if (fullyCached) frameStats_.fullyCachedFrames++;
+    else if (cachedRigCount > 0) frameStats_.partialFrames++;
+    else frameStats_.evaluatedFrames++;
+
+    for (unsigned int i=0; i<poseNodes.length(); i++)
+    {
+        RigStats& rigStats = rigStats_[HdUtils::getNodeName(poseNodes[i])];
+        rigStats.lastCached = rigCached[i];
+        if (rigCached[i]) rigStats.cachedFrames++;
+        else rigStats.evaluatedFrames++;
+        if (rigUnchanged[i]) rigStats.heldFrames++;
+    }
+}
+
+std::string HdEvaluator::getStatsJson()
 {
+    std::lock_guard<std::mutex> lock(statsMutex_);
+
+    std::string result = "{";
+    result += "\"frame\": " + std::to_string(frameStats_.frame) + ", ";
+    result += "\"fully_cached_frames\": " + std::to_string(frameStats_.fullyCachedFrames) + ", ";
+    result += "\"partial_frames\": " + std::to_string(frameStats_.partialFrames) + ", ";
+    result += "\"evaluated_frames\": " + std::to_string(frameStats_.evaluatedFrames) + ", ";
+    result += "\"task_pool\": " + HdTaskPool::instance().getStatsJson() + ", ";
+    result += "\"rigs\": [";
+    for (std::map<std::string, RigStats>::const_iterator it = rigStats_.begin(); it != rigStats_.end(); ++it)
+    {
+        if (it != rigStats_.begin()) result += ", ";
+        result += "{\"node\": \"" + it->first + "\", ";
+        result += "\"cached\": " + std::string(it->second.lastCached ? "true" : "false") + ", ";
+        result += "\"cached_frames\": " + std::to_string(it->second.cachedFrames) + ", ";
+        result += "\"evaluated_frames\": " + std::to_string(it->second.evaluatedFrames) + ", ";
+        result += "\"held_frames\": " + std::to_string(it->second.heldFrames) + "}";
+    }
+    return result + "]}";
+}
+
+void HdEvaluator::collectRigCones()
+{
+    // Claim the nodes between the controls of each pose node and the inMeshes of its
+    // cache nodes: downstream of the controls and upstream of the cached meshes. Nodes
+    // that also feed a control stay with Maya's scheduler, a claimed node between two
+    // controls would make the cluster depend on itself.
+    // Cones are kept across graph rebuilds, only the ones touching a node edited since
+    // the last build are traced again.
     MStatus status;
-    MItDependencyNodes nodeIt(MFn::kPluginDependNode);
-    if (status == MS::kSuccess)
+
+    std::unordered_map<unsigned int, size_t> nodeIndices;   // object hash -> bit
+    std::vector<bool> blocked;                              // controls of all rigs
+    std::vector<bool> downstream;                           // per rig
+    std::vector<bool> feedsControls;
+    std::vector<bool> upstream;
+    std::vector<MObject> stack;
+    std::vector<unsigned int> touched;                      // every node a traversal reached
+
+    auto bitIndex = [&](const MObject& oNode) -> size_t
     {
-        for (; !nodeIt.isDone(); nodeIt.next()) 
+        std::pair<std::unordered_map<unsigned int, size_t>::iterator, bool> result =
+            nodeIndices.emplace(MObjectHandle::objectHashCode(oNode), blocked.size());
+        if (result.second)
         {
-            MFnDependencyNode depNodeFn(nodeIt.thisNode(), &status);
-            if (status != MS::kSuccess) continue;
+            blocked.push_back(false);
+            downstream.push_back(false);
+            feedsControls.push_back(false);
+            upstream.push_back(false);
+        }
+        return result.first->second;
+    };
 
-            if (depNodeFn.typeId() != HdCacheNode::HdCacheNode::id) continue;
+    // connected nodes, world matrices also depend on the DAG parents without a connection
+    auto pushNeighbours = [&](const MObject& oNode, bool forward)
+    {
+        MPlugArray plugs;
+        MFnDependencyNode depNodeFn(oNode);
+        depNodeFn.getConnections(plugs);
+        for (unsigned int p=0; p<plugs.length(); p++)
+        {
+            if (!forward && plugs[p].isDestination()) stack.push_back(plugs[p].source().node());
+            if (!forward || !plugs[p].isSource()) continue;
 
-            std::string cacheNodeName = depNodeFn.name().asChar();
+            MPlugArray destinations;
+            plugs[p].destinations(destinations);
+            for (unsigned int d=0; d<destinations.length(); d++) stack.push_back(destinations[d].node());
+        }
 
-            log->debug("Found HdCacheNode: '{}'", cacheNodeName);
+        if (!oNode.hasFn(MFn::kDagNode)) return;
+        MFnDagNode dagFn(oNode);
+        if (forward) for (unsigned int c=0; c<dagFn.childCount(); c++) stack.push_back(dagFn.child(c));
+        else for (unsigned int p=0; p<dagFn.parentCount(); p++) stack.push_back(dagFn.parent(p));
+    };
 
-            // GET CONNECTED RIG NODES
-            MPlug outMeshesPlug = depNodeFn.findPlug(HdCacheNode::HdCacheNode::aOutMeshes, true, &status);
-            CHECK_MSTATUS(status);
-            if (status != MS::kSuccess) continue;
+    // marks the nodes reached from the stack, optionally only within a previous pass
+    auto walk = [&](bool forward, std::vector<bool>& marked, const std::vector<bool>* within, const std::vector<bool>* excluded,
+                    std::vector<unsigned int>* reached)
+    {
+        while (!stack.empty())
+        {
+            MObject oNode = stack.back();
+            stack.pop_back();
+
+            size_t bit = bitIndex(oNode);
+            if (marked[bit] || blocked[bit]) continue;
+            if (within != nullptr && !(*within)[bit]) continue;
+            if (excluded != nullptr && (*excluded)[bit]) continue;
+            marked[bit] = true;
+            touched.push_back(MObjectHandle::objectHashCode(oNode));
+
+            // the animation and Hyperdrive itself are not part of the cone
+            if (oNode.hasFn(MFn::kTime) || oNode.hasFn(MFn::kWorld) || isHyperdriveNode(oNode, status)) continue;
+            if (reached != nullptr) reached->push_back(MObjectHandle::objectHashCode(oNode));
+            pushNeighbours(oNode, forward);
+        }
+    };
 
-            MObjectArray meshNodes;
-            status = getNodesFromArrayPlug(outMeshesPlug, &meshNodes, false, true);
-            CHECK_MSTATUS(status);
-            if (status != MS::kSuccess) continue;
+    std::set<unsigned int> changedNodes;
+    bool allChanged = false;
+    HdSceneRegistry::instance().takeChanges(changedNodes, allChanged);
 
-            for (unsigned int i=0; i<meshNodes.length(); i++) 
-            {
-                MObject oMeshNode = meshNodes[i];
-                MFnDependencyNode meshNodeDepFn(oMeshNode, &status);
-                CHECK_MSTATUS(status);
-                if (status != MS::kSuccess) continue;
+    // the controls of all rigs bound every traversal, other controls move every cone
+    std::vector<MObjectArray> rigControls(poseNodes.length());
+    std::set<unsigned int> controlHashes;
+    for (unsigned int i=0; i<poseNodes.length(); i++)
+    {
+        MFnDependencyNode poseNodeDepFn(poseNodes[i], &status);
+        if (status != MS::kSuccess) continue;
 
-                unsigned int outputMeshHash = MObjectHandle::objectHashCode(oMeshNode);
-                outputMeshes.insert(outputMeshHash);
-                log->debug("Cache Node '{}' - collected output mesh node: '{}' ('{}')", 
-                cacheNodeName, meshNodeDepFn.name().asChar(), outputMeshHash);
-            }
+        MObjectArray matrixControlNodes;
+        status = getNodesFromArrayPlug(poseNodeDepFn.findPlug(HdPoseNode::aInCtrlVals, true), &rigControls[i], true, false);
+        CHECK_MSTATUS(status);
+        status = getNodesFromArrayPlug(poseNodeDepFn.findPlug(HdPoseNode::aInCtrlMatrices, true), &matrixControlNodes, true, false);
+        CHECK_MSTATUS(status);
+        for (unsigned int c=0; c<matrixControlNodes.length(); c++) rigControls[i].append(matrixControlNodes[c]);
+
+        for (unsigned int c=0; c<rigControls[i].length(); c++)
+        {
+            blocked[bitIndex(rigControls[i][c])] = true;
+            controlHashes.insert(MObjectHandle::objectHashCode(rigControls[i][c]));
         }
-        log->debug("Total output mesh nodes: {}", outputMeshes.size());
     }
-}
+    if (controlHashes != coneControls_) allChanged = true;
+    coneControls_.swap(controlHashes);
 
-void HdEvaluator::collectWhitelistNodes()
-{
-    MStatus status;
-    MItDependencyNodes nodeIt(MFn::kPluginDependNode);
-    if (status == MS::kSuccess)
+    std::map<unsigned int, RigCone> rigCones;
+    size_t traced = 0;
+    for (unsigned int i=0; i<poseNodes.length(); i++)
     {
-        for (; !nodeIt.isDone(); nodeIt.next()) 
-        {
-            MFnDependencyNode depNodeFn(nodeIt.thisNode(), &status);
-            if (status != MS::kSuccess) continue;
-
-            if (depNodeFn.typeId() != HdPoseNode::HdPoseNode::id) continue;
+        MFnDependencyNode poseNodeDepFn(poseNodes[i], &status);
+        if (status != MS::kSuccess) continue;
 
-            std::string poseNodeName = depNodeFn.name().asChar();
+        const MObjectArray& controlNodes = rigControls[i];
+        unsigned int poseNodeHash = MObjectHandle::objectHashCode(poseNodes[i]);
+        RigCone& cone = rigCones[poseNodeHash];
 
-            // GET CONNECTED RIG NODES
-            MPlug outMeshesPlug = depNodeFn.findPlug(HdPoseNode::HdPoseNode::aInWhitelist, true, &status);
-            CHECK_MSTATUS(status);
-            if (status != MS::kSuccess) continue;
+        std::map<unsigned int, RigCone>::iterator previous = rigCones_.find(poseNodeHash);
+        bool stale = allChanged || previous == rigCones_.end();
+        for (std::set<unsigned int>::const_iterator it = changedNodes.begin(); it != changedNodes.end() && !stale; ++it)
+        {
+            stale = previous->second.touched.count(*it) > 0;
+        }
 
-            MObjectArray oNodes;
-            status = getNodesFromArrayPlug(outMeshesPlug, &oNodes, true, false);
+        if (!stale)
+        {
+            cone = std::move(previous->second);
+        } else
+        {
+            traced++;
+            downstream.assign(downstream.size(), false);
+            feedsControls.assign(feedsControls.size(), false);
+            upstream.assign(upstream.size(), false);
+            touched.clear();
+
+            // forward from the controls, DAG children follow their parents
+            for (unsigned int c=0; c<controlNodes.length(); c++) pushNeighbours(controlNodes[c], true);
+            walk(true, downstream, nullptr, nullptr, nullptr);
+
+            // nodes between controls
+            for (unsigned int c=0; c<controlNodes.length(); c++) pushNeighbours(controlNodes[c], false);
+            walk(false, feedsControls, &downstream, nullptr, nullptr);
+
+            // reverse from the cached meshes, only through nodes driven by the controls
+            MObjectArray cacheNodes;
+            status = getNodesFromArrayPlug(poseNodeDepFn.findPlug(HdPoseNode::aOutCacheIds, true), &cacheNodes, false, true);
             CHECK_MSTATUS(status);
-            if (status != MS::kSuccess) continue;
 
-            for (unsigned int i=0; i<oNodes.length(); i++) 
+            for (unsigned int c=0; c<cacheNodes.length(); c++)
             {
-                MObject oNode = oNodes[i];
-                MFnDependencyNode poseNodeDepFn(oNode, &status);
+                MObjectArray meshSources;
+                status = getNodesFromArrayPlug(MPlug(cacheNodes[c], HdCacheNode::aInMeshes), &meshSources, true, false);
                 CHECK_MSTATUS(status);
-                if (status != MS::kSuccess) continue;
-
-                unsigned int nodeHash = MObjectHandle::objectHashCode(oNode);
-                whitelistNodes.insert(nodeHash);
-                log->debug("Pose Node '{}' - collected whitelisted node: '{}' ('{}')", 
-                poseNodeName, poseNodeDepFn.name().asChar(), nodeHash);
+                for (unsigned int m=0; m<meshSources.length(); m++)
+                {
+                    stack.push_back(meshSources[m]);
+                    touched.push_back(MObjectHandle::objectHashCode(meshSources[m]));
+                }
+                touched.push_back(MObjectHandle::objectHashCode(cacheNodes[c]));
             }
-        }
-        log->debug("Total whitelisted nodes: {}", whitelistNodes.size());
-    }
-}
+            cone.nodes.clear();
+            walk(false, upstream, &downstream, &feedsControls, &cone.nodes);
 
+            // rewired controls or cache nodes show up as connections of the pose node
+            touched.push_back(poseNodeHash);
+            for (unsigned int c=0; c<controlNodes.length(); c++) touched.push_back(MObjectHandle::objectHashCode(controlNodes[c]));
+            cone.touched = std::unordered_set<unsigned int>(touched.begin(), touched.end());
+        }
 
-void HdEvaluator::collectHdPoseNodes()
-{
-    MStatus status;
-    MItDependencyNodes nodeIt(MFn::kPluginDependNode);
-    if (status == MS::kSuccess)
-    {
-        for (; !nodeIt.isDone(); nodeIt.next()) 
+        for (size_t n=0; n<cone.nodes.size(); n++)
         {
-            MFnDependencyNode depNodeFn(nodeIt.thisNode(), &status);
-            if (status != MS::kSuccess) continue;
-
-            if (depNodeFn.typeId() != HdPoseNode::HdPoseNode::id) continue;
+            // nodes in the cones of several rigs are evaluated unless all of them are cached
+            std::pair<HashMap::iterator, bool> result = evalNodeMap.emplace(cone.nodes[n], i);
+            if (!result.second && result.first->second != i) result.first->second = SHARED_NODE;
+        }
 
-            log->debug("Found HdPoseNode: '{}'", depNodeFn.name().asChar());
-            poseNodes.append(depNodeFn.object());
+        // blacklisted nodes are skipped with the cone, also outside of it
+        std::vector<unsigned int> blacklistNodes;
+        HdSceneRegistry::instance().getBlacklistNodes(poseNodes[i], blacklistNodes);
+        for (size_t b=0; b<blacklistNodes.size(); b++)
+        {
+            std::pair<HashMap::iterator, bool> result = evalNodeMap.emplace(blacklistNodes[b], i);
+            if (!result.second && result.first->second != i) result.first->second = SHARED_NODE;
         }
-        log->debug("Total pose nodes: {}", poseNodes.length());
+
+        log->debug("Pose Node '{}' - rig cone: {} nodes, {} controls, {} blacklisted nodes ({})", 
+        poseNodeDepFn.name().asChar(), cone.nodes.size(), controlNodes.length(), blacklistNodes.size(), stale ? "traced" : "kept");
     }
-}
\ No newline at end of file
+    rigCones_.swap(rigCones);
+    log->info("Rig cones traced: {} of {}, {} changed nodes since the last build.", traced, rigCones_.size(), changedNodes.size());
+    log->info("Total rig cone nodes claimed: {}", evalNodeMap.size());
+}
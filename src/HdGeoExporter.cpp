@@ -0,0 +1,124 @@
+//
+// -----------------------------------------------------------------------------
+// This source file has been developed within the scope of the
+// Technical Director course at Filmakademie Baden-Wuerttemberg.
+// http://technicaldirector.de
+//
+// Written by Tim Lehr
+// Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+// -----------------------------------------------------------------------------
+//
+
+#include "HdGeoExporter.h"
+
+#include <algorithm>
+#include <vector>
+#include <maya/MObjectArray.h>
+
+#include "HdUtils.h"
+#include "HdMeshCache.h"
+#include "HdGeoStream.h"
+#include "HdPoseNode.h"
+#include "HdPoseSampler.h"
+#include "HdCoverage.h"
+
+std::shared_ptr<spdlog::logger> HdGeoExporter::log = HdUtils::getLoggerInstance("HdGeoExporter");
+
+MObject HdGeoExporter::findPoseNode(const std::string& cacheId, MStatus& status)
+{
+    MObjectArray poseNodes = HdCoverage::poseNodes(status);
+    CHECK_MSTATUS_AND_RETURN(status, MObject::kNullObj);
+
+    for (unsigned int i=0; i<poseNodes.length(); i++)
+    {
+        std::vector<std::string> cacheIds = HdPoseNode::getCacheIds(poseNodes[i], status);
+        if (status != MS::kSuccess) continue;
+        if (std::find(cacheIds.begin(), cacheIds.end(), cacheId) != cacheIds.end()) return poseNodes[i];
+    }
+
+    status = MS::kNotFound;
+    return MObject::kNullObj;
+}
+
+MStatus HdGeoExporter::exportCache(const std::string& cacheId, const std::string& path,
+                                   double start, double end, double step, std::string& json)
+{
+    if (step <= 0.0 || end < start) return MS::kInvalidParameter;
+
+    MStatus status;
+    HdUtils::time_point startTime = HdUtils::getCurrentTimePoint();
+
+    if (!HdCacheMap::exists(cacheId))
+    {
+        log->error("Cache '{}' does not exist.", cacheId);
+        return MS::kNotFound;
+    }
+    std::shared_ptr<HdMeshCache> meshCache = HdCacheMap::get(cacheId, status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    MObject oPoseNode = findPoseNode(cacheId, status);
+    if (status != MS::kSuccess)
+    {
+        log->error("No pose node drives cache '{}'.", cacheId);
+        return status;
+    }
+
+    std::vector<double> frames;
+    for (double frame=start; frame<=end; frame+=step) frames.push_back(frame);
+
+    HdPoseSampler sampler(oPoseNode, status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    std::vector<std::string> poseIds = sampler.sample(frames, status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    // one pose in memory at a time, repeated poses only add a frame table entry
+    HdGeoStreamWriter writer;
+    if (!writer.open(path)) return MS::kFailure;
+
+    uint64_t payloadBytes = 0;
+    for (size_t f=0; f<frames.size(); f++)
+    {
+        const std::string& poseId = poseIds[f];
+        if (!writer.hasPose(poseId))
+        {
+            HdBlob blob;
+            if (!meshCache->getBlob(poseId, blob))
+            {
+                log->error("Frame {} of cache '{}' is not cached. Bake the range first (hdCache -bake).", frames[f], cacheId);
+                writer.abort();
+                return MS::kNotFound;
+            }
+            if (!writer.addPose(poseId, blob))
+            {
+                writer.abort();
+                return MS::kFailure;
+            }
+            payloadBytes += blob.size;
+        }
+        if (!writer.addFrame(frames[f], poseId))
+        {
+            writer.abort();
+            return MS::kFailure;
+        }
+    }
+
+    uint64_t frameCount = writer.frameCount();
+    uint64_t poseCount = writer.poseCount();
+    if (!writer.finish()) return MS::kFailure;
+
+    // a frame based cache stores every frame, estimated from the average pose
+    uint64_t frameBasedBytes = poseCount > 0 ? payloadBytes / poseCount * frameCount : 0;
+    HdUtils::time_duration duration = HdUtils::getCurrentTimePoint() - startTime;
+
+    json = "{";
+    json += "\"cache\": \"" + cacheId + "\", ";
+    json += "\"path\": \"" + path + "\", ";
+    json += "\"frames\": " + std::to_string(frameCount) + ", ";
+    json += "\"unique_poses\": " + std::to_string(poseCount) + ", ";
+    json += "\"file_size\": " + std::to_string(writer.fileSize()) + ", ";
+    json += "\"frame_based_size\": " + std::to_string(frameBasedBytes) + ", ";
+    json += "\"time_ms\": " + std::to_string(duration.count()) + "}";
+
+    log->info("Exported {} frames ({} unique poses) of cache '{}' to '{}'. ({}ms)", frameCount, poseCount, cacheId, path, duration.count());
+    return MS::kSuccess;
+}
@@ -0,0 +1,362 @@
+//
+// -----------------------------------------------------------------------------
+// This source file has been developed within the scope of the
+// Technical Director course at Filmakademie Baden-Wuerttemberg.
+// http://technicaldirector.de
+//
+// Written by Tim Lehr
+// Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+// -----------------------------------------------------------------------------
+//
+
+#include "HdGeoStream.h"
+
+#include <cstring>
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "HdLogger.h"
+
+namespace
+{
+    uint64_t topologyHash(const std::vector<HdPoseBlobMeshView>& meshViews)
+    {
+        uint64_t hash = meshViews.size();
+        for (size_t i=0; i<meshViews.size(); i++)
+        {
+            const HdPoseBlobMeshView& view = meshViews[i];
+            hash = hash * 31 + view.mesh->vertCount;
+            hash = hash * 31 + hdChecksum64(reinterpret_cast<const char*>(view.polyVertCounts), view.topologySize());
+        }
+        return hash;
+    }
+
+    uint64_t alignOffset(uint64_t offset)
+    {
+        // keeps the float and table arrays aligned for direct access through the map
+        return (offset + 7) & ~((uint64_t) 7);
+    }
+}
+
+HdGeoStreamWriter::HdGeoStreamWriter()
+{
+    log = HdUtils::getLoggerInstance("HdGeoStream");
+}
+
+HdGeoStreamWriter::~HdGeoStreamWriter()
+{
+    if (fd_ >= 0) abort();
+}
+
+bool HdGeoStreamWriter::open(const std::string& path)
+{
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd_ < 0)
+    {
+        log->error("Could not create geometry stream '{}': {}", path, std::strerror(errno));
+        return false;
+    }
+
+    path_ = path;
+    endOffset_ = sizeof(HdGeoStreamHeader);
+    meshes_.clear();
+    poses_.clear();
+    poseKeys_.clear();
+    frames_.clear();
+    poseIndices_.clear();
+    pointCount_ = 0;
+
+    // an empty header until finish(), the reader rejects the file before
+    HdGeoStreamHeader header;
+    std::memset(&header, 0, sizeof(header));
+    return writeAt(reinterpret_cast<const char*>(&header), sizeof(header), 0);
+}
+
+bool HdGeoStreamWriter::writeAt(const char* data, size_t size, uint64_t offset)
+{
+    while (size > 0)
+    {
+        ssize_t result = ::pwrite(fd_, data, size, (off_t) offset);
+        if (result < 0 && errno == EINTR) continue;
+        if (result <= 0)
+        {
+            log->error("Write to geometry stream '{}' failed: {}", path_, std::strerror(errno));
+            return false;
+        }
+        data += result;
+        offset += result;
+        size -= result;
+    }
+    return true;
+}
+
+bool HdGeoStreamWriter::writeTopology(const std::vector<HdPoseBlobMeshView>& meshViews)
+{
+    for (size_t i=0; i<meshViews.size(); i++)
+    {
+        const HdPoseBlobMeshView& view = meshViews[i];
+        if (!writeAt(reinterpret_cast<const char*>(view.mesh), sizeof(HdPoseBlobMesh), endOffset_)) return false;
+        endOffset_ += sizeof(HdPoseBlobMesh);
+        if (!writeAt(reinterpret_cast<const char*>(view.polyVertCounts), view.topologySize(), endOffset_)) return false;
+        endOffset_ += view.topologySize();
+
+        meshes_.push_back(*view.mesh);
+        pointCount_ += view.mesh->vertCount;
+    }
+    topologyHash_ = topologyHash(meshViews);
+    return true;
+}
+
+bool HdGeoStreamWriter::hasPose(const std::string& poseKey)
+{
+    return poseIndices_.count(poseKey) > 0;
+}
+
+bool HdGeoStreamWriter::addPose(const std::string& poseKey, const HdBlob& poseBlob)
+{
+    if (fd_ < 0) return false;
+    if (hasPose(poseKey)) return true;
+
+    std::vector<HdPoseBlobMeshView> meshViews;
+    if (!HdPoseBlob::parse(poseBlob, meshViews))
+    {
+        log->error("Invalid pose data for pose key '{}'.", poseKey);
+        return false;
+    }
+
+    if (poses_.empty())
+    {
+        if (!writeTopology(meshViews)) return false;
+    }
+    else if (meshViews.size() != meshes_.size() || topologyHash(meshViews) != topologyHash_)
+    {
+        // a stream only holds deforming meshes, changing topology needs a frame based cache
+        log->error("Topology of pose key '{}' differs from the first pose.", poseKey);
+        return false;
+    }
+
+    HdGeoStreamPose pose;
+    pose.pointsOffset = alignOffset(endOffset_);
+    pose.keyOffset = 0;
+    pose.keySize = (uint32_t) poseKey.size();
+    pose.reserved = 0;
+
+    uint64_t offset = pose.pointsOffset;
+    for (size_t i=0; i<meshViews.size(); i++)
+    {
+        if (!writeAt(reinterpret_cast<const char*>(meshViews[i].points), meshViews[i].pointsSize(), offset)) return false;
+        offset += meshViews[i].pointsSize();
+    }
+    endOffset_ = offset;
+
+    poseIndices_[poseKey] = poses_.size();
+    poses_.push_back(pose);
+    poseKeys_.push_back(poseKey);
+    return true;
+}
+
+bool HdGeoStreamWriter::addFrame(double frame, const std::string& poseKey)
+{
+    std::unordered_map<std::string, uint64_t>::const_iterator it = poseIndices_.find(poseKey);
+    if (it == poseIndices_.end())
+    {
+        log->error("Frame {} references unknown pose key '{}'.", frame, poseKey);
+        return false;
+    }
+    if (!frames_.empty() && frame <= frames_.back().frame)
+    {
+        log->error("Frames have to be added in ascending order ({} after {}).", frame, frames_.back().frame);
+        return false;
+    }
+
+    HdGeoStreamFrame entry;
+    entry.frame = frame;
+    entry.poseIndex = it->second;
+    frames_.push_back(entry);
+    return true;
+}
+
+bool HdGeoStreamWriter::finish()
+{
+    if (fd_ < 0) return false;
+
+    // keys first, their offsets go into the pose table
+    uint64_t keysSize = 0;
+    for (size_t i=0; i<poses_.size(); i++)
+    {
+        poses_[i].keyOffset = keysSize;
+        keysSize += poseKeys_[i].size();
+    }
+
+    HdGeoStreamHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, HD_GEOSTREAM_MAGIC, sizeof(header.magic));
+    header.version = HD_GEOSTREAM_VERSION;
+    header.meshCount = (uint32_t) meshes_.size();
+    header.frameCount = frames_.size();
+    header.poseCount = poses_.size();
+    header.pointCount = pointCount_;
+    header.topologyOffset = sizeof(HdGeoStreamHeader);
+    header.poseTableOffset = alignOffset(endOffset_);
+    header.frameTableOffset = header.poseTableOffset + poses_.size() * sizeof(HdGeoStreamPose);
+    header.keysOffset = header.frameTableOffset + frames_.size() * sizeof(HdGeoStreamFrame);
+
+    bool success = writeAt(reinterpret_cast<const char*>(poses_.data()), poses_.size() * sizeof(HdGeoStreamPose), header.poseTableOffset) &&
+                   writeAt(reinterpret_cast<const char*>(frames_.data()), frames_.size() * sizeof(HdGeoStreamFrame), header.frameTableOffset);
+
+    uint64_t keyOffset = header.keysOffset;
+    for (size_t i=0; i<poseKeys_.size() && success; i++)
+    {
+        success = writeAt(poseKeys_[i].data(), poseKeys_[i].size(), keyOffset);
+        keyOffset += poseKeys_[i].size();
+    }
+    endOffset_ = keyOffset;
+
+    // the header goes last, a crash before leaves an invalid file behind
+    success = success && ::fsync(fd_) == 0 && writeAt(reinterpret_cast<const char*>(&header), sizeof(header), 0);
+    ::close(fd_);
+    fd_ = -1;
+
+    if (!success)
+    {
+        ::unlink(path_.c_str());
+        return false;
+    }
+
+    log->info("Wrote geometry stream '{}': {} frames, {} unique poses, {} bytes.", path_, frames_.size(), poses_.size(), endOffset_);
+    return true;
+}
+
+void HdGeoStreamWriter::abort()
+{
+    if (fd_ < 0) return;
+    ::close(fd_);
+    fd_ = -1;
+    ::unlink(path_.c_str());
+}
+
+HdGeoStreamReader::~HdGeoStreamReader()
+{
+    close();
+}
+
+bool HdGeoStreamReader::open(const std::string& path)
+{
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat fileStat;
+    if (::fstat(fd, &fileStat) != 0 || (size_t) fileStat.st_size < sizeof(HdGeoStreamHeader))
+    {
+        ::close(fd);
+        return false;
+    }
+
+    // the map stays valid after closing the descriptor
+    void* data = ::mmap(nullptr, (size_t) fileStat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) return false;
+
+    data_ = static_cast<const char*>(data);
+    size_ = (size_t) fileStat.st_size;
+    if (!validate())
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void HdGeoStreamReader::close()
+{
+    if (data_ != nullptr) ::munmap(const_cast<char*>(data_), size_);
+    data_ = nullptr;
+    size_ = 0;
+    header_ = nullptr;
+    poses_ = nullptr;
+    frames_ = nullptr;
+    topology_.clear();
+    pointOffsets_.clear();
+}
+
+bool HdGeoStreamReader::validate()
+{
+    header_ = reinterpret_cast<const HdGeoStreamHeader*>(data_);
+    if (std::memcmp(header_->magic, HD_GEOSTREAM_MAGIC, sizeof(header_->magic)) != 0) return false;
+    if (header_->version != HD_GEOSTREAM_VERSION) return false;
+
+    const HdGeoStreamHeader& header = *header_;
+    if (header.poseTableOffset > size_ || header.poseCount > (size_ - header.poseTableOffset) / sizeof(HdGeoStreamPose)) return false;
+    if (header.frameTableOffset > size_ || header.frameCount > (size_ - header.frameTableOffset) / sizeof(HdGeoStreamFrame)) return false;
+    if (header.keysOffset > size_) return false;
+
+    poses_ = reinterpret_cast<const HdGeoStreamPose*>(data_ + header.poseTableOffset);
+    frames_ = reinterpret_cast<const HdGeoStreamFrame*>(data_ + header.frameTableOffset);
+
+    uint64_t offset = header.topologyOffset;
+    uint64_t pointCount = 0;
+    for (uint32_t i=0; i<header.meshCount; i++)
+    {
+        if (offset + sizeof(HdPoseBlobMesh) > header.poseTableOffset) return false;
+
+        HdPoseBlobMeshView view;
+        view.mesh = reinterpret_cast<const HdPoseBlobMesh*>(data_ + offset);
+        view.points = nullptr;
+        view.polyVertCounts = reinterpret_cast<const int32_t*>(data_ + offset + sizeof(HdPoseBlobMesh));
+        view.polyVertConnections = view.polyVertCounts + view.mesh->polyCount;
+        offset += sizeof(HdPoseBlobMesh) + view.topologySize();
+        if (offset > header.poseTableOffset) return false;
+
+        topology_.push_back(view);
+        pointOffsets_.push_back(pointCount);
+        pointCount += view.mesh->vertCount;
+    }
+    if (pointCount != header.pointCount) return false;
+
+    const uint64_t poseSize = header.pointCount * 3 * sizeof(float);
+    uint64_t keysSize = size_ - header.keysOffset;
+    for (uint64_t i=0; i<header.poseCount; i++)
+    {
+        const HdGeoStreamPose& pose = poses_[i];
+        if (pose.pointsOffset < offset || pose.pointsOffset + poseSize > header.poseTableOffset) return false;
+        if (pose.keyOffset + pose.keySize > keysSize) return false;
+    }
+    for (uint64_t i=0; i<header.frameCount; i++)
+    {
+        if (frames_[i].poseIndex >= header.poseCount) return false;
+    }
+    return true;
+}
+
+std::string HdGeoStreamReader::poseKey(uint64_t poseIndex)
+{
+    const HdGeoStreamPose& pose = poses_[poseIndex];
+    return std::string(data_ + header_->keysOffset + pose.keyOffset, pose.keySize);
+}
+
+int64_t HdGeoStreamReader::findFrame(double frame)
+{
+    const HdGeoStreamFrame* end = frames_ + header_->frameCount;
+    const HdGeoStreamFrame* it = std::upper_bound(frames_, end, frame,
+        [](double value, const HdGeoStreamFrame& entry) {return value < entry.frame;});
+    return (int64_t) (it - frames_) - 1;
+}
+
+const float* HdGeoStreamReader::points(uint64_t poseIndex, uint32_t meshIndex)
+{
+    const float* posePoints = reinterpret_cast<const float*>(data_ + poses_[poseIndex].pointsOffset);
+    return posePoints + pointOffsets_[meshIndex] * 3;
+}
+
+HdPoseBlobMeshView HdGeoStreamReader::mesh(uint64_t poseIndex, uint32_t meshIndex)
+{
+    HdPoseBlobMeshView view = topology_[meshIndex];
+    view.points = points(poseIndex, meshIndex);
+    return view;
+}
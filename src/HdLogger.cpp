@@ -0,0 +1,34 @@
+//
+// -----------------------------------------------------------------------------
+// This source file has been developed within the scope of the
+// Technical Director course at Filmakademie Baden-Wuerttemberg.
+// http://technicaldirector.de
+//
+// Written by Tim Lehr
+// Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+// -----------------------------------------------------------------------------
+//
+
+#include "HdLogger.h"
+
+#include <iostream>
+
+std::shared_ptr<spdlog::logger> HdUtils::getLoggerInstance(std::string loggerName)
+{
+    auto log = spdlog::get(loggerName);
+    if (log != nullptr) {
+        return log;
+    }
+
+    try
+    {
+        return spdlog::stdout_color_mt(loggerName);
+    }
+    catch (const spdlog::spdlog_ex& ex)
+    {
+        std::cout << "Logger '" << loggerName << "' initialization failed: " << 
+        ex.what() << std::endl;
+    }
+
+    return nullptr;
+}
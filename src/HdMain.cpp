@@ -12,8 +12,18 @@
 #include "HdMeshCache.h"
 #include "HdCacheNode.h"
 #include "HdPoseNode.h"
+#include "HdPoseMemo.h"
+#include "HdRigFingerprint.h"
+#include "HdControlWatch.h"
 #include "HdCommands.h"
 #include "HdEvaluator.h"
+#include "HdPrefetcher.h"
+#include "HdAutoFill.h"
+#include "HdReplay.h"
+#include "HdRealtime.h"
+#include "HdSceneCallbacks.h"
+#include "HdSceneRegistry.h"
+#include "HdTaskPool.h"
 
 #include <maya/MFnPlugin.h>
 #include "spdlog/spdlog.h"
@@ -44,6 +54,38 @@ MStatus initializePlugin(MObject obj)
     status = fnPlugin.registerCommand("hdLog", HdCmdLog::creator);
     CHECK_MSTATUS_AND_RETURN_IT(status);
 
+    // Hyperdrive Prefetch Command
+    status = fnPlugin.registerCommand("hdPrefetch", HdCmdPrefetch::creator);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    // Hyperdrive Auto-Fill Command
+    status = fnPlugin.registerCommand("hdAutoFill", HdCmdAutoFill::creator);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    // Hyperdrive Coverage Command
+    status = fnPlugin.registerCommand("hdCoverage", HdCmdCoverage::creator);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    // Hyperdrive Export Command
+    status = fnPlugin.registerCommand("hdExport", HdCmdExport::creator);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    // Hyperdrive Replay Command
+    status = fnPlugin.registerCommand("hdReplay", HdCmdReplay::creator);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    // Hyperdrive Real-time Command
+    status = fnPlugin.registerCommand("hdRealtime", HdCmdRealtime::creator);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    // Hyperdrive Setup Command
+    status = fnPlugin.registerCommand("hdSetup", HdCmdSetup::creator);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    // Hyperdrive Interactive Command
+    status = fnPlugin.registerCommand("hdInteractive", HdCmdInteractive::creator);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
     // Hyperdrive Cache Node
     status = fnPlugin.registerNode("hyperdriveCache", 
     HdCacheNode::id, 
@@ -58,6 +100,22 @@ MStatus initializePlugin(MObject obj)
     HdPoseNode::initialize);
     CHECK_MSTATUS_AND_RETURN_IT(status);
 
+    // Sidecar cache files
+    status = HdSceneCallbacks::registerCallbacks();
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    // Hyperdrive nodes of the scene for the evaluator
+    status = HdSceneRegistry::instance().registerCallbacks();
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    // Pose memo and rig fingerprint invalidation on edits and undo, control manipulation
+    HdPoseMemo::registerCallbacks();
+    HdRigFingerprint::registerCallbacks();
+    HdControlWatch::registerCallbacks();
+
+    // Render-time replay, configured by the farm environment
+    HdReplay::instance().initFromEnvironment();
+
     std::cout << std::endl << 
     "##################################" << std::endl <<
     "HYPERDRIVE v" << hd_version << std::endl <<
@@ -71,6 +129,20 @@ MStatus uninitializePlugin(MObject obj)
     MStatus status;
     MFnPlugin fnPlugin(obj);
 
+    // stop pending disk reads before the caches go away
+    HdPrefetcher::instance().shutdown();
+    HdRealtime::instance().shutdown();
+    HdAutoFill::instance().shutdown();
+    HdReplay::instance().shutdown();
+    HdTaskPool::instance().shutdown();
+    HdSceneCallbacks::deregisterCallbacks();
+    HdSceneRegistry::instance().deregisterCallbacks();
+    HdPoseMemo::deregisterCallbacks();
+    HdRigFingerprint::deregisterCallbacks();
+    HdControlWatch::deregisterCallbacks();
+    HdUtils::setInteractiveActive(false);
+    HdCacheMap::stopWarmLoads();
+
     // deregister custom evaluator
     status =  fnPlugin.deregisterEvaluator("hdEvaluator");
     CHECK_MSTATUS_AND_RETURN_IT(status);
@@ -79,6 +151,38 @@ MStatus uninitializePlugin(MObject obj)
     status = fnPlugin.deregisterCommand("hdCache");
     CHECK_MSTATUS_AND_RETURN_IT(status);
 
+    // Hyperdrive Prefetch Command
+    status = fnPlugin.deregisterCommand("hdPrefetch");
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    // Hyperdrive Auto-Fill Command
+    status = fnPlugin.deregisterCommand("hdAutoFill");
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    // Hyperdrive Coverage Command
+    status = fnPlugin.deregisterCommand("hdCoverage");
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    // Hyperdrive Export Command
+    status = fnPlugin.deregisterCommand("hdExport");
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    // Hyperdrive Replay Command
+    status = fnPlugin.deregisterCommand("hdReplay");
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    // Hyperdrive Real-time Command
+    status = fnPlugin.deregisterCommand("hdRealtime");
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    // Hyperdrive Setup Command
+    status = fnPlugin.deregisterCommand("hdSetup");
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    // Hyperdrive Interactive Command
+    status = fnPlugin.deregisterCommand("hdInteractive");
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
     // Hyperdrive Status Command
     status = fnPlugin.deregisterCommand("hdStatus");
     CHECK_MSTATUS_AND_RETURN_IT(status);
@@ -11,8 +11,11 @@
 
 #include "HdMeshCache.h"
 
+#include <unistd.h>
+#include <algorithm>
 #include <maya/MGlobal.h>
 #include "HdUtils.h"
+#include "HdPoseBlob.h"
 
 /***********************************************
  * HDMESHUVSETDATA
@@ -26,6 +29,7 @@ double HdMeshUVSetData::memSize()
     result += polyUVCounts.capacity() * sizeof(int);
     result += polyUVIds.capacity() * sizeof(int);
     result = result / 1024.0; // Kbytes
+    return result;
 }
 
 /***********************************************
@@ -50,6 +54,7 @@ double HdMeshData::memSize()
 
     //result += uvSets->length() * sizeof(int); TODO: UvSet iterate and add size
     result = result * 2 / 1024.0; // + MObject estimation in Kbytes
+    return result;
 }
 
 /***********************************************
@@ -65,11 +70,113 @@ double HdMeshSet::memSize()
     return result;
 }
 
+HdBlob HdMeshSet::toBlob()
+{
+    size_t blobSize = sizeof(HdPoseBlobHeader);
+    for(std::vector<HdMeshData>::iterator it = begin(); it != end(); ++it) {
+        blobSize += HdPoseBlob::meshSize(it->points->length(), it->polyVertCounts->length(), it->polyVertConnections->length());
+    }
+
+    char* buffer;
+    HdBlob blob = HdBlob::allocate(blobSize, &buffer);
+
+    HdPoseBlobHeader header;
+    header.magic = HD_POSEBLOB_MAGIC;
+    header.version = HD_POSEBLOB_VERSION;
+    header.meshCount = (uint32_t) size();
+    header.reserved = 0;
+    std::memcpy(buffer, &header, sizeof(header));
+    char* pos = buffer + sizeof(header);
+
+    for(std::vector<HdMeshData>::iterator it = begin(); it != end(); ++it) {
+        HdPoseBlobMesh mesh;
+        mesh.vertCount = it->points->length();
+        mesh.polyCount = it->polyVertCounts->length();
+        mesh.connectionCount = it->polyVertConnections->length();
+        mesh.reserved = 0;
+        std::memcpy(pos, &mesh, sizeof(mesh));
+        pos += sizeof(mesh);
+
+        // points are stored without the homogeneous w component
+        float* points = reinterpret_cast<float*>(pos);
+        const MFloatPointArray& srcPoints = *(it->points);
+        for (unsigned int i=0; i<mesh.vertCount; i++)
+        {
+            const MFloatPoint& point = srcPoints[i];
+            points[i * 3] = point.x;
+            points[i * 3 + 1] = point.y;
+            points[i * 3 + 2] = point.z;
+        }
+        pos += (uint64_t) mesh.vertCount * 3 * sizeof(float);
+
+        it->polyVertCounts->get(reinterpret_cast<int*>(pos));
+        pos += mesh.polyCount * sizeof(int32_t);
+
+        it->polyVertConnections->get(reinterpret_cast<int*>(pos));
+        pos += mesh.connectionCount * sizeof(int32_t);
+    }
+
+    return blob;
+}
+
+std::shared_ptr<HdMeshSet> HdMeshSet::fromBlob(const HdBlob& blob, MStatus& status)
+{
+    std::vector<HdPoseBlobMeshView> meshViews;
+    if (!HdPoseBlob::parse(blob, meshViews))
+    {
+        status = MS::kInvalidParameter;
+        return nullptr;
+    }
+
+    std::shared_ptr<HdMeshSet> meshSet = std::make_shared<HdMeshSet>();
+    meshSet->reserve(meshViews.size());
+
+    for (size_t i=0; i<meshViews.size(); i++)
+    {
+        const HdPoseBlobMeshView& view = meshViews[i];
+        HdMeshData meshData((int) view.mesh->vertCount, (int) view.mesh->polyCount);
+
+        std::shared_ptr<MFloatPointArray> points = std::make_shared<MFloatPointArray>(view.mesh->vertCount);
+        for (unsigned int j=0; j<view.mesh->vertCount; j++)
+        {
+            points->set(j, view.points[j * 3], view.points[j * 3 + 1], view.points[j * 3 + 2]);
+        }
+        meshData.points = points;
+        meshData.polyVertCounts = std::make_shared<MIntArray>(view.polyVertCounts, view.mesh->polyCount);
+        meshData.polyVertConnections = std::make_shared<MIntArray>(view.polyVertConnections, view.mesh->connectionCount);
+
+        // no MObject yet, the cache node reconstructs the mesh on first use
+        meshSet->push_back(meshData);
+    }
+
+    status = MS::kSuccess;
+    return meshSet;
+}
+
+uint64_t HdMeshSet::topologyHash()
+{
+    // identifies meshes with the same point count and connectivity, independent of the pose
+    size_t hash = size();
+    for(std::vector<HdMeshData>::iterator it = begin(); it != end(); ++it) {
+        HdUtils::hash_combine(hash, it->totalVertCount);
+        HdUtils::hash_combine(hash, it->totalPolyCount);
+
+        std::vector<int> counts(it->polyVertCounts->length());
+        std::vector<int> connections(it->polyVertConnections->length());
+        it->polyVertCounts->get(counts.data());
+        it->polyVertConnections->get(connections.data());
+        HdUtils::hash_combine(hash, hdChecksum64(reinterpret_cast<const char*>(counts.data()), counts.size() * sizeof(int)));
+        HdUtils::hash_combine(hash, hdChecksum64(reinterpret_cast<const char*>(connections.data()), connections.size() * sizeof(int)));
+    }
+    return (uint64_t) hash;
+}
+
 /***********************************************
  * HDMESHCACHE
  * ********************************************/
 
-HdMeshCache::HdMeshCache(std::string cacheId, size_t maxCacheSize)
+HdMeshCache::HdMeshCache(std::string cacheId, size_t maxCacheSize) : 
+    warmLoadStop_(false), warmLoading_(false), warmLoaded_(0)
 {
     // set cache Id
     cacheId_ = cacheId;
@@ -81,7 +188,12 @@ HdMeshCache::HdMeshCache(std::string cacheId, size_t maxCacheSize)
 
 HdMeshCache::~HdMeshCache()
 {
+    stopWarmLoad();
     destroyCache();
+    detachDiskTier();
+    detachWriteBackTier();
+    detachSharedTier();
+    detachDaemonTier();
 }
 
 MStatus HdMeshCache::initCache(size_t maxCacheSize) 
@@ -103,6 +215,7 @@ MStatus HdMeshCache::initCache(size_t maxCacheSize)
 
 MStatus HdMeshCache::destroyCache() 
 {
+    stopWarmLoad();
     clear();
     delete meshCache_;
     meshCache_ = NULL;
@@ -114,54 +227,538 @@ MStatus HdMeshCache::destroyCache()
 
 MStatus HdMeshCache::put(std::string poseId, std::shared_ptr<HdMeshSet> meshSet)
 {
-    if (maxSize() == 0) 
     {
-        log->info("Cache without max size detected. Set max size based on current pose size.");
-        applyMaxMemSize(meshSet->memSize());
+        std::lock_guard<std::mutex> lock(sizeMutex_);
+        insertLocked(poseId, meshSet);
+        log->debug("Put cache for pose ID: '{}'. Mem size: {} kbytes", poseId, (int) itemMemSize_);
+    }
+
+    // write through, so poses evicted from memory stay available in the lower tiers
+    std::vector<std::shared_ptr<HdCacheTier>> tiers = getTiers();
+    if (!tiers.empty())
+    {
+        HdBlob blob = meshSet->toBlob();
+        for (size_t i=0; i<tiers.size(); i++)
+        {
+            if (!tiers[i]->writable() || tiers[i]->exists(poseId)) continue;
+            if (!tiers[i]->write(poseId, blob))
+            {
+                log->warn("Could not write pose ID '{}' to {} tier.", poseId, tiers[i]->tierName());
+            }
+        }
     }
+    return MS::kSuccess;
+}
 
+void HdMeshCache::materialize(std::string poseId, std::shared_ptr<HdMeshSet> meshSet)
+{
+    // memory only, the pose was read from a lower tier
+    if (meshSet == nullptr) return;
+    std::lock_guard<std::mutex> lock(sizeMutex_);
+    if (meshCache_->contains(poseId)) return;
+    insertLocked(poseId, meshSet);
+    log->debug("Materialized pose ID '{}' in memory.", poseId);
+}
+
+void HdMeshCache::insertLocked(const std::string& poseId, std::shared_ptr<HdMeshSet> meshSet)
+{
+    // expects sizeMutex_ to be held. Replays and prefetches never call put(),
+    // so every path into memory sizes the cache on its first pose.
     itemMemSize_ = meshSet->memSize();
-    log->debug("Put cache for pose ID: '{}'. Mem size: {} kbytes", poseId, (int) itemMemSize_);
+    if (maxSize() == 0) 
+    {
+        log->info("Cache without max size detected. Set max size based on current pose size.");
+        applyMaxMemSize(itemMemSize_);
+    }
     meshCache_->insert(poseId, *meshSet);
-    return MS::kSuccess;
 }
 
 std::shared_ptr<HdMeshSet> HdMeshCache::get(std::string poseId, MStatus &status, bool copyData = false)
 {
-    std::shared_ptr<HdMeshSet> data;
     log->debug("Get cache for pose: {}", poseId);
-    if(meshCache_->contains(poseId)) 
+
+    // copied under the cache lock, the pose may be evicted by another context meanwhile
+    std::shared_ptr<HdMeshSet> data = std::make_shared<HdMeshSet>();
+    if (meshCache_->tryGet(poseId, *data))
     {
         status = MS::kSuccess;
-        if (copyData)
-        {
-            return std::make_shared<HdMeshSet>(meshCache_->getCopy(poseId)); // get a copy so it's safe to delete
-        } else 
+        return data;
+    }
+
+    // not in memory (evicted or not prefetched in time), read it synchronously from the tiers
+    std::vector<std::shared_ptr<HdCacheTier>> tiers = getTiers();
+    for (size_t i=0; i<tiers.size(); i++)
+    {
+        HdBlob blob;
+        if (!tiers[i]->read(poseId, blob)) continue;
+
+        data = HdMeshSet::fromBlob(blob, status);
+        if (status != MS::kSuccess)
         {
-            return std::make_shared<HdMeshSet>(meshCache_->get(poseId));
+            log->warn("Invalid pose data for ID '{}' in {} tier.", poseId, tiers[i]->tierName());
+            continue;
         }
+
+        log->debug("Loaded pose ID '{}' from {} tier.", poseId, tiers[i]->tierName());
+        std::lock_guard<std::mutex> lock(sizeMutex_);
+        insertLocked(poseId, data);
+        return data;
     }
+
+    status = MS::kNotFound;
+    return nullptr;
+}
+
+bool HdMeshCache::getBlob(std::string poseId, HdBlob& blob)
+{
+    // serialized pose for export, tier reads do not displace the working set in memory
+    HdMeshSet meshSet;
+    if (meshCache_->tryGet(poseId, meshSet))
+    {
+        blob = meshSet.toBlob();
+        return true;
+    }
+
+    std::vector<std::shared_ptr<HdCacheTier>> tiers = getTiers();
+    for (size_t i=0; i<tiers.size(); i++)
+    {
+        if (tiers[i]->read(poseId, blob)) return true;
+    }
+    return false;
 }
 
 bool HdMeshCache::exists(std::string poseId) 
+{
+    if (meshCache_->contains(poseId)) return true;
+
+    std::vector<std::shared_ptr<HdCacheTier>> tiers = getTiers();
+    for (size_t i=0; i<tiers.size(); i++)
+    {
+        if (tiers[i]->exists(poseId)) return true;
+    }
+    return false;
+}
+
+bool HdMeshCache::existsInMemory(std::string poseId) 
 {
     return meshCache_->contains(poseId); 
 }
 
+std::vector<std::shared_ptr<HdCacheTier>> HdMeshCache::getTiers()
+{
+    std::lock_guard<std::mutex> lock(tiersMutex_);
+    return tiers_;
+}
+
+MStatus HdMeshCache::attachDiskTier(std::string path, bool writable)
+{
+    std::shared_ptr<HdCacheFile> cacheFile = std::make_shared<HdCacheFile>();
+    bool opened = cacheFile->open(path, writable);
+    if (!opened && writable && cacheFile->lockedByOther())
+    {
+        // another session writes the file, read its poses like a replay does
+        log->warn("Disk tier '{}' is written by another process. Attach it read-only.", path);
+        writable = false;
+        opened = cacheFile->open(path, false);
+    }
+    if (!opened)
+    {
+        log->error("Could not attach disk tier: '{}'", path);
+        return MS::kFailure;
+    }
+
+    detachDiskTier();
+
+    std::lock_guard<std::mutex> lock(tiersMutex_);
+    diskTier_ = cacheFile;
+    tiers_.push_back(cacheFile);
+    log->info("Attached {}disk tier '{}' ({} poses).", writable ? "" : "read-only ", path, cacheFile->size());
+    return MS::kSuccess;
+}
+
+MStatus HdMeshCache::detachDiskTier()
+{
+    std::lock_guard<std::mutex> lock(tiersMutex_);
+    if (diskTier_ == nullptr) return MS::kSuccess;
+
+    for (std::vector<std::shared_ptr<HdCacheTier>>::iterator it = tiers_.begin(); it != tiers_.end(); ++it)
+    {
+        if (*it == diskTier_)
+        {
+            tiers_.erase(it);
+            break;
+        }
+    }
+
+    diskTier_->flush();
+    log->info("Detached disk tier '{}'.", diskTier_->path());
+    diskTier_ = nullptr;
+    return MS::kSuccess;
+}
+
+std::shared_ptr<HdCacheFile> HdMeshCache::diskTier()
+{
+    std::lock_guard<std::mutex> lock(tiersMutex_);
+    return diskTier_;
+}
+
+MStatus HdMeshCache::attachWriteBackTier(std::string path)
+{
+    // a private file next to a shared read-only disk tier, merged later with hdcachetool
+    std::shared_ptr<HdCacheFile> cacheFile = std::make_shared<HdCacheFile>();
+    if (!cacheFile->open(path, true))
+    {
+        log->error("Could not attach write-back tier: '{}'", path);
+        return MS::kFailure;
+    }
+
+    detachWriteBackTier();
+
+    std::lock_guard<std::mutex> lock(tiersMutex_);
+    writeBackTier_ = cacheFile;
+    tiers_.push_back(cacheFile);
+    log->info("Attached write-back tier '{}'.", path);
+    return MS::kSuccess;
+}
+
+MStatus HdMeshCache::detachWriteBackTier()
+{
+    std::lock_guard<std::mutex> lock(tiersMutex_);
+    if (writeBackTier_ == nullptr) return MS::kSuccess;
+
+    for (std::vector<std::shared_ptr<HdCacheTier>>::iterator it = tiers_.begin(); it != tiers_.end(); ++it)
+    {
+        if (*it == writeBackTier_)
+        {
+            tiers_.erase(it);
+            break;
+        }
+    }
+
+    // nothing missed, leave no empty shard behind
+    std::string path = writeBackTier_->path();
+    bool empty = writeBackTier_->size() == 0;
+    writeBackTier_->close();
+    if (empty) ::unlink(path.c_str());
+
+    log->info("Detached write-back tier '{}'.", path);
+    writeBackTier_ = nullptr;
+    return MS::kSuccess;
+}
+
+std::shared_ptr<HdCacheFile> HdMeshCache::writeBackTier()
+{
+    std::lock_guard<std::mutex> lock(tiersMutex_);
+    return writeBackTier_;
+}
+
+void HdMeshCache::enableSharedTier(size_t segmentSize)
+{
+    // attached on the next put, once the mesh topology of this cache is known
+    std::lock_guard<std::mutex> lock(tiersMutex_);
+    sharedTierSize_ = segmentSize;
+    sharedTierFailed_ = false;
+}
+
+bool HdMeshCache::sharedTierPending()
+{
+    std::lock_guard<std::mutex> lock(tiersMutex_);
+    return sharedTierSize_ > 0 && sharedTier_ == nullptr && !sharedTierFailed_;
+}
+
+MStatus HdMeshCache::attachSharedTier(std::string rigTag, uint64_t topologyHash)
+{
+    size_t segmentSize;
+    {
+        std::lock_guard<std::mutex> lock(tiersMutex_);
+        segmentSize = sharedTierSize_;
+    }
+    if (segmentSize == 0) return MS::kInvalidParameter;
+
+    // processes with the same rig and meshes end up in the same segment
+    std::string segmentKey = rigTag + ":" + std::to_string(topologyHash);
+    std::shared_ptr<HdShmTier> shmTier = std::make_shared<HdShmTier>();
+    if (!shmTier->open(segmentKey, segmentSize))
+    {
+        log->error("Could not attach shared memory tier for rig tag '{}'.", rigTag);
+        std::lock_guard<std::mutex> lock(tiersMutex_);
+        sharedTierFailed_ = true;
+        return MS::kFailure;
+    }
+
+    detachSharedTier();
+
+    std::lock_guard<std::mutex> lock(tiersMutex_);
+    sharedTier_ = shmTier;
+    tiers_.insert(tiers_.begin(), shmTier); // cheapest lower tier, checked first
+    log->info("Attached shared memory tier '{}' ({} poses).", shmTier->name(), shmTier->size());
+    return MS::kSuccess;
+}
+
+MStatus HdMeshCache::detachSharedTier()
+{
+    std::lock_guard<std::mutex> lock(tiersMutex_);
+    if (sharedTier_ == nullptr) return MS::kSuccess;
+
+    for (std::vector<std::shared_ptr<HdCacheTier>>::iterator it = tiers_.begin(); it != tiers_.end(); ++it)
+    {
+        if (*it == sharedTier_)
+        {
+            tiers_.erase(it);
+            break;
+        }
+    }
+
+    log->info("Detached shared memory tier '{}'.", sharedTier_->name());
+    sharedTier_ = nullptr;
+    return MS::kSuccess;
+}
+
+std::shared_ptr<HdShmTier> HdMeshCache::sharedTier()
+{
+    std::lock_guard<std::mutex> lock(tiersMutex_);
+    return sharedTier_;
+}
+
+void HdMeshCache::enableDaemonTier(std::string socketPath)
+{
+    // attached on the next put, like the shared memory tier
+    std::lock_guard<std::mutex> lock(tiersMutex_);
+    daemonSocket_ = socketPath;
+}
+
+bool HdMeshCache::daemonTierPending()
+{
+    std::lock_guard<std::mutex> lock(tiersMutex_);
+    return !daemonSocket_.empty() && daemonTier_ == nullptr;
+}
+
+MStatus HdMeshCache::attachDaemonTier(std::string rigTag, uint64_t topologyHash)
+{
+    std::string socketPath;
+    {
+        std::lock_guard<std::mutex> lock(tiersMutex_);
+        socketPath = daemonSocket_;
+    }
+    if (socketPath.empty()) return MS::kInvalidParameter;
+
+    // the daemon may be started later, the tier reconnects on its own
+    std::shared_ptr<HdDaemonTier> tier = std::make_shared<HdDaemonTier>(socketPath, rigTag + ":" + std::to_string(topologyHash));
+    if (!tier->connect())
+    {
+        log->warn("Cache daemon not running at '{}'. Will retry in the background.", socketPath);
+    }
+
+    detachDaemonTier();
+
+    std::lock_guard<std::mutex> lock(tiersMutex_);
+    daemonTier_ = tier;
+    tiers_.insert(tiers_.begin() + (sharedTier_ ? 1 : 0), tier); // after shared memory, before disk
+    log->info("Attached cache daemon tier '{}'.", socketPath);
+    return MS::kSuccess;
+}
+
+MStatus HdMeshCache::detachDaemonTier()
+{
+    std::lock_guard<std::mutex> lock(tiersMutex_);
+    if (daemonTier_ == nullptr) return MS::kSuccess;
+
+    for (std::vector<std::shared_ptr<HdCacheTier>>::iterator it = tiers_.begin(); it != tiers_.end(); ++it)
+    {
+        if (*it == daemonTier_)
+        {
+            tiers_.erase(it);
+            break;
+        }
+    }
+
+    log->info("Detached cache daemon tier '{}'.", daemonTier_->socketPath());
+    daemonTier_ = nullptr;
+    return MS::kSuccess;
+}
+
+std::shared_ptr<HdDaemonTier> HdMeshCache::daemonTier()
+{
+    std::lock_guard<std::mutex> lock(tiersMutex_);
+    return daemonTier_;
+}
+
+MStatus HdMeshCache::persist(std::string path)
+{
+    std::shared_ptr<HdCacheFile> currentTier = diskTier();
+    if (currentTier != nullptr && currentTier->path() == path)
+    {
+        if (!currentTier->writable())
+        {
+            log->error("Cache file '{}' is attached read-only, it is written by another process.", path);
+            return MS::kFailure;
+        }
+
+        // poses were written through already
+        return currentTier->flush() ? MS::kSuccess : MS::kFailure;
+    }
+
+    HdCacheFile cacheFile;
+    if (!cacheFile.open(path, true))
+    {
+        log->error("Could not open cache file for writing: '{}'", path);
+        return MS::kFailure;
+    }
+
+    size_t written = 0;
+    size_t failed = 0;
+
+    // poses that only live on disk (evicted from memory)
+    if (currentTier != nullptr)
+    {
+        currentTier->forEachEntry([&](const std::string& poseId, const HdCacheFileEntry& entry) {
+            if (cacheFile.exists(poseId)) return;
+            HdBlob blob;
+            if (currentTier->readEntry(entry, blob, true) && cacheFile.write(poseId, blob)) written++;
+            else failed++;
+        });
+    }
+
+    // copy the memory entries first, the LRU is locked while walking it
+    std::vector<std::pair<std::string, HdMeshSet>> entries;
+    auto collect = [&entries](const lru11::KeyValuePair<std::string, HdMeshSet>& pair) {
+        entries.push_back(std::make_pair(pair.key, pair.value));
+    };
+    meshCache_->cwalk(collect);
+
+    for (size_t i=0; i<entries.size(); i++)
+    {
+        if (cacheFile.exists(entries[i].first)) continue;
+        if (cacheFile.write(entries[i].first, entries[i].second.toBlob())) written++;
+        else failed++;
+    }
+
+    bool flushed = cacheFile.flush();
+    log->info("Persisted {} new poses to '{}' ({} poses total).", written, path, cacheFile.size());
+
+    if (failed > 0 || !flushed)
+    {
+        log->error("Failed to persist {} poses to '{}'.", failed, path);
+        return MS::kFailure;
+    }
+    return MS::kSuccess;
+}
+
+MStatus HdMeshCache::mergeShard(std::string path, size_t& merged, size_t& skipped)
+{
+    HdCacheFile shard;
+    if (!shard.open(path, false))
+    {
+        log->error("Could not open cache shard: '{}'", path);
+        return MS::kFailure;
+    }
+
+    // put() writes through, so merged poses end up in the lower tiers as well
+    size_t failed = 0;
+    shard.forEachEntry([&](const std::string& poseId, const HdCacheFileEntry& entry) {
+        if (exists(poseId))
+        {
+            skipped++;
+            return;
+        }
+
+        HdBlob blob;
+        MStatus status;
+        std::shared_ptr<HdMeshSet> meshSet;
+        if (shard.readEntry(entry, blob, true)) meshSet = HdMeshSet::fromBlob(blob, status);
+        if (meshSet == nullptr || status != MS::kSuccess)
+        {
+            failed++;
+            return;
+        }
+
+        put(poseId, meshSet);
+        merged++;
+    });
+
+    log->info("Merged cache shard '{}'. Merged: {}, Skipped: {}, Failed: {}", path, merged, skipped, failed);
+    return failed > 0 ? MS::kFailure : MS::kSuccess;
+}
+
+MStatus HdMeshCache::startWarmLoad()
+{
+    std::shared_ptr<HdCacheFile> cacheFile = diskTier();
+    if (cacheFile == nullptr) return MS::kInvalidParameter;
+
+    stopWarmLoad();
+    warmLoadStop_ = false;
+    warmLoading_ = true;
+    warmLoaded_ = 0;
+    warmLoadThread_ = std::thread(&HdMeshCache::warmLoad, this, cacheFile);
+    return MS::kSuccess;
+}
+
+void HdMeshCache::stopWarmLoad()
+{
+    warmLoadStop_ = true;
+    if (warmLoadThread_.joinable()) warmLoadThread_.join();
+    warmLoading_ = false;
+}
+
+void HdMeshCache::warmLoad(std::shared_ptr<HdCacheFile> cacheFile)
+{
+    // runs on the warm load thread. Poses that are not loaded yet are still
+    // served from the disk tier, this only moves them into memory ahead of time.
+    std::vector<std::pair<std::string, HdCacheFileEntry>> entries;
+    cacheFile->forEachEntry([&entries](const std::string& poseId, const HdCacheFileEntry& entry) {
+        entries.push_back(std::make_pair(poseId, entry));
+    });
+
+    log->info("Warm load {} poses from '{}'.", entries.size(), cacheFile->path());
+
+    for (size_t i=0; i<entries.size() && !warmLoadStop_; i++)
+    {
+        if (existsInMemory(entries[i].first)) continue;
+
+        HdBlob blob;
+        if (!cacheFile->readEntry(entries[i].second, blob, true)) continue;
+
+        MStatus status;
+        std::shared_ptr<HdMeshSet> meshSet = HdMeshSet::fromBlob(blob, status);
+        if (status != MS::kSuccess) continue;
+
+        // sized like put() on the main thread, the check and the insert are one step
+        std::lock_guard<std::mutex> lock(sizeMutex_);
+        if (maxSize() == 0)
+        {
+            itemMemSize_ = meshSet->memSize();
+            applyMaxMemSize(itemMemSize_);
+        }
+
+        // stop before evicting poses that were loaded or computed already
+        if (maxSize() > 0 && size() >= maxSize()) break;
+        if (meshCache_->contains(entries[i].first)) continue;
+
+        insertLocked(entries[i].first, meshSet);
+        warmLoaded_++;
+    }
+
+    log->info("Warm load finished. Loaded {} poses into memory.", (size_t) warmLoaded_);
+    warmLoading_ = false;
+}
+
 void HdMeshCache::setMaxSize(size_t maxSize)
 {
     log->debug("Set maximum cache pose count to: {}", maxSize);
+    std::lock_guard<std::mutex> lock(sizeMutex_);
     meshCache_->setMaxSize(maxSize);
 }
 
 void HdMeshCache::applyMaxMemSize(double poseDataMemSize)
 {
+    // expects sizeMutex_ to be held
     if (poseDataMemSize == 0.0) 
     {
         log->warn("Cannot set maximum cache size. Pose Data Memory Size is at an invalid value: {}kB", poseDataMemSize);
         return;
     }
-    int poseCount = (int) (maxMemSize() / poseDataMemSize);
+    // a max size of 0 means unlimited to the LRU, keep at least the current pose
+    int poseCount = std::max(1, (int) (maxMemSize() / poseDataMemSize));
     log->info("Set maximum cache size to: {}kB. Estimated pose count: {} ({}kB each)", maxMemSize(), poseCount, poseDataMemSize);
     meshCache_->setMaxSize(poseCount);
 }
@@ -183,22 +780,13 @@ MStatus HdMeshCache::clear()
 // INIT LOG
 std::shared_ptr<spdlog::logger> HdCacheMap::log = HdUtils::getLoggerInstance("HdCacheMap");
 std::map<std::string, std::shared_ptr<HdMeshCache>> HdCacheMap::cacheMap = std::map<std::string, std::shared_ptr<HdMeshCache>>();
+std::mutex HdCacheMap::mapMutex;
 
 
 bool HdCacheMap::exists(std::string cacheId)
 {
-    if (cacheMap.empty()) 
-    {
-        return false;
-    }
-
-    if (cacheMap.count(cacheId) > 0) 
-    {
-        return true;
-    } else
-    {
-        return false;
-    }
+    std::lock_guard<std::mutex> lock(mapMutex);
+    return cacheMap.count(cacheId) > 0;
 }
 
 std::shared_ptr<HdMeshCache> HdCacheMap::get(std::string cacheId, MStatus &status)
@@ -209,49 +797,64 @@ std::shared_ptr<HdMeshCache> HdCacheMap::get(std::string cacheId, MStatus &statu
         return nullptr;
     }
 
+    std::lock_guard<std::mutex> lock(mapMutex);
+    status = MS::kSuccess;
     std::map<std::string, std::shared_ptr<HdMeshCache>>::iterator it = cacheMap.find(cacheId);
     if (it != cacheMap.end()) 
     {
-        status = MS::kSuccess;
         return it->second;
     } else 
     {
-        status = MS::kSuccess;
         log->warn("Could not find cache ID in map. Create new cache for ID: '{}'", cacheId);
-        return HdCacheMap::createCache(cacheId, status, 0);
+        return HdCacheMap::createCacheLocked(cacheId, 0);
     }
         
 }
 
 MStatus HdCacheMap::removeCache(std::string cacheId)
 {
-    MStatus  status = MS::kSuccess;
-
-    if (exists(cacheId))
+    std::shared_ptr<HdMeshCache> meshCache;
     {
-        std::shared_ptr<HdMeshCache> meshCache = get(cacheId, status);
-        meshCache->destroyCache();
-        cacheMap.erase(cacheId);
+        std::lock_guard<std::mutex> lock(mapMutex);
+        std::map<std::string, std::shared_ptr<HdMeshCache>>::iterator it = cacheMap.find(cacheId);
+        if (it == cacheMap.end()) return MS::kSuccess;
+        meshCache = it->second;
+        cacheMap.erase(it);
     }
+
+    // nodes of other contexts may still hold the cache, the last owner destroys it
+    meshCache->stopWarmLoad();
+    meshCache->clear();
+    return MS::kSuccess;
 }
 
 std::shared_ptr<HdMeshCache> HdCacheMap::createCache(std::string cacheId,  MStatus& status, size_t maxSize)
 {
+    std::lock_guard<std::mutex> lock(mapMutex);
+    status = MS::kSuccess;
+    return createCacheLocked(cacheId, maxSize);
+}
+
+std::shared_ptr<HdMeshCache> HdCacheMap::createCacheLocked(const std::string& cacheId, size_t maxSize)
+{
+    // expects mapMutex to be held
     std::shared_ptr<HdMeshCache> meshCache = std::make_shared<HdMeshCache>(cacheId, maxSize);
     cacheMap[cacheId] = meshCache;
-    status = MS::kSuccess;
     log->info("Created new cache for cache ID: '{}'", cacheId);
     return meshCache;
 }
 
 MStatus HdCacheMap::clearMap()
 {
+    std::lock_guard<std::mutex> lock(mapMutex);
     cacheMap.clear();
     log->info("Cleared Cache Mapping.");
+    return MS::kSuccess;
 }
 
 MStatus HdCacheMap::clearCaches()
 {
+    std::lock_guard<std::mutex> lock(mapMutex);
     std::map<std::string, std::shared_ptr<HdMeshCache>>::iterator it;
     for ( it = cacheMap.begin(); it != cacheMap.end(); it++)
     {
@@ -259,10 +862,33 @@ MStatus HdCacheMap::clearCaches()
         meshCache->clear();
     }
     log->info("Cleared all caches.");
+    return MS::kSuccess;
+}
+
+void HdCacheMap::stopWarmLoads()
+{
+    std::lock_guard<std::mutex> lock(mapMutex);
+    std::map<std::string, std::shared_ptr<HdMeshCache>>::iterator it;
+    for ( it = cacheMap.begin(); it != cacheMap.end(); it++)
+    {
+        it->second->stopWarmLoad();
+    }
+}
+
+void HdCacheMap::flushWriteBackTiers()
+{
+    std::lock_guard<std::mutex> lock(mapMutex);
+    std::map<std::string, std::shared_ptr<HdMeshCache>>::iterator it;
+    for ( it = cacheMap.begin(); it != cacheMap.end(); it++)
+    {
+        std::shared_ptr<HdCacheFile> writeBackTier = it->second->writeBackTier();
+        if (writeBackTier != nullptr) writeBackTier->flush();
+    }
 }
 
 std::string HdCacheMap::getStatsJson()
 {
+    std::lock_guard<std::mutex> lock(mapMutex);
     std::string result = "[";
     std::map<std::string, std::shared_ptr<HdMeshCache>>::iterator it;
     for ( it = cacheMap.begin(); it != cacheMap.end(); it++)
@@ -280,7 +906,23 @@ std::string HdCacheMap::getStatsJson()
         substring += "\"max_size\": " + std::to_string(meshCache->maxSize()) + ", ";
         substring += "\"item_mem_size\": " + std::to_string(meshCache->itemMemSize()) + ", ";
         substring += "\"current_mem_size\": " + std::to_string(meshCache->memSize()) + ", ";
-        substring += "\"max_mem_size\": " + std::to_string(meshCache->maxMemSize()) + "}";
+        substring += "\"max_mem_size\": " + std::to_string(meshCache->maxMemSize()) + ", ";
+
+        std::shared_ptr<HdCacheFile> diskTier = meshCache->diskTier();
+        substring += "\"disk_path\": \"" + (diskTier ? diskTier->path() : std::string("")) + "\", ";
+        substring += "\"disk_size\": " + std::to_string(diskTier ? diskTier->size() : 0) + ", ";
+        std::shared_ptr<HdCacheFile> writeBackTier = meshCache->writeBackTier();
+        substring += "\"write_back_path\": \"" + (writeBackTier ? writeBackTier->path() : std::string("")) + "\", ";
+        substring += "\"write_back_size\": " + std::to_string(writeBackTier ? writeBackTier->size() : 0) + ", ";
+        std::shared_ptr<HdShmTier> sharedTier = meshCache->sharedTier();
+        substring += "\"shared_segment\": \"" + (sharedTier ? sharedTier->name() : std::string("")) + "\", ";
+        substring += "\"shared_size\": " + std::to_string(sharedTier ? sharedTier->size() : 0) + ", ";
+        substring += "\"shared_bytes_used\": " + std::to_string(sharedTier ? sharedTier->bytesUsed() : 0) + ", ";
+        std::shared_ptr<HdDaemonTier> daemonTier = meshCache->daemonTier();
+        substring += "\"daemon_socket\": \"" + (daemonTier ? daemonTier->socketPath() : std::string("")) + "\", ";
+        substring += "\"daemon_connected\": " + std::string(daemonTier && daemonTier->connected() ? "true" : "false") + ", ";
+        substring += "\"warm_loading\": " + std::string(meshCache->warmLoading() ? "true" : "false") + ", ";
+        substring += "\"warm_loaded\": " + std::to_string(meshCache->warmLoaded()) + "}";
         result += substring;
     }
     result += "]";
@@ -0,0 +1,248 @@
+//
+// -----------------------------------------------------------------------------
+// This source file has been developed within the scope of the
+// Technical Director course at Filmakademie Baden-Wuerttemberg.
+// http://technicaldirector.de
+//
+// Written by Tim Lehr
+// Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+// -----------------------------------------------------------------------------
+//
+
+#include "HdPoseMemo.h"
+
+#include <vector>
+#include <maya/MAnimMessage.h>
+#include <maya/MEventMessage.h>
+#include <maya/MPlug.h>
+
+#include "HdUtils.h"
+#include "HdPoseSampler.h"
+
+namespace
+{
+    // a rig evaluated over many loops fits easily, a runaway memo is cleared
+    const size_t MAX_MEMO_ENTRIES = 100000;
+
+    const int EDIT_MESSAGES = MNodeMessage::kConnectionMade | MNodeMessage::kConnectionBroken |
+                              MNodeMessage::kAttributeSet | MNodeMessage::kOtherPlugSet |
+                              MNodeMessage::kAttributeArrayAdded | MNodeMessage::kAttributeArrayRemoved |
+                              MNodeMessage::kAttributeAdded | MNodeMessage::kAttributeRemoved;
+}
+
+std::shared_ptr<spdlog::logger> HdPoseMemo::log = HdUtils::getLoggerInstance("HdPoseMemo");
+std::mutex HdPoseMemo::registryMutex_;
+std::set<HdPoseMemo*> HdPoseMemo::registry_;
+MCallbackIdArray HdPoseMemo::globalCallbacks_;
+
+HdPoseMemo::HdPoseMemo(const MObject& oPoseNode): poseNode_(oPoseNode)
+{
+    std::lock_guard<std::mutex> lock(registryMutex_);
+    registry_.insert(this);
+}
+
+HdPoseMemo::~HdPoseMemo()
+{
+    {
+        std::lock_guard<std::mutex> lock(registryMutex_);
+        registry_.erase(this);
+    }
+    removeCallbacks();
+}
+
+void HdPoseMemo::registerCallbacks()
+{
+    MStatus status;
+    globalCallbacks_.append(MAnimMessage::addAnimCurveEditedCallback(HdPoseMemo::onCurvesEdited, nullptr, &status));
+    CHECK_MSTATUS(status);
+
+    // undo restores values without a reliable attribute message on every node
+    globalCallbacks_.append(MEventMessage::addEventCallback("Undo", HdPoseMemo::onUndoRedo, nullptr, &status));
+    CHECK_MSTATUS(status);
+    globalCallbacks_.append(MEventMessage::addEventCallback("Redo", HdPoseMemo::onUndoRedo, nullptr, &status));
+    CHECK_MSTATUS(status);
+}
+
+void HdPoseMemo::deregisterCallbacks()
+{
+    MMessage::removeCallbacks(globalCallbacks_);
+    globalCallbacks_.clear();
+}
+
+void HdPoseMemo::removeCallbacks()
+{
+    if (callbacks_.length() > 0) MMessage::removeCallbacks(callbacks_);
+    callbacks_.clear();
+}
+
+void HdPoseMemo::watchNode(MObject node)
+{
+    MStatus status;
+    MCallbackId id = MNodeMessage::addAttributeChangedCallback(node, HdPoseMemo::onAttributeChanged, this, &status);
+    CHECK_MSTATUS(status);
+    if (status == MS::kSuccess) callbacks_.append(id);
+}
+
+bool HdPoseMemo::needsTrace()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return !traced_;
+}
+
+void HdPoseMemo::trace()
+{
+    if (!poseNode_.isAlive()) return;
+    removeCallbacks();
+
+    MStatus status;
+    MObject oPoseNode = poseNode_.object();
+    HdPoseSampler sampler(oPoseNode, status, true);
+    CHECK_MSTATUS(status);
+
+    std::vector<MObject> nodes;
+    std::vector<MPlug> plugs;
+    sampler.getUpstream(nodes, plugs);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    poseIds_.clear();
+    watchedNodes_.clear();
+    watchedPlugs_.clear();
+
+    // the pose node itself: rig tag, control connections
+    watchedNodes_.insert(MObjectHandle::objectHashCode(oPoseNode));
+    watchNode(oPoseNode);
+
+    for (size_t i=0; i<nodes.size(); i++)
+    {
+        if (watchedNodes_.insert(MObjectHandle::objectHashCode(nodes[i])).second) watchNode(nodes[i]);
+    }
+
+    // control nodes are only watched for the attributes the pose depends on
+    std::set<unsigned int> plugNodes;
+    for (size_t i=0; i<plugs.size(); i++)
+    {
+        MObject node = plugs[i].node();
+        unsigned int nodeHash = MObjectHandle::objectHashCode(node);
+        watchedPlugs_.insert(std::make_pair(nodeHash, std::string(plugs[i].partialName().asChar())));
+        if (watchedNodes_.count(nodeHash) == 0 && plugNodes.insert(nodeHash).second) watchNode(node);
+    }
+
+    eligible_ = (status == MS::kSuccess && sampler.plugChannelCount() == 0);
+    traced_ = true;
+    log->debug("Traced pose memo: {} watched nodes, {} watched plugs, {}.",
+               callbacks_.length(), watchedPlugs_.size(), eligible_ ? "enabled" : "disabled, channels depend on more than anim curves");
+}
+
+bool HdPoseMemo::isWatched(const MPlug& plug)
+{
+    // expects mutex_ to be held
+    unsigned int nodeHash = MObjectHandle::objectHashCode(plug.node());
+    if (watchedNodes_.count(nodeHash) > 0) return true;
+    return watchedPlugs_.count(std::make_pair(nodeHash, std::string(plug.partialName().asChar()))) > 0;
+}
+
+bool HdPoseMemo::lookup(const MTime& time, std::string& poseId)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!traced_ || !eligible_) return false;
+
+    std::unordered_map<double, std::string>::const_iterator it = poseIds_.find(time.as(MTime::kSeconds));
+    if (it == poseIds_.end())
+    {
+        misses_++;
+        return false;
+    }
+
+    hits_++;
+    poseId = it->second;
+    return true;
+}
+
+void HdPoseMemo::store(const MTime& time, const std::string& poseId)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!traced_ || !eligible_) return;
+
+    if (poseIds_.size() >= MAX_MEMO_ENTRIES) poseIds_.clear();
+    poseIds_[time.as(MTime::kSeconds)] = poseId;
+}
+
+void HdPoseMemo::invalidate(const std::string& reason)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!traced_) return;
+
+    log->debug("Invalidate pose memo with {} entries: {}", poseIds_.size(), reason);
+    poseIds_.clear();
+    traced_ = false;
+    invalidations_++;
+}
+
+void HdPoseMemo::onAttributeChanged(MNodeMessage::AttributeMessage msg, MPlug& plug, MPlug& otherPlug, void* clientData)
+{
+    if ((msg & EDIT_MESSAGES) == 0) return;
+
+    HdPoseMemo* memo = static_cast<HdPoseMemo*>(clientData);
+    bool watched;
+    {
+        std::lock_guard<std::mutex> lock(memo->mutex_);
+        watched = memo->isWatched(plug);
+    }
+    if (watched) memo->invalidate(plug.info().asChar());
+}
+
+void HdPoseMemo::onCurvesEdited(MObjectArray& editedCurves, void* clientData)
+{
+    std::lock_guard<std::mutex> registryLock(registryMutex_);
+    for (std::set<HdPoseMemo*>::iterator it = registry_.begin(); it != registry_.end(); ++it)
+    {
+        bool watched = false;
+        {
+            std::lock_guard<std::mutex> lock((*it)->mutex_);
+            for (unsigned int i=0; i<editedCurves.length() && !watched; i++)
+            {
+                watched = (*it)->watchedNodes_.count(MObjectHandle::objectHashCode(editedCurves[i])) > 0;
+            }
+        }
+        if (watched) (*it)->invalidate("anim curve edited");
+    }
+}
+
+void HdPoseMemo::onUndoRedo(void* clientData)
+{
+    std::lock_guard<std::mutex> registryLock(registryMutex_);
+    for (std::set<HdPoseMemo*>::iterator it = registry_.begin(); it != registry_.end(); ++it)
+    {
+        (*it)->invalidate("undo / redo");
+    }
+}
+
+std::string HdPoseMemo::getStatsJson()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t lookups = hits_ + misses_;
+    double hitRate = lookups > 0 ? (double) hits_ / (double) lookups : 0.0;
+
+    std::string result = "{";
+    result += "\"node\": \"" + (poseNode_.isAlive() ? HdUtils::getNodeName(poseNode_.object()) : std::string()) + "\", ";
+    result += "\"enabled\": " + std::string(traced_ && eligible_ ? "true" : "false") + ", ";
+    result += "\"entries\": " + std::to_string(poseIds_.size()) + ", ";
+    result += "\"watched_nodes\": " + std::to_string(callbacks_.length()) + ", ";
+    result += "\"hits\": " + std::to_string(hits_) + ", ";
+    result += "\"misses\": " + std::to_string(misses_) + ", ";
+    result += "\"hit_rate\": " + std::to_string(hitRate) + ", ";
+    result += "\"invalidations\": " + std::to_string(invalidations_) + "}";
+    return result;
+}
+
+std::string HdPoseMemo::getAllStatsJson()
+{
+    std::lock_guard<std::mutex> registryLock(registryMutex_);
+    std::string result = "[";
+    for (std::set<HdPoseMemo*>::iterator it = registry_.begin(); it != registry_.end(); ++it)
+    {
+        if (it != registry_.begin()) result += ", ";
+        result += (*it)->getStatsJson();
+    }
+    return result + "]";
+}
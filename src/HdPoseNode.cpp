@@ -11,9 +11,14 @@
 
 #include "HdPoseNode.h"
 
+#include <cctype>
+#include <cstdio>
 #include <maya/MFnNumericAttribute.h>
 #include <maya/MFnTypedAttribute.h>
 #include <maya/MFnGenericAttribute.h>
+#include <maya/MFnMessageAttribute.h>
+#include <maya/MFnMatrixAttribute.h>
+#include <maya/MFnMatrixData.h>
 #include <maya/MFnStringData.h>
 #include <maya/MFnData.h>
 #include <maya/MArrayDataHandle.h>
@@ -27,17 +32,30 @@
 #include <maya/MEvaluationNode.h>
 #include <maya/MArrayDataBuilder.h>
 #include <maya/MFnDependencyNode.h>
+#include <maya/MDGContext.h>
+#include <maya/MAnimControl.h>
 
 #include "HdUtils.h"
 #include "HdMeshCache.h"
+#include "HdCacheTier.h"
+#include "HdRealtime.h"
+
+namespace
+{
+    const std::string SHARED_CACHE_ID_PREFIX = "rig-";
+}
 
 MTypeId HdPoseNode::id(0x00171215);
 MObject HdPoseNode::aInCtrlVals;
+MObject HdPoseNode::aInCtrlMatrices;
 MObject HdPoseNode::aInRigTag;
+MObject HdPoseNode::aInUseRigFingerprint;
+MObject HdPoseNode::aInShareCaches;
 MObject HdPoseNode::aOutPoseId;
 MObject HdPoseNode::aOutCacheIds;
 MObject HdPoseNode::aOutFreezeRig;
 MObject HdPoseNode::aInWhitelist;
+MObject HdPoseNode::aInBlacklist;
 
 HdPoseNode::HdPoseNode(){}
 HdPoseNode::~HdPoseNode(){}
@@ -53,6 +71,10 @@ void HdPoseNode::postConstructor()
     // set icon
     MFnDependencyNode nodeDepFn(thisMObject());
     nodeDepFn.setIcon("hyperdrivePose.png");
+
+    poseMemo.reset(new HdPoseMemo(thisMObject()));
+    rigFingerprint.reset(new HdRigFingerprint(thisMObject()));
+    controlWatch.reset(new HdControlWatch(thisMObject()));
 }
 
 HdPoseNode::SchedulingType HdPoseNode::schedulingType() const
@@ -63,17 +85,56 @@ HdPoseNode::SchedulingType HdPoseNode::schedulingType() const
 
 MStatus HdPoseNode::preEvaluation(const MDGContext& context, const MEvaluationNode& evaluationNode)
 {
-    needsEvaluation = !HdUtils::playbackActive();
+    // other contexts never bypass, their poses are looked up in compute
+    if (!context.isNormal()) return MS::kSuccess;
+
+    needsEvaluation = !HdUtils::cachingActive();
     log->debug("Needs evaluation: {}", needsEvaluation);
 
+    // DG queries and callback registration are not allowed inside compute
+    if (poseMemo && poseMemo->needsTrace()) poseMemo->trace();
+    if (MPlug(thisMObject(), aInUseRigFingerprint).asBool()) updateRigFingerprint();
+    if (HdUtils::interactiveActive() && controlWatch->needsTrace()) controlWatch->trace();
+
     return MS::kSuccess;
 }
 
+void HdPoseNode::updateRigFingerprint()
+{
+    // pose IDs of the old rig must not be served from the memo
+    if (rigFingerprint && rigFingerprint->update()) poseMemo->invalidate("rig fingerprint changed");
+}
+
+
+std::string HdPoseNode::getSharedCacheId(const std::string& rigTag, unsigned int index)
+{
+    // the cache ID is a file name in the sidecar directory, keep it readable and safe
+    std::string readableTag;
+    for (size_t i=0; i<rigTag.size() && readableTag.size() < 32; i++)
+    {
+        char c = rigTag[i];
+        readableTag += (isalnum((unsigned char) c) || c == '-' || c == '_') ? c : '_';
+    }
+
+    std::string key = rigTag + "/" + std::to_string(index);
+    char digest[17];
+    snprintf(digest, sizeof(digest), "%016llx", (unsigned long long) hdChecksum64(key.data(), key.size()));
+
+    return SHARED_CACHE_ID_PREFIX + readableTag + "-" + std::string(digest, 8) + "-" + std::to_string(index);
+}
 
 MStatus HdPoseNode::setCacheIds(MDataBlock& data)
 {
     MStatus status = MS::kFailure;
 
+    // instances of a rig share their caches, the pose keys keep differing rigs apart
+    MDataHandle hInShareCaches = data.inputValue(aInShareCaches, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    MDataHandle hInRigTag = data.inputValue(aInRigTag, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    std::string rigTag = hInRigTag.asString().asChar();
+    bool shareCaches = hInShareCaches.asBool() && !rigTag.empty();
+
     MArrayDataHandle hOutCacheIds = data.outputArrayValue(aOutCacheIds, &status);
     CHECK_MSTATUS(status);
 
@@ -96,8 +157,20 @@ MStatus HdPoseNode::setCacheIds(MDataBlock& data)
         CHECK_MSTATUS_AND_RETURN_IT(status);
 
         std::string cacheId = hOutCacheId.asString().asChar();
+        bool sharedId = cacheId.compare(0, SHARED_CACHE_ID_PREFIX.size(), SHARED_CACHE_ID_PREFIX) == 0;
 
-        if(cacheId.size() < 1)
+        if (shareCaches)
+        {
+            // the element index identifies the cache node and its meshes within the rig
+            std::string rigCacheId = getSharedCacheId(rigTag, hOutCacheIds.elementIndex());
+            if (cacheId != rigCacheId)
+            {
+                hOutCacheId.setString(MString(rigCacheId.c_str()));
+                hOutCacheId.setClean();
+                log->info("Cache ID for output plug index {} is shared by all '{}' rigs: '{}'", i, rigTag, rigCacheId);
+            }
+        }
+        else if(cacheId.size() < 1 || sharedId)
         {
             // Generate UUID
             MUuid uuid = MUuid();
@@ -194,7 +267,10 @@ MStatus HdPoseNode::compute(const MPlug& plug, MDataBlock& data)
     // init vars
     MStatus status;
 
-    if (!instanceLog) 
+    // the instance members belong to the normal context, other contexts evaluate concurrently
+    bool normalContext = data.context().isNormal();
+
+    if (!instanceLog && normalContext) 
     {
         std::string nodeName = HdUtils::getNodeName(thisMObject());
         if (nodeName != "") 
@@ -209,6 +285,15 @@ MStatus HdPoseNode::compute(const MPlug& plug, MDataBlock& data)
     // CHECK IF COMPUTE NEEDS TO RUN
     // ***********************************
 
+    if (plug == aOutCacheIds)
+    {
+        // cache nodes pull their ID, e.g. after the rig tag or sharing changed
+        status = setCacheIds(data);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+        data.setClean(plug);
+        return MS::kSuccess;
+    }
+
     if (plug != aOutPoseId)
     {
         log->debug("Ignore plug: {}", plug.info().asChar());
@@ -239,12 +324,22 @@ MStatus HdPoseNode::compute(const MPlug& plug, MDataBlock& data)
 
         CHECK_MSTATUS(status);
         return status;
-    } else if (needsEvaluation) 
+    } else if (normalContext && needsEvaluation && !HdUtils::cachingActive()) 
     {
         log->warn("Bypass pose node. Forced evaluation.");
         status = setRigFrozen(data, false);
         CHECK_MSTATUS(status);
         return status;
+    } else if (HdUtils::interactiveActive() && !HdUtils::playbackActive() && controlWatch->manipulated())
+    {
+        // the edited poses are not cached, the empty pose ID bypasses the cache nodes
+        log->debug("Controls manipulated. Evaluate rig.");
+        status = setRigFrozen(data, false);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+        status = setPoseId(data, std::string());
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+        data.setClean(plug);
+        return MS::kSuccess;
     }
 
     // STOP TIME
@@ -260,77 +355,253 @@ MStatus HdPoseNode::compute(const MPlug& plug, MDataBlock& data)
     // CREATE POSE AND SET DEBUG HASH ATTR
     // *************************************
 
-    HdPose pose = createPose(data, status);
-    CHECK_MSTATUS_AND_RETURN_IT(status);
-    log->debug("Pose ID computed: {}", pose.hash());
+    MTime evalTime = MAnimControl::currentTime();
+    if (!data.context().isNormal()) data.context().getTime(evalTime);
+
+    // a rig edit is hashed in the next preEvaluation, until then the rig is evaluated
+    std::string poseTag;
+    if (!getPoseTag(data, poseTag))
+    {
+        log->debug("Rig fingerprint is outdated. Evaluate rig.");
+        setPoseId(data, std::string());
+        data.setClean(plug);
+        return MS::kSuccess;
+    }
+
+    // the memo skips reading and hashing the controls if nothing changed upstream
+    std::string poseId;
+    if (!poseMemo->lookup(evalTime, poseId))
+    {
+        HdPose pose = createPose(data, status);
+        CHECK_MSTATUS_AND_RETURN_IT(status);
+        poseId = pose.hash();
+        poseMemo->store(evalTime, poseId);
+        log->debug("Pose ID computed: {}", poseId);
+    }
 
-    bool poseCached = cachesContainPoseId(data, pose.hash(), status);
+    bool poseCached = cachesContainPoseId(data, poseId, status);
     CHECK_MSTATUS_AND_RETURN_IT(status);
 
+    HdRealtime& realtime = HdRealtime::instance();
+    if (realtime.enabled() && HdUtils::playbackActive() && normalContext)
+    {
+        double frame = evalTime.value();
+        if (poseCached) realtime.recordCached(thisMObject(), frame, poseId);
+        else if (!realtime.requestEvaluation(thisMObject(), frame, poseId))
+        {
+            // over the frame budget, show the nearest cached pose and evaluate the frame when idle
+            std::vector<std::pair<double, std::string>> nearestPoses;
+            realtime.getNearestPoses(thisMObject(), frame, nearestPoses);
+            for (size_t i=0; i<nearestPoses.size() && !poseCached; i++)
+            {
+                poseCached = cachesContainPoseId(data, nearestPoses[i].second, status);
+                CHECK_MSTATUS_AND_RETURN_IT(status);
+                if (!poseCached) continue;
+
+                log->debug("Frame budget exceeded. Substitute pose of frame {}.", nearestPoses[i].first);
+                realtime.recordSubstitution(thisMObject(), frame, nearestPoses[i].first);
+                poseId = nearestPoses[i].second;
+            }
+            if (!poseCached) realtime.forceEvaluation(thisMObject(), frame, poseId);
+        }
+    }
+
     if(!poseCached) // ... if there is no cache for the current Pose
     {
         // set node states to NORMAL
-        log->debug("Missing cache for pose ID '{}'. Evaluate Rig.", pose.hash());
+        log->debug("Missing cache for pose ID '{}'. Evaluate Rig.", poseId);
         status = setRigFrozen(data, false);
         CHECK_MSTATUS_AND_RETURN_IT(status);
     } 
     else 
     {
         // set node states to HASNOEFFECT
-        log->debug("Found cache for pose ID '{}'. Freeze Rig.", pose.hash());
+        log->debug("Found cache for pose ID '{}'. Freeze Rig.", poseId);
         status = setRigFrozen(data, true);
         CHECK_MSTATUS_AND_RETURN_IT(status);
     }
 
     // SET POSE ID
-    setPoseId(data, &pose);
+    setPoseId(data, poseId);
 
     // remove dirty so it won't be recalculated
     data.setClean(plug); 
 
-    // FREE MEMORY
-    pose.clear();
-
     logExecutionTime(startTime);
 
     return MS::kSuccess;
 }
 
-HdPose HdPoseNode::createPose(MDataBlock& data, MStatus& status) 
+bool HdPoseNode::getPoseTag(MDataBlock& data, std::string& poseTag)
 {
-    // get RigTag
+    MStatus status;
     MDataHandle hInRigTag = data.inputValue(aInRigTag, &status);
     CHECK_MSTATUS(status);
-    MString rigTag = hInRigTag.asString();
+    poseTag = hInRigTag.asString().asChar();
+
+    MDataHandle hInUseRigFingerprint = data.inputValue(aInUseRigFingerprint, &status);
+    CHECK_MSTATUS(status);
+    if (!hInUseRigFingerprint.asBool()) return true;
+
+    std::string fingerprint;
+    if (!rigFingerprint->get(fingerprint)) return false;
+    poseTag += "@" + fingerprint;
+    return true;
+}
+
+std::string HdPoseNode::getPoseTag(const MObject& oPoseNode, MStatus& status)
+{
+    // rig tag and rig fingerprint, the prefix of every pose key
+    MPlug rigTagPlug(oPoseNode, aInRigTag);
+    MString rigTag;
+    status = rigTagPlug.getValue(rigTag);
+    CHECK_MSTATUS(status);
+    std::string poseTag = rigTag.asChar();
+
+    if (!MPlug(oPoseNode, aInUseRigFingerprint).asBool()) return poseTag;
+
+    HdPoseNode* poseNode = dynamic_cast<HdPoseNode*>(MFnDependencyNode(oPoseNode).userNode());
+    if (poseNode == nullptr || !poseNode->rigFingerprint)
+    {
+        status = MS::kInvalidParameter;
+        return poseTag;
+    }
+
+    std::string fingerprint;
+    poseNode->updateRigFingerprint();
+    poseNode->rigFingerprint->get(fingerprint);
+    return poseTag + "@" + fingerprint;
+}
+
+HdPose HdPoseNode::createPose(MDataBlock& data, MStatus& status) 
+{
+    std::string poseTag;
+    if (!getPoseTag(data, poseTag))
+    {
+        status = MS::kNotFound;
+        return HdPose(poseTag);
+    }
 
     // create pose
-    HdPose pose = HdPose(rigTag.asChar());
+    HdPose pose = HdPose(poseTag);
 
-    // get controller values
+    // one pass over each control array in physical order, scalar values first
     MArrayDataHandle hInCtrlVals = data.inputArrayValue(aInCtrlVals, &status);
+    CHECK_MSTATUS_AND_RETURN(status, pose);
+    unsigned int count = hInCtrlVals.elementCount();
+
+    MArrayDataHandle hInCtrlMatrices = data.inputArrayValue(aInCtrlMatrices, &status);
+    CHECK_MSTATUS_AND_RETURN(status, pose);
+    unsigned int matrixCount = hInCtrlMatrices.elementCount();
+
+    pose.reserve(count + matrixCount * POSE_MATRIX_VALUES);
+    for (unsigned int i=0; i<count; i++, hInCtrlVals.next())
+    {
+        pose.push_back(hInCtrlVals.inputValue().asDouble());
+    }
+
+    // a control matrix stands for the transform channels of a control, rotations a full
+    // turn apart give the same matrix, so the rotate channels stay in inCtrlVals
+    double matrixValues[POSE_MATRIX_VALUES];
+    for (unsigned int i=0; i<matrixCount; i++, hInCtrlMatrices.next())
+    {
+        getMatrixValues(hInCtrlMatrices.inputValue().asMatrix(), matrixValues);
+        pose.insert(pose.end(), matrixValues, matrixValues + POSE_MATRIX_VALUES);
+    }
+
+    status = MS::kSuccess;
+    return pose;
+}
+
+HdPose HdPoseNode::createPoseAtTime(const MObject& oPoseNode, const MTime& time, MStatus& status)
+{
+    // Same pose as createPose() would build, but evaluated at an arbitrary time 
+    // through the plugs instead of the datablock. Used to look ahead during playback.
+    MDGContext context(time);
+
+    std::string poseTag = getPoseTag(oPoseNode, status);
     CHECK_MSTATUS(status);
-    
-    int count = hInCtrlVals.elementCount(&status);
+
+    HdPose pose = HdPose(poseTag);
+
+    MPlug ctrlValsPlug(oPoseNode, aInCtrlVals);
+    unsigned int count = ctrlValsPlug.numElements(&status);
+    CHECK_MSTATUS(status);
+
+    MPlug ctrlMatricesPlug(oPoseNode, aInCtrlMatrices);
+    unsigned int matrixCount = ctrlMatricesPlug.numElements(&status);
     CHECK_MSTATUS(status);
 
-    if ( count > 0) 
+    pose.reserve(count + matrixCount * POSE_MATRIX_VALUES);
+    for (unsigned int i=0; i < count; i++)
     {
-        for (int i=0; i < count; i++)
-        {
-            status = hInCtrlVals.jumpToElement(i);
-            CHECK_MSTATUS(status);
+        MPlug elementPlug = ctrlValsPlug.elementByPhysicalIndex(i, &status);
+        CHECK_MSTATUS(status);
 
-            MDataHandle hInputCtrl = hInCtrlVals.inputValue(&status);
-            CHECK_MSTATUS(status);
+        double value = 0.0;
+        status = elementPlug.getValue(value, context);
+        CHECK_MSTATUS(status);
+        pose.push_back(value);
+    }
 
-            pose.push_back(hInputCtrl.asDouble());
-        }
+    double matrixValues[POSE_MATRIX_VALUES];
+    for (unsigned int i=0; i < matrixCount; i++)
+    {
+        MObject matrixData;
+        status = ctrlMatricesPlug.elementByPhysicalIndex(i).getValue(matrixData, context);
+        CHECK_MSTATUS_AND_RETURN(status, pose);
+
+        getMatrixValues(MFnMatrixData(matrixData).matrix(), matrixValues);
+        pose.insert(pose.end(), matrixValues, matrixValues + POSE_MATRIX_VALUES);
     }
 
     status = MS::kSuccess;
     return pose;
 }
 
+void HdPoseNode::getMatrixValues(const MMatrix& matrix, double* values)
+{
+    // row by row, same order in createPose(), createPoseAtTime() and HdPoseSampler
+    for (unsigned int r=0; r<4; r++)
+    {
+        for (unsigned int c=0; c<3; c++) values[r * 3 + c] = matrix(r, c);
+    }
+}
+
+void HdPoseNode::dirtyOutputs(const MObject& oPoseNode)
+{
+    // rig edits that do not reach inCtrlVals leave the outputs clean. Callbacks must
+    // not touch the DG, so the pose ID is dirtied once the edit has finished.
+    if (!HdUtils::cachingActive()) return;
+    std::string nodeName = HdUtils::getNodeName(oPoseNode);
+    std::string cmd = "dgdirty \"" + nodeName + ".outPoseId\" \"" + nodeName + ".outFreezeRig\"";
+    MGlobal::executeCommandOnIdle(MString(cmd.c_str()), false);
+}
+
+std::vector<std::string> HdPoseNode::getCacheIds(const MObject& oPoseNode, MStatus& status)
+{
+    std::vector<std::string> cacheIds;
+
+    MPlug cacheIdsPlug(oPoseNode, aOutCacheIds);
+    unsigned int count = cacheIdsPlug.numElements(&status);
+    CHECK_MSTATUS(status);
+
+    for (unsigned int i=0; i<count; i++)
+    {
+        MPlug elementPlug = cacheIdsPlug.elementByPhysicalIndex(i, &status);
+        if (status != MS::kSuccess || !elementPlug.isConnected()) continue;
+
+        MString cacheId;
+        status = elementPlug.getValue(cacheId);
+        if (status != MS::kSuccess || cacheId.length() < 1) continue;
+
+        cacheIds.push_back(cacheId.asChar());
+    }
+
+    status = MS::kSuccess;
+    return cacheIds;
+}
+
 MStatus HdPoseNode::setRigFrozen(MDataBlock& data, bool frozen)
 {
     MStatus status = MS::kSuccess;
@@ -346,12 +617,17 @@ MStatus HdPoseNode::setRigFrozen(MDataBlock& data, bool frozen)
 }
 
 MStatus HdPoseNode::setPoseId(MDataBlock& data, HdPose* pose)
+{
+    return setPoseId(data, pose->hash());
+}
+
+MStatus HdPoseNode::setPoseId(MDataBlock& data, const std::string& poseId)
 {
     MStatus status = MS::kSuccess;
 
     MDataHandle hOutPoseId = data.outputValue(aOutPoseId, &status);
     CHECK_MSTATUS_AND_RETURN_IT(status);
-    hOutPoseId.setString(MString(pose->hash().c_str()));
+    hOutPoseId.setString(MString(poseId.c_str()));
     hOutPoseId.setClean();
 
     return status;
@@ -375,6 +651,8 @@ MStatus HdPoseNode::initialize()
     MStatus status;
     MFnNumericAttribute nAttr;
     MFnTypedAttribute tAttr;
+    MFnMessageAttribute mAttr;
+    MFnMatrixAttribute mtxAttr;
 
     // OUTPUT - POSE ID
     aOutPoseId = tAttr.create("outPoseId", "outPoseId", MFnData::kString);
@@ -412,6 +690,27 @@ MStatus HdPoseNode::initialize()
     attributeAffects(aInRigTag, aOutFreezeRig);
     attributeAffects(aInRigTag, aOutCacheIds);
 
+    // INPUT - RIG FINGERPRINT
+    aInUseRigFingerprint = nAttr.create("inUseRigFingerprint", "inUseRigFingerprint", MFnNumericData::kBoolean);
+    nAttr.setKeyable(false);
+    nAttr.setStorable(true);
+    nAttr.setReadable(false); // disable output
+    nAttr.setDefault(true);
+    addAttribute(aInUseRigFingerprint);
+    attributeAffects(aInUseRigFingerprint, aOutPoseId);
+    attributeAffects(aInUseRigFingerprint, aOutFreezeRig);
+
+    // INPUT - SHARE CACHES
+    aInShareCaches = nAttr.create("inShareCaches", "inShareCaches", MFnNumericData::kBoolean);
+    nAttr.setKeyable(false);
+    nAttr.setStorable(true);
+    nAttr.setReadable(false); // disable output
+    nAttr.setDefault(false);
+    addAttribute(aInShareCaches);
+    attributeAffects(aInShareCaches, aOutPoseId);
+    attributeAffects(aInShareCaches, aOutFreezeRig);
+    attributeAffects(aInShareCaches, aOutCacheIds);
+
     // INPUT - CONTROLLER VALUES
     aInCtrlVals = nAttr.create("inCtrlVals", "inCtrlVals",MFnNumericData::kDouble);
     nAttr.setKeyable(true); // has to be true to be visible in node editor
@@ -425,6 +724,20 @@ MStatus HdPoseNode::initialize()
     attributeAffects(aInCtrlVals, aOutFreezeRig);
     attributeAffects(aInCtrlVals, aOutCacheIds);
 
+    // INPUT - CONTROLLER MATRICES
+    // one connection per transform control instead of one per channel
+    aInCtrlMatrices = mtxAttr.create("inCtrlMatrices", "inCtrlMatrices", MFnMatrixAttribute::kDouble);
+    mtxAttr.setKeyable(false);
+    mtxAttr.setConnectable(true);
+    mtxAttr.setStorable(true);
+    mtxAttr.setReadable(false); // disable output
+    mtxAttr.setArray(true);
+    mtxAttr.setIndexMatters(false);
+    addAttribute(aInCtrlMatrices);
+    attributeAffects(aInCtrlMatrices, aOutPoseId);
+    attributeAffects(aInCtrlMatrices, aOutFreezeRig);
+    attributeAffects(aInCtrlMatrices, aOutCacheIds);
+
     // INPUT - WHITELIST NODES
     aInWhitelist = tAttr.create("inWhitelist", "inWhitelist", MFnData::kString);
     tAttr.setKeyable(true); // has to be true to be visible in node editor
@@ -435,5 +748,15 @@ MStatus HdPoseNode::initialize()
     tAttr.setIndexMatters(false); // has to be true to be visible in node editor
     addAttribute(aInWhitelist);
 
+    // INPUT - BLACKLIST NODES
+    // skipped by the evaluator on cached frames, no DG attribute of the node changes
+    aInBlacklist = mAttr.create("inBlacklist", "inBlacklist");
+    mAttr.setConnectable(true);
+    mAttr.setStorable(true);
+    mAttr.setReadable(false); // disable output
+    mAttr.setArray(true);
+    mAttr.setIndexMatters(false);
+    addAttribute(aInBlacklist);
+
     return MS::kSuccess;
 }
\ No newline at end of file
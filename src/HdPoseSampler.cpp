@@ -0,0 +1,291 @@
+//
+// -----------------------------------------------------------------------------
+// This source file has been developed within the scope of the
+// Technical Director course at Filmakademie Baden-Wuerttemberg.
+// http://technicaldirector.de
+//
+// Written by Tim Lehr
+// Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+// -----------------------------------------------------------------------------
+//
+
+#include "HdPoseSampler.h"
+
+#include <algorithm>
+
+#include <maya/MAnimControl.h>
+#include <maya/MDGContext.h>
+#include <maya/MFnAttribute.h>
+#include <maya/MFnDependencyNode.h>
+#include <maya/MFnMatrixData.h>
+
+#include "HdUtils.h"
+#include "HdPose.h"
+#include "HdPoseNode.h"
+
+namespace
+{
+    const unsigned int MAX_UPSTREAM_HOPS = 16;
+    const size_t FRAME_BLOCK_SIZE = 1024;
+
+    // transform channels a control matrix is built from
+    const char* MATRIX_CHANNELS[] = {
+        "translateX", "translateY", "translateZ",
+        "rotateX", "rotateY", "rotateZ",
+        "scaleX", "scaleY", "scaleZ",
+        "shearXY", "shearXZ", "shearYZ",
+        "rotateOrder",
+    };
+
+    // an attribute that only holds its input value, like a control's translateX
+    bool isPassThrough(const MPlug& plug)
+    {
+        if (plug.isKeyable()) return true;
+        MFnAttribute attrFn(plug.attribute());
+        return attrFn.isWritable() && attrFn.isStorable();
+    }
+}
+
+std::shared_ptr<spdlog::logger> HdPoseSampler::log = HdUtils::getLoggerInstance("HdPoseSampler");
+
+HdPoseSampler::HdPoseSampler(const MObject& oPoseNode, MStatus& status, bool traceOnly)
+{
+    if (!traceOnly)
+    {
+        // rig tag and fingerprint, same prefix as HdPoseNode::createPose()
+        rigTag_ = HdPoseNode::getPoseTag(oPoseNode, status);
+        CHECK_MSTATUS(status);
+    }
+
+    // same element order as HdPoseNode::createPoseAtTime()
+    MPlug ctrlValsPlug(oPoseNode, HdPoseNode::aInCtrlVals);
+    unsigned int count = ctrlValsPlug.numElements(&status);
+    CHECK_MSTATUS(status);
+
+    MPlug ctrlMatricesPlug(oPoseNode, HdPoseNode::aInCtrlMatrices);
+    unsigned int matrixCount = ctrlMatricesPlug.numElements(&status);
+    CHECK_MSTATUS(status);
+
+    channels_.resize(count + matrixCount * POSE_MATRIX_VALUES);
+    for (unsigned int i=0; i<count; i++)
+    {
+        MPlug elementPlug = ctrlValsPlug.elementByPhysicalIndex(i, &status);
+        CHECK_MSTATUS(status);
+
+        resolveChannel(elementPlug, channels_[i], traceOnly);
+        if (!traceOnly) verifyChannel(channels_[i]);
+    }
+
+    for (unsigned int i=0; i<matrixCount; i++)
+    {
+        resolveMatrixChannels(ctrlMatricesPlug.elementByPhysicalIndex(i), count + i * POSE_MATRIX_VALUES);
+    }
+
+    log->debug("Sampler for rig '{}': {} channels, {} curves, {} evaluated.", rigTag_, channelCount(), curveChannelCount(), plugChannelCount());
+    status = MS::kSuccess;
+}
+
+void HdPoseSampler::resolveChannel(const MPlug& elementPlug, Channel& channel, bool traceOnly)
+{
+    channel.plug = elementPlug;
+    channel.source = kPlug;
+
+    MPlug current = elementPlug;
+    for (unsigned int hop=0; hop<MAX_UPSTREAM_HOPS; hop++)
+    {
+        MPlug source = current.source();
+        if (source.isNull())
+        {
+            // nothing upstream changes over time
+            channel.source = kConstant;
+            if (!traceOnly) channel.plug.getValue(channel.value);
+            return;
+        }
+
+        MObject sourceNode = source.node();
+        MFnDependencyNode nodeFn(sourceNode);
+
+        if (sourceNode.hasFn(MFn::kAnimCurve))
+        {
+            channel.upstreamNodes.push_back(sourceNode);
+
+            // curves with a driver (set driven keys, time warps) are not sampled
+            std::shared_ptr<MFnAnimCurve> curveFn = std::make_shared<MFnAnimCurve>(sourceNode);
+            if (curveFn->isTimeInput() && !nodeFn.findPlug("input").isConnected())
+            {
+                channel.source = kCurve;
+                channel.curveFn = curveFn;
+            }
+            return;
+        }
+
+        if (sourceNode.hasFn(MFn::kUnitConversion))
+        {
+            channel.upstreamNodes.push_back(sourceNode);
+            channel.factors.push_back(nodeFn.findPlug("conversionFactor").asDouble());
+            current = nodeFn.findPlug("input");
+            continue;
+        }
+
+        // computed outputs (constraints, utility nodes) are evaluated
+        if (!isPassThrough(source)) return;
+        channel.upstreamPlugs.push_back(source);
+        current = source;
+    }
+}
+
+void HdPoseSampler::resolveMatrixChannels(const MPlug& elementPlug, size_t firstChannel)
+{
+    for (unsigned int v=0; v<POSE_MATRIX_VALUES; v++)
+    {
+        channels_[firstChannel + v].source = kMatrix;
+        channels_[firstChannel + v].plug = elementPlug;
+        channels_[firstChannel + v].matrixValue = v;
+    }
+
+    // the transform channels are the control attributes of the matrix
+    MPlug source = elementPlug.source();
+    if (source.isNull()) return;
+
+    MFnDependencyNode nodeFn(source.node());
+    Channel& channel = channels_[firstChannel];
+    for (size_t i=0; i<sizeof(MATRIX_CHANNELS) / sizeof(MATRIX_CHANNELS[0]); i++)
+    {
+        MStatus status;
+        MPlug channelPlug = nodeFn.findPlug(MATRIX_CHANNELS[i], true, &status);
+        if (status == MS::kSuccess && !channelPlug.isNull()) channel.upstreamPlugs.push_back(channelPlug);
+    }
+}
+
+double HdPoseSampler::sampleCurve(const Channel& channel, const MTime& time) const
+{
+    double value = 0.0;
+    channel.curveFn->evaluate(time, value);
+
+    // apply the conversions in the order the DG does, starting at the curve
+    for (std::vector<double>::const_reverse_iterator it = channel.factors.rbegin(); it != channel.factors.rend(); ++it)
+    {
+        value = value * (*it);
+    }
+    return value;
+}
+
+bool HdPoseSampler::verifyChannel(Channel& channel)
+{
+    if (channel.source != kCurve) return true;
+
+    // the pose IDs have to be bit identical, so the sampled value must match the DG
+    double expected = 0.0;
+    channel.plug.getValue(expected);
+    if (sampleCurve(channel, MAnimControl::currentTime()) == expected) return true;
+
+    log->debug("Sampled value of '{}' differs from the DG. Evaluate plug instead.", channel.plug.info().asChar());
+    channel.source = kPlug;
+    channel.curveFn.reset();
+    return false;
+}
+
+std::vector<std::string> HdPoseSampler::sample(const std::vector<double>& frames, MStatus& status)
+{
+    status = MS::kSuccess;
+    const size_t frameCount = frames.size();
+    const size_t count = channels_.size();
+    std::vector<std::string> poseIds(frameCount);
+    if (frameCount == 0) return poseIds;
+
+    std::vector<MTime> times;
+    times.reserve(frameCount);
+    MTime::Unit unit = MTime::uiUnit();
+    for (size_t f=0; f<frameCount; f++) times.push_back(MTime(frames[f], unit));
+
+    std::vector<size_t> curveChannels;
+    for (size_t c=0; c<count; c++)
+    {
+        if (channels_[c].source == kCurve) curveChannels.push_back(c);
+    }
+
+    // blocks of frames bound the memory of the value table, one row per channel
+    std::vector<double> values(count * std::min(frameCount, FRAME_BLOCK_SIZE));
+    for (size_t blockStart=0; blockStart<frameCount; blockStart+=FRAME_BLOCK_SIZE)
+    {
+        const size_t blockSize = std::min(FRAME_BLOCK_SIZE, frameCount - blockStart);
+        const MTime* blockTimes = &times[blockStart];
+
+        for (size_t c=0; c<count; c++)
+        {
+            double* row = &values[c * blockSize];
+            if (channels_[c].source == kConstant)
+            {
+                std::fill(row, row + blockSize, channels_[c].value);
+            }
+            else if (channels_[c].source == kPlug)
+            {
+                // the DG can only be pulled from the main thread
+                for (size_t f=0; f<blockSize; f++)
+                {
+                    MDGContext context(blockTimes[f]);
+                    status = channels_[c].plug.getValue(row[f], context);
+                    CHECK_MSTATUS_AND_RETURN(status, poseIds);
+                }
+            }
+            else if (channels_[c].source == kMatrix && channels_[c].matrixValue == 0)
+            {
+                // one evaluation fills the rows of all values of the matrix
+                double matrixValues[POSE_MATRIX_VALUES];
+                for (size_t f=0; f<blockSize; f++)
+                {
+                    MDGContext context(blockTimes[f]);
+                    MObject matrixData;
+                    status = channels_[c].plug.getValue(matrixData, context);
+                    CHECK_MSTATUS_AND_RETURN(status, poseIds);
+
+                    HdPoseNode::getMatrixValues(MFnMatrixData(matrixData).matrix(), matrixValues);
+                    for (unsigned int v=0; v<POSE_MATRIX_VALUES; v++) values[(c + v) * blockSize + f] = matrixValues[v];
+                }
+            }
+        }
+
+        HdUtils::parallelFor(curveChannels.size(), [&](size_t i) {
+            const Channel& channel = channels_[curveChannels[i]];
+            double* row = &values[curveChannels[i] * blockSize];
+            for (size_t f=0; f<blockSize; f++) row[f] = sampleCurve(channel, blockTimes[f]);
+        });
+
+        HdUtils::parallelFor(blockSize, [&](size_t f) {
+            HdPose pose = HdPose(rigTag_);
+            pose.reserve(count);
+            for (size_t c=0; c<count; c++) pose.push_back(values[c * blockSize + f]);
+            poseIds[blockStart + f] = pose.hash();
+        });
+    }
+
+    return poseIds;
+}
+
+unsigned int HdPoseSampler::channelCount() const
+{
+    return (unsigned int) channels_.size();
+}
+
+unsigned int HdPoseSampler::curveChannelCount() const
+{
+    unsigned int count = 0;
+    for (size_t c=0; c<channels_.size(); c++) if (channels_[c].source == kCurve) count++;
+    return count;
+}
+
+unsigned int HdPoseSampler::plugChannelCount() const
+{
+    unsigned int count = 0;
+    for (size_t c=0; c<channels_.size(); c++) if (channels_[c].source == kPlug || channels_[c].source == kMatrix) count++;
+    return count;
+}
+
+void HdPoseSampler::getUpstream(std::vector<MObject>& nodes, std::vector<MPlug>& plugs) const
+{
+    for (size_t c=0; c<channels_.size(); c++)
+    {
+        nodes.insert(nodes.end(), channels_[c].upstreamNodes.begin(), channels_[c].upstreamNodes.end());
+        plugs.insert(plugs.end(), channels_[c].upstreamPlugs.begin(), channels_[c].upstreamPlugs.end());
+    }
+}
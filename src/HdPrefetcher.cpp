@@ -0,0 +1,329 @@
+//
+// -----------------------------------------------------------------------------
+// This source file has been developed within the scope of the
+// Technical Director course at Filmakademie Baden-Wuerttemberg.
+// http://technicaldirector.de
+//
+// Written by Tim Lehr
+// Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+// -----------------------------------------------------------------------------
+//
+
+#include "HdPrefetcher.h"
+
+#include <cmath>
+#include <algorithm>
+#include <maya/MAnimControl.h>
+#include <maya/MObjectHandle.h>
+
+#include "HdUtils.h"
+#include "HdPoseNode.h"
+
+namespace
+{
+    const double LATENCY_SMOOTHING = 0.2;   // weight of the newest sample in the latency average
+    const double LATENCY_SAFETY = 2.0;      // keep twice the measured latency in flight
+}
+
+HdPrefetcher::HdPrefetcher()
+{
+    log = HdUtils::getLoggerInstance("HdPrefetcher");
+}
+
+HdPrefetcher::~HdPrefetcher()
+{
+    // stop the reader first, its callbacks point back to this instance
+    reader_.reset();
+}
+
+HdPrefetcher& HdPrefetcher::instance()
+{
+    static HdPrefetcher prefetcher;
+    return prefetcher;
+}
+
+HdAsyncReader* HdPrefetcher::getReader()
+{
+    // created lazily, so scenes without disk tiers never spin up reader threads
+    if (!reader_)
+    {
+        reader_.reset(new HdAsyncReader());
+    }
+    return reader_.get();
+}
+
+void HdPrefetcher::setEnabled(bool enabled)
+{
+    enabled_ = enabled;
+    log->info("Prefetching {}.", enabled ? "enabled" : "disabled");
+    if (!enabled) reset();
+}
+
+void HdPrefetcher::setMaxLookahead(unsigned int frames)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    maxLookahead_ = std::max(frames, minLookahead_);
+    lookahead_ = std::min(lookahead_, maxLookahead_);
+}
+
+void HdPrefetcher::reset()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    prefetched_.clear();
+    plannedPoses_.clear();
+    lookahead_ = minLookahead_;
+}
+
+void HdPrefetcher::shutdown()
+{
+    // waits for reads already handed to the kernel
+    reader_.reset();
+    reset();
+}
+
+unsigned int HdPrefetcher::computeLookahead()
+{
+    // expects mutex_ to be held
+    double fps = MTime(1.0, MTime::kSeconds).as(MTime::uiUnit());
+    double speed = MAnimControl::playbackSpeed();
+    if (speed > 0.0) fps *= speed; // 0.0 means "play every frame"
+
+    double step = std::fabs(MAnimControl::playbackBy().value());
+    if (step <= 0.0) step = 1.0;
+
+    double frameMs = 1000.0 / (fps / step);
+    if (frameMs <= 0.0) return maxLookahead_;
+
+    unsigned int frames = (unsigned int) std::ceil(LATENCY_SAFETY * latencyMs_ / frameMs) + minLookahead_;
+    return std::max(minLookahead_, std::min(frames, maxLookahead_));
+}
+
+double HdPrefetcher::nextFrame(double frame, unsigned int steps)
+{
+    double by = MAnimControl::playbackBy().value();
+    double minFrame = MAnimControl::minTime().value();
+    double maxFrame = MAnimControl::maxTime().value();
+    double next = frame + by * steps;
+
+    if (MAnimControl::playbackMode() == MAnimControl::kPlaybackLoop && maxFrame > minFrame)
+    {
+        double range = maxFrame - minFrame + by;
+        while (next > maxFrame) next -= range;
+        while (next < minFrame) next += range;
+    }
+    return next;
+}
+
+void HdPrefetcher::expire()
+{
+    // expects mutex_ to be held
+    for (std::map<std::string, PrefetchEntry>::iterator it = prefetched_.begin(); it != prefetched_.end();)
+    {
+        if (it->second.deadlineTick < tick_)
+        {
+            // the playhead passed the predicted frame without requesting the pose
+            wasted_ += it->second.blobCount;
+            wastedBytes_ += it->second.bytes;
+            it = prefetched_.erase(it);
+        } else
+        {
+            ++it;
+        }
+    }
+}
+
+void HdPrefetcher::observe(const std::string& poseId)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::map<std::string, PrefetchEntry>::iterator it = prefetched_.find(poseId);
+    if (it == prefetched_.end()) return;
+
+    used_ += it->second.blobCount;
+    prefetched_.erase(it);
+}
+
+void HdPrefetcher::update(const MObjectArray& poseNodes, double currentFrame)
+{
+    // the lookahead poses are DG context evaluations, not worth it while scrubbing or editing
+    if (!enabled_ || !HdUtils::playbackActive()) return;
+
+    MStatus status;
+    unsigned int lookahead;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tick_++;
+        expire();
+
+        // planned poses are only valid for continuous playback
+        if (currentFrame != nextFrame(lastFrame_, 1))
+        {
+            plannedPoses_.clear();
+        }
+        lastFrame_ = currentFrame;
+
+        lookahead_ = computeLookahead();
+        lookahead = lookahead_;
+    }
+
+    for (unsigned int i=0; i<poseNodes.length(); i++)
+    {
+        MObject oPoseNode = poseNodes[i];
+        unsigned int poseNodeHash = MObjectHandle::objectHashCode(oPoseNode);
+
+        // collect caches with a disk tier, nothing to prefetch for memory only caches
+        std::vector<std::shared_ptr<HdMeshCache>> meshCaches;
+        std::vector<std::string> cacheIds = HdPoseNode::getCacheIds(oPoseNode, status);
+        for (size_t j=0; j<cacheIds.size(); j++)
+        {
+            if (!HdCacheMap::exists(cacheIds[j])) continue;
+            std::shared_ptr<HdMeshCache> meshCache = HdCacheMap::get(cacheIds[j], status);
+            if (meshCache != nullptr && meshCache->diskTier() != nullptr)
+            {
+                meshCaches.push_back(meshCache);
+            }
+        }
+        if (meshCaches.empty()) continue;
+
+        for (unsigned int step=1; step<=lookahead; step++)
+        {
+            double frame = nextFrame(currentFrame, step);
+            std::pair<unsigned int, double> planKey(poseNodeHash, frame);
+
+            std::string poseId;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                std::map<std::pair<unsigned int, double>, std::string>::iterator it = plannedPoses_.find(planKey);
+                if (it != plannedPoses_.end()) poseId = it->second;
+            }
+
+            if (poseId.empty())
+            {
+                HdPose pose = HdPoseNode::createPoseAtTime(oPoseNode, MTime(frame, MTime::uiUnit()), status);
+                if (status != MS::kSuccess) break;
+                poseId = pose.hash();
+
+                std::lock_guard<std::mutex> lock(mutex_);
+                plannedPoses_[planKey] = poseId;
+            }
+
+            for (size_t j=0; j<meshCaches.size(); j++)
+            {
+                request(meshCaches[j], poseId, step);
+            }
+        }
+    }
+
+    // drop plans behind the playhead
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (std::map<std::pair<unsigned int, double>, std::string>::iterator it = plannedPoses_.begin(); it != plannedPoses_.end();)
+    {
+        if (it->first.second == currentFrame) it = plannedPoses_.erase(it);
+        else ++it;
+    }
+    if (plannedPoses_.size() > poseNodes.length() * maxLookahead_ * 4) plannedPoses_.clear();
+}
+
+void HdPrefetcher::prefetch(std::shared_ptr<HdMeshCache> meshCache, const std::string& poseId)
+{
+    // poses keyed by the caller, e.g. render subframes
+    if (!enabled_) return;
+    request(meshCache, poseId, 1);
+}
+
+void HdPrefetcher::request(std::shared_ptr<HdMeshCache> meshCache, const std::string& poseId, unsigned int distance)
+{
+    if (meshCache->existsInMemory(poseId)) return;
+
+    HdCacheFileEntry entry;
+    std::shared_ptr<HdCacheFile> diskTier = meshCache->diskTier();
+    if (diskTier == nullptr || !diskTier->locate(poseId, entry)) return;
+
+    std::string requestKey = meshCache->cacheId() + "/" + poseId;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (inFlight_.count(requestKey) > 0) return;
+        inFlight_.insert(requestKey);
+        requested_++;
+    }
+
+    log->debug("Prefetch pose ID '{}' for cache '{}' ({} frames ahead).", poseId, meshCache->cacheId(), distance);
+
+    // the cache file stays open as long as the callback holds the tier
+    bool submitted = getReader()->submit(diskTier->fd(), entry.payloadOffset, entry.payloadSize,
+        [this, meshCache, diskTier, poseId, entry, distance](bool success, const HdBlob& payload, double latencyMs) {
+            onReadComplete(meshCache, poseId, entry, success, payload, latencyMs);
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (success)
+            {
+                PrefetchEntry& prefetchEntry = prefetched_[poseId];
+                prefetchEntry.bytes += entry.payloadSize;
+                prefetchEntry.blobCount++;
+                prefetchEntry.deadlineTick = std::max(prefetchEntry.deadlineTick, tick_ + distance + 2);
+            }
+        });
+
+    if (!submitted)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        inFlight_.erase(requestKey);
+        failed_++;
+    }
+}
+
+void HdPrefetcher::onReadComplete(std::shared_ptr<HdMeshCache> meshCache, const std::string& poseId,
+                                  const HdCacheFileEntry& entry, bool success, const HdBlob& payload, double latencyMs)
+{
+    // runs on a reader thread
+    HdBlob blob;
+    if (success)
+    {
+        success = hdChecksum64(payload.begin(), payload.size) == entry.checksum &&
+                  HdCacheFile::decodePayload(entry, payload, blob);
+    }
+
+    if (success)
+    {
+        MStatus status;
+        std::shared_ptr<HdMeshSet> meshSet = HdMeshSet::fromBlob(blob, status);
+        success = (status == MS::kSuccess);
+        if (success) meshCache->materialize(poseId, meshSet);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    inFlight_.erase(meshCache->cacheId() + "/" + poseId);
+    latencyMs_ = (latencyMs_ == 0.0) ? latencyMs : latencyMs_ + LATENCY_SMOOTHING * (latencyMs - latencyMs_);
+
+    if (success)
+    {
+        bytesRead_ += entry.payloadSize;
+    } else
+    {
+        failed_++;
+        log->warn("Prefetch failed for pose ID '{}' in cache '{}'.", poseId, meshCache->cacheId());
+    }
+}
+
+std::string HdPrefetcher::getStatsJson()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    uint64_t resolved = used_ + wasted_;
+    double accuracy = resolved > 0 ? (double) used_ / (double) resolved : 0.0;
+
+    std::string result = "{";
+    result += "\"enabled\": " + std::string(enabled_ ? "true" : "false") + ", ";
+    result += "\"backend\": \"" + (reader_ ? reader_->backendName() : std::string("none")) + "\", ";
+    result += "\"lookahead\": " + std::to_string(lookahead_) + ", ";
+    result += "\"max_lookahead\": " + std::to_string(maxLookahead_) + ", ";
+    result += "\"latency_ms\": " + std::to_string(latencyMs_) + ", ";
+    result += "\"requested\": " + std::to_string(requested_) + ", ";
+    result += "\"in_flight\": " + std::to_string(inFlight_.size()) + ", ";
+    result += "\"failed\": " + std::to_string(failed_) + ", ";
+    result += "\"used\": " + std::to_string(used_) + ", ";
+    result += "\"wasted\": " + std::to_string(wasted_) + ", ";
+    result += "\"accuracy\": " + std::to_string(accuracy) + ", ";
+    result += "\"bytes_read\": " + std::to_string(bytesRead_) + ", ";
+    result += "\"wasted_bytes\": " + std::to_string(wastedBytes_) + "}";
+    return result;
+}
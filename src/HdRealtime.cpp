@@ -0,0 +1,304 @@
+//
+// -----------------------------------------------------------------------------
+// This source file has been developed within the scope of the
+// Technical Director course at Filmakademie Baden-Wuerttemberg.
+// http://technicaldirector.de
+//
+// Written by Tim Lehr
+// Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+// -----------------------------------------------------------------------------
+//
+
+#include "HdRealtime.h"
+
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <maya/MConditionMessage.h>
+#include <maya/MDGMessage.h>
+
+#include "HdAutoFill.h"
+
+namespace
+{
+    // weight of the last frame in the frame time estimates
+    const double SMOOTHING = 0.2;
+
+    // an evaluation is granted now and then to follow changing rig costs
+    const unsigned int PROBE_INTERVAL = 12;
+
+    // cached poses tried as a substitute, nearest first
+    const size_t MAX_CANDIDATES = 8;
+
+    const size_t MAX_CACHED_FRAMES = 100000;
+}
+
+HdRealtime::HdRealtime()
+{
+    log = HdUtils::getLoggerInstance("HdRealtime");
+    frameStart_ = HdUtils::getCurrentTimePoint();
+}
+
+HdRealtime::~HdRealtime()
+{
+    shutdown();
+}
+
+HdRealtime& HdRealtime::instance()
+{
+    static HdRealtime realtime;
+    return realtime;
+}
+
+void HdRealtime::setEnabled(bool enabled)
+{
+    if (enabled == enabled_) return;
+    enabled_ = enabled;
+
+    if (enabled) registerCallbacks();
+    else
+    {
+        deregisterCallbacks();
+        flushBackFill();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    measuring_ = false;
+    allowance_ = std::numeric_limits<unsigned int>::max();
+    log->info("Real-time playback {}.", enabled ? "enabled" : "disabled");
+}
+
+void HdRealtime::setTargetFps(double fps)
+{
+    targetFps_ = std::max(0.0, fps);
+}
+
+void HdRealtime::shutdown()
+{
+    deregisterCallbacks();
+    enabled_ = false;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    rigs_.clear();
+    backFill_.clear();
+}
+
+void HdRealtime::registerCallbacks()
+{
+    MStatus status;
+    callbacks_.append(MDGMessage::addTimeChangeCallback(HdRealtime::onTimeChange, this, &status));
+    CHECK_MSTATUS(status);
+    callbacks_.append(MConditionMessage::addConditionCallback("playingBack", HdRealtime::onPlayingBack, this, &status));
+    CHECK_MSTATUS(status);
+}
+
+void HdRealtime::deregisterCallbacks()
+{
+    if (callbacks_.length() > 0) MMessage::removeCallbacks(callbacks_);
+    callbacks_.clear();
+}
+
+HdRealtime::Rig& HdRealtime::getRig(const MObject& oPoseNode)
+{
+    // expects mutex_ to be held
+    Rig& rig = rigs_[MObjectHandle::objectHashCode(oPoseNode)];
+    if (!rig.poseNode.isAlive()) rig = Rig();
+    rig.poseNode = MObjectHandle(oPoseNode);
+    return rig;
+}
+
+void HdRealtime::startFrame()
+{
+    // expects mutex_ to be held, the frame time runs from time change to time change
+    HdUtils::time_point now = HdUtils::getCurrentTimePoint();
+    double fps = targetFps_ > 0.0 ? targetFps_ : MTime(1.0, MTime::kSeconds).as(MTime::uiUnit());
+    budgetMs_ = fps > 0.0 ? 1000.0 / fps : 0.0;
+
+    if (measuring_)
+    {
+        HdUtils::time_duration frameTime = now - frameStart_;
+        double frameMs = frameTime.count();
+        if (frameMs > budgetMs_) framesOverBudget_++;
+
+        if (frameEvaluations_ == 0) baseMs_ += SMOOTHING * (frameMs - baseMs_);
+        else
+        {
+            double perEvaluation = std::max(0.0, frameMs - baseMs_) / frameEvaluations_;
+            evaluationMs_ = evaluationMs_ > 0.0 ? evaluationMs_ + SMOOTHING * (perEvaluation - evaluationMs_) : perEvaluation;
+        }
+    }
+
+    if (frameEvaluations_ == 0) framesSinceEvaluation_++;
+    else framesSinceEvaluation_ = 0;
+
+    if (evaluationMs_ <= 0.0) allowance_ = std::numeric_limits<unsigned int>::max();
+    else allowance_ = (unsigned int) std::max(0.0, (budgetMs_ - baseMs_) / evaluationMs_);
+    if (allowance_ == 0 && framesSinceEvaluation_ >= PROBE_INTERVAL) allowance_ = 1;
+
+    frameStart_ = now;
+    frameEvaluations_ = 0;
+    measuring_ = true;
+}
+
+void HdRealtime::flushBackFill()
+{
+    std::vector<double> frames;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        frames.swap(backFill_);
+    }
+    HdAutoFill::instance().backFill(frames);
+}
+
+void HdRealtime::recordCached(const MObject& oPoseNode, double frame, const std::string& poseId)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    Rig& rig = getRig(oPoseNode);
+    if (rig.cachedFrames.size() >= MAX_CACHED_FRAMES) rig.cachedFrames.clear();
+    rig.cachedFrames[frame] = poseId;
+}
+
+bool HdRealtime::requestEvaluation(const MObject& oPoseNode, double frame, const std::string& poseId)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (frameEvaluations_ >= allowance_) return false;
+
+    // the cache nodes store the pose in this frame
+    frameEvaluations_++;
+    evaluations_++;
+    frames_[frame].evaluated++;
+    getRig(oPoseNode).cachedFrames[frame] = poseId;
+    return true;
+}
+
+void HdRealtime::forceEvaluation(const MObject& oPoseNode, double frame, const std::string& poseId)
+{
+    // nothing cached to show instead
+    std::lock_guard<std::mutex> lock(mutex_);
+    frameEvaluations_++;
+    forcedEvaluations_++;
+    frames_[frame].evaluated++;
+    getRig(oPoseNode).cachedFrames[frame] = poseId;
+}
+
+void HdRealtime::getNearestPoses(const MObject& oPoseNode, double frame, std::vector<std::pair<double, std::string>>& poses)
+{
+    poses.clear();
+    std::lock_guard<std::mutex> lock(mutex_);
+    const std::map<double, std::string>& cachedFrames = getRig(oPoseNode).cachedFrames;
+
+    // walk outwards from the frame, nearest first
+    std::map<double, std::string>::const_iterator after = cachedFrames.lower_bound(frame);
+    std::map<double, std::string>::const_iterator before = after;
+    while (poses.size() < MAX_CANDIDATES && (before != cachedFrames.begin() || after != cachedFrames.end()))
+    {
+        bool takeBefore = after == cachedFrames.end();
+        if (!takeBefore && before != cachedFrames.begin())
+        {
+            std::map<double, std::string>::const_iterator previous = std::prev(before);
+            takeBefore = (frame - previous->first) <= (after->first - frame);
+        }
+
+        if (takeBefore)
+        {
+            --before;
+            poses.push_back(*before);
+        } else
+        {
+            poses.push_back(*after);
+            ++after;
+        }
+    }
+}
+
+void HdRealtime::recordSubstitution(const MObject& oPoseNode, double frame, double sourceFrame)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    unsigned int rigHash = MObjectHandle::objectHashCode(oPoseNode);
+    frames_[frame].substituted.push_back(std::make_pair(rigHash, sourceFrame));
+    substitutions_++;
+
+    // the pose of this frame was not the one cached under it
+    getRig(oPoseNode).cachedFrames.erase(frame);
+    if (std::find(backFill_.begin(), backFill_.end(), frame) == backFill_.end()) backFill_.push_back(frame);
+}
+
+void HdRealtime::onTimeChange(MTime& time, void* clientData)
+{
+    HdRealtime* realtime = static_cast<HdRealtime*>(clientData);
+    if (!HdUtils::playbackActive()) return;
+
+    std::lock_guard<std::mutex> lock(realtime->mutex_);
+    realtime->startFrame();
+}
+
+void HdRealtime::onPlayingBack(bool playing, void* clientData)
+{
+    HdRealtime* realtime = static_cast<HdRealtime*>(clientData);
+    if (playing)
+    {
+        // the record covers the last playback, the frame times start over
+        std::lock_guard<std::mutex> lock(realtime->mutex_);
+        realtime->frames_.clear();
+        realtime->measuring_ = false;
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(realtime->mutex_);
+        realtime->measuring_ = false;
+        if (!realtime->backFill_.empty()) realtime->log->info("Playback stopped, back-fill {} substituted frames.", realtime->backFill_.size());
+    }
+    realtime->flushBackFill();
+}
+
+std::string HdRealtime::getStatsJson()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    unsigned int substitutedFrames = 0;
+    for (std::map<double, FrameRecord>::const_iterator it = frames_.begin(); it != frames_.end(); ++it)
+    {
+        if (!it->second.substituted.empty()) substitutedFrames++;
+    }
+
+    std::string result = "{";
+    result += "\"enabled\": " + std::string(enabled_ ? "true" : "false") + ", ";
+    result += "\"target_fps\": " + std::to_string(targetFps_) + ", ";
+    result += "\"budget_ms\": " + std::to_string(budgetMs_) + ", ";
+    result += "\"base_ms\": " + std::to_string(baseMs_) + ", ";
+    result += "\"evaluation_ms\": " + std::to_string(evaluationMs_) + ", ";
+    result += "\"evaluations\": " + std::to_string(evaluations_) + ", ";
+    result += "\"forced_evaluations\": " + std::to_string(forcedEvaluations_) + ", ";
+    result += "\"substitutions\": " + std::to_string(substitutions_) + ", ";
+    result += "\"frames_over_budget\": " + std::to_string(framesOverBudget_) + ", ";
+    result += "\"frames\": " + std::to_string(frames_.size()) + ", ";
+    result += "\"substituted_frames\": " + std::to_string(substitutedFrames) + ", ";
+    result += "\"back_fill_pending\": " + std::to_string(backFill_.size()) + "}";
+    return result;
+}
+
+std::string HdRealtime::getFramesJson()
+{
+    // main thread only, node names are resolved
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::string result = "[";
+    for (std::map<double, FrameRecord>::const_iterator it = frames_.begin(); it != frames_.end(); ++it)
+    {
+        if (it != frames_.begin()) result += ", ";
+        result += "{\"frame\": " + std::to_string(it->first) + ", ";
+        result += "\"evaluated\": " + std::to_string(it->second.evaluated) + ", ";
+        result += "\"substituted\": [";
+        for (size_t i=0; i<it->second.substituted.size(); i++)
+        {
+            std::map<unsigned int, Rig>::const_iterator rig = rigs_.find(it->second.substituted[i].first);
+            std::string nodeName;
+            if (rig != rigs_.end() && rig->second.poseNode.isAlive()) nodeName = HdUtils::getNodeName(rig->second.poseNode.object());
+
+            if (i > 0) result += ", ";
+            result += "{\"node\": \"" + nodeName + "\", ";
+            result += "\"source_frame\": " + std::to_string(it->second.substituted[i].second) + "}";
+        }
+        result += "]}";
+    }
+    return result + "]";
+}
@@ -0,0 +1,241 @@
+//
+// -----------------------------------------------------------------------------
+// This source file has been developed within the scope of the
+// Technical Director course at Filmakademie Baden-Wuerttemberg.
+// http://technicaldirector.de
+//
+// Written by Tim Lehr
+// Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+// -----------------------------------------------------------------------------
+//
+
+#include "HdReplay.h"
+
+#include <cstdlib>
+#include <sstream>
+#include <unistd.h>
+
+#include <maya/MDGMessage.h>
+#include <maya/MFileIO.h>
+#include <maya/MObjectArray.h>
+#include <maya/MSceneMessage.h>
+
+#include "HdUtils.h"
+#include "HdMeshCache.h"
+#include "HdPoseNode.h"
+#include "HdCoverage.h"
+#include "HdPrefetcher.h"
+#include "HdSceneCallbacks.h"
+
+HdReplay::HdReplay()
+{
+    log = HdUtils::getLoggerInstance("HdReplay");
+}
+
+HdReplay::~HdReplay()
+{
+    shutdown();
+}
+
+HdReplay& HdReplay::instance()
+{
+    static HdReplay replay;
+    return replay;
+}
+
+void HdReplay::initFromEnvironment()
+{
+    const char* subframes = std::getenv("HD_REPLAY_SUBFRAMES");
+    if (subframes != nullptr) CHECK_MSTATUS(setSubframes(subframes));
+
+    const char* mode = std::getenv("HD_REPLAY");
+    if (mode == nullptr) return;
+
+    std::string modeString = mode;
+    if (modeString.empty() || modeString == "0") return;
+
+    writeBack_ = (modeString == "writeback");
+    setEnabled(true);
+}
+
+void HdReplay::setEnabled(bool enabled)
+{
+    if (enabled == enabled_) return;
+    enabled_ = enabled;
+    HdUtils::setReplayActive(enabled);
+
+    if (enabled) registerCallbacks();
+    else deregisterCallbacks();
+
+    reloadCaches();
+    log->info("Replay {}{}.", enabled ? "enabled" : "disabled", enabled && writeBack_ ? " with write-back" : "");
+}
+
+void HdReplay::setWriteBack(bool writeBack)
+{
+    if (writeBack == writeBack_) return;
+    writeBack_ = writeBack;
+    if (enabled_) reloadCaches();
+}
+
+MStatus HdReplay::setSubframes(const std::string& offsets)
+{
+    std::vector<double> subframes;
+    std::stringstream stream(offsets);
+    std::string token;
+    while (std::getline(stream, token, ','))
+    {
+        if (token.empty()) continue;
+        char* end = nullptr;
+        double offset = std::strtod(token.c_str(), &end);
+        if (end == token.c_str())
+        {
+            log->error("Invalid subframe offset '{}'.", token);
+            return MS::kInvalidParameter;
+        }
+        // the frame itself is always keyed
+        if (offset != 0.0) subframes.push_back(offset);
+    }
+
+    subframes_ = subframes;
+    return MS::kSuccess;
+}
+
+void HdReplay::shutdown()
+{
+    deregisterCallbacks();
+    if (enabled_) HdCacheMap::flushWriteBackTiers();
+    enabled_ = false;
+    HdUtils::setReplayActive(false);
+}
+
+void HdReplay::registerCallbacks()
+{
+    MStatus status;
+    callbacks_.append(MDGMessage::addTimeChangeCallback(HdReplay::onTimeChange, this, &status));
+    CHECK_MSTATUS(status);
+
+    // batch renders exit without a save, the shard indices must hit the disk
+    callbacks_.append(MSceneMessage::addCallback(MSceneMessage::kMayaExiting, HdReplay::onExit, this, &status));
+    CHECK_MSTATUS(status);
+}
+
+void HdReplay::deregisterCallbacks()
+{
+    if (callbacks_.length() > 0) MMessage::removeCallbacks(callbacks_);
+    callbacks_.clear();
+}
+
+void HdReplay::reloadCaches()
+{
+    // the tiers depend on the mode, attach them again for an open scene
+    std::string scenePath = MFileIO::currentFile().asChar();
+    if (scenePath.empty() || ::access(scenePath.c_str(), R_OK) != 0) return;
+
+    CHECK_MSTATUS(HdSceneCallbacks::loadCaches(scenePath));
+}
+
+std::string HdReplay::shardPath(const std::string& sidecarPath)
+{
+    // "sh010.hdcache/abc.hdc" -> "sh010.hdcache/abc.<host>-<pid>.hdc"
+    char hostname[256] = "localhost";
+    ::gethostname(hostname, sizeof(hostname) - 1);
+    hostname[sizeof(hostname) - 1] = '\0';
+
+    std::string base = sidecarPath;
+    std::string extension;
+    size_t dot = sidecarPath.find_last_of('.');
+    size_t slash = sidecarPath.find_last_of('/');
+    if (dot != std::string::npos && (slash == std::string::npos || dot > slash))
+    {
+        base = sidecarPath.substr(0, dot);
+        extension = sidecarPath.substr(dot);
+    }
+    return base + "." + hostname + "-" + std::to_string(::getpid()) + extension;
+}
+
+void HdReplay::prepareFrame(const MTime& time)
+{
+    MStatus status;
+    MObjectArray poseNodes = HdCoverage::poseNodes(status);
+    CHECK_MSTATUS(status);
+
+    std::vector<MTime> times(1, time);
+    for (size_t i=0; i<subframes_.size(); i++)
+    {
+        times.push_back(MTime(time.value() + subframes_[i], time.unit()));
+    }
+
+    uint64_t cached = 0;
+    uint64_t missing = 0;
+    for (unsigned int i=0; i<poseNodes.length(); i++)
+    {
+        std::vector<std::shared_ptr<HdMeshCache>> meshCaches;
+        std::vector<std::string> cacheIds = HdPoseNode::getCacheIds(poseNodes[i], status);
+        for (size_t j=0; j<cacheIds.size(); j++)
+        {
+            if (!HdCacheMap::exists(cacheIds[j])) continue;
+            std::shared_ptr<HdMeshCache> meshCache = HdCacheMap::get(cacheIds[j], status);
+            if (meshCache != nullptr) meshCaches.push_back(meshCache);
+        }
+        if (meshCaches.empty()) continue;
+
+        for (size_t t=0; t<times.size(); t++)
+        {
+            HdPose pose = HdPoseNode::createPoseAtTime(poseNodes[i], times[t], status);
+            if (status != MS::kSuccess) break;
+            std::string poseId = pose.hash();
+
+            for (size_t j=0; j<meshCaches.size(); j++)
+            {
+                if (meshCaches[j]->exists(poseId))
+                {
+                    cached++;
+                    HdPrefetcher::instance().prefetch(meshCaches[j], poseId);
+                } else
+                {
+                    missing++;
+                }
+            }
+        }
+    }
+
+    frames_++;
+    keysCached_ += cached;
+    keysMissing_ += missing;
+    if (missing > 0) log->info("Frame {}: {} cached, {} missing poses.", time.value(), cached, missing);
+}
+
+void HdReplay::onTimeChange(MTime& time, void* clientData)
+{
+    HdReplay* replay = static_cast<HdReplay*>(clientData);
+    replay->prepareFrame(time);
+}
+
+void HdReplay::onExit(void* clientData)
+{
+    HdCacheMap::flushWriteBackTiers();
+}
+
+std::string HdReplay::getStatsJson()
+{
+    uint64_t keys = keysCached_ + keysMissing_;
+    double hitRate = keys > 0 ? (double) keysCached_ / (double) keys : 0.0;
+
+    std::string subframes;
+    for (size_t i=0; i<subframes_.size(); i++)
+    {
+        if (i > 0) subframes += ", ";
+        subframes += std::to_string(subframes_[i]);
+    }
+
+    std::string result = "{";
+    result += "\"enabled\": " + std::string(enabled_ ? "true" : "false") + ", ";
+    result += "\"write_back\": " + std::string(writeBack_ ? "true" : "false") + ", ";
+    result += "\"subframes\": [" + subframes + "], ";
+    result += "\"frames\": " + std::to_string(frames_) + ", ";
+    result += "\"keys_cached\": " + std::to_string(keysCached_) + ", ";
+    result += "\"keys_missing\": " + std::to_string(keysMissing_) + ", ";
+    result += "\"hit_rate\": " + std::to_string(hitRate) + "}";
+    return result;
+}
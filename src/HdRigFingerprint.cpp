@@ -0,0 +1,447 @@
+//
+// -----------------------------------------------------------------------------
+// This source file has been developed within the scope of the
+// Technical Director course at Filmakademie Baden-Wuerttemberg.
+// http://technicaldirector.de
+//
+// Written by Tim Lehr
+// Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+// -----------------------------------------------------------------------------
+//
+
+#include "HdRigFingerprint.h"
+
+#include <cstdio>
+#include <deque>
+#include <maya/MEventMessage.h>
+#include <maya/MFnAnimCurve.h>
+#include <maya/MFnAttribute.h>
+#include <maya/MFnDagNode.h>
+#include <maya/MFnDependencyNode.h>
+#include <maya/MFnMesh.h>
+#include <maya/MIntArray.h>
+#include <maya/MPlug.h>
+#include <maya/MPlugArray.h>
+#include <maya/MStringArray.h>
+
+#include "HdUtils.h"
+#include "HdCacheTier.h"
+#include "HdCacheNode.h"
+#include "HdPoseNode.h"
+#include "HdPoseSampler.h"
+
+namespace
+{
+    const size_t NOT_A_RIG_NODE = (size_t) -1;
+
+    const int VALUE_MESSAGES = MNodeMessage::kAttributeSet | MNodeMessage::kOtherPlugSet |
+                               MNodeMessage::kAttributeArrayAdded | MNodeMessage::kAttributeArrayRemoved;
+    const int STRUCTURE_MESSAGES = MNodeMessage::kConnectionMade | MNodeMessage::kConnectionBroken |
+                                   MNodeMessage::kAttributeAdded | MNodeMessage::kAttributeRemoved;
+
+    std::string hexString(uint64_t value)
+    {
+        char buffer[17];
+        std::snprintf(buffer, sizeof(buffer), "%016llx", (unsigned long long) value);
+        return buffer;
+    }
+
+    template <typename T>
+    void appendRaw(std::string& buffer, const T* data, size_t count)
+    {
+        buffer.append(reinterpret_cast<const char*>(data), count * sizeof(T));
+    }
+
+    void appendSetAttrCmds(MPlug plug, std::string& buffer)
+    {
+        // the same values Maya writes into a scene file
+        MStringArray cmds;
+        if (plug.getSetAttrCmds(cmds, MPlug::kChanged) != MS::kSuccess) return;
+        for (unsigned int i=0; i<cmds.length(); i++)
+        {
+            buffer += cmds[i].asChar();
+            buffer += '\n';
+        }
+    }
+
+    // nodes that belong to the animation or to Hyperdrive, not to the rig
+    bool isRigNode(const MObject& node)
+    {
+        if (node.hasFn(MFn::kTime)) return false;
+        if (node.hasFn(MFn::kAnimCurve))
+        {
+            MFnAnimCurve curveFn(node);
+            return !curveFn.isTimeInput() || curveFn.findPlug("input").isConnected();
+        }
+        if (node.hasFn(MFn::kPluginDependNode))
+        {
+            MTypeId typeId = MFnDependencyNode(node).typeId();
+            return typeId != HdPoseNode::id && typeId != HdCacheNode::id;
+        }
+        return true;
+    }
+}
+
+std::shared_ptr<spdlog::logger> HdRigFingerprint::log = HdUtils::getLoggerInstance("HdRigFingerprint");
+std::mutex HdRigFingerprint::registryMutex_;
+std::set<HdRigFingerprint*> HdRigFingerprint::registry_;
+MCallbackIdArray HdRigFingerprint::globalCallbacks_;
+
+HdRigFingerprint::HdRigFingerprint(const MObject& oPoseNode): poseNode_(oPoseNode)
+{
+    std::lock_guard<std::mutex> lock(registryMutex_);
+    registry_.insert(this);
+}
+
+HdRigFingerprint::~HdRigFingerprint()
+{
+    {
+        std::lock_guard<std::mutex> lock(registryMutex_);
+        registry_.erase(this);
+    }
+    removeCallbacks();
+}
+
+void HdRigFingerprint::registerCallbacks()
+{
+    MStatus status;
+    globalCallbacks_.append(MEventMessage::addEventCallback("Undo", HdRigFingerprint::onUndoRedo, nullptr, &status));
+    CHECK_MSTATUS(status);
+    globalCallbacks_.append(MEventMessage::addEventCallback("Redo", HdRigFingerprint::onUndoRedo, nullptr, &status));
+    CHECK_MSTATUS(status);
+}
+
+void HdRigFingerprint::deregisterCallbacks()
+{
+    MMessage::removeCallbacks(globalCallbacks_);
+    globalCallbacks_.clear();
+}
+
+void HdRigFingerprint::removeCallbacks()
+{
+    if (callbacks_.length() > 0) MMessage::removeCallbacks(callbacks_);
+    callbacks_.clear();
+}
+
+void HdRigFingerprint::watchNode(MObject node)
+{
+    MStatus status;
+    MCallbackId id = MNodeMessage::addAttributeChangedCallback(node, HdRigFingerprint::onAttributeChanged, this, &status);
+    CHECK_MSTATUS(status);
+    if (status == MS::kSuccess) callbacks_.append(id);
+}
+
+bool HdRigFingerprint::isExcluded(unsigned int nodeHash, const std::string& plugName)
+{
+    return excludedPlugs_.count(std::make_pair(nodeHash, plugName)) > 0;
+}
+
+void HdRigFingerprint::trace()
+{
+    MStatus status;
+    MObject oPoseNode = poseNode_.object();
+    removeCallbacks();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    nodes_.clear();
+    nodeIndices_.clear();
+    excludedPlugs_.clear();
+    rootStructure_.clear();
+
+    // control values are part of the pose
+    HdPoseSampler sampler(oPoseNode, status, true);
+    std::vector<MObject> upstreamNodes;
+    std::vector<MPlug> controlPlugs;
+    sampler.getUpstream(upstreamNodes, controlPlugs);
+    for (size_t i=0; i<controlPlugs.size(); i++)
+    {
+        unsigned int nodeHash = MObjectHandle::objectHashCode(controlPlugs[i].node());
+        excludedPlugs_.insert(std::make_pair(nodeHash, std::string(controlPlugs[i].partialName().asChar())));
+        if (controlPlugs[i].isChild()) excludedPlugs_.insert(std::make_pair(nodeHash, std::string(controlPlugs[i].parent().partialName().asChar())));
+    }
+
+    // breadth first, the node order only depends on the rig, not on node names
+    std::deque<MObject> queue;
+    auto visit = [&](const MObject& node) -> size_t {
+        unsigned int nodeHash = MObjectHandle::objectHashCode(node);
+        std::unordered_map<unsigned int, size_t>::const_iterator it = nodeIndices_.find(nodeHash);
+        if (it != nodeIndices_.end()) return it->second;
+        if (!isRigNode(node)) return NOT_A_RIG_NODE;
+
+        RigNode rigNode;
+        rigNode.node = MObjectHandle(node);
+        nodes_.push_back(rigNode);
+        nodeIndices_[nodeHash] = nodes_.size() - 1;
+        queue.push_back(node);
+        return nodes_.size() - 1;
+    };
+
+    // roots: the meshes cached for this pose node
+    MPlug cacheIdsPlug(oPoseNode, HdPoseNode::aOutCacheIds);
+    for (unsigned int i=0; i<cacheIdsPlug.numElements(); i++)
+    {
+        MPlugArray cachePlugs;
+        cacheIdsPlug.elementByPhysicalIndex(i).connectedTo(cachePlugs, false, true);
+        for (unsigned int c=0; c<cachePlugs.length(); c++)
+        {
+            MPlug inMeshesPlug(cachePlugs[c].node(), HdCacheNode::aInMeshes);
+            for (unsigned int m=0; m<inMeshesPlug.numElements(); m++)
+            {
+                MPlug source = inMeshesPlug.elementByPhysicalIndex(m).source();
+                if (source.isNull()) continue;
+
+                size_t index = visit(source.node());
+                rootStructure_ += std::to_string(i) + "." + std::to_string(m) + "<" + std::to_string(index) + "." + source.partialName().asChar() + "|";
+            }
+        }
+    }
+
+    while (!queue.empty())
+    {
+        MObject node = queue.front();
+        queue.pop_front();
+        size_t index = nodeIndices_[MObjectHandle::objectHashCode(node)];
+
+        MFnDependencyNode nodeFn(node);
+        std::string structure = nodeFn.typeName().asChar();
+
+        MPlugArray plugs;
+        nodeFn.getConnections(plugs);
+        for (unsigned int i=0; i<plugs.length(); i++)
+        {
+            if (!plugs[i].isDestination()) continue;
+            MPlug source = plugs[i].source();
+            size_t sourceIndex = visit(source.node());
+            if (sourceIndex == NOT_A_RIG_NODE) continue;
+            structure += "|" + std::string(plugs[i].partialName().asChar()) + "<" + std::to_string(sourceIndex) + "." + source.partialName().asChar();
+        }
+
+        // world matrices depend on the DAG parents without a connection
+        if (node.hasFn(MFn::kDagNode))
+        {
+            MFnDagNode dagFn(node);
+            for (unsigned int p=0; p<dagFn.parentCount(); p++)
+            {
+                size_t parentIndex = visit(dagFn.parent(p));
+                if (parentIndex != NOT_A_RIG_NODE) structure += "|^" + std::to_string(parentIndex);
+            }
+        }
+
+        nodes_[index].structure = structure;
+        watchNode(node);
+    }
+
+    traced_ = true;
+    dirty_ = true;
+    traces_++;
+    log->debug("Traced rig of '{}': {} nodes, {} control plugs excluded.", HdUtils::getNodeName(oPoseNode), nodes_.size(), excludedPlugs_.size());
+}
+
+void HdRigFingerprint::gatherValues(const RigNode& rigNode, std::string& buffer)
+{
+    if (!rigNode.node.isAlive()) return;
+    MObject node = rigNode.node.object();
+    unsigned int nodeHash = MObjectHandle::objectHashCode(node);
+
+    if (node.hasFn(MFn::kMesh))
+    {
+        // the deformed points change with the pose, only the topology and rest shapes count
+        MFnMesh meshFn(node);
+        MIntArray polyVertCounts;
+        MIntArray polyVertConnections;
+        meshFn.getVertices(polyVertCounts, polyVertConnections);
+        std::vector<int> ints(polyVertCounts.length() + polyVertConnections.length());
+        if (polyVertCounts.length() > 0) polyVertCounts.get(ints.data());
+        if (polyVertConnections.length() > 0) polyVertConnections.get(ints.data() + polyVertCounts.length());
+        appendRaw(buffer, ints.data(), ints.size());
+
+        if (!meshFn.findPlug("inMesh").isDestination())
+        {
+            MStatus status;
+            const float* points = meshFn.getRawPoints(&status);
+            if (status == MS::kSuccess) appendRaw(buffer, points, (size_t) meshFn.numVertices() * 3);
+        }
+        return;
+    }
+
+    MFnDependencyNode nodeFn(node);
+    for (unsigned int a=0; a<nodeFn.attributeCount(); a++)
+    {
+        MObject attribute = nodeFn.attribute(a);
+        MFnAttribute attrFn(attribute);
+        if (!attrFn.parent().isNull() || !attrFn.isStorable()) continue;
+
+        MPlug plug(node, attribute);
+        std::string plugName = plug.partialName().asChar();
+        if (isExcluded(nodeHash, plugName)) continue;
+        buffer += plugName + ":";
+
+        if (plug.isArray())
+        {
+            for (unsigned int e=0; e<plug.numElements(); e++)
+            {
+                MPlug element = plug.elementByPhysicalIndex(e);
+                if (!element.isDestination()) appendSetAttrCmds(element, buffer);
+            }
+        }
+        else if (plug.isCompound())
+        {
+            for (unsigned int c=0; c<plug.numChildren(); c++)
+            {
+                MPlug child = plug.child(c);
+                if (child.isDestination() || isExcluded(nodeHash, child.partialName().asChar())) continue;
+                appendSetAttrCmds(child, buffer);
+            }
+        }
+        else if (!plug.isDestination())
+        {
+            appendSetAttrCmds(plug, buffer);
+        }
+    }
+}
+
+bool HdRigFingerprint::update()
+{
+    if (!poseNode_.isAlive()) return false;
+
+    bool needsTrace;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!dirty_ && traced_) return false;
+        needsTrace = !traced_;
+    }
+
+    HdUtils::time_point startTime = HdUtils::getCurrentTimePoint();
+    if (needsTrace) trace();
+
+    // the DG is read on the main thread, the hashing runs in parallel
+    std::vector<size_t> dirtyNodes;
+    for (size_t i=0; i<nodes_.size(); i++)
+    {
+        if (nodes_[i].dirty) dirtyNodes.push_back(i);
+    }
+
+    std::vector<std::string> buffers(dirtyNodes.size());
+    for (size_t i=0; i<dirtyNodes.size(); i++)
+    {
+        buffers[i] = nodes_[dirtyNodes[i]].structure + "\n";
+        gatherValues(nodes_[dirtyNodes[i]], buffers[i]);
+    }
+
+    std::vector<uint64_t> digests(dirtyNodes.size());
+    HdUtils::parallelFor(dirtyNodes.size(), [&](size_t i) {
+        digests[i] = hdChecksum64(buffers[i].data(), buffers[i].size());
+    });
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i=0; i<dirtyNodes.size(); i++)
+    {
+        nodes_[dirtyNodes[i]].digest = digests[i];
+        nodes_[dirtyNodes[i]].dirty = false;
+    }
+
+    std::string combined = rootStructure_;
+    for (size_t i=0; i<nodes_.size(); i++) appendRaw(combined, &nodes_[i].digest, 1);
+    std::string fingerprint = hexString(hdChecksum64(combined.data(), combined.size()));
+
+    bool changed = (fingerprint != fingerprint_);
+    fingerprint_ = fingerprint;
+    dirty_ = false;
+    updates_++;
+    nodesHashed_ += dirtyNodes.size();
+    HdUtils::time_duration elapsed = HdUtils::getCurrentTimePoint() - startTime;
+    lastUpdateMs_ = elapsed.count();
+
+    log->debug("Rig fingerprint of '{}': {} ({} of {} nodes hashed, {}ms)", HdUtils::getNodeName(poseNode_.object()),
+               fingerprint_, dirtyNodes.size(), nodes_.size(), lastUpdateMs_);
+    return changed;
+}
+
+bool HdRigFingerprint::get(std::string& fingerprint)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (dirty_ || !traced_) return false;
+    fingerprint = fingerprint_;
+    return true;
+}
+
+bool HdRigFingerprint::invalidate(bool retrace)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    bool wasDirty = dirty_ || !traced_;
+    if (retrace) traced_ = false;
+    for (size_t i=0; i<nodes_.size(); i++) nodes_[i].dirty = true;
+    dirty_ = true;
+    return wasDirty;
+}
+
+void HdRigFingerprint::requestUpdate(bool wasDirty)
+{
+    // the pose node hashes the edit in its next preEvaluation, which only runs if its
+    // outputs are dirty. Until then the stale fingerprint makes it evaluate the rig.
+    if (wasDirty || !poseNode_.isAlive()) return;
+    HdPoseNode::dirtyOutputs(poseNode_.object());
+}
+
+void HdRigFingerprint::onAttributeChanged(MNodeMessage::AttributeMessage msg, MPlug& plug, MPlug& otherPlug, void* clientData)
+{
+    HdRigFingerprint* fingerprint = static_cast<HdRigFingerprint*>(clientData);
+    if (msg & STRUCTURE_MESSAGES)
+    {
+        fingerprint->requestUpdate(fingerprint->invalidate(true));
+        return;
+    }
+    if ((msg & VALUE_MESSAGES) == 0 || plug.isDestination()) return;
+
+    unsigned int nodeHash = MObjectHandle::objectHashCode(plug.node());
+    bool wasDirty;
+    {
+        std::lock_guard<std::mutex> lock(fingerprint->mutex_);
+        if (fingerprint->isExcluded(nodeHash, plug.partialName().asChar())) return;
+        if (plug.isChild() && fingerprint->isExcluded(nodeHash, plug.parent().partialName().asChar())) return;
+
+        std::unordered_map<unsigned int, size_t>::const_iterator it = fingerprint->nodeIndices_.find(nodeHash);
+        if (it == fingerprint->nodeIndices_.end()) return;
+        fingerprint->nodes_[it->second].dirty = true;
+        wasDirty = fingerprint->dirty_;
+        fingerprint->dirty_ = true;
+    }
+    fingerprint->requestUpdate(wasDirty);
+}
+
+void HdRigFingerprint::onUndoRedo(void* clientData)
+{
+    // undo restores values without a reliable attribute message on every node
+    std::lock_guard<std::mutex> registryLock(registryMutex_);
+    for (std::set<HdRigFingerprint*>::iterator it = registry_.begin(); it != registry_.end(); ++it)
+    {
+        (*it)->requestUpdate((*it)->invalidate(false));
+    }
+}
+
+std::string HdRigFingerprint::getStatsJson()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::string result = "{";
+    result += "\"node\": \"" + (poseNode_.isAlive() ? HdUtils::getNodeName(poseNode_.object()) : std::string()) + "\", ";
+    result += "\"fingerprint\": \"" + fingerprint_ + "\", ";
+    result += "\"stale\": " + std::string(dirty_ || !traced_ ? "true" : "false") + ", ";
+    result += "\"rig_nodes\": " + std::to_string(nodes_.size()) + ", ";
+    result += "\"traces\": " + std::to_string(traces_) + ", ";
+    result += "\"updates\": " + std::to_string(updates_) + ", ";
+    result += "\"nodes_hashed\": " + std::to_string(nodesHashed_) + ", ";
+    result += "\"last_update_ms\": " + std::to_string(lastUpdateMs_) + "}";
+    return result;
+}
+
+std::string HdRigFingerprint::getAllStatsJson()
+{
+    std::lock_guard<std::mutex> registryLock(registryMutex_);
+    std::string result = "[";
+    for (std::set<HdRigFingerprint*>::iterator it = registry_.begin(); it != registry_.end(); ++it)
+    {
+        if (it != registry_.begin()) result += ", ";
+        result += (*it)->getStatsJson();
+    }
+    return result + "]";
+}
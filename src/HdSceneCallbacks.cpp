@@ -0,0 +1,243 @@
+//
+// -----------------------------------------------------------------------------
+// This source file has been developed within the scope of the
+// Technical Director course at Filmakademie Baden-Wuerttemberg.
+// http://technicaldirector.de
+//
+// Written by Tim Lehr
+// Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+// -----------------------------------------------------------------------------
+//
+
+#include "HdSceneCallbacks.h"
+
+#include <set>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <maya/MSceneMessage.h>
+#include <maya/MFileIO.h>
+#include <maya/MItDependencyNodes.h>
+#include <maya/MFnDependencyNode.h>
+#include <maya/MPlug.h>
+
+#include "HdUtils.h"
+#include "HdMeshCache.h"
+#include "HdCacheNode.h"
+#include "HdReplay.h"
+
+namespace
+{
+    const std::string SIDECAR_SUFFIX = ".hdcache";
+    const std::string CACHEFILE_EXTENSION = ".hdc";
+}
+
+MCallbackIdArray HdSceneCallbacks::callbackIds;
+std::shared_ptr<spdlog::logger> HdSceneCallbacks::log = HdUtils::getLoggerInstance("HdSceneCallbacks");
+
+MStatus HdSceneCallbacks::registerCallbacks()
+{
+    MStatus status;
+
+    callbackIds.append(MSceneMessage::addCallback(MSceneMessage::kBeforeSave, beforeSave, nullptr, &status));
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    callbackIds.append(MSceneMessage::addCallback(MSceneMessage::kAfterOpen, afterOpen, nullptr, &status));
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    callbackIds.append(MSceneMessage::addCallback(MSceneMessage::kBeforeOpen, beforeSceneChange, nullptr, &status));
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    callbackIds.append(MSceneMessage::addCallback(MSceneMessage::kBeforeNew, beforeSceneChange, nullptr, &status));
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    return status;
+}
+
+MStatus HdSceneCallbacks::deregisterCallbacks()
+{
+    MStatus status = MMessage::removeCallbacks(callbackIds);
+    callbackIds.clear();
+    return status;
+}
+
+void HdSceneCallbacks::beforeSave(void* clientData)
+{
+    // the target name is only known before saving, the reference has to be stored in the file
+    std::string scenePath = MFileIO::beforeSaveFilename().asChar();
+    CHECK_MSTATUS(saveCaches(scenePath));
+}
+
+void HdSceneCallbacks::afterOpen(void* clientData)
+{
+    // bake workers write into their own shards and skip the sidecar
+    if (HdUtils::bakeActive()) return;
+
+    std::string scenePath = MFileIO::currentFile().asChar();
+    CHECK_MSTATUS(loadCaches(scenePath));
+}
+
+void HdSceneCallbacks::beforeSceneChange(void* clientData)
+{
+    HdCacheMap::stopWarmLoads();
+}
+
+std::string HdSceneCallbacks::sceneDirectory(const std::string& scenePath)
+{
+    size_t pos = scenePath.find_last_of('/');
+    if (pos == std::string::npos) return ".";
+    return scenePath.substr(0, pos);
+}
+
+std::string HdSceneCallbacks::sidecarDirectoryName(const std::string& scenePath)
+{
+    // "/shots/sh010.ma" -> "sh010.hdcache"
+    size_t start = scenePath.find_last_of('/');
+    std::string sceneName = (start == std::string::npos) ? scenePath : scenePath.substr(start + 1);
+    size_t end = sceneName.find_last_of('.');
+    if (end != std::string::npos && end > 0) sceneName = sceneName.substr(0, end);
+    return sceneName + SIDECAR_SUFFIX;
+}
+
+MStatus HdSceneCallbacks::saveCaches(const std::string& scenePath)
+{
+    MStatus status;
+    if (scenePath.empty()) return MS::kInvalidParameter;
+
+    std::string sidecarName = sidecarDirectoryName(scenePath);
+    std::string sidecarDir = sceneDirectory(scenePath) + "/" + sidecarName;
+    bool sidecarDirReady = false;
+    std::set<std::string> savedCacheIds;    // rig instances share caches
+
+    MItDependencyNodes nodeIt(MFn::kPluginDependNode, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    for (; !nodeIt.isDone(); nodeIt.next())
+    {
+        MFnDependencyNode depNodeFn(nodeIt.thisNode(), &status);
+        if (status != MS::kSuccess) continue;
+        if (depNodeFn.typeId() != HdCacheNode::HdCacheNode::id) continue;
+
+        MPlug cacheFilePlug = depNodeFn.findPlug(HdCacheNode::aCacheFile, true, &status);
+        CHECK_MSTATUS(status);
+        if (status != MS::kSuccess) continue;
+
+        MString cacheIdValue;
+        MPlug cacheIdPlug = depNodeFn.findPlug(HdCacheNode::aInCacheId, true, &status);
+        if (status == MS::kSuccess) status = cacheIdPlug.getValue(cacheIdValue);
+        std::string cacheId = cacheIdValue.asChar();
+
+        if (status != MS::kSuccess || cacheId.empty() || !HdCacheMap::exists(cacheId))
+        {
+            // nothing cached for this node, drop stale references
+            cacheFilePlug.setValue(MString(""));
+            continue;
+        }
+
+        std::shared_ptr<HdMeshCache> meshCache = HdCacheMap::get(cacheId, status);
+        if (meshCache == nullptr || (meshCache->size() == 0 && meshCache->diskTier() == nullptr))
+        {
+            cacheFilePlug.setValue(MString(""));
+            continue;
+        }
+
+        if (!sidecarDirReady)
+        {
+            if (::mkdir(sidecarDir.c_str(), 0775) != 0 && errno != EEXIST)
+            {
+                log->error("Could not create sidecar cache directory: '{}'", sidecarDir);
+                return MS::kFailure;
+            }
+            sidecarDirReady = true;
+        }
+
+        std::string relativePath = sidecarName + "/" + cacheId + CACHEFILE_EXTENSION;
+        if (!savedCacheIds.insert(cacheId).second)
+        {
+            cacheFilePlug.setValue(MString(relativePath.c_str()));
+            continue;
+        }
+
+        status = meshCache->persist(sidecarDir + "/" + cacheId + CACHEFILE_EXTENSION);
+        if (status != MS::kSuccess)
+        {
+            log->error("Could not persist cache '{}' for node '{}'.", cacheId, depNodeFn.name().asChar());
+            continue;
+        }
+
+        cacheFilePlug.setValue(MString(relativePath.c_str()));
+        log->info("Saved cache '{}' to sidecar file '{}'.", cacheId, relativePath);
+    }
+
+    return MS::kSuccess;
+}
+
+MStatus HdSceneCallbacks::loadCaches(const std::string& scenePath)
+{
+    MStatus status;
+    if (scenePath.empty()) return MS::kInvalidParameter;
+
+    std::string sceneDir = sceneDirectory(scenePath);
+    std::set<std::string> loadedCacheIds;   // rig instances share caches
+
+    MItDependencyNodes nodeIt(MFn::kPluginDependNode, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    for (; !nodeIt.isDone(); nodeIt.next())
+    {
+        MFnDependencyNode depNodeFn(nodeIt.thisNode(), &status);
+        if (status != MS::kSuccess) continue;
+        if (depNodeFn.typeId() != HdCacheNode::HdCacheNode::id) continue;
+
+        MPlug cacheFilePlug = depNodeFn.findPlug(HdCacheNode::aCacheFile, true, &status);
+        if (status != MS::kSuccess) continue;
+
+        std::string relativePath = cacheFilePlug.asString().asChar();
+        if (relativePath.empty()) continue;
+
+        // the cache ID is the file name, so the pose node does not have to be evaluated
+        size_t nameStart = relativePath.find_last_of('/');
+        std::string cacheId = relativePath.substr(nameStart == std::string::npos ? 0 : nameStart + 1);
+        if (cacheId.size() > CACHEFILE_EXTENSION.size())
+        {
+            cacheId = cacheId.substr(0, cacheId.size() - CACHEFILE_EXTENSION.size());
+        }
+        if (!loadedCacheIds.insert(cacheId).second) continue;
+
+        std::string path = sceneDir + "/" + relativePath;
+        if (::access(path.c_str(), R_OK) != 0)
+        {
+            log->warn("Sidecar cache file for node '{}' not found: '{}'", depNodeFn.name().asChar(), path);
+            continue;
+        }
+
+        std::shared_ptr<HdMeshCache> meshCache = HdCacheMap::get(cacheId, status);
+        if (meshCache == nullptr) continue;
+
+        if (!HdUtils::replayActive())
+        {
+            meshCache->detachWriteBackTier();
+            status = meshCache->attachDiskTier(path);
+            if (status != MS::kSuccess) continue;
+
+            status = meshCache->startWarmLoad();
+            CHECK_MSTATUS(status);
+            continue;
+        }
+
+        // replay: render processes share the sidecar, only the frames they need are read
+        status = meshCache->attachDiskTier(path, false);
+        if (status != MS::kSuccess) continue;
+
+        if (HdReplay::instance().writeBack())
+        {
+            if (meshCache->writeBackTier() == nullptr) CHECK_MSTATUS(meshCache->attachWriteBackTier(HdReplay::shardPath(path)));
+        } else
+        {
+            meshCache->detachWriteBackTier();
+        }
+    }
+
+    return MS::kSuccess;
+}
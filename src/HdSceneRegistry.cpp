@@ -0,0 +1,299 @@
+//
+// -----------------------------------------------------------------------------
+// This source file has been developed within the scope of the
+// Technical Director course at Filmakademie Baden-Wuerttemberg.
+// http://technicaldirector.de
+//
+// Written by Tim Lehr
+// Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+// -----------------------------------------------------------------------------
+//
+
+#include "HdSceneRegistry.h"
+
+#include <maya/MDGMessage.h>
+#include <maya/MDagMessage.h>
+#include <maya/MItDependencyNodes.h>
+#include <maya/MFnDependencyNode.h>
+#include <maya/MPlug.h>
+#include <maya/MPlugArray.h>
+
+#include "HdUtils.h"
+#include "HdPoseNode.h"
+#include "HdCacheNode.h"
+
+namespace
+{
+    const int LINK_MESSAGES = MNodeMessage::kConnectionMade | MNodeMessage::kConnectionBroken |
+                              MNodeMessage::kAttributeArrayRemoved;
+
+    // larger edits, e.g. file reads or references, rebuild all rig cones anyway
+    const size_t MAX_CHANGED_NODES = 10000;
+}
+
+HdSceneRegistry::HdSceneRegistry()
+{
+    log = HdUtils::getLoggerInstance("HdSceneRegistry");
+}
+
+HdSceneRegistry::~HdSceneRegistry(){}
+
+HdSceneRegistry& HdSceneRegistry::instance()
+{
+    static HdSceneRegistry registry;
+    return registry;
+}
+
+MStatus HdSceneRegistry::registerCallbacks()
+{
+    MStatus status;
+
+    callbacks_.append(MDGMessage::addNodeAddedCallback(HdSceneRegistry::onNodeAdded, "hyperdrivePose", this, &status));
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    callbacks_.append(MDGMessage::addNodeAddedCallback(HdSceneRegistry::onNodeAdded, "hyperdriveCache", this, &status));
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    callbacks_.append(MDGMessage::addNodeRemovedCallback(HdSceneRegistry::onNodeRemoved, "hyperdrivePose", this, &status));
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    callbacks_.append(MDGMessage::addNodeRemovedCallback(HdSceneRegistry::onNodeRemoved, "hyperdriveCache", this, &status));
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    callbacks_.append(MDGMessage::addConnectionCallback(HdSceneRegistry::onConnection, this, &status));
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    callbacks_.append(MDagMessage::addParentAddedCallback(HdSceneRegistry::onParentChanged, this, &status));
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    callbacks_.append(MDagMessage::addParentRemovedCallback(HdSceneRegistry::onParentChanged, this, &status));
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+
+    // nodes of the scene the plugin was loaded into
+    MItDependencyNodes nodeIt(MFn::kPluginDependNode, &status);
+    CHECK_MSTATUS_AND_RETURN_IT(status);
+    for (; !nodeIt.isDone(); nodeIt.next()) add(nodeIt.thisNode());
+
+    return MS::kSuccess;
+}
+
+void HdSceneRegistry::deregisterCallbacks()
+{
+    MMessage::removeCallbacks(callbacks_);
+    callbacks_.clear();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (std::map<unsigned int, Entry>::iterator it = poseNodes_.begin(); it != poseNodes_.end(); ++it) removeEntry(it->second);
+    for (std::map<unsigned int, Entry>::iterator it = cacheNodes_.begin(); it != cacheNodes_.end(); ++it) removeEntry(it->second);
+    poseNodes_.clear();
+    cacheNodes_.clear();
+    changedNodes_.clear();
+    allChanged_ = true;
+}
+
+void HdSceneRegistry::add(MObject node)
+{
+    MStatus status;
+    MFnDependencyNode depNodeFn(node, &status);
+    if (status != MS::kSuccess) return;
+
+    std::map<unsigned int, Entry>* entries = nullptr;
+    if (depNodeFn.typeId() == HdPoseNode::id) entries = &poseNodes_;
+    else if (depNodeFn.typeId() == HdCacheNode::id) entries = &cacheNodes_;
+    else return;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    Entry& entry = (*entries)[MObjectHandle::objectHashCode(node)];
+    removeEntry(entry);
+    entry.node = MObjectHandle(node);
+    entry.dirty = true;
+
+    // connections are made after the node is added, e.g. while a file is read
+    entry.callback = MNodeMessage::addAttributeChangedCallback(node, HdSceneRegistry::onAttributeChanged, this, &status);
+    CHECK_MSTATUS(status);
+    if (status != MS::kSuccess) entry.callback = 0;
+}
+
+void HdSceneRegistry::remove(const MObject& node)
+{
+    unsigned int nodeHash = MObjectHandle::objectHashCode(node);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::map<unsigned int, Entry>* maps[] = {&poseNodes_, &cacheNodes_};
+    for (std::map<unsigned int, Entry>* entries : maps)
+    {
+        std::map<unsigned int, Entry>::iterator it = entries->find(nodeHash);
+        if (it == entries->end()) continue;
+        removeEntry(it->second);
+        entries->erase(it);
+    }
+}
+
+void HdSceneRegistry::removeEntry(Entry& entry)
+{
+    // expects mutex_ to be held
+    if (entry.callback != 0) MMessage::removeCallback(entry.callback);
+    entry.callback = 0;
+}
+
+void HdSceneRegistry::refresh(Entry& entry, const MObject& linkAttr, bool asDst, std::vector<unsigned int>& links)
+{
+    // expects mutex_ to be held
+    links.clear();
+    entry.dirty = false;
+    refreshes_++;
+
+    MPlug arrayPlug(entry.node.object(), linkAttr);
+    for (unsigned int i=0; i<arrayPlug.numElements(); i++)
+    {
+        MPlugArray connectedPlugs;
+        arrayPlug.elementByPhysicalIndex(i).connectedTo(connectedPlugs, asDst, !asDst);
+        for (unsigned int j=0; j<connectedPlugs.length(); j++)
+        {
+            links.push_back(MObjectHandle::objectHashCode(connectedPlugs[j].node()));
+        }
+    }
+}
+
+void HdSceneRegistry::refreshAll()
+{
+    // expects mutex_ to be held, only edited nodes are refreshed
+    for (std::map<unsigned int, Entry>::iterator it = poseNodes_.begin(); it != poseNodes_.end();)
+    {
+        if (!it->second.node.isAlive())
+        {
+            removeEntry(it->second);
+            it = poseNodes_.erase(it);
+            continue;
+        }
+        if (it->second.dirty)
+        {
+            refresh(it->second, HdPoseNode::aInWhitelist, true, it->second.links);
+            refresh(it->second, HdPoseNode::aInBlacklist, true, it->second.blacklist);
+        }
+        ++it;
+    }
+
+    for (std::map<unsigned int, Entry>::iterator it = cacheNodes_.begin(); it != cacheNodes_.end();)
+    {
+        if (!it->second.node.isAlive())
+        {
+            removeEntry(it->second);
+            it = cacheNodes_.erase(it);
+            continue;
+        }
+        if (it->second.dirty) refresh(it->second, HdCacheNode::aOutMeshes, false, it->second.links);
+        ++it;
+    }
+}
+
+void HdSceneRegistry::getPoseNodes(MObjectArray& poseNodes)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    refreshAll();
+
+    poseNodes.clear();
+    for (std::map<unsigned int, Entry>::iterator it = poseNodes_.begin(); it != poseNodes_.end(); ++it)
+    {
+        poseNodes.append(it->second.node.object());
+    }
+}
+
+void HdSceneRegistry::getOutputMeshes(std::set<unsigned int>& outputMeshes)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    refreshAll();
+
+    outputMeshes.clear();
+    for (std::map<unsigned int, Entry>::iterator it = cacheNodes_.begin(); it != cacheNodes_.end(); ++it)
+    {
+        outputMeshes.insert(it->second.links.begin(), it->second.links.end());
+    }
+}
+
+void HdSceneRegistry::getWhitelistNodes(std::set<unsigned int>& whitelistNodes)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    refreshAll();
+
+    whitelistNodes.clear();
+    for (std::map<unsigned int, Entry>::iterator it = poseNodes_.begin(); it != poseNodes_.end(); ++it)
+    {
+        whitelistNodes.insert(it->second.links.begin(), it->second.links.end());
+    }
+}
+
+void HdSceneRegistry::getBlacklistNodes(const MObject& poseNode, std::vector<unsigned int>& blacklistNodes)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    refreshAll();
+
+    blacklistNodes.clear();
+    std::map<unsigned int, Entry>::const_iterator it = poseNodes_.find(MObjectHandle::objectHashCode(poseNode));
+    if (it != poseNodes_.end()) blacklistNodes = it->second.blacklist;
+}
+
+void HdSceneRegistry::takeChanges(std::set<unsigned int>& changedNodes, bool& allChanged)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    changedNodes.clear();
+    changedNodes.swap(changedNodes_);
+    allChanged = allChanged_;
+    allChanged_ = false;
+}
+
+void HdSceneRegistry::onNodeAdded(MObject& node, void* clientData)
+{
+    static_cast<HdSceneRegistry*>(clientData)->add(node);
+}
+
+void HdSceneRegistry::onNodeRemoved(MObject& node, void* clientData)
+{
+    static_cast<HdSceneRegistry*>(clientData)->remove(node);
+}
+
+void HdSceneRegistry::onAttributeChanged(MNodeMessage::AttributeMessage msg, MPlug& plug, MPlug& otherPlug, void* clientData)
+{
+    if ((msg & LINK_MESSAGES) == 0) return;
+
+    HdSceneRegistry* registry = static_cast<HdSceneRegistry*>(clientData);
+    unsigned int nodeHash = MObjectHandle::objectHashCode(plug.node());
+
+    std::lock_guard<std::mutex> lock(registry->mutex_);
+    std::map<unsigned int, Entry>::iterator it = registry->poseNodes_.find(nodeHash);
+    if (it != registry->poseNodes_.end()) it->second.dirty = true;
+    it = registry->cacheNodes_.find(nodeHash);
+    if (it != registry->cacheNodes_.end()) it->second.dirty = true;
+}
+
+void HdSceneRegistry::markChanged(const MObject& node, const MObject& otherNode)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    changes_++;
+    if (allChanged_) return;
+
+    changedNodes_.insert(MObjectHandle::objectHashCode(node));
+    changedNodes_.insert(MObjectHandle::objectHashCode(otherNode));
+    if (changedNodes_.size() > MAX_CHANGED_NODES)
+    {
+        changedNodes_.clear();
+        allChanged_ = true;
+    }
+}
+
+void HdSceneRegistry::onConnection(MPlug& srcPlug, MPlug& dstPlug, bool made, void* clientData)
+{
+    static_cast<HdSceneRegistry*>(clientData)->markChanged(srcPlug.node(), dstPlug.node());
+}
+
+void HdSceneRegistry::onParentChanged(MDagPath& child, MDagPath& parent, void* clientData)
+{
+    // world matrices follow the DAG parents without a connection
+    static_cast<HdSceneRegistry*>(clientData)->markChanged(child.node(), parent.node());
+}
+
+std::string HdSceneRegistry::getStatsJson()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::string result = "{";
+    result += "\"pose_nodes\": " + std::to_string(poseNodes_.size()) + ", ";
+    result += "\"cache_nodes\": " + std::to_string(cacheNodes_.size()) + ", ";
+    result += "\"link_refreshes\": " + std::to_string(refreshes_) + ", ";
+    result += "\"graph_changes\": " + std::to_string(changes_) + ", ";
+    result += "\"changed_nodes\": " + std::to_string(changedNodes_.size()) + "}";
+    return result;
+}
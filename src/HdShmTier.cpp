@@ -0,0 +1,366 @@
+//
+// -----------------------------------------------------------------------------
+// This source file has been developed within the scope of the
+// Technical Director course at Filmakademie Baden-Wuerttemberg.
+// http://technicaldirector.de
+//
+// Written by Tim Lehr
+// Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+// -----------------------------------------------------------------------------
+//
+
+#include "HdShmTier.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <chrono>
+#include <thread>
+#include <cstdio>
+#include <algorithm>
+
+#include "HdLogger.h"
+
+namespace
+{
+    const uint64_t STATE_KIND_MASK = 0xff;
+    const uint64_t MIN_SLOT_COUNT = 256;
+    const uint64_t BYTES_PER_SLOT = 16 * 1024;      // expected average pose size, sizes the index
+    const int      OPEN_TIMEOUT_MS = 2000;
+    const double   MAX_LOAD_FACTOR = 0.75;
+
+    inline uint64_t align(uint64_t value, uint64_t alignment)
+    {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+
+    inline uint64_t writingState()
+    {
+        return ((uint64_t) ::getpid() << 32) | kSlotWriting;
+    }
+
+    inline uint64_t keyHashOf(const std::string& poseId)
+    {
+        return hdChecksum64(poseId.data(), poseId.size());
+    }
+}
+
+HdShmTier::HdShmTier()
+{
+    log = HdUtils::getLoggerInstance("HdShmTier");
+}
+
+HdShmTier::~HdShmTier()
+{
+    close();
+}
+
+std::string HdShmTier::segmentName(const std::string& segmentKey)
+{
+    // per user, segments are private to the sessions of their owner
+    char name[64];
+    std::snprintf(name, sizeof(name), "/hyperdrive-%u-%016llx", (unsigned int) ::geteuid(),
+                  (unsigned long long) hdChecksum64(segmentKey.data(), segmentKey.size()));
+    return name;
+}
+
+bool HdShmTier::unlink(const std::string& segmentKey)
+{
+    return ::shm_unlink(segmentName(segmentKey).c_str()) == 0;
+}
+
+bool HdShmTier::writerAlive(uint64_t state)
+{
+    pid_t pid = (pid_t) (state >> 32);
+    if (pid <= 0) return false;
+    if (::kill(pid, 0) == 0) return true;
+    return errno == EPERM; // exists, but belongs to another user
+}
+
+bool HdShmTier::open(const std::string& segmentKey, size_t segmentSize)
+{
+    close();
+    name_ = segmentName(segmentKey);
+
+    bool created = true;
+    int fd = ::shm_open(name_.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0 && errno == EEXIST)
+    {
+        created = false;
+        fd = ::shm_open(name_.c_str(), O_RDWR, 0600);
+    }
+    if (fd < 0)
+    {
+        log->error("Could not open shared memory segment '{}': {}", name_, std::strerror(errno));
+        return false;
+    }
+
+    // a segment created by someone else could serve poisoned meshes
+    struct stat segmentStat;
+    if (::fstat(fd, &segmentStat) != 0 || segmentStat.st_uid != ::geteuid() || (segmentStat.st_mode & 077) != 0)
+    {
+        log->error("Shared memory segment '{}' is not private to this user, ignore it.", name_);
+        ::close(fd);
+        return false;
+    }
+
+    if (created)
+    {
+        if (::ftruncate(fd, (off_t) segmentSize) != 0)
+        {
+            log->error("Could not allocate {} bytes for shared memory segment '{}'.", segmentSize, name_);
+            ::close(fd);
+            ::shm_unlink(name_.c_str());
+            return false;
+        }
+    } else
+    {
+        // the creator may not have sized the segment yet
+        struct stat segmentStat;
+        for (int i=0; i<OPEN_TIMEOUT_MS; i++)
+        {
+            if (::fstat(fd, &segmentStat) == 0 && (size_t) segmentStat.st_size > sizeof(HdShmHeader)) break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        segmentSize = (size_t) segmentStat.st_size;
+    }
+
+    void* ptr = ::mmap(nullptr, segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (ptr == MAP_FAILED || segmentSize <= sizeof(HdShmHeader))
+    {
+        log->error("Could not map shared memory segment '{}'.", name_);
+        if (ptr != MAP_FAILED) ::munmap(ptr, segmentSize);
+        return false;
+    }
+
+    mappingSize_ = segmentSize;
+    mapping_ = std::shared_ptr<char>((char*) ptr, [segmentSize](char* p) { ::munmap(p, segmentSize); });
+
+    bool ready = created ? initSegment(segmentSize) : waitForSegment();
+    if (!ready)
+    {
+        close();
+        return false;
+    }
+
+    log->info("{} shared memory segment '{}' ({} poses, {} MB).", created ? "Created" : "Attached to",
+              name_, size(), mappingSize_ / (1024 * 1024));
+    return true;
+}
+
+void HdShmTier::close()
+{
+    // the segment itself stays alive for other processes, see unlink()
+    mapping_.reset();
+    mappingSize_ = 0;
+}
+
+bool HdShmTier::initSegment(size_t segmentSize)
+{
+    // ftruncate zero fills, so all slots start out EMPTY
+    HdShmHeader* hdr = header();
+    __atomic_store_n(&hdr->state, writingState(), __ATOMIC_RELEASE);
+
+    uint64_t slotCount = MIN_SLOT_COUNT;
+    while (slotCount * 2 * BYTES_PER_SLOT <= segmentSize) slotCount *= 2;
+
+    uint64_t dataOffset = align(sizeof(HdShmHeader) + slotCount * sizeof(HdShmSlot), 64);
+    if (dataOffset >= segmentSize)
+    {
+        log->error("Shared memory segment size {} is too small.", segmentSize);
+        __atomic_store_n(&hdr->state, (uint64_t) kSlotEmpty, __ATOMIC_RELEASE);
+        ::shm_unlink(name_.c_str());
+        return false;
+    }
+
+    hdr->magic = HD_SHM_MAGIC;
+    hdr->version = HD_SHM_VERSION;
+    hdr->segmentSize = segmentSize;
+    hdr->slotCount = slotCount;
+    hdr->dataOffset = dataOffset;
+    hdr->dataEnd = dataOffset;
+    hdr->recordCount = 0;
+
+    __atomic_store_n(&hdr->state, (uint64_t) kSlotReady, __ATOMIC_RELEASE);
+    return true;
+}
+
+bool HdShmTier::waitForSegment()
+{
+    HdShmHeader* hdr = header();
+    for (int i=0; i<OPEN_TIMEOUT_MS; i++)
+    {
+        uint64_t state = __atomic_load_n(&hdr->state, __ATOMIC_ACQUIRE);
+        if ((state & STATE_KIND_MASK) == kSlotReady)
+        {
+            if (hdr->magic != HD_SHM_MAGIC || hdr->version != HD_SHM_VERSION || hdr->segmentSize != mappingSize_)
+            {
+                log->error("Incompatible shared memory segment '{}'. Remove it from /dev/shm.", name_);
+                return false;
+            }
+            return true;
+        }
+
+        if ((state & STATE_KIND_MASK) == kSlotWriting && !writerAlive(state))
+        {
+            log->error("Creator of shared memory segment '{}' died during initialization.", name_);
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    log->error("Timed out waiting for shared memory segment '{}'.", name_);
+    return false;
+}
+
+bool HdShmTier::findSlot(const std::string& poseId, uint64_t keyHash, HdShmSlot** slot)
+{
+    HdShmHeader* hdr = header();
+    HdShmSlot* slotArray = slots();
+    uint64_t mask = hdr->slotCount - 1;
+
+    for (uint64_t i=0; i<hdr->slotCount; i++)
+    {
+        HdShmSlot* current = &slotArray[(keyHash + i) & mask];
+        uint64_t state = __atomic_load_n(&current->state, __ATOMIC_ACQUIRE);
+
+        if ((state & STATE_KIND_MASK) == kSlotEmpty) return false;
+        if ((state & STATE_KIND_MASK) != kSlotReady || current->keyHash != keyHash) continue;
+
+        // never trust offsets blindly, the segment is writable by other processes
+        uint64_t offset = current->recordOffset;
+        if (offset < hdr->dataOffset || offset + sizeof(uint32_t) + poseId.size() > mappingSize_) continue;
+
+        uint32_t keySize;
+        std::memcpy(&keySize, mapping_.get() + offset, sizeof(keySize));
+        if (keySize != poseId.size()) continue;
+        if (std::memcmp(mapping_.get() + offset + sizeof(keySize), poseId.data(), keySize) != 0) continue;
+        if (offset + sizeof(keySize) + keySize + current->payloadSize > mappingSize_) continue;
+
+        *slot = current;
+        return true;
+    }
+    return false;
+}
+
+bool HdShmTier::claimSlot(HdShmSlot* slot, uint64_t expected)
+{
+    return __atomic_compare_exchange_n(&slot->state, &expected, writingState(), false,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+bool HdShmTier::exists(const std::string& poseId)
+{
+    if (!isOpen()) return false;
+    HdShmSlot* slot;
+    return findSlot(poseId, keyHashOf(poseId), &slot);
+}
+
+bool HdShmTier::read(const std::string& poseId, HdBlob& blob)
+{
+    if (!isOpen()) return false;
+
+    HdShmSlot* slot;
+    if (!findSlot(poseId, keyHashOf(poseId), &slot)) return false;
+
+    const char* payload = mapping_.get() + slot->recordOffset + sizeof(uint32_t) + poseId.size();
+    if (hdChecksum64(payload, slot->payloadSize) != slot->checksum)
+    {
+        log->error("Checksum mismatch for pose ID '{}' in shared memory segment '{}'.", poseId, name_);
+        return false;
+    }
+
+    // zero-copy, the blob keeps the mapping alive
+    blob = HdBlob(std::shared_ptr<const char>(mapping_, payload), slot->payloadSize);
+    return true;
+}
+
+bool HdShmTier::write(const std::string& poseId, const HdBlob& blob)
+{
+    if (!isOpen()) return false;
+
+    HdShmHeader* hdr = header();
+    uint64_t keyHash = keyHashOf(poseId);
+    HdShmSlot* slot;
+    if (findSlot(poseId, keyHash, &slot)) return true;
+
+    // keep linear probing short, a full index stops publishing instead of degrading lookups
+    if (__atomic_load_n(&hdr->recordCount, __ATOMIC_RELAXED) >= hdr->slotCount * MAX_LOAD_FACTOR)
+    {
+        log->debug("Shared memory index of '{}' is full.", name_);
+        return false;
+    }
+
+    // allocate and fill the record before claiming a slot, so a failed allocation never blocks a slot
+    uint32_t keySize = (uint32_t) poseId.size();
+    uint64_t recordSize = align(sizeof(keySize) + keySize + blob.size, 8);
+    uint64_t offset = __atomic_fetch_add(&hdr->dataEnd, recordSize, __ATOMIC_ACQ_REL);
+    if (offset + recordSize > mappingSize_)
+    {
+        log->debug("Shared memory segment '{}' is full.", name_);
+        return false;
+    }
+
+    char* record = mapping_.get() + offset;
+    std::memcpy(record, &keySize, sizeof(keySize));
+    std::memcpy(record + sizeof(keySize), poseId.data(), keySize);
+    std::memcpy(record + sizeof(keySize) + keySize, blob.begin(), blob.size);
+
+    HdShmSlot* slotArray = slots();
+    uint64_t mask = hdr->slotCount - 1;
+
+    for (uint64_t i=0; i<hdr->slotCount; i++)
+    {
+        HdShmSlot* current = &slotArray[(keyHash + i) & mask];
+        uint64_t state = __atomic_load_n(&current->state, __ATOMIC_ACQUIRE);
+        uint64_t kind = state & STATE_KIND_MASK;
+
+        bool claimed = false;
+        if (kind == kSlotEmpty)
+        {
+            claimed = claimSlot(current, state);
+        }
+        else if (kind == kSlotWriting && !writerAlive(state))
+        {
+            // the writer crashed, its half written record is abandoned
+            claimed = claimSlot(current, state);
+            if (claimed) log->warn("Reclaimed slot of dead writer (pid {}) in '{}'.", state >> 32, name_);
+        }
+        else if (kind == kSlotReady && current->keyHash == keyHash && findSlot(poseId, keyHash, &slot))
+        {
+            // published by another process in the meantime
+            return true;
+        }
+
+        if (!claimed) continue;
+
+        current->keyHash = keyHash;
+        current->recordOffset = offset;
+        current->payloadSize = blob.size;
+        current->checksum = hdChecksum64(blob.begin(), blob.size);
+        __atomic_store_n(&current->state, (uint64_t) kSlotReady, __ATOMIC_RELEASE);
+        __atomic_fetch_add(&hdr->recordCount, 1, __ATOMIC_RELAXED);
+        return true;
+    }
+
+    log->debug("Shared memory index of '{}' is full.", name_);
+    return false;
+}
+
+size_t HdShmTier::size()
+{
+    if (!isOpen()) return 0;
+    return (size_t) __atomic_load_n(&header()->recordCount, __ATOMIC_RELAXED);
+}
+
+uint64_t HdShmTier::bytesUsed()
+{
+    if (!isOpen()) return 0;
+    HdShmHeader* hdr = header();
+    uint64_t dataEnd = __atomic_load_n(&hdr->dataEnd, __ATOMIC_RELAXED);
+    return std::min<uint64_t>(dataEnd, mappingSize_);
+}
@@ -0,0 +1,147 @@
+//
+// -----------------------------------------------------------------------------
+// This source file has been developed within the scope of the
+// Technical Director course at Filmakademie Baden-Wuerttemberg.
+// http://technicaldirector.de
+//
+// Written by Tim Lehr
+// Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+// -----------------------------------------------------------------------------
+//
+
+#include "HdTaskPool.h"
+
+#include "HdUtils.h"
+
+namespace
+{
+    // chunks per thread, so threads that finish early pick up more work
+    const size_t CHUNKS_PER_THREAD = 4;
+}
+
+void HdTaskGraph::buildLevels()
+{
+    // longest path from a root, so every dependency of a task is in an earlier level
+    levels.clear();
+    std::vector<uint32_t> pending = dependencyCounts;
+    std::vector<uint32_t> current = roots;
+    while (!current.empty())
+    {
+        std::vector<uint32_t> next;
+        for (size_t i=0; i<current.size(); i++)
+        {
+            const std::vector<uint32_t>& taskSuccessors = successors[current[i]];
+            for (size_t s=0; s<taskSuccessors.size(); s++)
+            {
+                if (--pending[taskSuccessors[s]] == 0) next.push_back(taskSuccessors[s]);
+            }
+        }
+        levels.push_back(std::move(current));
+        current.swap(next);
+    }
+}
+
+HdTaskPool::HdTaskPool()
+{
+    log = HdUtils::getLoggerInstance("HdTaskPool");
+}
+
+HdTaskPool::~HdTaskPool()
+{
+    shutdown();
+}
+
+HdTaskPool& HdTaskPool::instance()
+{
+    static HdTaskPool pool;
+    return pool;
+}
+
+void HdTaskPool::shutdown()
+{
+    std::lock_guard<std::mutex> runLock(runMutex_);
+    if (!initialized_) return;
+    MThreadPool::release();
+    initialized_ = false;
+}
+
+void HdTaskPool::run(const HdTaskGraph& graph, const std::vector<bool>& serial, const std::function<void(size_t)>& fn)
+{
+    if (graph.size() == 0) return;
+
+    std::lock_guard<std::mutex> runLock(runMutex_);
+    if (!initialized_)
+    {
+        MStatus status = MThreadPool::init();
+        CHECK_MSTATUS(status);
+        initialized_ = status == MS::kSuccess;
+        if (initialized_) log->info("Initialized Maya thread pool for {} threads.", threadCount());
+    }
+
+    fn_ = &fn;
+    graphs_++;
+    for (size_t l=0; l<graph.levels.size(); l++)
+    {
+        const std::vector<uint32_t>& level = graph.levels[l];
+        parallelTasks_.clear();
+        for (size_t i=0; i<level.size(); i++)
+        {
+            if (!serial[level[i]]) parallelTasks_.push_back(level[i]);
+        }
+
+        // a single task is not worth a parallel region
+        if (initialized_ && parallelTasks_.size() > 1)
+        {
+            size_t chunkCount = std::min(parallelTasks_.size(), threadCount() * CHUNKS_PER_THREAD);
+            chunks_.resize(chunkCount);
+            for (size_t c=0; c<chunkCount; c++)
+            {
+                chunks_[c].pool = this;
+                chunks_[c].begin = parallelTasks_.size() * c / chunkCount;
+                chunks_[c].end = parallelTasks_.size() * (c + 1) / chunkCount;
+            }
+            MStatus status = MThreadPool::newParallelRegion(HdTaskPool::runRegion, this);
+            CHECK_MSTATUS(status);
+            regions_++;
+        } else
+        {
+            for (size_t i=0; i<parallelTasks_.size(); i++) fn(parallelTasks_[i]);
+        }
+
+        for (size_t i=0; i<level.size(); i++)
+        {
+            if (!serial[level[i]]) continue;
+            fn(level[i]);
+            serialTasks_++;
+        }
+    }
+    fn_ = nullptr;
+}
+
+void HdTaskPool::runRegion(void* data, MThreadRootTask* root)
+{
+    HdTaskPool* pool = static_cast<HdTaskPool*>(data);
+    for (size_t c=0; c<pool->chunks_.size(); c++)
+    {
+        MThreadPool::createTask(HdTaskPool::runChunk, &pool->chunks_[c], root);
+    }
+    MThreadPool::executeAndJoin(root);
+}
+
+MThreadRetVal HdTaskPool::runChunk(void* data)
+{
+    Chunk* chunk = static_cast<Chunk*>(data);
+    HdTaskPool* pool = chunk->pool;
+    for (size_t i=chunk->begin; i<chunk->end; i++) (*pool->fn_)(pool->parallelTasks_[i]);
+    return (MThreadRetVal) 0;
+}
+
+std::string HdTaskPool::getStatsJson()
+{
+    std::string result = "{";
+    result += "\"threads\": " + std::to_string(threadCount()) + ", ";
+    result += "\"graphs\": " + std::to_string(graphs_) + ", ";
+    result += "\"parallel_regions\": " + std::to_string(regions_) + ", ";
+    result += "\"serial_tasks\": " + std::to_string(serialTasks_) + "}";
+    return result;
+}
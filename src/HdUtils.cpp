@@ -12,6 +12,11 @@
 #include "HdUtils.h"
 
 #include <map>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+#include <algorithm>
 #include <maya/MFnDependencyNode.h>
 #include <maya/MAnimControl.h>
 #include <spdlog/spdlog.h>
@@ -41,6 +46,58 @@ bool HdUtils::playbackActive()
     return (animPlay && !animScrub); 
 }
 
+bool HdUtils::bakeActive()
+{
+    // set for the mayapy workers launched by hdCache -bake
+    static bool bakeWorker = std::getenv("HD_BAKE_WORKER") != nullptr;
+    return bakeWorker;
+}
+
+namespace
+{
+    bool autoFillFlag = false;
+    bool replayFlag = false;
+    bool interactiveFlag = false;
+}
+
+void HdUtils::setAutoFillActive(bool active)
+{
+    autoFillFlag = active;
+}
+
+bool HdUtils::autoFillActive()
+{
+    // set while HdAutoFill pulls a frame through the cache nodes
+    return autoFillFlag;
+}
+
+void HdUtils::setReplayActive(bool active)
+{
+    replayFlag = active;
+}
+
+bool HdUtils::replayActive()
+{
+    // set by HdReplay for batch and farm renders
+    return replayFlag;
+}
+
+void HdUtils::setInteractiveActive(bool active)
+{
+    interactiveFlag = active;
+}
+
+bool HdUtils::interactiveActive()
+{
+    // set by hdInteractive, caches are served while scrubbing and stepping
+    return interactiveFlag;
+}
+
+bool HdUtils::cachingActive()
+{
+    return playbackActive() || bakeActive() || autoFillActive() || replayActive() || interactiveActive();
+}
+
 double HdUtils::getCurrentFrame()
 {
     return MAnimControl::currentTime().value(); 
@@ -76,26 +133,6 @@ std::string HdUtils::getNodeName(const MObject& obj)
     return name;
 }
 
-std::shared_ptr<spdlog::logger> HdUtils::getLoggerInstance(std::string loggerName)
-{
-    auto log = spdlog::get(loggerName);
-    if (log != nullptr) {
-        return log;
-    }
-
-    try
-    {
-        return spdlog::stdout_color_mt(loggerName);
-    }
-    catch (const spdlog::spdlog_ex& ex)
-    {
-        std::cout << "Logger '" << loggerName << "' initialization failed: " << 
-        ex.what() << std::endl;
-    }
-
-    return nullptr;
-}
-
 template<typename T>
 MStatus HdVector4<T>::toMPoint(MPoint& point)
 {
@@ -133,4 +170,24 @@ std::shared_ptr<HdVector3<T>>  HdVector3<T>::fromMVector(const MVector& vec)
 template class HdVector3<double>;
 template class HdVector3<float>;
 template class HdVector4<double>;
-template class HdVector4<float>;
\ No newline at end of file
+template class HdVector4<float>;
+
+void HdUtils::parallelFor(size_t count, const std::function<void(size_t)>& fn)
+{
+    size_t threadCount = std::min((size_t) std::max(1u, std::thread::hardware_concurrency()), count);
+    if (threadCount <= 1)
+    {
+        for (size_t i=0; i<count; i++) fn(i);
+        return;
+    }
+
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> threads;
+    for (size_t t=0; t<threadCount; t++)
+    {
+        threads.push_back(std::thread([&]() {
+            for (size_t i = next++; i < count; i = next++) fn(i);
+        }));
+    }
+    for (size_t t=0; t<threads.size(); t++) threads[t].join();
+}
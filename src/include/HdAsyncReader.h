@@ -0,0 +1,78 @@
+/* * -----------------------------------------------------------------------------
+ * This source file has been developed within the scope of the
+ * Technical Director course at Filmakademie Baden-Wuerttemberg.
+ * http://technicaldirector.de
+ *
+ * Written by Tim Lehr
+ * Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+ * -----------------------------------------------------------------------------
+ */
+
+#ifndef HD_ASYNCREADER_H
+#define HD_ASYNCREADER_H
+
+#include <map>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+#include <sys/uio.h>
+#include "spdlog/spdlog.h"
+
+#include "HdCacheTier.h"
+
+// Asynchronous positional file reads. Uses io_uring where the kernel supports it
+// and falls back to a small pool of threads issuing blocking preads otherwise.
+// Callbacks are executed on a reader thread.
+class HdAsyncReader
+{
+    public:
+        typedef std::function<void(bool success, const HdBlob& blob, double latencyMs)> Callback;
+
+    private:
+        struct Request
+        {
+            int                                 fd;
+            uint64_t                            offset;
+            size_t                              size;
+            Callback                            callback;
+            HdBlob                              blob;
+            char*                               buffer;
+            size_t                              done;
+            iovec                               iov;
+            std::chrono::high_resolution_clock::time_point submitTime;
+        };
+
+        struct Ring;
+
+        std::shared_ptr<spdlog::logger>         log;
+        std::unique_ptr<Ring>                   ring_;
+        std::vector<std::thread>                threads_;
+        std::deque<Request*>                    queue_;
+        std::map<uint64_t, Request*>            inFlight_;
+        std::mutex                              mutex_;
+        std::condition_variable                 condition_;
+        std::atomic<size_t>                     pending_;
+        uint64_t                                nextRequestId_ = 1;
+        bool                                    stopping_ = false;
+
+        bool                                    initRing(unsigned int queueDepth);
+        bool                                    submitToRing(uint64_t requestId, Request* request);
+        void                                    ringCompletionLoop();
+        void                                    poolWorkerLoop();
+        void                                    complete(Request* request, bool success);
+
+    public:
+                                                HdAsyncReader(unsigned int threadCount = 2, unsigned int queueDepth = 64);
+        virtual                                 ~HdAsyncReader();
+
+        bool                                    submit(int fd, uint64_t offset, size_t size, Callback callback);
+        size_t                                  pending() {return pending_.load();};
+        std::string                             backendName();
+};
+
+#endif
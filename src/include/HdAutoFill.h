@@ -0,0 +1,94 @@
+/* * -----------------------------------------------------------------------------
+ * This source file has been developed within the scope of the
+ * Technical Director course at Filmakademie Baden-Wuerttemberg.
+ * http://technicaldirector.de
+ *
+ * Written by Tim Lehr
+ * Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+ * -----------------------------------------------------------------------------
+ */
+
+#ifndef HD_AUTOFILL_H
+#define HD_AUTOFILL_H
+
+#include <deque>
+#include <string>
+#include <vector>
+#include "spdlog/spdlog.h"
+
+#include <maya/MObject.h>
+#include <maya/MMessage.h>
+#include <maya/MCallbackIdArray.h>
+
+#include "HdUtils.h"
+
+// Idle-time filling of uncached frames in the playback range.
+// While Maya is idle, frames are evaluated in short time slices, nearest to the
+// playhead first. The poses are stored by the regular cache node compute.
+// Every user interaction pauses the fill and restarts it at the playhead.
+// Frames queued for back-fill (see HdRealtime) are filled first, also while the
+// range fill is disabled.
+class HdAutoFill
+{
+    private:
+        struct FillTarget
+        {
+            MObject                             poseNode;
+            std::vector<MObject>                cacheNodes;
+            std::vector<std::string>            cacheIds;
+        };
+
+        std::shared_ptr<spdlog::logger>         log;
+
+        MCallbackIdArray                        interactionCallbacks_;
+        MCallbackId                             idleCallback_ = 0;
+        bool                                    idleRegistered_ = false;
+
+        bool                                    enabled_ = false;
+        double                                  budgetMs_ = 20.0;
+        double                                  idleDelayMs_ = 500.0;
+        HdUtils::time_point                     lastInteraction_;
+
+        // nearest-first walk through the playback range
+        double                                  origin_ = 0.0;
+        double                                  rangeStart_ = 0.0;
+        double                                  rangeEnd_ = 0.0;
+        unsigned int                            step_ = 0;
+        bool                                    done_ = true;
+        std::deque<double>                      backFill_;
+
+        // stats
+        uint64_t                                slices_ = 0;
+        uint64_t                                framesChecked_ = 0;
+        uint64_t                                framesFilled_ = 0;
+        uint64_t                                posesStored_ = 0;
+        uint64_t                                framesBackFilled_ = 0;
+        uint64_t                                interruptions_ = 0;
+
+                                                HdAutoFill();
+        void                                    registerIdle();
+        void                                    deregisterIdle();
+        void                                    restart();
+        bool                                    nextFrame(double& frame);
+        bool                                    hasWork();
+        std::vector<FillTarget>                 collectTargets();
+        bool                                    fillFrame(const std::vector<FillTarget>& targets, double frame);
+        void                                    runSlice();
+
+        static void                             onIdle(void* clientData);
+        static void                             onInteraction(void* clientData);
+
+    public:
+        virtual                                 ~HdAutoFill();
+        static HdAutoFill&                      instance();
+
+        bool                                    enabled()                   {return enabled_;};
+        void                                    setEnabled(bool enabled);
+        void                                    setBudget(double milliseconds);
+        void                                    backFill(const std::vector<double>& frames);
+        void                                    shutdown();
+
+        std::string                             getStatsJson();
+};
+
+#endif
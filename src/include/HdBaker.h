@@ -0,0 +1,47 @@
+/* * -----------------------------------------------------------------------------
+ * This source file has been developed within the scope of the
+ * Technical Director course at Filmakademie Baden-Wuerttemberg.
+ * http://technicaldirector.de
+ *
+ * Written by Tim Lehr
+ * Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+ * -----------------------------------------------------------------------------
+ */
+
+#ifndef HD_BAKER_H
+#define HD_BAKER_H
+
+#include <set>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include "spdlog/spdlog.h"
+
+#include <maya/MStatus.h>
+
+// Bakes a frame range into the pose caches with headless mayapy workers.
+//
+// The frames whose poses are missing in at least one cache are split into
+// contiguous chunks, one per worker. Every worker opens the saved scene,
+// evaluates its frames (hyperdrive.hdbake) and writes the poses into its own
+// disk cache shards ("<bakeDir>/worker<N>/<cacheId>.hdc"). Once all workers
+// exited, the shards are merged into the caches of this session.
+class HdBaker
+{
+    private:
+        static std::shared_ptr<spdlog::logger>  log;
+
+        static MStatus                          planFrames(double start, double end, const std::set<std::string>& cacheIds,
+                                                           std::vector<double>& frames, std::set<std::string>& bakeCacheIds);
+        static pid_t                            spawnWorker(const std::string& scenePath, const std::string& framesFile,
+                                                            const std::string& shardDir, const std::set<std::string>& cacheIds);
+        static MStatus                          waitForWorkers(std::vector<pid_t>& workers);
+        static std::string                      workerCommand();
+
+    public:
+        // an empty cacheIds set bakes all caches of the scene
+        static MStatus                          bake(double start, double end, unsigned int workerCount,
+                                                     const std::set<std::string>& cacheIds, std::string& report);
+};
+
+#endif
@@ -0,0 +1,144 @@
+/* * -----------------------------------------------------------------------------
+ * This source file has been developed within the scope of the
+ * Technical Director course at Filmakademie Baden-Wuerttemberg.
+ * http://technicaldirector.de
+ *
+ * Written by Tim Lehr
+ * Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+ * -----------------------------------------------------------------------------
+ */
+
+#ifndef HD_CACHEFILE_H
+#define HD_CACHEFILE_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <functional>
+#include <unordered_map>
+#include "spdlog/spdlog.h"
+
+#include "HdCacheTier.h"
+
+// On-disk layout (little endian):
+//
+//   HdCacheFileHeader
+//   [HdCacheRecordHeader | pose ID | payload] ... (append only)
+//   [index] (written on flush, located through the file header)
+//
+// Records are never rewritten in place. Overwritten or removed poses leave
+// dead records behind until the file is compacted. If the index is missing
+// or damaged (e.g. Maya crashed), it is rebuilt by scanning the records.
+// Writable opens hold an exclusive flock, a file has one writer at a time.
+
+static const char     HD_CACHEFILE_MAGIC[8] = {'H', 'D', 'C', 'A', 'C', 'H', 'E', '1'};
+static const uint32_t HD_CACHEFILE_VERSION = 1;
+static const uint32_t HD_CACHERECORD_MAGIC = 0x43524448; // 'HDRC'
+static const uint32_t HD_CACHEINDEX_MAGIC = 0x58494448; // 'HDIX'
+
+enum HdCacheCodec
+{
+    kCodecRaw = 0,
+    kCodecShuffleRle = 1,   // 4 byte lanes split into planes, then run length encoded
+};
+
+struct HdCacheFileHeader
+{
+    char                                magic[8];
+    uint32_t                            version;
+    uint32_t                            codec;
+    uint64_t                            indexOffset;
+    uint64_t                            indexSize;
+    uint64_t                            recordCount;
+    uint64_t                            reserved[3];
+};
+
+struct HdCacheRecordHeader
+{
+    uint32_t                            magic;
+    uint32_t                            flags;
+    uint32_t                            keySize;
+    uint32_t                            codec;
+    uint64_t                            payloadSize;
+    uint64_t                            rawSize;
+    uint64_t                            checksum;
+};
+
+enum HdCacheRecordFlags
+{
+    kRecordTombstone = 1 << 0,
+};
+
+// Location and checksum of a single pose payload inside the file
+struct HdCacheFileEntry
+{
+    uint64_t                            recordOffset = 0;
+    uint64_t                            payloadOffset = 0;
+    uint64_t                            payloadSize = 0;
+    uint64_t                            rawSize = 0;
+    uint64_t                            checksum = 0;
+    uint32_t                            codec = kCodecRaw;
+};
+
+class HdCacheFile : public HdCacheTier
+{
+    private:
+        std::string                                         path_;
+        int                                                 fd_ = -1;
+        bool                                                writable_ = false;
+        bool                                                lockedByOther_ = false;
+        bool                                                indexDirty_ = false;
+        uint32_t                                            codec_ = kCodecRaw;
+        uint64_t                                            endOffset_ = 0;
+        uint64_t                                            recordCount_ = 0;
+        uint64_t                                            deadBytes_ = 0;
+
+        std::unordered_map<std::string, HdCacheFileEntry>   index_;
+        std::mutex                                          mutex_;
+        std::shared_ptr<spdlog::logger>                     log;
+
+        bool                        readHeader(HdCacheFileHeader& header);
+        bool                        writeHeader(uint64_t indexOffset, uint64_t indexSize);
+        bool                        loadIndex(const HdCacheFileHeader& header);
+        bool                        scanRecords();
+        bool                        appendRecord(const std::string& poseId, const char* payload, const HdCacheFileEntry& entry, uint32_t flags);
+        void                        insertEntry(const std::string& poseId, const HdCacheFileEntry& entry);
+
+    public:
+                                    HdCacheFile();
+        virtual                     ~HdCacheFile();
+
+        bool                        open(const std::string& path, bool writable);
+        bool                        flush();
+        void                        close();
+        bool                        isOpen()        {return fd_ >= 0;};
+        bool                        lockedByOther() {return lockedByOther_;};   // the last writable open failed on the file lock
+
+        // HdCacheTier
+        std::string                 tierName()      {return "disk";};
+        bool                        exists(const std::string& poseId);
+        bool                        read(const std::string& poseId, HdBlob& blob);
+        bool                        write(const std::string& poseId, const HdBlob& blob);
+        size_t                      size();
+        bool                        writable()      {return writable_;};
+
+        bool                        remove(const std::string& poseId);
+        bool                        locate(const std::string& poseId, HdCacheFileEntry& entry);
+        bool                        readEntry(const HdCacheFileEntry& entry, HdBlob& blob, bool verify);
+        bool                        readPayload(const HdCacheFileEntry& entry, HdBlob& payload, bool verify);
+        bool                        writeEncoded(const std::string& poseId, const HdBlob& payload, const HdCacheFileEntry& entry);
+        void                        forEachEntry(std::function<void(const std::string&, const HdCacheFileEntry&)> callback);
+
+        static bool                 decodePayload(const HdCacheFileEntry& entry, const HdBlob& payload, HdBlob& blob);
+        static bool                 encodePayload(uint32_t codec, const HdBlob& blob, HdBlob& payload, HdCacheFileEntry& entry);
+        static std::string          codecName(uint32_t codec);
+
+        std::string                 path()          {return path_;};
+        int                         fd()            {return fd_;};
+        uint32_t                    codec()         {return codec_;};
+        void                        setCodec(uint32_t codec);
+        uint64_t                    fileSize()      {return endOffset_;};
+        uint64_t                    deadBytes()     {return deadBytes_;};
+};
+
+#endif
@@ -40,6 +40,7 @@ class HdCacheNode : public MPxNode
         
         std::shared_ptr<HdMeshCache> getMeshCache(std::string cacheId, MStatus& status);
         std::string                  getCacheId(MDataBlock& data, MStatus& status);
+        std::string                  getRigTag(MStatus& status);
         
         void                         logExecutionTime(HdUtils::time_point startTime);
 
@@ -49,11 +50,12 @@ class HdCacheNode : public MPxNode
         static MObject aInMeshes;
         static MObject aOutMeshes;
         static MObject aInCacheId;
+        static MObject aCacheFile;
 
     private:
         std::string                     lastPoseId;
         bool                            currentPoseValid;
-        bool                            needsEvaluation;
+        bool                            needsEvaluation = false;
         bool                            hdDisabled = false;
         std::shared_ptr<spdlog::logger> log;
         bool                            instanceLog = false;
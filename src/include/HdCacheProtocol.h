@@ -0,0 +1,133 @@
+/* * -----------------------------------------------------------------------------
+ * This source file has been developed within the scope of the
+ * Technical Director course at Filmakademie Baden-Wuerttemberg.
+ * http://technicaldirector.de
+ *
+ * Written by Tim Lehr
+ * Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+ * -----------------------------------------------------------------------------
+ */
+
+#ifndef HD_CACHEPROTOCOL_H
+#define HD_CACHEPROTOCOL_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+
+#include "HdCacheTier.h"
+
+// Wire protocol between HdDaemonTier and the hyperdrive-cached daemon (Unix domain stream socket).
+//
+//   request:  HdCacheMsgHeader | body | SCM_RIGHTS fds (put only)
+//   reply:    HdCacheMsgHeader | body | SCM_RIGHTS fds (get only)
+//
+// Request bodies:
+//   kOpGet, kOpExists:  count x [uint16 keySize | key]
+//   kOpPut:             count x [uint16 keySize | uint64 payloadSize | uint64 checksum | key], one fd per entry
+//   kOpStats:           empty
+//
+// Reply bodies:
+//   kOpGet:             count x [uint8 found | uint64 payloadSize | uint64 checksum], one fd per found entry
+//   kOpExists, kOpPut:  count x [uint8 result]
+//   kOpStats:           JSON string
+//   kOpError:           count 0, error message. Replaces the reply of a request the daemon could not serve.
+//
+// Payloads never travel through the socket. They are handed over as sealed memfds,
+// so both sides map the same pages and neither can modify them after the handoff.
+
+static const uint32_t HD_CACHEPROTO_MAGIC = 0x50434448; // 'HDCP'
+static const uint16_t HD_CACHEPROTO_VERSION = 1;
+static const uint32_t HD_CACHEPROTO_MAX_BATCH = 128;    // fds per message stay well below SCM_MAX_FD
+static const uint32_t HD_CACHEPROTO_MAX_BODY = 1 << 20;
+
+enum HdCacheOp
+{
+    kOpGet = 1,
+    kOpPut = 2,
+    kOpExists = 3,
+    kOpStats = 4,
+    kOpError = 0xff,
+};
+
+#pragma pack(push, 1)
+struct HdCacheMsgHeader
+{
+    uint32_t                            magic;
+    uint16_t                            version;
+    uint16_t                            op;
+    uint32_t                            count;
+    uint32_t                            bodySize;
+    uint64_t                            requestId;
+};
+
+struct HdCacheGetResult
+{
+    uint8_t                             found;
+    uint64_t                            payloadSize;
+    uint64_t                            checksum;
+};
+
+struct HdCachePutEntry
+{
+    uint16_t                            keySize;
+    uint64_t                            payloadSize;
+    uint64_t                            checksum;
+};
+#pragma pack(pop)
+
+// A serialized message. fds are owned by the message until taken.
+struct HdCacheMessage
+{
+    HdCacheMsgHeader                    header;
+    std::string                         body;
+    std::vector<int>                    fds;
+
+                                        HdCacheMessage();
+                                        ~HdCacheMessage();
+    void                                reset(uint16_t op, uint32_t count, uint64_t requestId);
+    void                                closeFds();
+
+    void                                appendKey(const std::string& key);
+    template <typename T> void          append(const T& value)  {body.append(reinterpret_cast<const char*>(&value), sizeof(T));};
+};
+
+// Sequential reader for message bodies. All reads are bounds checked.
+class HdCacheBodyReader
+{
+    private:
+        const std::string&              body_;
+        size_t                          pos_ = 0;
+        bool                            valid_ = true;
+
+    public:
+                                        HdCacheBodyReader(const std::string& body) : body_(body){}
+        bool                            valid() const   {return valid_;};
+        bool                            readKey(std::string& key);
+        bool                            readBytes(size_t size, std::string& bytes);
+        template <typename T> bool      read(T& value)
+        {
+            if (!valid_ || pos_ + sizeof(T) > body_.size()) return valid_ = false;
+            std::memcpy(&value, body_.data() + pos_, sizeof(T));
+            pos_ += sizeof(T);
+            return true;
+        }
+};
+
+namespace HdCacheProtocol
+{
+    bool                                sendMessage(int sock, const HdCacheMessage& message);
+    bool                                recvMessage(int sock, HdCacheMessage& message);
+
+    int                                 connectSocket(const std::string& path);
+    int                                 listenSocket(const std::string& path);
+    std::string                         defaultSocketPath();
+
+    // sealed, read-only handoff of a payload
+    int                                 createPayloadFd(const HdBlob& blob);
+    bool                                validatePayloadFd(int fd, size_t size);
+    bool                                mapPayloadFd(int fd, size_t size, HdBlob& blob);
+}
+
+#endif
@@ -0,0 +1,70 @@
+/* * -----------------------------------------------------------------------------
+ * This source file has been developed within the scope of the
+ * Technical Director course at Filmakademie Baden-Wuerttemberg.
+ * http://technicaldirector.de
+ *
+ * Written by Tim Lehr
+ * Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+ * -----------------------------------------------------------------------------
+ */
+
+#ifndef HD_CACHETIER_H
+#define HD_CACHETIER_H
+
+#include <memory>
+#include <string>
+#include <cstring>
+#include <cstdint>
+
+// Opaque, reference counted byte buffer holding one serialized pose.
+// The owner of the memory is hidden behind the shared pointer, so a blob
+// can point into heap memory as well as into a mapped file or segment.
+struct HdBlob
+{
+    std::shared_ptr<const char>         data;
+    size_t                              size = 0;
+
+                                        HdBlob(){}
+                                        HdBlob(std::shared_ptr<const char> blobData, size_t blobSize) :
+                                            data(blobData), size(blobSize){}
+
+    bool                                empty() const {return data == nullptr || size == 0;};
+    const char*                         begin() const {return data.get();};
+
+    static HdBlob                       allocate(size_t blobSize, char** writePtr)
+    {
+        char* buffer = new char[blobSize > 0 ? blobSize : 1];
+        *writePtr = buffer;
+        return HdBlob(std::shared_ptr<const char>(buffer, std::default_delete<char[]>()), blobSize);
+    }
+
+    static HdBlob                       copy(const char* src, size_t blobSize)
+    {
+        char* buffer;
+        HdBlob blob = allocate(blobSize, &buffer);
+        std::memcpy(buffer, src, blobSize);
+        return blob;
+    }
+};
+
+// 64 bit checksum used to validate serialized pose data.
+uint64_t                                hdChecksum64(const char* data, size_t size);
+
+// A storage layer below the in-memory LRU cache of a HdMeshCache. 
+// Tiers store serialized poses addressed by pose ID and have to be thread safe.
+class HdCacheTier
+{
+    public:
+        virtual                         ~HdCacheTier(){}
+
+        virtual std::string             tierName() = 0;
+        virtual bool                    exists(const std::string& poseId) = 0;
+        virtual bool                    read(const std::string& poseId, HdBlob& blob) = 0;
+        virtual bool                    write(const std::string& poseId, const HdBlob& blob) = 0;
+        virtual size_t                  size() = 0;
+
+        // read-only tiers are skipped by the write through
+        virtual bool                    writable()      {return true;};
+};
+
+#endif
@@ -11,12 +11,18 @@
 #ifndef HD_COMMANDS_H
 #define HD_COMMANDS_H
 
+#include <set>
+#include <string>
 #include <maya/MPxCommand.h>
 #include <maya/MStatus.h>
 #include <maya/MArgList.h>
+#include <maya/MDGModifier.h>
 
 class HdCmdCache : public MPxCommand
 {
+    private:
+        MStatus                 doBake(const MArgList& args, unsigned int flagIndex, const std::set<std::string>& cacheIds, const MString& help);
+
     public:
                                 HdCmdCache();
                                 ~HdCmdCache();
@@ -42,4 +48,83 @@ class HdCmdLog : public MPxCommand
         static void*            creator();
 };
 
+class HdCmdPrefetch : public MPxCommand
+{
+    public:
+                                HdCmdPrefetch();
+                                ~HdCmdPrefetch();
+        MStatus                 doIt( const MArgList& args);
+        static void*            creator();
+};
+
+class HdCmdAutoFill : public MPxCommand
+{
+    public:
+                                HdCmdAutoFill();
+                                ~HdCmdAutoFill();
+        MStatus                 doIt( const MArgList& args);
+        static void*            creator();
+};
+
+class HdCmdCoverage : public MPxCommand
+{
+    public:
+                                HdCmdCoverage();
+                                ~HdCmdCoverage();
+        MStatus                 doIt( const MArgList& args);
+        static void*            creator();
+};
+
+class HdCmdExport : public MPxCommand
+{
+    public:
+                                HdCmdExport();
+                                ~HdCmdExport();
+        MStatus                 doIt( const MArgList& args);
+        static void*            creator();
+};
+
+class HdCmdReplay : public MPxCommand
+{
+    public:
+                                HdCmdReplay();
+                                ~HdCmdReplay();
+        MStatus                 doIt( const MArgList& args);
+        static void*            creator();
+};
+
+class HdCmdRealtime : public MPxCommand
+{
+    public:
+                                HdCmdRealtime();
+                                ~HdCmdRealtime();
+        MStatus                 doIt( const MArgList& args);
+        static void*            creator();
+};
+
+class HdCmdSetup : public MPxCommand
+{
+    private:
+        MDGModifier             dgModifier;
+        bool                    changed = false;
+
+    public:
+                                HdCmdSetup();
+                                ~HdCmdSetup();
+        MStatus                 doIt( const MArgList& args);
+        MStatus                 redoIt();
+        MStatus                 undoIt();
+        bool                    isUndoable() const;
+        static void*            creator();
+};
+
+class HdCmdInteractive : public MPxCommand
+{
+    public:
+                                HdCmdInteractive();
+                                ~HdCmdInteractive();
+        MStatus                 doIt( const MArgList& args);
+        static void*            creator();
+};
+
 #endif
\ No newline at end of file
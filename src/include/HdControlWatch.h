@@ -0,0 +1,76 @@
+/* * -----------------------------------------------------------------------------
+ * This source file has been developed within the scope of the
+ * Technical Director course at Filmakademie Baden-Wuerttemberg.
+ * http://technicaldirector.de
+ *
+ * Written by Tim Lehr
+ * Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+ * -----------------------------------------------------------------------------
+ */
+
+#ifndef HD_CONTROLWATCH_H
+#define HD_CONTROLWATCH_H
+
+#include <set>
+#include <mutex>
+#include <string>
+#include "spdlog/spdlog.h"
+
+#include <maya/MObject.h>
+#include <maya/MObjectHandle.h>
+#include <maya/MCallbackIdArray.h>
+#include <maya/MNodeMessage.h>
+#include <maya/MTime.h>
+
+// Manipulation state of the controls of a pose node for the interactive mode.
+//
+// The control attributes feeding 'inCtrlVals' are watched with DG callbacks. A
+// value set on one of them (manipulators, channel box, scripts) marks the rig as
+// manipulated until the next time change, meanwhile the rig is evaluated and the
+// edited poses are not cached. Both transitions dirty the pose node outputs. Scrubbing and frame stepping only change the time
+// and are served from the cache.
+class HdControlWatch
+{
+    private:
+        static std::shared_ptr<spdlog::logger>  log;
+        static std::mutex                       registryMutex_;
+        static std::set<HdControlWatch*>        registry_;
+        static MCallbackIdArray                 globalCallbacks_;
+
+        std::mutex                              mutex_;
+        MObjectHandle                           poseNode_;
+        MCallbackIdArray                        callbacks_;
+
+        std::set<std::pair<unsigned int, std::string>> controlPlugs_;
+        bool                                    traced_ = false;
+        bool                                    manipulated_ = false;
+
+        // stats
+        uint64_t                                manipulations_ = 0;
+        uint64_t                                bypasses_ = 0;
+
+        void                                    removeCallbacks();
+        void                                    watchNode(MObject node);
+        void                                    release();
+
+        static void                             onAttributeChanged(MNodeMessage::AttributeMessage msg, MPlug& plug, MPlug& otherPlug, void* clientData);
+        static void                             onTimeChange(MTime& time, void* clientData);
+
+    public:
+                                                HdControlWatch(const MObject& oPoseNode);
+        virtual                                 ~HdControlWatch();
+
+        // main thread only, rebuilds the watch list after the controls were rewired
+        void                                    trace();
+        bool                                    needsTrace();
+
+        bool                                    manipulated();
+
+        std::string                             getStatsJson();
+
+        static void                             registerCallbacks();
+        static void                             deregisterCallbacks();
+        static std::string                      getAllStatsJson();
+};
+
+#endif
@@ -0,0 +1,43 @@
+/* * -----------------------------------------------------------------------------
+ * This source file has been developed within the scope of the
+ * Technical Director course at Filmakademie Baden-Wuerttemberg.
+ * http://technicaldirector.de
+ *
+ * Written by Tim Lehr
+ * Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+ * -----------------------------------------------------------------------------
+ */
+
+#ifndef HD_COVERAGE_H
+#define HD_COVERAGE_H
+
+#include <string>
+#include <vector>
+#include "spdlog/spdlog.h"
+
+#include <maya/MObject.h>
+#include <maya/MObjectArray.h>
+#include <maya/MStatus.h>
+
+// Cache coverage of a frame range, computed from the anim curves (HdPoseSampler).
+//
+// Every frame is classified per pose node:
+//   'c' cached     all caches of the pose node contain the frame's pose
+//   'u' uncached   first frame in the range that reaches a missing pose
+//   'd' duplicate  missing pose, reached by an earlier frame of the range already
+// Consecutive frames with the same pose are reported as holds.
+class HdCoverage
+{
+    private:
+        static std::shared_ptr<spdlog::logger>  log;
+
+        static MStatus                          nodeCoverage(const MObject& oPoseNode, const std::vector<double>& frames,
+                                                             std::string& coverage, std::string& json);
+
+    public:
+        static MObjectArray                     poseNodes(MStatus& status);
+        static MStatus                          build(double start, double end, double step,
+                                                      const MObjectArray& poseNodes, std::string& json);
+};
+
+#endif
@@ -0,0 +1,66 @@
+/* * -----------------------------------------------------------------------------
+ * This source file has been developed within the scope of the
+ * Technical Director course at Filmakademie Baden-Wuerttemberg.
+ * http://technicaldirector.de
+ *
+ * Written by Tim Lehr
+ * Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+ * -----------------------------------------------------------------------------
+ */
+
+#ifndef HD_DAEMONTIER_H
+#define HD_DAEMONTIER_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include "spdlog/spdlog.h"
+
+#include "HdCacheTier.h"
+#include "HdCacheProtocol.h"
+
+// Client of the hyperdrive-cached daemon. Keys are prefixed with a namespace,
+// so caches of the same rig and meshes share poses across sessions.
+// If the daemon is not running, every call fails fast and the connection is
+// retried at most once per second.
+class HdDaemonTier : public HdCacheTier
+{
+    private:
+        std::string                             socketPath_;
+        std::string                             namespace_;
+        int                                     sock_ = -1;
+        uint64_t                                nextRequestId_ = 1;
+        std::chrono::steady_clock::time_point   lastConnectAttempt_;
+        std::mutex                              mutex_;
+        std::shared_ptr<spdlog::logger>         log;
+
+        bool                                    ensureConnected();
+        void                                    disconnect();
+        bool                                    roundTrip(HdCacheMessage& request, HdCacheMessage& reply);
+        std::string                             key(const std::string& poseId)   {return namespace_ + "/" + poseId;};
+
+    public:
+                                                HdDaemonTier(const std::string& socketPath, const std::string& keyNamespace);
+        virtual                                 ~HdDaemonTier();
+
+        bool                                    connect();
+        bool                                    connected();
+
+        // batched variants, split into messages of HD_CACHEPROTO_MAX_BATCH entries
+        bool                                    getMany(const std::vector<std::string>& poseIds, std::vector<HdBlob>& blobs);
+        bool                                    putMany(const std::vector<std::string>& poseIds, const std::vector<HdBlob>& blobs);
+        bool                                    existsMany(const std::vector<std::string>& poseIds, std::vector<bool>& results);
+        std::string                             statsJson();
+
+        // HdCacheTier
+        std::string                             tierName()      {return "daemon";};
+        bool                                    exists(const std::string& poseId);
+        bool                                    read(const std::string& poseId, HdBlob& blob);
+        bool                                    write(const std::string& poseId, const HdBlob& blob);
+        size_t                                  size();
+
+        std::string                             socketPath()    {return socketPath_;};
+};
+
+#endif
@@ -13,20 +13,30 @@
 
 #include <map>
 #include <set>
+#include <mutex>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
 #include <maya/MPxCustomEvaluator.h>
 #include <maya/MStatus.h>
 #include <maya/MArgList.h>
 #include <maya/MObjectArray.h>
 #include <maya/MProfiler.h>
+#include <maya/MEvaluationNode.h>
 
 #include "spdlog/spdlog.h"
 
+#include "HdTaskPool.h"
+
 class HdEvaluator : public MPxCustomEvaluator
 {
     public:
         typedef std::map<unsigned int, unsigned int>                HashMap;
         typedef std::map<unsigned int, std::vector<std::string>>    StringMap;
 
+        // evalNodeMap value of nodes in the cones of several rigs
+        static const unsigned int   SHARED_NODE = 0xFFFFFFFF;
+
                             HdEvaluator();
         virtual             ~HdEvaluator();
 
@@ -42,22 +52,71 @@ class HdEvaluator : public MPxCustomEvaluator
 
         void                evaluatorInit();
         void                evaluatorReset();
-        void                collectHdPoseNodes();
-        void                collectOutputMeshes();
-        void                collectWhitelistNodes();
+        void                collectRigCones();
+        void                compileSchedule(const MCustomEvaluatorClusterNode* cluster);
+        void                recordFrameStats(double frame);
+
+        static std::string  getStatsJson();
 
         MStatus             getNodesFromArrayPlug(MPlug arrayPlug, MObjectArray* nodes, bool asDst, bool asSrc);
         bool                isHyperdriveNode(MObject oNode, MStatus& status);
 
     private:
+        struct ClusterSchedule
+        {
+            std::vector<MEvaluationNode>    cachedNodes;    // evaluated on fully cached frames
+            HdTaskGraph                     cachedGraph;    // dependencies between the cached nodes
+            std::vector<bool>               cachedSerial;   // not safe to run next to each other
+            std::vector<unsigned int>       cachedRigs;     // per cached node, skipped while the rig holds its pose
+            bool                            cachedParallel = false;
+            std::vector<MEvaluationNode>    nodes;          // all nodes, for partially cached frames
+            std::vector<unsigned int>       nodeRigs;       // owning rig per node, SHARED_NODE always runs
+            std::vector<unsigned int>       nodeHoldRigs;   // cachedRigs of the cached nodes
+            size_t                          nodeCount = 0;
+        };
+
+        struct RigCone
+        {
+            std::vector<unsigned int>       nodes;          // claimed nodes
+            std::unordered_set<unsigned int> touched;       // nodes reached by the traversals, an edit of one retraces the cone
+        };
+
+        struct RigStats
+        {
+            uint64_t                        cachedFrames = 0;
+            uint64_t                        evaluatedFrames = 0;
+            uint64_t                        heldFrames = 0;
+            bool                            lastCached = false;
+        };
+
+        struct FrameStats
+        {
+            double                          frame = 0.0;
+            uint64_t                        fullyCachedFrames = 0;
+            uint64_t                        partialFrames = 0;
+            uint64_t                        evaluatedFrames = 0;
+        };
+
+        void                                compileCachedGraph(ClusterSchedule& schedule, const std::vector<MObject>& cachedObjects);
+
+        static std::mutex                   statsMutex_;
+        static std::map<std::string, RigStats> rigStats_;   // by pose node name
+        static FrameStats                   frameStats_;
+
         std::shared_ptr<spdlog::logger> log;
-        HashMap                         evalNodeMap;
+        HashMap                         evalNodeMap;        // rig cone node -> index in poseNodes
+        std::map<unsigned int, RigCone> rigCones_;          // pose node hash -> cone, kept across graph rebuilds
+        std::set<unsigned int>          coneControls_;      // controls of all rigs at the last trace
 
-        std::set<unsigned int>          cachedPoses;
+        std::vector<bool>               rigCached;          // per pose node, current frame
+        std::vector<bool>               rigUnchanged;       // per pose node, same cached pose as the last frame
+        std::vector<std::string>        lastPoseIds;        // per pose node
+        unsigned int                    cachedRigCount = 0;
         std::set<unsigned int>          outputMeshes;
         std::set<unsigned int>          whitelistNodes;
         
         MObjectArray                    poseNodes;
+        std::unordered_map<const MCustomEvaluatorClusterNode*, ClusterSchedule> clusterSchedules;
 
         bool                            hdAvailable = false;
         bool                            fullyCached = false;
@@ -0,0 +1,35 @@
+/* * -----------------------------------------------------------------------------
+ * This source file has been developed within the scope of the
+ * Technical Director course at Filmakademie Baden-Wuerttemberg.
+ * http://technicaldirector.de
+ *
+ * Written by Tim Lehr
+ * Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+ * -----------------------------------------------------------------------------
+ */
+
+#ifndef HD_GEOEXPORTER_H
+#define HD_GEOEXPORTER_H
+
+#include <string>
+#include "spdlog/spdlog.h"
+
+#include <maya/MObject.h>
+#include <maya/MStatus.h>
+
+// Exports the cached poses of a frame range into a geometry stream (HdGeoStream).
+// Pose IDs are sampled from the anim curves (HdPoseSampler), so the rig is not
+// evaluated. Every frame has to be cached, uncached frames fail the export.
+class HdGeoExporter
+{
+    private:
+        static std::shared_ptr<spdlog::logger>  log;
+
+        static MObject                          findPoseNode(const std::string& cacheId, MStatus& status);
+
+    public:
+        static MStatus                          exportCache(const std::string& cacheId, const std::string& path,
+                                                            double start, double end, double step, std::string& json);
+};
+
+#endif
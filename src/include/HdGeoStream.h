@@ -0,0 +1,147 @@
+/* * -----------------------------------------------------------------------------
+ * This source file has been developed within the scope of the
+ * Technical Director course at Filmakademie Baden-Wuerttemberg.
+ * http://technicaldirector.de
+ *
+ * Written by Tim Lehr
+ * Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+ * -----------------------------------------------------------------------------
+ */
+
+#ifndef HD_GEOSTREAM_H
+#define HD_GEOSTREAM_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+#include "spdlog/spdlog.h"
+
+#include "HdCacheTier.h"
+#include "HdPoseBlob.h"
+
+// Pose indexed geometry stream (.hdgeo) for downstream departments.
+// Frames reference unique poses, so held and repeated poses are stored once.
+// The topology is shared by all poses and written once.
+//
+// On-disk layout (little endian):
+//
+//   HdGeoStreamHeader
+//   topology: per mesh HdPoseBlobMesh | int polyVertCounts[polyCount] | int polyVertConnections[connectionCount]
+//   points:   per unique pose float points[pointCount * 3] of all meshes (appended while streaming)
+//   pose table:  HdGeoStreamPose[poseCount]
+//   frame table: HdGeoStreamFrame[frameCount] (ascending frames)
+//   pose keys
+//
+// The tables are written on finish(), the header points to them. Files without
+// tables (an aborted export) are rejected by the reader.
+
+static const char     HD_GEOSTREAM_MAGIC[8] = {'H', 'D', 'G', 'E', 'O', 'S', 'T', '1'};
+static const uint32_t HD_GEOSTREAM_VERSION = 1;
+
+struct HdGeoStreamHeader
+{
+    char                                magic[8];
+    uint32_t                            version;
+    uint32_t                            meshCount;
+    uint64_t                            frameCount;
+    uint64_t                            poseCount;
+    uint64_t                            pointCount;         // points of all meshes per pose
+    uint64_t                            topologyOffset;
+    uint64_t                            poseTableOffset;
+    uint64_t                            frameTableOffset;
+    uint64_t                            keysOffset;
+    uint64_t                            reserved[3];
+};
+
+struct HdGeoStreamPose
+{
+    uint64_t                            pointsOffset;
+    uint64_t                            keyOffset;
+    uint32_t                            keySize;
+    uint32_t                            reserved;
+};
+
+struct HdGeoStreamFrame
+{
+    double                              frame;
+    uint64_t                            poseIndex;
+};
+
+// Streaming writer. Memory use is bounded by the pose and frame tables,
+// the points of a pose are written as soon as the pose is added.
+class HdGeoStreamWriter
+{
+    private:
+        std::shared_ptr<spdlog::logger>                     log;
+        std::string                                         path_;
+        int                                                 fd_ = -1;
+        uint64_t                                            endOffset_ = 0;
+
+        std::vector<HdPoseBlobMesh>                         meshes_;
+        uint64_t                                            pointCount_ = 0;
+        uint64_t                                            topologyHash_ = 0;
+        std::vector<HdGeoStreamPose>                        poses_;
+        std::vector<std::string>                            poseKeys_;
+        std::vector<HdGeoStreamFrame>                       frames_;
+        std::unordered_map<std::string, uint64_t>           poseIndices_;
+
+        bool                        writeTopology(const std::vector<HdPoseBlobMeshView>& meshViews);
+        bool                        writeAt(const char* data, size_t size, uint64_t offset);
+
+    public:
+                                    HdGeoStreamWriter();
+        virtual                     ~HdGeoStreamWriter();
+
+        bool                        open(const std::string& path);
+        bool                        hasPose(const std::string& poseKey);
+        bool                        addPose(const std::string& poseKey, const HdBlob& poseBlob);
+        bool                        addFrame(double frame, const std::string& poseKey);
+        bool                        finish();
+        void                        abort();
+
+        uint64_t                    frameCount()    {return frames_.size();};
+        uint64_t                    poseCount()     {return poses_.size();};
+        uint64_t                    fileSize()      {return endOffset_;};
+};
+
+// Random frame access through a read-only memory map of the whole file.
+class HdGeoStreamReader
+{
+    private:
+        const char*                                         data_ = nullptr;
+        size_t                                              size_ = 0;
+        const HdGeoStreamHeader*                            header_ = nullptr;
+        const HdGeoStreamPose*                              poses_ = nullptr;
+        const HdGeoStreamFrame*                             frames_ = nullptr;
+        std::vector<HdPoseBlobMeshView>                     topology_;
+        std::vector<uint64_t>                               pointOffsets_;  // first point of each mesh
+
+        bool                        validate();
+
+    public:
+                                    HdGeoStreamReader(){}
+        virtual                     ~HdGeoStreamReader();
+
+        bool                        open(const std::string& path);
+        void                        close();
+        bool                        isOpen()        {return data_ != nullptr;};
+
+        uint32_t                    meshCount()     {return header_->meshCount;};
+        uint64_t                    frameCount()    {return header_->frameCount;};
+        uint64_t                    poseCount()     {return header_->poseCount;};
+        size_t                      fileSize()      {return size_;};
+
+        double                      frame(uint64_t frameIndex)        {return frames_[frameIndex].frame;};
+        uint64_t                    poseIndex(uint64_t frameIndex)    {return frames_[frameIndex].poseIndex;};
+        std::string                 poseKey(uint64_t poseIndex);
+
+        // index of the last frame at or before the given frame, -1 before the first frame
+        int64_t                     findFrame(double frame);
+
+        // topology of the mesh with the points of a pose, valid while the reader is open
+        HdPoseBlobMeshView          mesh(uint64_t poseIndex, uint32_t meshIndex);
+        const float*                points(uint64_t poseIndex, uint32_t meshIndex);
+};
+
+#endif
@@ -0,0 +1,27 @@
+/* * -----------------------------------------------------------------------------
+ * This source file has been developed within the scope of the
+ * Technical Director course at Filmakademie Baden-Wuerttemberg.
+ * http://technicaldirector.de
+ *
+ * Written by Tim Lehr
+ * Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+ * -----------------------------------------------------------------------------
+ */
+
+#ifndef HD_LOGGER_H
+#define HD_LOGGER_H
+
+#include <memory>
+#include <string>
+
+#include "spdlog/spdlog.h"
+#include "spdlog/sinks/stdout_color_sinks.h"
+
+// Logger access without any Maya dependency, so it can be shared by the
+// plugin and the standalone cache tools.
+namespace HdUtils 
+{
+    std::shared_ptr<spdlog::logger>     getLoggerInstance(std::string loggerName);
+}
+
+#endif
@@ -14,6 +14,9 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <atomic>
+#include <thread>
+#include <mutex>
 #include "LRUCache11.hpp"
 #include "spdlog/spdlog.h"
 
@@ -22,6 +25,10 @@
 #include <maya/MObject.h>
 
 #include "HdUtils.h"
+#include "HdCacheTier.h"
+#include "HdCacheFile.h"
+#include "HdShmTier.h"
+#include "HdDaemonTier.h"
 
 struct HdMeshUVSetData 
 {
@@ -57,7 +64,11 @@ struct HdMeshData
 class HdMeshSet : public std::vector<HdMeshData> 
 {
     public:
-        double                      memSize();
+        double                                  memSize();
+
+        HdBlob                                  toBlob();
+        static std::shared_ptr<HdMeshSet>       fromBlob(const HdBlob& blob, MStatus& status);
+        uint64_t                                topologyHash();
 };
 
 class HdMeshCache 
@@ -66,7 +77,28 @@ class HdMeshCache
         lru11::Cache<std::string, HdMeshSet, std::mutex>*  meshCache_;
         std::shared_ptr<spdlog::logger> log;
         std::string cacheId_;
+
+        std::vector<std::shared_ptr<HdCacheTier>>   tiers_;
+        std::shared_ptr<HdCacheFile>                diskTier_;
+        std::shared_ptr<HdCacheFile>                writeBackTier_;
+        std::shared_ptr<HdShmTier>                  sharedTier_;
+        size_t                                      sharedTierSize_ = 0;
+        bool                                        sharedTierFailed_ = false;
+        std::shared_ptr<HdDaemonTier>               daemonTier_;
+        std::string                                 daemonSocket_;
+        std::mutex                                  tiersMutex_;
+
+        std::vector<std::shared_ptr<HdCacheTier>>   getTiers();
+
+        std::thread                                 warmLoadThread_;
+        std::atomic<bool>                           warmLoadStop_;
+        std::atomic<bool>                           warmLoading_;
+        std::atomic<size_t>                         warmLoaded_;
+
+        void                                        warmLoad(std::shared_ptr<HdCacheFile> cacheFile);
+        void                                        insertLocked(const std::string& poseId, std::shared_ptr<HdMeshSet> meshSet);
         
+        std::mutex                                  sizeMutex_;     // itemMemSize_ and the capacity, put() races the warm load
         double itemMemSize_ = 0.0;
         double maxMemSize_ = 500 * 1024.0; // 500MB default
 
@@ -75,14 +107,44 @@ class HdMeshCache
         virtual                      ~HdMeshCache();
 
         bool                         exists(std::string poseId);
+        bool                         existsInMemory(std::string poseId);
         MStatus                      put(std::string poseId, std::shared_ptr<HdMeshSet> meshDataPtr);
         std::shared_ptr<HdMeshSet>   get(std::string poseId, MStatus &status, bool copyData);
+        bool                         getBlob(std::string poseId, HdBlob& blob);
+        void                         materialize(std::string poseId, std::shared_ptr<HdMeshSet> meshSet);
         MStatus                      clear();
+
+        MStatus                      attachDiskTier(std::string path, bool writable = true);
+        MStatus                      detachDiskTier();
+        std::shared_ptr<HdCacheFile> diskTier();
+
+        MStatus                      attachWriteBackTier(std::string path);
+        MStatus                      detachWriteBackTier();
+        std::shared_ptr<HdCacheFile> writeBackTier();
+
+        void                         enableSharedTier(size_t segmentSize);
+        bool                         sharedTierPending();
+        MStatus                      attachSharedTier(std::string rigTag, uint64_t topologyHash);
+        MStatus                      detachSharedTier();
+        std::shared_ptr<HdShmTier>   sharedTier();
+
+        void                         enableDaemonTier(std::string socketPath);
+        bool                         daemonTierPending();
+        MStatus                      attachDaemonTier(std::string rigTag, uint64_t topologyHash);
+        MStatus                      detachDaemonTier();
+        std::shared_ptr<HdDaemonTier> daemonTier();
+
+        MStatus                      persist(std::string path);
+        MStatus                      mergeShard(std::string path, size_t& merged, size_t& skipped);
+        MStatus                      startWarmLoad();
+        void                         stopWarmLoad();
+        bool                         warmLoading()  {return warmLoading_;};
+        size_t                       warmLoaded()   {return warmLoaded_;};
         
         std::string                  cacheId()      {return cacheId_;};
        
         size_t                       size()         {return meshCache_->size();};
-        double                       itemMemSize()  {return itemMemSize_;};
+        double                       itemMemSize()  {std::lock_guard<std::mutex> lock(sizeMutex_); return itemMemSize_;};
         double                       memSize()      {return itemMemSize() * meshCache_->size();};
         
         double                       maxMemSize() {return maxMemSize_;};
@@ -102,8 +164,11 @@ class HdCacheMap
 {
     private:
         static std::map<std::string, std::shared_ptr<HdMeshCache>> cacheMap;
+        static std::mutex                   mapMutex;   // cache nodes look up caches from several contexts at once
         static std::shared_ptr<spdlog::logger> log;
 
+        static std::shared_ptr<HdMeshCache> createCacheLocked(const std::string& cacheId, size_t maxSize);
+
     public:
         static bool                         exists(std::string cacheId);
         static std::shared_ptr<HdMeshCache> get(std::string cacheId, MStatus &status);
@@ -111,6 +176,8 @@ class HdCacheMap
         static std::shared_ptr<HdMeshCache> createCache(std::string cacheId, MStatus& status, size_t maxSize = 0);
         static MStatus                      clearMap();
         static MStatus                      clearCaches();
+        static void                         stopWarmLoads();
+        static void                         flushWriteBackTiers();
         static std::string                  getStatsJson();
 };
 
@@ -17,6 +17,7 @@
 
 
 static const double FLOATING_POINT_HASH_FIX_SCALE(4096.0); // Disney scale for fixing floating point hashing
+static const unsigned int POSE_MATRIX_VALUES(12); // first three columns of a control matrix, the last one is constant
 
 class HdPose : public std::vector<double>
 {
@@ -0,0 +1,94 @@
+/* * -----------------------------------------------------------------------------
+ * This source file has been developed within the scope of the
+ * Technical Director course at Filmakademie Baden-Wuerttemberg.
+ * http://technicaldirector.de
+ *
+ * Written by Tim Lehr
+ * Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+ * -----------------------------------------------------------------------------
+ */
+
+#ifndef HD_POSEBLOB_H
+#define HD_POSEBLOB_H
+
+#include <vector>
+#include <cstdint>
+
+#include "HdCacheTier.h"
+
+// Serialized layout of a cached mesh set (one pose of one cache node):
+//
+//   HdPoseBlobHeader
+//   per mesh: HdPoseBlobMesh | float points[vertCount * 3] | int polyVertCounts[polyCount] | int polyVertConnections[connectionCount]
+//
+// The layout does not depend on Maya, so cache files can be inspected by standalone tools.
+
+static const uint32_t HD_POSEBLOB_MAGIC = 0x42504448; // 'HDPB'
+static const uint32_t HD_POSEBLOB_VERSION = 1;
+
+struct HdPoseBlobHeader
+{
+    uint32_t                            magic;
+    uint32_t                            version;
+    uint32_t                            meshCount;
+    uint32_t                            reserved;
+};
+
+struct HdPoseBlobMesh
+{
+    uint32_t                            vertCount;
+    uint32_t                            polyCount;
+    uint32_t                            connectionCount;
+    uint32_t                            reserved;
+};
+
+// Non-owning view of one mesh inside a pose blob
+struct HdPoseBlobMeshView
+{
+    const HdPoseBlobMesh*               mesh;
+    const float*                        points;
+    const int32_t*                      polyVertCounts;
+    const int32_t*                      polyVertConnections;
+
+    size_t                              pointsSize() const      {return (uint64_t) mesh->vertCount * 3 * sizeof(float);};
+    size_t                              topologySize() const    {return ((uint64_t) mesh->polyCount + mesh->connectionCount) * sizeof(int32_t);};
+};
+
+namespace HdPoseBlob
+{
+    // widened to 64 bit, the counts of a corrupt blob must not wrap around
+    inline uint64_t meshSize(uint32_t vertCount, uint32_t polyCount, uint32_t connectionCount)
+    {
+        return sizeof(HdPoseBlobMesh) + (uint64_t) vertCount * 3 * sizeof(float) + ((uint64_t) polyCount + connectionCount) * sizeof(int32_t);
+    }
+
+    // Splits a blob into mesh views. Returns false if the blob is malformed.
+    inline bool parse(const HdBlob& blob, std::vector<HdPoseBlobMeshView>& meshes)
+    {
+        meshes.clear();
+        if (blob.size < sizeof(HdPoseBlobHeader)) return false;
+
+        const HdPoseBlobHeader* header = reinterpret_cast<const HdPoseBlobHeader*>(blob.begin());
+        if (header->magic != HD_POSEBLOB_MAGIC || header->version != HD_POSEBLOB_VERSION) return false;
+
+        size_t pos = sizeof(HdPoseBlobHeader);
+        for (uint32_t i=0; i<header->meshCount; i++)
+        {
+            if (sizeof(HdPoseBlobMesh) > blob.size - pos) return false;
+            const HdPoseBlobMesh* mesh = reinterpret_cast<const HdPoseBlobMesh*>(blob.begin() + pos);
+            uint64_t size = meshSize(mesh->vertCount, mesh->polyCount, mesh->connectionCount);
+            if (size > blob.size - pos) return false;
+
+            HdPoseBlobMeshView view;
+            view.mesh = mesh;
+            view.points = reinterpret_cast<const float*>(blob.begin() + pos + sizeof(HdPoseBlobMesh));
+            view.polyVertCounts = reinterpret_cast<const int32_t*>(view.points + (uint64_t) mesh->vertCount * 3);
+            view.polyVertConnections = view.polyVertCounts + mesh->polyCount;
+            meshes.push_back(view);
+            pos += (size_t) size;
+        }
+        return pos == blob.size;
+    }
+}
+
+#endif
@@ -0,0 +1,84 @@
+/* * -----------------------------------------------------------------------------
+ * This source file has been developed within the scope of the
+ * Technical Director course at Filmakademie Baden-Wuerttemberg.
+ * http://technicaldirector.de
+ *
+ * Written by Tim Lehr
+ * Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+ * -----------------------------------------------------------------------------
+ */
+
+#ifndef HD_POSEMEMO_H
+#define HD_POSEMEMO_H
+
+#include <set>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "spdlog/spdlog.h"
+
+#include <maya/MObject.h>
+#include <maya/MObjectHandle.h>
+#include <maya/MCallbackIdArray.h>
+#include <maya/MNodeMessage.h>
+#include <maya/MObjectArray.h>
+#include <maya/MTime.h>
+
+// Frame -> pose ID memo of a pose node.
+//
+// The memo is only used when every control value is driven by a time based anim
+// curve or is static (see HdPoseSampler). All curves, unit conversions and control
+// attributes in between are watched with DG callbacks. Any edit, as well as undo
+// and redo, clears the memo and the upstream is traced again before the next
+// evaluation.
+class HdPoseMemo
+{
+    private:
+        static std::shared_ptr<spdlog::logger>  log;
+        static std::mutex                       registryMutex_;
+        static std::set<HdPoseMemo*>            registry_;
+        static MCallbackIdArray                 globalCallbacks_;
+
+        std::mutex                              mutex_;
+        MObjectHandle                           poseNode_;
+        MCallbackIdArray                        callbacks_;
+
+        std::unordered_map<double, std::string> poseIds_;
+        std::set<unsigned int>                  watchedNodes_;
+        std::set<std::pair<unsigned int, std::string>> watchedPlugs_;
+        bool                                    traced_ = false;
+        bool                                    eligible_ = false;
+
+        // stats
+        uint64_t                                hits_ = 0;
+        uint64_t                                misses_ = 0;
+        uint64_t                                invalidations_ = 0;
+
+        void                                    removeCallbacks();
+        void                                    watchNode(MObject node);
+        bool                                    isWatched(const MPlug& plug);
+
+        static void                             onAttributeChanged(MNodeMessage::AttributeMessage msg, MPlug& plug, MPlug& otherPlug, void* clientData);
+        static void                             onCurvesEdited(MObjectArray& editedCurves, void* clientData);
+        static void                             onUndoRedo(void* clientData);
+
+    public:
+                                                HdPoseMemo(const MObject& oPoseNode);
+        virtual                                 ~HdPoseMemo();
+
+        // main thread only, rebuilds the watch list after an invalidation
+        void                                    trace();
+        bool                                    needsTrace();
+
+        bool                                    lookup(const MTime& time, std::string& poseId);
+        void                                    store(const MTime& time, const std::string& poseId);
+        void                                    invalidate(const std::string& reason);
+
+        std::string                             getStatsJson();
+
+        static void                             registerCallbacks();
+        static void                             deregisterCallbacks();
+        static std::string                      getAllStatsJson();
+};
+
+#endif
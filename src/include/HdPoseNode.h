@@ -11,9 +11,15 @@
 #ifndef HD_POSE_NODE
 #define HD_POSE_NODE
 
+#include <vector>
 #include <maya/MPxNode.h>
+#include <maya/MTime.h>
+#include <maya/MMatrix.h>
 #include "spdlog/spdlog.h"
 #include "HdPose.h"
+#include "HdPoseMemo.h"
+#include "HdRigFingerprint.h"
+#include "HdControlWatch.h"
 
 class HdPoseNode : public MPxNode 
 {
@@ -29,31 +35,47 @@ class HdPoseNode : public MPxNode
         virtual MStatus             compute(const MPlug& plug, MDataBlock& data);
         
         MStatus                     setCacheIds(MDataBlock& data);
+        static std::string          getSharedCacheId(const std::string& rigTag, unsigned int index);
         bool                        cachesContainPoseId(MDataBlock& data, std::string poseIdHash, MStatus& status);
 
+        bool                        getPoseTag(MDataBlock& data, std::string& poseTag);
         HdPose                      createPose(MDataBlock& data, MStatus& status);
+        static std::string          getPoseTag(const MObject& oPoseNode, MStatus& status);
+        static HdPose               createPoseAtTime(const MObject& oPoseNode, const MTime& time, MStatus& status);
+        static void                 getMatrixValues(const MMatrix& matrix, double* values);
+        static std::vector<std::string> getCacheIds(const MObject& oPoseNode, MStatus& status);
+        static void                 dirtyOutputs(const MObject& oPoseNode);
         MStatus                     setPoseId(MDataBlock& data, HdPose* pose);
+        MStatus                     setPoseId(MDataBlock& data, const std::string& poseId);
         MStatus                     setRigFrozen(MDataBlock& data, bool frozen);
 
         MStatus                     preEvaluation(const MDGContext& context, const MEvaluationNode& evaluationNode);
+        void                        updateRigFingerprint();
 
         void                        logExecutionTime(HdUtils::time_point startTime);
 
         static MTypeId id; // unique node id
     
         static MObject aInCtrlVals;
+        static MObject aInCtrlMatrices;
         static MObject aInRigTag;
+        static MObject aInUseRigFingerprint;
+        static MObject aInShareCaches;
         static MObject aOutPoseId;
         static MObject aOutFreezeRig;
         static MObject aOutCacheIds;
 
         static MObject aInWhitelist;
+        static MObject aInBlacklist;
 
     private:
         std::shared_ptr<spdlog::logger> log;
         bool                            instanceLog = false;
         bool                            currentPoseValid = false;
         bool                            needsEvaluation = false;
+        std::unique_ptr<HdPoseMemo>     poseMemo;
+        std::unique_ptr<HdRigFingerprint> rigFingerprint;
+        std::unique_ptr<HdControlWatch> controlWatch;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,80 @@
+/* * -----------------------------------------------------------------------------
+ * This source file has been developed within the scope of the
+ * Technical Director course at Filmakademie Baden-Wuerttemberg.
+ * http://technicaldirector.de
+ *
+ * Written by Tim Lehr
+ * Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+ * -----------------------------------------------------------------------------
+ */
+
+#ifndef HD_POSESAMPLER_H
+#define HD_POSESAMPLER_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "spdlog/spdlog.h"
+
+#include <maya/MObject.h>
+#include <maya/MPlug.h>
+#include <maya/MStatus.h>
+#include <maya/MFnAnimCurve.h>
+#include <maya/MTime.h>
+
+// Computes the pose IDs of a pose node for many frames without evaluating the rig.
+//
+// Every 'inCtrlVals' element is traced upstream once. Channels driven by a time
+// based anim curve (optionally through unit conversions and pass-through control
+// attributes) are sampled with MFnAnimCurve on worker threads, static channels
+// are read once. Everything else falls back to evaluating the plug per frame.
+// Control matrices ('inCtrlMatrices') are evaluated per frame, one channel per
+// matrix value. The resulting pose IDs are identical to HdPoseNode::createPoseAtTime().
+class HdPoseSampler
+{
+    private:
+        enum ChannelSource
+        {
+            kConstant,
+            kCurve,
+            kPlug,
+            kMatrix
+        };
+
+        struct Channel
+        {
+            ChannelSource                   source = kConstant;
+            double                          value = 0.0;
+            std::vector<double>             factors;        // unit conversions, nearest to the pose node first
+            std::shared_ptr<MFnAnimCurve>   curveFn;
+            MPlug                           plug;
+            unsigned int                    matrixValue = 0;    // kMatrix, index into the matrix values
+            std::vector<MObject>            upstreamNodes;  // curves and unit conversions
+            std::vector<MPlug>              upstreamPlugs;  // pass-through control attributes
+        };
+
+        static std::shared_ptr<spdlog::logger>  log;
+
+        std::string                         rigTag_;
+        std::vector<Channel>                channels_;
+
+        void                                resolveChannel(const MPlug& elementPlug, Channel& channel, bool traceOnly);
+        void                                resolveMatrixChannels(const MPlug& elementPlug, size_t firstChannel);
+        bool                                verifyChannel(Channel& channel);
+        double                              sampleCurve(const Channel& channel, const MTime& time) const;
+
+    public:
+        // traceOnly resolves the channel sources without reading any values from the DG
+                                            HdPoseSampler(const MObject& oPoseNode, MStatus& status, bool traceOnly=false);
+
+        std::vector<std::string>            sample(const std::vector<double>& frames, MStatus& status);
+
+        unsigned int                        channelCount() const;
+        unsigned int                        curveChannelCount() const;
+        unsigned int                        plugChannelCount() const;
+
+        // everything the sampled channels depend on, for invalidation callbacks
+        void                                getUpstream(std::vector<MObject>& nodes, std::vector<MPlug>& plugs) const;
+};
+
+#endif
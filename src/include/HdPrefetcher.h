@@ -0,0 +1,90 @@
+/* * -----------------------------------------------------------------------------
+ * This source file has been developed within the scope of the
+ * Technical Director course at Filmakademie Baden-Wuerttemberg.
+ * http://technicaldirector.de
+ *
+ * Written by Tim Lehr
+ * Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+ * -----------------------------------------------------------------------------
+ */
+
+#ifndef HD_PREFETCHER_H
+#define HD_PREFETCHER_H
+
+#include <map>
+#include <set>
+#include <mutex>
+#include <string>
+#include <memory>
+#include "spdlog/spdlog.h"
+
+#include <maya/MObjectArray.h>
+#include <maya/MTime.h>
+
+#include "HdAsyncReader.h"
+#include "HdMeshCache.h"
+
+// Playback-ahead prefetching of disk-resident poses.
+// Computes the pose IDs of the upcoming frames and materializes poses that only live
+// in a disk tier into memory, before the playhead reaches them.
+class HdPrefetcher
+{
+    private:
+        struct PrefetchEntry
+        {
+            uint64_t                            bytes = 0;
+            unsigned int                        blobCount = 0;
+            uint64_t                            deadlineTick = 0;
+        };
+
+        std::shared_ptr<spdlog::logger>         log;
+        std::unique_ptr<HdAsyncReader>          reader_;
+        std::mutex                              mutex_;
+
+        std::set<std::string>                   inFlight_;       // cache ID + pose ID
+        std::map<std::string, PrefetchEntry>    prefetched_;     // pose ID -> materialized, not consumed yet
+        std::map<std::pair<unsigned int, double>, std::string> plannedPoses_; // (pose node, frame) -> pose ID
+
+        bool                                    enabled_ = false;       // opt-in, the lookahead evaluates poses in preEvaluate
+        unsigned int                            minLookahead_ = 2;
+        unsigned int                            maxLookahead_ = 48;
+        unsigned int                            lookahead_ = 2;
+        double                                  latencyMs_ = 0.0;
+        double                                  lastFrame_ = 0.0;
+        uint64_t                                tick_ = 0;
+
+        // stats
+        uint64_t                                requested_ = 0;
+        uint64_t                                failed_ = 0;
+        uint64_t                                used_ = 0;
+        uint64_t                                wasted_ = 0;
+        uint64_t                                bytesRead_ = 0;
+        uint64_t                                wastedBytes_ = 0;
+
+                                                HdPrefetcher();
+        HdAsyncReader*                          getReader();
+        unsigned int                            computeLookahead();
+        double                                  nextFrame(double frame, unsigned int steps);
+        void                                    expire();
+        void                                    request(std::shared_ptr<HdMeshCache> meshCache, const std::string& poseId, unsigned int distance);
+        void                                    onReadComplete(std::shared_ptr<HdMeshCache> meshCache, const std::string& poseId,
+                                                               const HdCacheFileEntry& entry, bool success, const HdBlob& payload, double latencyMs);
+
+    public:
+        virtual                                 ~HdPrefetcher();
+        static HdPrefetcher&                    instance();
+
+        void                                    update(const MObjectArray& poseNodes, double currentFrame);
+        void                                    prefetch(std::shared_ptr<HdMeshCache> meshCache, const std::string& poseId);
+        void                                    observe(const std::string& poseId);
+        void                                    reset();
+        void                                    shutdown();
+
+        bool                                    enabled()                   {return enabled_;};
+        void                                    setEnabled(bool enabled);
+        void                                    setMaxLookahead(unsigned int frames);
+
+        std::string                             getStatsJson();
+};
+
+#endif
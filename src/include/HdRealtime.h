@@ -0,0 +1,105 @@
+/* * -----------------------------------------------------------------------------
+ * This source file has been developed within the scope of the
+ * Technical Director course at Filmakademie Baden-Wuerttemberg.
+ * http://technicaldirector.de
+ *
+ * Written by Tim Lehr
+ * Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+ * -----------------------------------------------------------------------------
+ */
+
+#ifndef HD_REALTIME_H
+#define HD_REALTIME_H
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "spdlog/spdlog.h"
+
+#include <maya/MObject.h>
+#include <maya/MObjectHandle.h>
+#include <maya/MCallbackIdArray.h>
+#include <maya/MTime.h>
+
+#include "HdUtils.h"
+
+// Real-time playback for rigs that cannot be evaluated at the target frame rate.
+// A frame budget scheduler grants as many rig evaluations per frame as fit into
+// the frame time, which is measured between the time changes of the playback.
+// A rig missing its pose beyond that shows the cached pose nearest in time and
+// the frame is back-filled by HdAutoFill once Maya is idle. The substituted
+// frames of the last playback are kept as a per-frame record.
+class HdRealtime
+{
+    private:
+        struct Rig
+        {
+            MObjectHandle                       poseNode;
+            std::map<double, std::string>       cachedFrames;   // frame -> pose ID in the caches
+        };
+
+        struct FrameRecord
+        {
+            unsigned int                        evaluated = 0;
+            std::vector<std::pair<unsigned int, double>> substituted; // rig, frame of the shown pose
+        };
+
+        std::shared_ptr<spdlog::logger>         log;
+        std::mutex                              mutex_;
+        MCallbackIdArray                        callbacks_;
+
+        bool                                    enabled_ = false;
+        double                                  targetFps_ = 0.0;       // 0 is the scene frame rate
+
+        // frame budget, evaluations are granted per time change
+        HdUtils::time_point                     frameStart_;
+        bool                                    measuring_ = false;
+        unsigned int                            frameEvaluations_ = 0;
+        unsigned int                            allowance_ = 0;
+        unsigned int                            framesSinceEvaluation_ = 0;
+        double                                  budgetMs_ = 0.0;
+        double                                  baseMs_ = 0.0;          // frame time without evaluations
+        double                                  evaluationMs_ = 0.0;    // per rig evaluation
+
+        std::map<unsigned int, Rig>             rigs_;                  // pose node hash -> rig
+        std::map<double, FrameRecord>           frames_;
+        std::vector<double>                     backFill_;
+
+        // stats
+        uint64_t                                evaluations_ = 0;
+        uint64_t                                forcedEvaluations_ = 0;
+        uint64_t                                substitutions_ = 0;
+        uint64_t                                framesOverBudget_ = 0;
+
+                                                HdRealtime();
+        void                                    registerCallbacks();
+        void                                    deregisterCallbacks();
+        void                                    startFrame();
+        void                                    flushBackFill();
+        Rig&                                    getRig(const MObject& oPoseNode);
+
+        static void                             onTimeChange(MTime& time, void* clientData);
+        static void                             onPlayingBack(bool playing, void* clientData);
+
+    public:
+        virtual                                 ~HdRealtime();
+        static HdRealtime&                      instance();
+
+        bool                                    enabled()                   {return enabled_;};
+        void                                    setEnabled(bool enabled);
+        void                                    setTargetFps(double fps);
+        void                                    shutdown();
+
+        // thread safe, called by the pose nodes during playback
+        void                                    recordCached(const MObject& oPoseNode, double frame, const std::string& poseId);
+        bool                                    requestEvaluation(const MObject& oPoseNode, double frame, const std::string& poseId);
+        void                                    forceEvaluation(const MObject& oPoseNode, double frame, const std::string& poseId);
+        void                                    getNearestPoses(const MObject& oPoseNode, double frame, std::vector<std::pair<double, std::string>>& poses);
+        void                                    recordSubstitution(const MObject& oPoseNode, double frame, double sourceFrame);
+
+        std::string                             getStatsJson();
+        std::string                             getFramesJson();
+};
+
+#endif
@@ -0,0 +1,73 @@
+/* * -----------------------------------------------------------------------------
+ * This source file has been developed within the scope of the
+ * Technical Director course at Filmakademie Baden-Wuerttemberg.
+ * http://technicaldirector.de
+ *
+ * Written by Tim Lehr
+ * Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+ * -----------------------------------------------------------------------------
+ */
+
+#ifndef HD_REPLAY_H
+#define HD_REPLAY_H
+
+#include <string>
+#include <vector>
+#include "spdlog/spdlog.h"
+
+#include <maya/MCallbackIdArray.h>
+#include <maya/MTime.h>
+
+// Render-time cache replay for batch and farm evaluation.
+// The sidecar caches of the scene are served read-only and the cache nodes bypass
+// the rig for every cached pose, also outside of playback. On each time change the
+// poses of the frame and its motion blur subframes are keyed and prefetched.
+// With write-back, missed poses are stored in a shard per render process, which
+// can be merged into the sidecar with "hdcachetool merge".
+//
+// Environment:
+//   HD_REPLAY            "1" read-only replay, "writeback" replay with write-back
+//   HD_REPLAY_SUBFRAMES  subframe offsets to key, e.g. "-0.25,0.25"
+class HdReplay
+{
+    private:
+        std::shared_ptr<spdlog::logger>         log;
+        MCallbackIdArray                        callbacks_;
+
+        bool                                    enabled_ = false;
+        bool                                    writeBack_ = false;
+        std::vector<double>                     subframes_;
+
+        // stats
+        uint64_t                                frames_ = 0;
+        uint64_t                                keysCached_ = 0;
+        uint64_t                                keysMissing_ = 0;
+
+                                                HdReplay();
+        void                                    registerCallbacks();
+        void                                    deregisterCallbacks();
+        void                                    reloadCaches();
+        void                                    prepareFrame(const MTime& time);
+
+        static void                             onTimeChange(MTime& time, void* clientData);
+        static void                             onExit(void* clientData);
+
+    public:
+        virtual                                 ~HdReplay();
+        static HdReplay&                        instance();
+
+        void                                    initFromEnvironment();
+        void                                    shutdown();
+
+        bool                                    enabled()                   {return enabled_;};
+        bool                                    writeBack()                 {return writeBack_;};
+        void                                    setEnabled(bool enabled);
+        void                                    setWriteBack(bool writeBack);
+        MStatus                                 setSubframes(const std::string& offsets);
+
+        static std::string                      shardPath(const std::string& sidecarPath);
+
+        std::string                             getStatsJson();
+};
+
+#endif
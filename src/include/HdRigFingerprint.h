@@ -0,0 +1,101 @@
+/* * -----------------------------------------------------------------------------
+ * This source file has been developed within the scope of the
+ * Technical Director course at Filmakademie Baden-Wuerttemberg.
+ * http://technicaldirector.de
+ *
+ * Written by Tim Lehr
+ * Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+ * -----------------------------------------------------------------------------
+ */
+
+#ifndef HD_RIGFINGERPRINT_H
+#define HD_RIGFINGERPRINT_H
+
+#include <set>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "spdlog/spdlog.h"
+
+#include <maya/MObject.h>
+#include <maya/MObjectHandle.h>
+#include <maya/MCallbackIdArray.h>
+#include <maya/MNodeMessage.h>
+
+// Fingerprint of the rig upstream of the cache nodes of a pose node.
+//
+// Covers node types, connections, non-animated attribute values (deformer weights
+// included), DAG parents and the topology and rest points of input meshes. Time
+// based anim curves and the control values read by the pose node are left out,
+// they are part of the pose. The fingerprint is mixed into the pose key, so a
+// changed rig never reuses poses cached for an older version.
+//
+// Every rig node is watched with a DG callback. A value edit only recomputes the
+// digest of the edited node, a connection edit traces the rig again. Either one
+// dirties the pose node outputs, so the rig is evaluated until the edit is hashed.
+// The digests are hashed on all hardware threads, the DG is only read on the main thread.
+class HdRigFingerprint
+{
+    private:
+        struct RigNode
+        {
+            MObjectHandle                       node;
+            std::string                         structure;      // type and incoming connections
+            uint64_t                            digest = 0;
+            bool                                dirty = true;
+        };
+
+        static std::shared_ptr<spdlog::logger>  log;
+        static std::mutex                       registryMutex_;
+        static std::set<HdRigFingerprint*>      registry_;
+        static MCallbackIdArray                 globalCallbacks_;
+
+        std::mutex                              mutex_;
+        MObjectHandle                           poseNode_;
+        MCallbackIdArray                        callbacks_;
+
+        std::vector<RigNode>                    nodes_;
+        std::unordered_map<unsigned int, size_t> nodeIndices_;     // object hash -> index in nodes_
+        std::set<std::pair<unsigned int, std::string>> excludedPlugs_;
+        std::string                             rootStructure_;
+        std::string                             fingerprint_;
+        bool                                    traced_ = false;
+        bool                                    dirty_ = true;
+
+        // stats
+        uint64_t                                traces_ = 0;
+        uint64_t                                updates_ = 0;
+        uint64_t                                nodesHashed_ = 0;
+        double                                  lastUpdateMs_ = 0.0;
+
+        void                                    removeCallbacks();
+        void                                    watchNode(MObject node);
+        void                                    trace();
+        bool                                    isExcluded(unsigned int nodeHash, const std::string& plugName);
+        void                                    gatherValues(const RigNode& rigNode, std::string& buffer);
+        void                                    requestUpdate(bool wasDirty);
+
+        static void                             onAttributeChanged(MNodeMessage::AttributeMessage msg, MPlug& plug, MPlug& otherPlug, void* clientData);
+        static void                             onUndoRedo(void* clientData);
+
+    public:
+                                                HdRigFingerprint(const MObject& oPoseNode);
+        virtual                                 ~HdRigFingerprint();
+
+        // main thread only, returns true if the fingerprint changed
+        bool                                    update();
+
+        // false while an edit has not been hashed yet
+        bool                                    get(std::string& fingerprint);
+        // returns true if the fingerprint was stale already
+        bool                                    invalidate(bool retrace);
+
+        std::string                             getStatsJson();
+
+        static void                             registerCallbacks();
+        static void                             deregisterCallbacks();
+        static std::string                      getAllStatsJson();
+};
+
+#endif
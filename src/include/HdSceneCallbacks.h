@@ -0,0 +1,46 @@
+/* * -----------------------------------------------------------------------------
+ * This source file has been developed within the scope of the
+ * Technical Director course at Filmakademie Baden-Wuerttemberg.
+ * http://technicaldirector.de
+ *
+ * Written by Tim Lehr
+ * Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+ * -----------------------------------------------------------------------------
+ */
+
+#ifndef HD_SCENECALLBACKS_H
+#define HD_SCENECALLBACKS_H
+
+#include <string>
+#include "spdlog/spdlog.h"
+
+#include <maya/MCallbackIdArray.h>
+#include <maya/MStatus.h>
+
+// Couples the pose caches to the scene file.
+// On save every cache is written to a sidecar cache file next to the scene
+// ("<scene>.hdcache/<cacheId>.hdc") and only the relative path is stored on the
+// cache node. On open the sidecar files are attached as disk tiers and streamed
+// into memory on a background thread.
+class HdSceneCallbacks
+{
+    private:
+        static MCallbackIdArray                 callbackIds;
+        static std::shared_ptr<spdlog::logger>  log;
+
+        static void                             beforeSave(void* clientData);
+        static void                             afterOpen(void* clientData);
+        static void                             beforeSceneChange(void* clientData);
+
+        static std::string                      sceneDirectory(const std::string& scenePath);
+        static std::string                      sidecarDirectoryName(const std::string& scenePath);
+
+    public:
+        static MStatus                          registerCallbacks();
+        static MStatus                          deregisterCallbacks();
+
+        static MStatus                          saveCaches(const std::string& scenePath);
+        static MStatus                          loadCaches(const std::string& scenePath);
+};
+
+#endif
@@ -0,0 +1,94 @@
+/* * -----------------------------------------------------------------------------
+ * This source file has been developed within the scope of the
+ * Technical Director course at Filmakademie Baden-Wuerttemberg.
+ * http://technicaldirector.de
+ *
+ * Written by Tim Lehr
+ * Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+ * -----------------------------------------------------------------------------
+ */
+
+#ifndef HD_SCENEREGISTRY_H
+#define HD_SCENEREGISTRY_H
+
+#include <map>
+#include <set>
+#include <mutex>
+#include <vector>
+#include "spdlog/spdlog.h"
+
+#include <maya/MObject.h>
+#include <maya/MObjectArray.h>
+#include <maya/MObjectHandle.h>
+#include <maya/MCallbackIdArray.h>
+#include <maya/MNodeMessage.h>
+#include <maya/MDagPath.h>
+
+// Persistent registry of the Hyperdrive nodes in the scene and the nodes they link
+// to: the output meshes of cache nodes and the white- and blacklisted nodes of pose
+// nodes. Node added / removed callbacks and a connection callback per Hyperdrive
+// node keep it current, so a graph rebuild only refreshes the links of edited nodes
+// instead of scanning the scene.
+//
+// Scene-wide connection and DAG parent callbacks collect the nodes edited since the
+// last graph build, so the evaluator only retraces the rig cones touching them.
+class HdSceneRegistry
+{
+    private:
+        struct Entry
+        {
+            MObjectHandle                       node;
+            MCallbackId                         callback = 0;
+            std::vector<unsigned int>           links;      // output meshes or whitelisted nodes
+            std::vector<unsigned int>           blacklist;  // pose nodes only
+            bool                                dirty = true;
+        };
+
+        std::shared_ptr<spdlog::logger>         log;
+        std::mutex                              mutex_;
+        MCallbackIdArray                        callbacks_;
+        std::map<unsigned int, Entry>           poseNodes_;     // object hash -> entry
+        std::map<unsigned int, Entry>           cacheNodes_;
+        std::set<unsigned int>                  changedNodes_;  // edited since the last takeChanges()
+        bool                                    allChanged_ = true;
+
+        // stats
+        uint64_t                                refreshes_ = 0;
+        uint64_t                                changes_ = 0;
+
+                                                HdSceneRegistry();
+        void                                    add(MObject node);
+        void                                    remove(const MObject& node);
+        void                                    removeEntry(Entry& entry);
+        void                                    refresh(Entry& entry, const MObject& linkAttr, bool asDst, std::vector<unsigned int>& links);
+        void                                    refreshAll();
+        void                                    markChanged(const MObject& node, const MObject& otherNode);
+
+        static void                             onNodeAdded(MObject& node, void* clientData);
+        static void                             onNodeRemoved(MObject& node, void* clientData);
+        static void                             onAttributeChanged(MNodeMessage::AttributeMessage msg, MPlug& plug, MPlug& otherPlug, void* clientData);
+        static void                             onConnection(MPlug& srcPlug, MPlug& dstPlug, bool made, void* clientData);
+        static void                             onParentChanged(MDagPath& child, MDagPath& parent, void* clientData);
+
+    public:
+        virtual                                 ~HdSceneRegistry();
+        static HdSceneRegistry&                 instance();
+
+        // scans the scene once, afterwards it is kept up to date by callbacks
+        MStatus                                 registerCallbacks();
+        void                                    deregisterCallbacks();
+
+        // main thread only
+        void                                    getPoseNodes(MObjectArray& poseNodes);
+        void                                    getOutputMeshes(std::set<unsigned int>& outputMeshes);
+        void                                    getWhitelistNodes(std::set<unsigned int>& whitelistNodes);
+        void                                    getBlacklistNodes(const MObject& poseNode, std::vector<unsigned int>& blacklistNodes);
+
+        // nodes whose connections or DAG parents changed since the last call, allChanged
+        // if the set overflowed or the registry was just started
+        void                                    takeChanges(std::set<unsigned int>& changedNodes, bool& allChanged);
+
+        std::string                             getStatsJson();
+};
+
+#endif
@@ -0,0 +1,105 @@
+/* * -----------------------------------------------------------------------------
+ * This source file has been developed within the scope of the
+ * Technical Director course at Filmakademie Baden-Wuerttemberg.
+ * http://technicaldirector.de
+ *
+ * Written by Tim Lehr
+ * Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+ * -----------------------------------------------------------------------------
+ */
+
+#ifndef HD_SHMTIER_H
+#define HD_SHMTIER_H
+
+#include <string>
+#include <memory>
+#include <cstdint>
+#include "spdlog/spdlog.h"
+
+#include "HdCacheTier.h"
+
+// Segment layout (POSIX shared memory, one segment per rig tag + mesh topology):
+//
+//   HdShmHeader | HdShmSlot[slotCount] | data (bump allocated, never reused)
+//
+// The index is an open addressing hash table with linear probing. A slot goes
+// EMPTY -> WRITING(pid) -> READY and never back, so readers only ever look at
+// immutable records. Record data is published by the release store of the READY
+// state. A writer that dies leaves a WRITING slot behind, which readers skip and
+// the next writer probing past it takes over once the owning process is gone.
+
+static const uint32_t HD_SHM_MAGIC = 0x4d534448; // 'HDSM'
+static const uint32_t HD_SHM_VERSION = 1;
+
+enum HdShmSlotState
+{
+    kSlotEmpty = 0,
+    kSlotWriting = 1,
+    kSlotReady = 2,
+};
+
+struct HdShmHeader
+{
+    uint32_t                            magic;
+    uint32_t                            version;
+    uint64_t                            state;          // kSlotWriting(pid) while the creator initializes
+    uint64_t                            segmentSize;
+    uint64_t                            slotCount;      // power of two
+    uint64_t                            dataOffset;
+    uint64_t                            dataEnd;        // bump allocator, atomic
+    uint64_t                            recordCount;    // atomic
+    uint64_t                            reserved;
+};
+
+struct HdShmSlot
+{
+    uint64_t                            state;          // HdShmSlotState | pid << 32, atomic
+    uint64_t                            keyHash;
+    uint64_t                            recordOffset;   // uint32 key size | key | payload
+    uint64_t                            payloadSize;
+    uint64_t                            checksum;
+    uint64_t                            reserved[3];
+};
+
+class HdShmTier : public HdCacheTier
+{
+    private:
+        std::string                     name_;
+        std::shared_ptr<char>           mapping_;       // unmapped once the last blob pointing into it is gone
+        size_t                          mappingSize_ = 0;
+        std::shared_ptr<spdlog::logger> log;
+
+        HdShmHeader*                    header()        {return reinterpret_cast<HdShmHeader*>(mapping_.get());};
+        HdShmSlot*                      slots()         {return reinterpret_cast<HdShmSlot*>(mapping_.get() + sizeof(HdShmHeader));};
+
+        bool                            initSegment(size_t segmentSize);
+        bool                            waitForSegment();
+        bool                            findSlot(const std::string& poseId, uint64_t keyHash, HdShmSlot** slot);
+        bool                            claimSlot(HdShmSlot* slot, uint64_t expected);
+
+        static bool                     writerAlive(uint64_t state);
+
+    public:
+                                        HdShmTier();
+        virtual                         ~HdShmTier();
+
+        bool                            open(const std::string& segmentKey, size_t segmentSize);
+        void                            close();
+        bool                            isOpen()        {return mapping_ != nullptr;};
+
+        // HdCacheTier
+        std::string                     tierName()      {return "shared memory";};
+        bool                            exists(const std::string& poseId);
+        bool                            read(const std::string& poseId, HdBlob& blob);
+        bool                            write(const std::string& poseId, const HdBlob& blob);
+        size_t                          size();
+
+        std::string                     name()          {return name_;};
+        uint64_t                        bytesUsed();
+        uint64_t                        bytesTotal()    {return mappingSize_;};
+
+        static std::string              segmentName(const std::string& segmentKey);
+        static bool                     unlink(const std::string& segmentKey);
+};
+
+#endif
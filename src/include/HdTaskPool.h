@@ -0,0 +1,79 @@
+/* * -----------------------------------------------------------------------------
+ * This source file has been developed within the scope of the
+ * Technical Director course at Filmakademie Baden-Wuerttemberg.
+ * http://technicaldirector.de
+ *
+ * Written by Tim Lehr
+ * Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+ * -----------------------------------------------------------------------------
+ */
+
+#ifndef HD_TASKPOOL_H
+#define HD_TASKPOOL_H
+
+#include <mutex>
+#include <thread>
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include <functional>
+#include "spdlog/spdlog.h"
+
+#include <maya/MThreadPool.h>
+
+// Tasks with dependencies, e.g. the nodes of an evaluation schedule.
+struct HdTaskGraph
+{
+    std::vector<uint32_t>                       dependencyCounts;   // per task, unfinished dependencies
+    std::vector<std::vector<uint32_t>>          successors;         // per task
+    std::vector<uint32_t>                       roots;              // tasks without dependencies
+    std::vector<std::vector<uint32_t>>          levels;             // tasks whose dependencies are in earlier levels
+
+    size_t                                      size() const {return dependencyCounts.size();};
+    void                                        buildLevels();
+};
+
+// Runs one task graph at a time on Maya's thread pool.
+// Every level of the graph is a parallel region of MThreadPool tasks, so no thread
+// outside of Maya's control evaluates nodes. Serial tasks run on the calling thread
+// once the parallel tasks of their level are done.
+class HdTaskPool
+{
+    private:
+        struct Chunk
+        {
+            HdTaskPool*                         pool;
+            size_t                              begin;
+            size_t                              end;
+        };
+
+        std::shared_ptr<spdlog::logger>         log;
+        std::mutex                              runMutex_;      // one graph at a time
+        bool                                    initialized_ = false;
+
+        // current level, only replaced between parallel regions
+        const std::function<void(size_t)>*      fn_ = nullptr;
+        std::vector<uint32_t>                   parallelTasks_;
+        std::vector<Chunk>                      chunks_;
+
+        // stats
+        uint64_t                                graphs_ = 0;
+        uint64_t                                regions_ = 0;
+        uint64_t                                serialTasks_ = 0;
+
+                                                HdTaskPool();
+        static void                             runRegion(void* data, MThreadRootTask* root);
+        static MThreadRetVal                    runChunk(void* data);
+
+    public:
+        virtual                                 ~HdTaskPool();
+        static HdTaskPool&                      instance();
+
+        void                                    run(const HdTaskGraph& graph, const std::vector<bool>& serial, const std::function<void(size_t)>& fn);
+        void                                    shutdown();
+
+        size_t                                  threadCount() {return std::max(1u, std::thread::hardware_concurrency());};
+        std::string                             getStatsJson();
+};
+
+#endif
@@ -16,12 +16,12 @@
 #include <string>
 #include <time.h>
 #include <chrono>
+#include <functional>
 #include <maya/MObject.h>
 #include <maya/MPoint.h>
 #include <maya/MVector.h>
 
-#include "spdlog/spdlog.h"
-#include "spdlog/sinks/stdout_color_sinks.h"
+#include "HdLogger.h"
 
 namespace HdUtils 
 {
@@ -38,7 +38,6 @@ namespace HdUtils
     }
     
     std::string                         getNodeName(const MObject& obj);
-    std::shared_ptr<spdlog::logger>     getLoggerInstance(std::string loggerName);
     void                                setLogLevel(int level);
     
     std::string                         getTimeDiffString(HdUtils::time_point start, HdUtils::time_point end);
@@ -46,7 +45,18 @@ namespace HdUtils
     double                              timePointToDouble(time_point timePoint);
 
     bool                                playbackActive();
+    bool                                bakeActive();
+    bool                                autoFillActive();
+    void                                setAutoFillActive(bool active);
+    bool                                replayActive();
+    void                                setReplayActive(bool active);
+    bool                                interactiveActive();
+    void                                setInteractiveActive(bool active);
+    bool                                cachingActive();
     double                              getCurrentFrame();
+
+    // runs fn(index) for all indices on the hardware threads, no Maya API calls inside fn
+    void                                parallelFor(size_t count, const std::function<void(size_t)>& fn);
 }
 
 template <typename T>
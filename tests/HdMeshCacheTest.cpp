@@ -0,0 +1,158 @@
+//
+// -----------------------------------------------------------------------------
+// This source file has been developed within the scope of the
+// Technical Director course at Filmakademie Baden-Wuerttemberg.
+// http://technicaldirector.de
+//
+// Written by Tim Lehr
+// Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+// -----------------------------------------------------------------------------
+//
+
+#include <iostream>
+#include <string>
+#include <unistd.h>
+
+#include <maya/MLibrary.h>
+
+#include "HdMeshCache.h"
+
+const int POSE_COUNT = 40;
+const int MEMORY_POSES = 10;
+const int GRID_QUADS = 32;
+
+// a quad grid, every pose moves the points a little so the blobs differ
+std::shared_ptr<HdMeshSet> makePose(int pose)
+{
+    int rowVerts = GRID_QUADS + 1;
+    HdMeshData meshData(rowVerts * rowVerts, GRID_QUADS * GRID_QUADS);
+
+    meshData.points = std::make_shared<MFloatPointArray>(rowVerts * rowVerts);
+    for (int i=0; i<rowVerts * rowVerts; i++)
+    {
+        meshData.points->set(i, (float) (i % rowVerts), (float) pose, (float) (i / rowVerts));
+    }
+
+    meshData.polyVertCounts = std::make_shared<MIntArray>(GRID_QUADS * GRID_QUADS, 4);
+    meshData.polyVertConnections = std::make_shared<MIntArray>();
+    for (int row=0; row<GRID_QUADS; row++)
+    {
+        for (int col=0; col<GRID_QUADS; col++)
+        {
+            int corner = row * rowVerts + col;
+            meshData.polyVertConnections->append(corner);
+            meshData.polyVertConnections->append(corner + 1);
+            meshData.polyVertConnections->append(corner + rowVerts + 1);
+            meshData.polyVertConnections->append(corner + rowVerts);
+        }
+    }
+
+    std::shared_ptr<HdMeshSet> meshSet = std::make_shared<HdMeshSet>();
+    meshSet->push_back(meshData);
+    return meshSet;
+}
+
+std::string poseId(int pose)
+{
+    return "pose" + std::to_string(pose);
+}
+
+bool writeCacheFile(const std::string& path, double& poseMemSize)
+{
+    HdCacheFile cacheFile;
+    if (!cacheFile.open(path, true)) return false;
+
+    for (int i=0; i<POSE_COUNT; i++)
+    {
+        std::shared_ptr<HdMeshSet> meshSet = makePose(i);
+        poseMemSize = meshSet->memSize();
+        if (!cacheFile.write(poseId(i), meshSet->toBlob())) return false;
+    }
+    return cacheFile.flush();
+}
+
+bool checkPruned(const std::string& name, HdMeshCache& meshCache)
+{
+    if (meshCache.maxSize() == 0 || meshCache.size() > meshCache.maxSize() || meshCache.size() >= (size_t) POSE_COUNT)
+    {
+        std::cerr << name << ": memory cache not pruned. Size: " << meshCache.size() << ", max size: " << meshCache.maxSize() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// replay: every frame is a hit in the disk tier, put() is never called
+bool testTierReadsArePruned(const std::string& path, double poseMemSize)
+{
+    HdMeshCache meshCache("testTierReads", 0);
+    meshCache.setMaxMemSize(poseMemSize * (MEMORY_POSES + 0.5));
+    if (meshCache.attachDiskTier(path, false) != MS::kSuccess) return false;
+
+    for (int i=0; i<POSE_COUNT; i++)
+    {
+        MStatus status;
+        std::shared_ptr<HdMeshSet> meshSet = meshCache.get(poseId(i), status, false);
+        if (status != MS::kSuccess || meshSet == nullptr)
+        {
+            std::cerr << "testTierReadsArePruned: could not read " << poseId(i) << std::endl;
+            return false;
+        }
+        if (!checkPruned("testTierReadsArePruned", meshCache)) return false;
+    }
+    return meshCache.size() == (size_t) MEMORY_POSES && meshCache.existsInMemory(poseId(POSE_COUNT - 1));
+}
+
+// prefetch only: reads complete in the background and are materialized
+bool testMaterializedPosesArePruned(const std::string& path, double poseMemSize)
+{
+    HdMeshCache meshCache("testMaterialize", 0);
+    meshCache.setMaxMemSize(poseMemSize * (MEMORY_POSES + 0.5));
+
+    HdCacheFile cacheFile;
+    if (!cacheFile.open(path, false)) return false;
+
+    for (int i=0; i<POSE_COUNT; i++)
+    {
+        HdBlob blob;
+        MStatus status;
+        if (!cacheFile.read(poseId(i), blob)) return false;
+        meshCache.materialize(poseId(i), HdMeshSet::fromBlob(blob, status));
+        if (!checkPruned("testMaterializedPosesArePruned", meshCache)) return false;
+    }
+    return meshCache.size() == (size_t) MEMORY_POSES;
+}
+
+int main(int, char** argv)
+{
+    MStatus status = MLibrary::initialize(argv[0], true);
+    if (status != MS::kSuccess)
+    {
+        std::cerr << "Could not initialize Maya: " << status.errorString().asChar() << std::endl;
+        return 1;
+    }
+
+    char path[] = "/tmp/hdMeshCacheTestXXXXXX";
+    int fd = ::mkstemp(path);
+    if (fd < 0) return 1;
+    ::close(fd);
+    ::unlink(path);
+
+    int failed = 0;
+    double poseMemSize = 0.0;
+    if (!writeCacheFile(path, poseMemSize))
+    {
+        std::cerr << "Could not write cache file: " << path << std::endl;
+        failed++;
+    }
+    else
+    {
+        if (!testTierReadsArePruned(path, poseMemSize)) failed++;
+        if (!testMaterializedPosesArePruned(path, poseMemSize)) failed++;
+    }
+
+    ::unlink(path);
+    MLibrary::cleanup(0, false);
+
+    std::cout << (failed == 0 ? "All tests passed." : "Tests failed.") << std::endl;
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,456 @@
+//
+// -----------------------------------------------------------------------------
+// This source file has been developed within the scope of the
+// Technical Director course at Filmakademie Baden-Wuerttemberg.
+// http://technicaldirector.de
+//
+// Written by Tim Lehr
+// Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+// -----------------------------------------------------------------------------
+//
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_set>
+#include <unistd.h>
+
+#include "HdCacheFile.h"
+#include "HdPoseBlob.h"
+#include "HdGeoStream.h"
+#include "HdLogger.h"
+
+// Standalone maintenance tool for Hyperdrive cache files (.hdc).
+// Every command visits one pose at a time in file order, so memory use is
+// bounded by the pose index and the largest pose, not by the file size.
+
+namespace
+{
+    struct MeshStats
+    {
+        uint64_t                            poses = 0;
+        uint64_t                            pointBytes = 0;
+        uint64_t                            topologyBytes = 0;
+        std::unordered_set<uint64_t>        uniquePoints;
+        std::unordered_set<uint64_t>        uniqueTopology;
+        uint64_t                            uniquePointBytes = 0;
+        uint64_t                            uniqueTopologyBytes = 0;
+    };
+
+    void printUsage()
+    {
+        std::printf(
+            "usage: hdcachetool [--verbose] <command> [args]\n"
+            "\n"
+            "commands:\n"
+            "  list <cache.hdc> [--meshes]             list poses (and meshes per pose)\n"
+            "  verify <cache.hdc>                      verify checksums and pose layout\n"
+            "  stats <cache.hdc>                       per mesh byte usage and deduplication ratios\n"
+            "  compact <cache.hdc> [-o out.hdc]        drop dead records (in place by default)\n"
+            "  merge <out.hdc> <in.hdc> [in.hdc ...]   merge caches, the first occurrence of a pose wins\n"
+            "  encode <in.hdc> <out.hdc> --codec C     re-encode poses (codecs: raw, shufflerle)\n"
+            "  geo <geo.hdgeo> [--frame F]             summary of a geometry stream (hdExport), or the pose of a frame\n");
+    }
+
+    bool parseCodec(const std::string& name, uint32_t& codec)
+    {
+        if (name == "raw") codec = kCodecRaw;
+        else if (name == "shufflerle") codec = kCodecShuffleRle;
+        else return false;
+        return true;
+    }
+
+    std::string formatBytes(uint64_t bytes)
+    {
+        char buffer[32];
+        if (bytes >= 1024ull * 1024 * 1024) std::snprintf(buffer, sizeof(buffer), "%.2f GB", bytes / (1024.0 * 1024.0 * 1024.0));
+        else if (bytes >= 1024 * 1024) std::snprintf(buffer, sizeof(buffer), "%.2f MB", bytes / (1024.0 * 1024.0));
+        else if (bytes >= 1024) std::snprintf(buffer, sizeof(buffer), "%.2f KB", bytes / 1024.0);
+        else std::snprintf(buffer, sizeof(buffer), "%llu B", (unsigned long long) bytes);
+        return buffer;
+    }
+
+    double ratio(uint64_t total, uint64_t unique)
+    {
+        return unique > 0 ? (double) total / (double) unique : 1.0;
+    }
+
+    std::shared_ptr<HdCacheFile> openCache(const std::string& path, bool writable)
+    {
+        std::shared_ptr<HdCacheFile> cacheFile = std::make_shared<HdCacheFile>();
+        if (!cacheFile->open(path, writable))
+        {
+            std::fprintf(stderr, "Could not open cache file '%s'.\n", path.c_str());
+            return nullptr;
+        }
+        return cacheFile;
+    }
+
+    int cmdList(const std::vector<std::string>& args)
+    {
+        if (args.empty()) return 2;
+        bool meshes = args.size() > 1 && args[1] == "--meshes";
+        std::shared_ptr<HdCacheFile> cacheFile = openCache(args[0], false);
+        if (!cacheFile) return 1;
+
+        std::printf("%-48s %12s %12s %-10s\n", "pose", "payload", "raw", "codec");
+        cacheFile->forEachEntry([&](const std::string& poseId, const HdCacheFileEntry& entry) {
+            std::printf("%-48s %12llu %12llu %-10s\n", poseId.c_str(), (unsigned long long) entry.payloadSize,
+                (unsigned long long) entry.rawSize, HdCacheFile::codecName(entry.codec).c_str());
+            if (!meshes) return;
+
+            HdBlob blob;
+            std::vector<HdPoseBlobMeshView> views;
+            if (!cacheFile->readEntry(entry, blob, false) || !HdPoseBlob::parse(blob, views))
+            {
+                std::printf("    <unreadable>\n");
+                return;
+            }
+            for (size_t i=0; i<views.size(); i++)
+            {
+                std::printf("    mesh %zu: %u verts, %u polys, %u connections\n", i, views[i].mesh->vertCount,
+                    views[i].mesh->polyCount, views[i].mesh->connectionCount);
+            }
+        });
+        std::printf("%zu poses\n", cacheFile->size());
+        return 0;
+    }
+
+    int cmdVerify(const std::vector<std::string>& args)
+    {
+        if (args.empty()) return 2;
+        std::shared_ptr<HdCacheFile> cacheFile = openCache(args[0], false);
+        if (!cacheFile) return 1;
+
+        uint64_t checked = 0;
+        uint64_t failed = 0;
+        cacheFile->forEachEntry([&](const std::string& poseId, const HdCacheFileEntry& entry) {
+            HdBlob blob;
+            std::vector<HdPoseBlobMeshView> views;
+            checked++;
+            if (!cacheFile->readEntry(entry, blob, true))
+            {
+                std::printf("CORRUPT   %s (checksum or codec)\n", poseId.c_str());
+                failed++;
+            } else if (!HdPoseBlob::parse(blob, views))
+            {
+                std::printf("MALFORMED %s (pose layout)\n", poseId.c_str());
+                failed++;
+            }
+        });
+
+        std::printf("%llu poses checked, %llu failed\n", (unsigned long long) checked, (unsigned long long) failed);
+        return failed > 0 ? 1 : 0;
+    }
+
+    int cmdStats(const std::vector<std::string>& args)
+    {
+        if (args.empty()) return 2;
+        std::shared_ptr<HdCacheFile> cacheFile = openCache(args[0], false);
+        if (!cacheFile) return 1;
+
+        // only hashes are kept per pose, so this scales with the pose count
+        std::vector<MeshStats> meshStats;
+        uint64_t payloadBytes = 0;
+        uint64_t rawBytes = 0;
+        uint64_t unreadable = 0;
+
+        cacheFile->forEachEntry([&](const std::string&, const HdCacheFileEntry& entry) {
+            payloadBytes += entry.payloadSize;
+            rawBytes += entry.rawSize;
+
+            HdBlob blob;
+            std::vector<HdPoseBlobMeshView> views;
+            if (!cacheFile->readEntry(entry, blob, false) || !HdPoseBlob::parse(blob, views))
+            {
+                unreadable++;
+                return;
+            }
+
+            if (meshStats.size() < views.size()) meshStats.resize(views.size());
+            for (size_t i=0; i<views.size(); i++)
+            {
+                MeshStats& stats = meshStats[i];
+                const HdPoseBlobMeshView& view = views[i];
+                stats.poses++;
+                stats.pointBytes += view.pointsSize();
+                stats.topologyBytes += view.topologySize();
+
+                uint64_t pointsHash = hdChecksum64(reinterpret_cast<const char*>(view.points), view.pointsSize());
+                if (stats.uniquePoints.insert(pointsHash).second) stats.uniquePointBytes += view.pointsSize();
+
+                uint64_t topologyHash = hdChecksum64(reinterpret_cast<const char*>(view.polyVertCounts), view.topologySize());
+                if (stats.uniqueTopology.insert(topologyHash).second) stats.uniqueTopologyBytes += view.topologySize();
+            }
+        });
+
+        std::printf("file:          %s\n", cacheFile->path().c_str());
+        std::printf("codec:         %s\n", HdCacheFile::codecName(cacheFile->codec()).c_str());
+        std::printf("poses:         %zu\n", cacheFile->size());
+        std::printf("file size:     %s\n", formatBytes(cacheFile->fileSize()).c_str());
+        std::printf("dead bytes:    %s (%.1f%%)\n", formatBytes(cacheFile->deadBytes()).c_str(),
+            cacheFile->fileSize() > 0 ? 100.0 * cacheFile->deadBytes() / cacheFile->fileSize() : 0.0);
+        std::printf("payload bytes: %s (raw %s, %.2fx)\n", formatBytes(payloadBytes).c_str(), formatBytes(rawBytes).c_str(),
+            ratio(rawBytes, payloadBytes));
+        if (unreadable > 0) std::printf("unreadable:    %llu poses\n", (unsigned long long) unreadable);
+
+        std::printf("\n%-6s %8s %12s %12s %8s %12s %12s %8s\n", "mesh", "poses", "points", "unique", "dedup",
+            "topology", "unique", "dedup");
+        for (size_t i=0; i<meshStats.size(); i++)
+        {
+            const MeshStats& stats = meshStats[i];
+            std::printf("%-6zu %8llu %12s %12s %7.2fx %12s %12s %7.2fx\n", i, (unsigned long long) stats.poses,
+                formatBytes(stats.pointBytes).c_str(), formatBytes(stats.uniquePointBytes).c_str(),
+                ratio(stats.pointBytes, stats.uniquePointBytes),
+                formatBytes(stats.topologyBytes).c_str(), formatBytes(stats.uniqueTopologyBytes).c_str(),
+                ratio(stats.topologyBytes, stats.uniqueTopologyBytes));
+        }
+        return 0;
+    }
+
+    // copies all live records of source into target, re-encoding if codec is set
+    bool copyPoses(HdCacheFile& source, HdCacheFile& target, const uint32_t* codec, uint64_t& copied, uint64_t& skipped)
+    {
+        bool success = true;
+        source.forEachEntry([&](const std::string& poseId, const HdCacheFileEntry& entry) {
+            if (!success) return;
+            if (target.exists(poseId))
+            {
+                skipped++;
+                return;
+            }
+
+            HdBlob payload;
+            HdCacheFileEntry targetEntry = entry;
+            if (codec == nullptr || *codec == entry.codec)
+            {
+                // no need to decode, copy the payload as is
+                if (!source.readPayload(entry, payload, true))
+                {
+                    std::fprintf(stderr, "Skip corrupt pose '%s' in '%s'.\n", poseId.c_str(), source.path().c_str());
+                    skipped++;
+                    return;
+                }
+            } else
+            {
+                HdBlob blob;
+                if (!source.readEntry(entry, blob, true))
+                {
+                    std::fprintf(stderr, "Skip corrupt pose '%s' in '%s'.\n", poseId.c_str(), source.path().c_str());
+                    skipped++;
+                    return;
+                }
+                HdCacheFile::encodePayload(*codec, blob, payload, targetEntry);
+            }
+
+            if (!target.writeEncoded(poseId, payload, targetEntry))
+            {
+                std::fprintf(stderr, "Could not write pose '%s' to '%s'.\n", poseId.c_str(), target.path().c_str());
+                success = false;
+                return;
+            }
+            copied++;
+        });
+        return success;
+    }
+
+    bool createTarget(const std::string& path, HdCacheFile& target, uint32_t codec)
+    {
+        if (::access(path.c_str(), F_OK) == 0)
+        {
+            std::fprintf(stderr, "Output file '%s' already exists.\n", path.c_str());
+            return false;
+        }
+        if (!target.open(path, true)) return false;
+        target.setCodec(codec);
+        return true;
+    }
+
+    int cmdCompact(const std::vector<std::string>& args)
+    {
+        if (args.empty()) return 2;
+        std::string inputPath = args[0];
+        bool inPlace = !(args.size() > 2 && args[1] == "-o");
+        std::string outputPath = inPlace ? inputPath + ".compact.tmp" : args[2];
+
+        std::shared_ptr<HdCacheFile> source = openCache(inputPath, false);
+        if (!source) return 1;
+        uint64_t sizeBefore = source->fileSize();
+
+        HdCacheFile target;
+        if (!createTarget(outputPath, target, source->codec())) return 1;
+
+        uint64_t copied = 0;
+        uint64_t skipped = 0;
+        bool success = copyPoses(*source, target, nullptr, copied, skipped) && target.flush();
+        uint64_t sizeAfter = target.fileSize();
+        target.close();
+        source->close();
+
+        if (!success)
+        {
+            ::unlink(outputPath.c_str());
+            return 1;
+        }
+
+        // the flushed copy replaces the original atomically
+        if (inPlace && std::rename(outputPath.c_str(), inputPath.c_str()) != 0)
+        {
+            std::fprintf(stderr, "Could not replace '%s': %s\n", inputPath.c_str(), std::strerror(errno));
+            ::unlink(outputPath.c_str());
+            return 1;
+        }
+
+        std::printf("%llu poses kept, %llu skipped. %s -> %s\n", (unsigned long long) copied, (unsigned long long) skipped,
+            formatBytes(sizeBefore).c_str(), formatBytes(sizeAfter).c_str());
+        return skipped > 0 ? 1 : 0;
+    }
+
+    int cmdMerge(const std::vector<std::string>& args)
+    {
+        if (args.size() < 2) return 2;
+
+        HdCacheFile target;
+        std::shared_ptr<HdCacheFile> first = openCache(args[1], false);
+        if (!first || !createTarget(args[0], target, first->codec())) return 1;
+        first->close();
+
+        uint64_t copied = 0;
+        uint64_t skipped = 0;
+        for (size_t i=1; i<args.size(); i++)
+        {
+            std::shared_ptr<HdCacheFile> source = openCache(args[i], false);
+            if (!source || !copyPoses(*source, target, nullptr, copied, skipped))
+            {
+                target.close();
+                ::unlink(args[0].c_str());
+                return 1;
+            }
+        }
+
+        if (!target.flush()) return 1;
+        std::printf("%llu poses merged, %llu duplicates skipped. Output: %s (%s)\n", (unsigned long long) copied,
+            (unsigned long long) skipped, args[0].c_str(), formatBytes(target.fileSize()).c_str());
+        return 0;
+    }
+
+    int cmdEncode(const std::vector<std::string>& args)
+    {
+        uint32_t codec;
+        if (args.size() < 4 || args[2] != "--codec" || !parseCodec(args[3], codec)) return 2;
+
+        std::shared_ptr<HdCacheFile> source = openCache(args[0], false);
+        if (!source) return 1;
+
+        HdCacheFile target;
+        if (!createTarget(args[1], target, codec)) return 1;
+
+        uint64_t copied = 0;
+        uint64_t skipped = 0;
+        if (!copyPoses(*source, target, &codec, copied, skipped) || !target.flush())
+        {
+            target.close();
+            ::unlink(args[1].c_str());
+            return 1;
+        }
+
+        std::printf("%llu poses encoded as '%s', %llu skipped. %s -> %s\n", (unsigned long long) copied, args[3].c_str(),
+            (unsigned long long) skipped, formatBytes(source->fileSize()).c_str(), formatBytes(target.fileSize()).c_str());
+        return skipped > 0 ? 1 : 0;
+    }
+
+    int cmdGeo(const std::vector<std::string>& args)
+    {
+        if (args.empty()) return 2;
+        bool showFrame = args.size() > 2 && args[1] == "--frame";
+        if (args.size() > 1 && !showFrame) return 2;
+
+        HdGeoStreamReader reader;
+        if (!reader.open(args[0]))
+        {
+            std::fprintf(stderr, "Could not open geometry stream '%s'.\n", args[0].c_str());
+            return 1;
+        }
+
+        if (showFrame)
+        {
+            int64_t frameIndex = reader.findFrame(std::atof(args[2].c_str()));
+            if (frameIndex < 0)
+            {
+                std::fprintf(stderr, "Frame %s is before the first frame.\n", args[2].c_str());
+                return 1;
+            }
+
+            uint64_t poseIndex = reader.poseIndex(frameIndex);
+            std::printf("frame %g -> pose %llu '%s'\n", reader.frame(frameIndex), (unsigned long long) poseIndex,
+                reader.poseKey(poseIndex).c_str());
+            for (uint32_t i=0; i<reader.meshCount(); i++)
+            {
+                HdPoseBlobMeshView view = reader.mesh(poseIndex, i);
+                float bounds[6] = {0, 0, 0, 0, 0, 0};
+                for (uint32_t v=0; v<view.mesh->vertCount; v++)
+                {
+                    for (int axis=0; axis<3; axis++)
+                    {
+                        float value = view.points[v * 3 + axis];
+                        if (v == 0 || value < bounds[axis]) bounds[axis] = value;
+                        if (v == 0 || value > bounds[axis + 3]) bounds[axis + 3] = value;
+                    }
+                }
+                std::printf("    mesh %u: %u verts, bounds (%g %g %g) - (%g %g %g)\n", i, view.mesh->vertCount,
+                    bounds[0], bounds[1], bounds[2], bounds[3], bounds[4], bounds[5]);
+            }
+            return 0;
+        }
+
+        uint64_t pointsPerPose = 0;
+        for (uint32_t i=0; i<reader.meshCount(); i++) pointsPerPose += reader.mesh(0, i).mesh->vertCount;
+        uint64_t frameBasedBytes = reader.frameCount() * pointsPerPose * 3 * sizeof(float);
+
+        std::printf("frames:        %llu", (unsigned long long) reader.frameCount());
+        if (reader.frameCount() > 0) std::printf(" (%g - %g)", reader.frame(0), reader.frame(reader.frameCount() - 1));
+        std::printf("\nunique poses:  %llu\n", (unsigned long long) reader.poseCount());
+        std::printf("meshes:        %u (%llu points per pose)\n", reader.meshCount(), (unsigned long long) pointsPerPose);
+        std::printf("file size:     %s\n", formatBytes(reader.fileSize()).c_str());
+        std::printf("frame based:   %s (points only)\n", formatBytes(frameBasedBytes).c_str());
+        return 0;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<std::string> args(argv + 1, argv + argc);
+
+    // HdCacheFile logs to stdout, keep the tool output clean unless asked for
+    spdlog::set_level(spdlog::level::warn);
+    if (!args.empty() && args[0] == "--verbose")
+    {
+        spdlog::set_level(spdlog::level::debug);
+        args.erase(args.begin());
+    }
+
+    if (args.empty())
+    {
+        printUsage();
+        return 2;
+    }
+
+    std::string command = args[0];
+    args.erase(args.begin());
+
+    int result = 2;
+    if (command == "list") result = cmdList(args);
+    else if (command == "verify") result = cmdVerify(args);
+    else if (command == "stats") result = cmdStats(args);
+    else if (command == "compact") result = cmdCompact(args);
+    else if (command == "merge") result = cmdMerge(args);
+    else if (command == "encode") result = cmdEncode(args);
+    else if (command == "geo") result = cmdGeo(args);
+
+    if (result == 2) printUsage();
+    return result;
+}
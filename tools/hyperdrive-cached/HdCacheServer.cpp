@@ -0,0 +1,286 @@
+//
+// -----------------------------------------------------------------------------
+// This source file has been developed within the scope of the
+// Technical Director course at Filmakademie Baden-Wuerttemberg.
+// http://technicaldirector.de
+//
+// Written by Tim Lehr
+// Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+// -----------------------------------------------------------------------------
+//
+
+#include "HdCacheServer.h"
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <thread>
+#include <chrono>
+
+#include "HdLogger.h"
+
+namespace
+{
+    const uint64_t FD_HEADROOM = 4 * HD_CACHEPROTO_MAX_BATCH + 256;
+}
+
+HdCacheServer::HdCacheServer(const std::string& socketPath, uint64_t maxBytes) :
+    socketPath_(socketPath), maxBytes_(maxBytes), stopping_(false), clientCount_(0)
+{
+    log = HdUtils::getLoggerInstance("hyperdrive-cached");
+
+    // every cached pose holds an fd, raise the soft limit as far as allowed
+    // and keep some headroom for clients and fds in flight
+    rlimit limit;
+    maxEntries_ = 1024;
+    if (::getrlimit(RLIMIT_NOFILE, &limit) == 0)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        ::setrlimit(RLIMIT_NOFILE, &limit);
+        ::getrlimit(RLIMIT_NOFILE, &limit);
+        maxEntries_ = limit.rlim_cur;
+    }
+    maxEntries_ = maxEntries_ > FD_HEADROOM * 2 ? maxEntries_ - FD_HEADROOM : maxEntries_ / 2;
+}
+
+HdCacheServer::~HdCacheServer()
+{
+    stopping_ = true;
+    while (clientCount_ > 0)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    if (listenSock_ >= 0)
+    {
+        ::close(listenSock_);
+        ::unlink(socketPath_.c_str());
+    }
+
+    for (std::unordered_map<std::string, Entry>::iterator it = entries_.begin(); it != entries_.end(); ++it)
+    {
+        ::close(it->second.fd);
+    }
+}
+
+bool HdCacheServer::listen()
+{
+    listenSock_ = HdCacheProtocol::listenSocket(socketPath_);
+    if (listenSock_ < 0)
+    {
+        log->error("Could not listen on '{}': {}", socketPath_, std::strerror(errno));
+        return false;
+    }
+    log->info("Listening on '{}'. Max memory: {} MB, max poses: {}", socketPath_, maxBytes_ / (1024 * 1024), maxEntries_);
+    return true;
+}
+
+void HdCacheServer::run()
+{
+    while (!stopping_)
+    {
+        pollfd pfd;
+        pfd.fd = listenSock_;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+
+        // wake up regularly to notice stop()
+        if (::poll(&pfd, 1, 200) <= 0) continue;
+
+        int clientSock = ::accept(listenSock_, nullptr, nullptr);
+        if (clientSock < 0) continue;
+
+        clientCount_++;
+        std::thread(&HdCacheServer::serveClient, this, clientSock).detach();
+    }
+}
+
+void HdCacheServer::serveClient(int sock)
+{
+    log->debug("Client connected ({} total).", (int) clientCount_);
+
+    while (!stopping_)
+    {
+        pollfd pfd;
+        pfd.fd = sock;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        int ready = ::poll(&pfd, 1, 200);
+        if (ready == 0 || (ready < 0 && errno == EINTR)) continue;
+        if (ready < 0)
+        {
+            log->warn("Poll on client failed: {}", std::strerror(errno));
+            break;
+        }
+
+        HdCacheMessage request;
+        if (!HdCacheProtocol::recvMessage(sock, request)) break;
+
+        HdCacheMessage reply;
+        reply.reset(request.header.op, request.header.count, request.header.requestId);
+
+        bool valid = request.header.count <= HD_CACHEPROTO_MAX_BATCH;
+        if (valid)
+        {
+            switch (request.header.op)
+            {
+                case kOpGet:    valid = handleGet(request, reply); break;
+                case kOpPut:    valid = handlePut(request, reply); break;
+                case kOpExists: valid = handleExists(request, reply); break;
+                case kOpStats:  reply.body = statsJson(); break;
+                default:        valid = false;
+            }
+        }
+
+        if (!valid)
+        {
+            log->warn("Invalid request (op {}). Drop client.", request.header.op);
+            break;
+        }
+
+        if (!HdCacheProtocol::sendMessage(sock, reply)) break;
+    }
+
+    ::close(sock);
+    clientCount_--;
+    log->debug("Client disconnected.");
+}
+
+bool HdCacheServer::handleGet(HdCacheMessage& request, HdCacheMessage& reply)
+{
+    HdCacheBodyReader reader(request.body);
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    for (uint32_t i=0; i<request.header.count; i++)
+    {
+        std::string key;
+        if (!reader.readKey(key)) return false;
+
+        HdCacheGetResult result;
+        std::unordered_map<std::string, Entry>::iterator it = entries_.find(key);
+        if (it == entries_.end())
+        {
+            misses_++;
+            result.found = 0;
+            result.payloadSize = 0;
+            result.checksum = 0;
+        } else
+        {
+            hits_++;
+            lru_.splice(lru_.begin(), lru_, it->second.lruPos);
+            result.found = 1;
+            result.payloadSize = it->second.size;
+            result.checksum = it->second.checksum;
+            // a duplicate, the entry may be evicted before the reply is sent
+            int fd = ::fcntl(it->second.fd, F_DUPFD_CLOEXEC, 0);
+            if (fd < 0)
+            {
+                // e.g. out of fds, the client keeps its connection and reads the tiers below
+                log->error("Could not duplicate payload fd: {}", std::strerror(errno));
+                reply.reset(kOpError, 0, request.header.requestId);
+                reply.body = "Could not duplicate payload fd.";
+                return true;
+            }
+            reply.fds.push_back(fd);
+        }
+        reply.append(result);
+    }
+    return true;
+}
+
+bool HdCacheServer::handlePut(HdCacheMessage& request, HdCacheMessage& reply)
+{
+    if (request.fds.size() != request.header.count) return false;
+
+    HdCacheBodyReader reader(request.body);
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    for (uint32_t i=0; i<request.header.count; i++)
+    {
+        HdCachePutEntry entry;
+        if (!reader.read(entry)) return false;
+
+        std::string key;
+        if (!reader.readBytes(entry.keySize, key)) return false;
+
+        uint8_t stored = 1;
+        if (entries_.find(key) == entries_.end())
+        {
+            if (!HdCacheProtocol::validatePayloadFd(request.fds[i], entry.payloadSize) || entry.payloadSize > maxBytes_)
+            {
+                stored = 0;
+            } else
+            {
+                lru_.push_front(key);
+
+                Entry cacheEntry;
+                cacheEntry.fd = request.fds[i];
+                cacheEntry.size = entry.payloadSize;
+                cacheEntry.checksum = entry.checksum;
+                cacheEntry.lruPos = lru_.begin();
+                entries_[key] = cacheEntry;
+
+                request.fds[i] = -1; // owned by the cache now
+                bytes_ += entry.payloadSize;
+                puts_++;
+            }
+        }
+        reply.append(stored);
+    }
+
+    evict();
+    return true;
+}
+
+bool HdCacheServer::handleExists(HdCacheMessage& request, HdCacheMessage& reply)
+{
+    HdCacheBodyReader reader(request.body);
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    for (uint32_t i=0; i<request.header.count; i++)
+    {
+        std::string key;
+        if (!reader.readKey(key)) return false;
+        uint8_t found = entries_.find(key) != entries_.end() ? 1 : 0;
+        reply.append(found);
+    }
+    return true;
+}
+
+// expects mutex_ to be held
+void HdCacheServer::evict()
+{
+    while ((bytes_ > maxBytes_ || entries_.size() > maxEntries_) && !lru_.empty())
+    {
+        std::unordered_map<std::string, Entry>::iterator it = entries_.find(lru_.back());
+        bytes_ -= it->second.size;
+
+        // clients that received the fd keep their mapping
+        ::close(it->second.fd);
+        entries_.erase(it);
+        lru_.pop_back();
+        evictions_++;
+    }
+}
+
+std::string HdCacheServer::statsJson()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::string result = "{";
+    result += "\"socket\": \"" + socketPath_ + "\", ";
+    result += "\"clients\": " + std::to_string((int) clientCount_) + ", ";
+    result += "\"entries\": " + std::to_string(entries_.size()) + ", ";
+    result += "\"bytes\": " + std::to_string(bytes_) + ", ";
+    result += "\"max_bytes\": " + std::to_string(maxBytes_) + ", ";
+    result += "\"max_entries\": " + std::to_string(maxEntries_) + ", ";
+    result += "\"hits\": " + std::to_string(hits_) + ", ";
+    result += "\"misses\": " + std::to_string(misses_) + ", ";
+    result += "\"puts\": " + std::to_string(puts_) + ", ";
+    result += "\"evictions\": " + std::to_string(evictions_) + "}";
+    return result;
+}
@@ -0,0 +1,70 @@
+/* * -----------------------------------------------------------------------------
+ * This source file has been developed within the scope of the
+ * Technical Director course at Filmakademie Baden-Wuerttemberg.
+ * http://technicaldirector.de
+ *
+ * Written by Tim Lehr
+ * Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+ * -----------------------------------------------------------------------------
+ */
+
+#ifndef HD_CACHESERVER_H
+#define HD_CACHESERVER_H
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <atomic>
+#include <unordered_map>
+#include "spdlog/spdlog.h"
+
+#include "HdCacheProtocol.h"
+
+// Pose cache owned by the daemon. Payloads are kept as the sealed memfds the
+// clients handed over, so gets and puts never copy pose data.
+class HdCacheServer
+{
+    private:
+        struct Entry
+        {
+            int                                 fd;
+            uint64_t                            size;
+            uint64_t                            checksum;
+            std::list<std::string>::iterator    lruPos;
+        };
+
+        std::string                             socketPath_;
+        uint64_t                                maxBytes_;
+        uint64_t                                maxEntries_;    // bounded by the fd limit
+        int                                     listenSock_ = -1;
+        std::atomic<bool>                       stopping_;
+        std::atomic<int>                        clientCount_;
+
+        std::unordered_map<std::string, Entry>  entries_;
+        std::list<std::string>                  lru_;           // most recently used first
+        uint64_t                                bytes_ = 0;
+        uint64_t                                hits_ = 0;
+        uint64_t                                misses_ = 0;
+        uint64_t                                puts_ = 0;
+        uint64_t                                evictions_ = 0;
+        std::mutex                              mutex_;
+        std::shared_ptr<spdlog::logger>         log;
+
+        void                                    serveClient(int sock);
+        bool                                    handleGet(HdCacheMessage& request, HdCacheMessage& reply);
+        bool                                    handlePut(HdCacheMessage& request, HdCacheMessage& reply);
+        bool                                    handleExists(HdCacheMessage& request, HdCacheMessage& reply);
+        void                                    evict();
+
+    public:
+                                                HdCacheServer(const std::string& socketPath, uint64_t maxBytes);
+        virtual                                 ~HdCacheServer();
+
+        bool                                    listen();
+        void                                    run();
+        void                                    stop()          {stopping_ = true;};
+
+        std::string                             statsJson();
+};
+
+#endif
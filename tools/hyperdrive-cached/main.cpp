@@ -0,0 +1,228 @@
+//
+// -----------------------------------------------------------------------------
+// This source file has been developed within the scope of the
+// Technical Director course at Filmakademie Baden-Wuerttemberg.
+// http://technicaldirector.de
+//
+// Written by Tim Lehr
+// Copyright (c) 2019 Animationsinstitut of Filmakademie Baden-Wuerttemberg
+// -----------------------------------------------------------------------------
+//
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <unistd.h>
+
+#include "HdCacheServer.h"
+#include "HdDaemonTier.h"
+#include "HdLogger.h"
+
+namespace
+{
+    HdCacheServer* runningServer = nullptr;
+
+    void handleSignal(int)
+    {
+        if (runningServer != nullptr) runningServer->stop();
+    }
+
+    void printUsage()
+    {
+        std::printf(
+            "usage: hyperdrive-cached [--socket PATH] [--max-mem MB] [--verbose]\n"
+            "       hyperdrive-cached --stats [--socket PATH]\n"
+            "       hyperdrive-cached --bench [--count N] [--size KB] [--batch B]\n"
+            "\n"
+            "Local pose cache shared by all Hyperdrive sessions of the user.\n"
+            "Default socket: %s\n", HdCacheProtocol::defaultSocketPath().c_str());
+    }
+
+    double elapsedSeconds(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    HdBlob makePayload(size_t index, size_t size)
+    {
+        char* data;
+        HdBlob blob = HdBlob::allocate(size, &data);
+        for (size_t i=0; i<size; i++)
+        {
+            data[i] = (char) ((i * 31 + index * 7) & 0xff);
+        }
+        return blob;
+    }
+
+    // runs a private daemon and measures batched throughput and single get latency through HdDaemonTier
+    int runBenchmark(size_t count, size_t payloadSize, size_t batchSize)
+    {
+        std::string socketPath = "/tmp/hyperdrive-cached-bench-" + std::to_string(::getpid()) + ".sock";
+        HdCacheServer server(socketPath, (uint64_t) count * payloadSize * 2);
+        if (!server.listen()) return 1;
+        std::thread serverThread(&HdCacheServer::run, &server);
+
+        HdDaemonTier tier(socketPath, "bench");
+        int result = 0;
+        if (!tier.connect())
+        {
+            std::printf("Could not connect to benchmark daemon.\n");
+            result = 1;
+        }
+
+        std::vector<std::string> poseIds(count);
+        std::vector<HdBlob> payloads(count);
+        for (size_t i=0; i<count && result == 0; i++)
+        {
+            poseIds[i] = "pose-" + std::to_string(i);
+            payloads[i] = makePayload(i, payloadSize);
+        }
+        double totalMb = (double) count * payloadSize / (1024.0 * 1024.0);
+
+        // batched puts
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (size_t i=0; i<count && result == 0; i+=batchSize)
+        {
+            size_t end = std::min(count, i + batchSize);
+            std::vector<std::string> ids(poseIds.begin() + i, poseIds.begin() + end);
+            std::vector<HdBlob> blobs(payloads.begin() + i, payloads.begin() + end);
+            if (!tier.putMany(ids, blobs))
+            {
+                std::printf("Put failed at pose %zu.\n", i);
+                result = 1;
+            }
+        }
+        double putSeconds = elapsedSeconds(start);
+
+        // batched gets, contents are verified after the clock stopped
+        std::vector<HdBlob> fetched;
+        fetched.reserve(count);
+        start = std::chrono::steady_clock::now();
+        for (size_t i=0; i<count && result == 0; i+=batchSize)
+        {
+            size_t end = std::min(count, i + batchSize);
+            std::vector<std::string> ids(poseIds.begin() + i, poseIds.begin() + end);
+            std::vector<HdBlob> blobs;
+            if (!tier.getMany(ids, blobs))
+            {
+                std::printf("Get failed at pose %zu.\n", i);
+                result = 1;
+            }
+            fetched.insert(fetched.end(), blobs.begin(), blobs.end());
+        }
+        double getSeconds = elapsedSeconds(start);
+
+        size_t mismatches = 0;
+        for (size_t i=0; i<fetched.size(); i++)
+        {
+            if (fetched[i].size != payloadSize || std::memcmp(fetched[i].begin(), payloads[i].begin(), payloadSize) != 0)
+            {
+                mismatches++;
+            }
+        }
+        fetched.clear();
+
+        // single get round trip latency
+        std::vector<double> latencies;
+        for (size_t i=0; i<std::min(count, (size_t) 2000) && result == 0; i++)
+        {
+            HdBlob blob;
+            std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now();
+            if (!tier.read(poseIds[i], blob)) mismatches++;
+            latencies.push_back(elapsedSeconds(t) * 1e6);
+        }
+        std::sort(latencies.begin(), latencies.end());
+
+        if (result == 0)
+        {
+            std::printf("poses: %zu, payload: %zu KB, batch: %zu\n", count, payloadSize / 1024, batchSize);
+            std::printf("put:   %8.1f MB/s  %10.0f poses/s\n", totalMb / putSeconds, count / putSeconds);
+            std::printf("get:   %8.1f MB/s  %10.0f poses/s\n", totalMb / getSeconds, count / getSeconds);
+            if (!latencies.empty())
+            {
+                std::printf("single get latency: p50 %.1f us, p99 %.1f us\n",
+                    latencies[latencies.size() / 2], latencies[latencies.size() * 99 / 100]);
+            }
+            std::printf("daemon: %s\n", tier.statsJson().c_str());
+        }
+
+        if (mismatches > 0)
+        {
+            std::printf("%zu poses missing or corrupt.\n", mismatches);
+            result = 1;
+        }
+
+        server.stop();
+        serverThread.join();
+        return result;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::string socketPath = HdCacheProtocol::defaultSocketPath();
+    uint64_t maxMemoryMb = 4096;
+    bool stats = false;
+    bool bench = false;
+    size_t benchCount = 4096;
+    size_t benchSizeKb = 64;
+    size_t benchBatch = 64;
+
+    for (int i=1; i<argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--socket" && hasValue) socketPath = argv[++i];
+        else if (arg == "--max-mem" && hasValue) maxMemoryMb = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--count" && hasValue) benchCount = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--size" && hasValue) benchSizeKb = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--batch" && hasValue) benchBatch = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--verbose") spdlog::set_level(spdlog::level::debug);
+        else if (arg == "--stats") stats = true;
+        else if (arg == "--bench") bench = true;
+        else
+        {
+            printUsage();
+            return arg == "--help" || arg == "-h" ? 0 : 2;
+        }
+    }
+
+    if (bench)
+    {
+        if (benchCount == 0 || benchBatch == 0)
+        {
+            printUsage();
+            return 2;
+        }
+        return runBenchmark(benchCount, benchSizeKb * 1024, benchBatch);
+    }
+
+    if (stats)
+    {
+        HdDaemonTier tier(socketPath, "");
+        if (!tier.connect())
+        {
+            std::printf("No cache daemon running at '%s'.\n", socketPath.c_str());
+            return 1;
+        }
+        std::printf("%s\n", tier.statsJson().c_str());
+        return 0;
+    }
+
+    HdCacheServer server(socketPath, maxMemoryMb * 1024 * 1024);
+    if (!server.listen()) return 1;
+
+    runningServer = &server;
+    std::signal(SIGINT, handleSignal);
+    std::signal(SIGTERM, handleSignal);
+    server.run();
+    runningServer = nullptr;
+    return 0;
+}